@@ -0,0 +1,243 @@
+//-----------------------------------------------------------------
+//
+// OpenDCC - native build
+//
+// This source file is subject of the GNU general public license 2,
+// that is available at the world-wide-web at
+// http://www.gnu.org/licenses/gpl.txt
+//
+//-----------------------------------------------------------------
+//
+// file:      Arduino.h (lib/native_hal)
+// history:   2026-10-16 V0.1 started
+//
+//-----------------------------------------------------------------
+//
+// purpose:   run the command station on the host ([env:native])
+// content:   the parts of the Arduino core and avr-libc used by the
+//            command station, on top of a simulated ATmega328:
+//            - Timer1 (CTC mode, OC1A on D9, OC1B on D10)
+//            - USART0 (8 or 9 bit, interrupts RX, UDRE, TX)
+//            - EEPROM, loaded with the image of config.cpp (ee_mem)
+//            - millis/micros/delay, timer0 (TCNT0, timer0_overflow_count),
+//              digital & analog pins, INT0/INT1
+//            the simulation itself is controlled with native_hal.h
+//
+//            time only moves in delay(), delayMicroseconds(),
+//            millis()/micros() (1us each call), BUSY_WAIT() and
+//            native_Advance(); ISRs run there if SREG.I is set.
+//
+//-----------------------------------------------------------------
+#ifndef _NATIVE_ARDUINO_H_
+#define _NATIVE_ARDUINO_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <stdlib.h>
+
+#ifndef __AVR_ATmega328P__
+  #define __AVR_ATmega328P__ 1          // simulated processor: arduino nano
+#endif
+#ifndef F_CPU
+  #define F_CPU 16000000UL
+#endif
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+//----------------------------------------------------------------- avr/pgmspace.h
+#define PROGMEM
+#define PSTR(s)                (s)
+#define pgm_read_byte(p)       (*(const uint8_t *)(p))
+#define pgm_read_word(p)       (*(const uint16_t *)(p))
+#define pgm_read_dword(p)      (*(const uint32_t *)(p))
+#define pgm_read_ptr(p)        (*(void * const *)(p))
+#define memcpy_P               memcpy
+#define strcpy_P               strcpy
+#define strlen_P               strlen
+
+//----------------------------------------------------------------- avr/interrupt.h
+#define ISR(vector)            extern "C" void vector(void); extern "C" void vector(void)
+void cli();
+void sei();
+#define _BV(bit)               (1 << (bit))
+
+//----------------------------------------------------------------- avr/eeprom.h
+#define EEMEM
+uint8_t eeprom_read_byte(const uint8_t *addr);
+uint16_t eeprom_read_word(const uint16_t *addr);
+void eeprom_write_byte(uint8_t *addr, uint8_t value);
+void eeprom_update_byte(uint8_t *addr, uint8_t value);
+void eeprom_write_word(uint16_t *addr, uint16_t value);
+void eeprom_update_word(uint16_t *addr, uint16_t value);
+void eeprom_read_block(void *dst, const void *src, size_t n);
+void eeprom_update_block(const void *src, void *dst, size_t n);
+bool eeprom_is_ready();                 // always: the simulated eeprom writes at once
+
+//----------------------------------------------------------------- avr/io.h
+extern volatile uint8_t SREG;
+extern volatile uint8_t TCCR1A, TCCR1B, TIMSK1, TIFR1;
+extern volatile uint16_t TCNT1, OCR1A, OCR1B, ICR1;
+extern volatile uint8_t TCCR2A, TCCR2B, TCNT2, OCR2A, TIMSK2;
+extern volatile uint8_t TCNT0;                 // timer0 of the arduino core (div 64), read only
+extern volatile uint8_t PINB, PIND, PORTB, PORTD, DDRB, DDRD;
+extern volatile uint8_t ACSR, EIMSK, EICRA, TWBR, GPIOR0, GPIOR1, GPIOR2;
+extern volatile uint8_t UCSR0B, UCSR0C, UBRR0H, UBRR0L;
+
+// UCSR0A and UDR0 have side effects (flags, rx/tx data) -> small classes
+class native_ucsr0a {
+  public:
+    operator uint8_t() const;
+    native_ucsr0a &operator=(uint8_t value);
+    native_ucsr0a &operator|=(uint8_t value) { return (*this = (uint8_t)(*this | value)); }
+    native_ucsr0a &operator&=(uint8_t value) { return (*this = (uint8_t)(*this & value)); }
+};
+class native_udr0 {
+  public:
+    operator uint8_t();                 // read rx data, clears RXC0
+    native_udr0 &operator=(uint8_t value);  // write tx data (with TXB80)
+};
+class native_tifr {                     // interrupt flags: writing 1 clears
+  public:
+    uint8_t flags;
+    operator uint8_t() const { return flags; }
+    native_tifr &operator=(uint8_t value) { flags &= ~value; return *this; }
+};
+extern native_tifr TIFR2;
+extern native_ucsr0a UCSR0A;
+extern native_udr0 UDR0;
+
+// Timer1
+#define COM1A1 7
+#define COM1A0 6
+#define COM1B1 5
+#define COM1B0 4
+#define FOC1A  3
+#define FOC1B  2
+#define WGM11  1
+#define WGM10  0
+#define ICNC1  7
+#define ICES1  6
+#define WGM13  4
+#define WGM12  3
+#define CS12   2
+#define CS11   1
+#define CS10   0
+#define ICIE1  5
+#define OCIE1B 2
+#define OCIE1A 1
+#define TOIE1  0
+#define OCF1B  2
+#define OCF1A  1
+#define TOV1   0
+// Timer2
+#define COM2A1 7
+#define COM2A0 6
+#define COM2B1 5
+#define COM2B0 4
+#define WGM21  1
+#define WGM20  0
+#define FOC2A  7
+#define FOC2B  6
+#define WGM22  3
+#define CS22   2
+#define CS21   1
+#define CS20   0
+#define OCIE2A 1
+#define OCF2A  1
+// USART0
+#define RXC0   7
+#define TXC0   6
+#define UDRE0  5
+#define FE0    4
+#define DOR0   3
+#define UPE0   2
+#define U2X0   1
+#define MPCM0  0
+#define RXCIE0 7
+#define TXCIE0 6
+#define UDRIE0 5
+#define RXEN0  4
+#define TXEN0  3
+#define UCSZ02 2
+#define RXB80  1
+#define TXB80  0
+#define UMSEL01 7
+#define UMSEL00 6
+#define UPM01  5
+#define UPM00  4
+#define USBS0  3
+#define UCSZ01 2
+#define UCSZ00 1
+#define UCPOL0 0
+
+//----------------------------------------------------------------- Arduino.h
+#define HIGH          1
+#define LOW           0
+#define INPUT         0
+#define OUTPUT        1
+#define INPUT_PULLUP  2
+#define CHANGE        1
+#define FALLING       2
+#define RISING        3
+#define DEFAULT       1
+#define INTERNAL      3
+#define DEC           10
+#define HEX           16
+
+#define A0 14
+#define A1 15
+#define A2 16
+#define A3 17
+#define A4 18
+#define A5 19
+#define A6 20
+#define A7 21
+
+uint32_t millis();
+uint32_t micros();
+void delay(uint32_t ms);
+void delayMicroseconds(unsigned int us);
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t value);
+int digitalRead(uint8_t pin);
+int analogRead(uint8_t pin);
+void analogReference(uint8_t mode);
+void attachInterrupt(uint8_t irq, void (*handler)(void), int mode);
+void detachInterrupt(uint8_t irq);
+
+class __FlashStringHelper;
+#define F(s) ((const __FlashStringHelper *)(s))
+
+class Print {
+  public:
+    virtual size_t write(uint8_t c) = 0;
+    size_t write(const char *s);
+    size_t print(const char *s)                     { return write(s); }
+    size_t print(const __FlashStringHelper *s)      { return write((const char *)s); }
+    size_t print(char c)                            { return write((uint8_t)c); }
+    size_t print(int n, int base = DEC)             { return print((long)n, base); }
+    size_t print(unsigned int n, int base = DEC)    { return print((unsigned long)n, base); }
+    size_t print(long n, int base = DEC);
+    size_t print(unsigned long n, int base = DEC);
+    size_t println()                                { return write((uint8_t)'\n'); }
+    template <typename T> size_t println(T v)       { size_t n = print(v); return n + println(); }
+    template <typename T> size_t println(T v, int base) { size_t n = print(v, base); return n + println(); }
+    virtual ~Print() {}
+};
+
+class HardwareSerial : public Print {
+  public:
+    void begin(unsigned long baud) { (void)baud; }
+    void flush() {}
+    using Print::write;
+    virtual size_t write(uint8_t c);    // -> stdout
+};
+extern HardwareSerial Serial;
+
+//----------------------------------------------------------------- see config.h
+#define BUSY_WAIT()   native_Idle()
+void native_Idle();
+
+#endif // _NATIVE_ARDUINO_H_
@@ -0,0 +1,35 @@
+//-----------------------------------------------------------------
+//
+// OpenDCC - native build
+//
+// file:      LiquidCrystal_I2C.h (lib/native_hal)
+// history:   2026-10-16 V0.1 started
+//
+// purpose:   simulated 20x4 lcd, contents via native_LcdLine()
+//
+//-----------------------------------------------------------------
+#ifndef _NATIVE_LIQUIDCRYSTAL_I2C_H_
+#define _NATIVE_LIQUIDCRYSTAL_I2C_H_
+
+#include "Arduino.h"
+
+typedef enum { POSITIVE, NEGATIVE } t_backlighPol;
+
+class LiquidCrystal_I2C : public Print {
+  public:
+    LiquidCrystal_I2C(uint8_t lcd_Addr, uint8_t En, uint8_t Rw, uint8_t Rs,
+                      uint8_t d4, uint8_t d5, uint8_t d6, uint8_t d7,
+                      uint8_t backlighPin, t_backlighPol pol);
+    void begin(uint8_t cols, uint8_t rows);
+    void clear();
+    void home();
+    void setCursor(uint8_t col, uint8_t row);
+    void createChar(uint8_t location, uint8_t charmap[]);
+    void setBacklight(uint8_t value);
+    using Print::write;
+    virtual size_t write(uint8_t c);
+  private:
+    uint8_t col, row;
+};
+
+#endif // _NATIVE_LIQUIDCRYSTAL_I2C_H_
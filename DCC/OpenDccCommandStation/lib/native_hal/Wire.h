@@ -0,0 +1,30 @@
+//-----------------------------------------------------------------
+//
+// OpenDCC - native build
+//
+// file:      Wire.h (lib/native_hal)
+// history:   2026-10-16 V0.1 started
+//
+// purpose:   simulated i2c bus; the lcd is simulated completely in
+//            LiquidCrystal_I2C.h, the only device on the bus is a 24C32
+//            eeprom at 0x50 (LOCODB_EXT_EEPROM), contents via native_ExtEeprom()
+//
+//-----------------------------------------------------------------
+#ifndef _NATIVE_WIRE_H_
+#define _NATIVE_WIRE_H_
+#include "Arduino.h"
+
+class TwoWire {
+  public:
+    void begin();
+    void beginTransmission(uint8_t address);
+    size_t write(uint8_t data);
+    uint8_t endTransmission();                    // 0: ok, 2: no ack on address
+    uint8_t requestFrom(uint8_t address, uint8_t quantity);
+    int available();
+    int read();
+};
+
+extern TwoWire Wire;
+
+#endif
@@ -0,0 +1,698 @@
+//-----------------------------------------------------------------
+//
+// OpenDCC - native build
+//
+// This source file is subject of the GNU general public license 2,
+// that is available at the world-wide-web at
+// http://www.gnu.org/licenses/gpl.txt
+//
+//-----------------------------------------------------------------
+//
+// file:      native_hal.cpp (lib/native_hal)
+// history:   2026-10-16 V0.1 started
+//            2026-10-16 V0.2 timer2, native_OnUartTx
+//            2026-10-16 V0.3 i2c eeprom
+//            2026-10-16 V0.4 native_OnDccEdge
+//            2026-10-16 V0.5 edges at the time of the compare match, OC1B and OC1A
+//                            on the same match, native_OnNdccEdge
+//            2026-10-16 V0.6 timer2 compare A (OC2A toggles D11), native_OnProgEdge
+//
+//-----------------------------------------------------------------
+//
+// purpose:   simulated ATmega328 for the native build, see Arduino.h
+//
+// how:       everything is counted in cpu cycles (F_CPU). native_Advance()
+//            walks from event to event (timer1 compare, uart char done,
+//            uart char received) and runs the pending ISRs in AVR vector
+//            order as long as SREG.I is set. ISRs take no simulated time.
+//            Timer1: only CTC with TOP = OCR1A (WGM12) is simulated, this
+//            is what dccout uses. If OCR1A is set below TCNT1, the counter
+//            wraps at 0xFFFF like the real one. OC1A and OC1B change at the
+//            cycle of their compare match; OCR1B == OCR1A: both on the same edge.
+//            Timer0 and timer2 are derived from the cycle count. Timer2 runs
+//            free (normal mode, div 64); its compare A sets OCF2A and drives
+//            OC2A (D11) at the cycle where TCNT2 becomes OCR2A.
+//
+//-----------------------------------------------------------------
+
+#include <stdio.h>
+#include "native_hal.h"
+#include "LiquidCrystal_I2C.h"
+#include "Wire.h"
+
+//----------------------------------------------------------------- registers
+volatile uint8_t SREG = 0x80;                 // arduino core starts with interrupts enabled
+volatile uint8_t TCCR1A, TCCR1B, TIMSK1, TIFR1;
+volatile uint16_t TCNT1, OCR1A, OCR1B, ICR1;
+volatile uint8_t TCCR2A, TCCR2B, TCNT2, OCR2A, TIMSK2;
+native_tifr TIFR2;
+volatile uint8_t TCNT0;
+extern "C" volatile unsigned long timer0_overflow_count;
+volatile unsigned long timer0_overflow_count;
+volatile uint8_t PINB, PIND, PORTB, PORTD, DDRB, DDRD;
+volatile uint8_t ACSR, EIMSK, EICRA, TWBR, GPIOR0, GPIOR1, GPIOR2;
+volatile uint8_t UCSR0B, UCSR0C, UBRR0H, UBRR0L;
+native_ucsr0a UCSR0A;
+native_udr0 UDR0;
+HardwareSerial Serial;
+
+// ISRs of the application (not every build has all of them)
+extern "C" void TIMER2_COMPA_vect(void) __attribute__((weak));
+extern "C" void TIMER1_COMPA_vect(void) __attribute__((weak));
+extern "C" void TIMER1_COMPB_vect(void) __attribute__((weak));
+extern "C" void USART_RX_vect(void) __attribute__((weak));
+extern "C" void USART_UDRE_vect(void) __attribute__((weak));
+extern "C" void USART_TX_vect(void) __attribute__((weak));
+
+// eeprom image, see config.cpp
+extern uint8_t ee_mem[] __attribute__((weak));
+extern const uint16_t ee_mem_size __attribute__((weak));
+
+#define NUM_PINS          22
+#define CYCLES_PER_US     (F_CPU / 1000000L)
+#define NEVER             UINT64_MAX
+
+static uint64_t now;                          // cycles
+static unsigned char in_isr;
+
+static uint8_t pin_level[NUM_PINS];
+static uint8_t pin_driven[NUM_PINS];          // set by native_SetPin, not by pullup
+static int analog_value[NUM_PINS];
+
+static void (*ext_handler[2])(void);          // INT0 (D2), INT1 (D3)
+static uint8_t ext_mode[2];
+static uint8_t ext_pending[2];
+
+static uint32_t t1_sub;                       // cycles into the current prescaler tick
+static uint8_t t1_b_done;                     // compare B already matched in this period
+static uint64_t t2_last;                      // timer2 tick (cycles / 64) of the last compare A
+
+static uint16_t rx_queue[64];
+static uint8_t rx_read, rx_write;
+static uint64_t rx_next = NEVER;
+static uint16_t rx_data;
+static uint8_t rx_full;
+
+static uint16_t tx_udr;
+static uint8_t tx_udr_full;
+static uint16_t tx_shift;
+static uint64_t tx_shift_end = NEVER;
+static uint8_t txc_flag;
+static uint8_t u2x;
+static uint16_t tx_log[256];
+static uint8_t tx_log_read, tx_log_write;
+static uint16_t tx_log_fill;
+
+static uint8_t eeprom[NATIVE_EEPROM_SIZE];
+static uint8_t ext_eeprom[NATIVE_EXT_EEPROM_SIZE];
+
+static char lcd_buf[4][21];
+
+static void dispatch();
+static void dcc_edge();
+
+//----------------------------------------------------------------- pins
+static void set_level(uint8_t pin, uint8_t level) {
+  uint8_t old;
+  if (pin >= NUM_PINS) return;
+  old = pin_level[pin];
+  pin_level[pin] = level ? 1 : 0;
+  if (pin < 8) PIND = (PIND & ~(1 << pin)) | (pin_level[pin] << pin);
+  else if (pin < 14) PINB = (PINB & ~(1 << (pin-8))) | (pin_level[pin] << (pin-8));
+  if (old == pin_level[pin]) return;
+
+  if ((pin == 2) || (pin == 3)) {
+    uint8_t irq = pin - 2;
+    if ((ext_mode[irq] == CHANGE) ||
+        ((ext_mode[irq] == RISING) && level) ||
+        ((ext_mode[irq] == FALLING) && !level)) ext_pending[irq] = 1;
+  }
+  if (pin == 9) {                             // OC1A = DCC
+    if (native_OnDccEdge) native_OnDccEdge(pin_level[pin], now);
+    dcc_edge();
+  }
+  if ((pin == 10) && native_OnNdccEdge) native_OnNdccEdge(pin_level[pin], now);   // OC1B = NDCC
+  if ((pin == 11) && native_OnProgEdge) native_OnProgEdge(pin_level[pin], now);    // OC2A = PROG_DCC
+}
+
+void pinMode(uint8_t pin, uint8_t mode) {
+  if ((pin < NUM_PINS) && (mode == INPUT_PULLUP) && !pin_driven[pin]) set_level(pin, HIGH);
+}
+
+void digitalWrite(uint8_t pin, uint8_t value) { set_level(pin, value); }
+
+int digitalRead(uint8_t pin) { return (pin < NUM_PINS) ? pin_level[pin] : LOW; }
+
+int analogRead(uint8_t pin) { return (pin < NUM_PINS) ? analog_value[pin] : 0; }
+
+void analogReference(uint8_t mode) { (void)mode; }
+
+void attachInterrupt(uint8_t irq, void (*handler)(void), int mode) {
+  if (irq > 1) return;
+  ext_handler[irq] = handler;
+  ext_mode[irq] = mode;
+  ext_pending[irq] = 0;
+}
+
+void detachInterrupt(uint8_t irq) { if (irq <= 1) ext_handler[irq] = NULL; }
+
+void native_SetPin(uint8_t pin, uint8_t level) {
+  if (pin >= NUM_PINS) return;
+  pin_driven[pin] = 1;
+  set_level(pin, level);
+  dispatch();
+}
+
+void native_SetAnalog(uint8_t pin, int value) { if (pin < NUM_PINS) analog_value[pin] = value; }
+
+//----------------------------------------------------------------- timer1
+static uint32_t t1_prescale() {
+  static const uint16_t div[8] = {0, 1, 8, 64, 256, 1024, 0, 0};
+  return div[TCCR1B & 0x07];
+}
+
+static void t1_pin_action(uint8_t com, uint8_t pin) {
+  if (com == 1) set_level(pin, !pin_level[pin]);   // toggle
+  else if (com == 2) set_level(pin, LOW);          // clear
+  else if (com == 3) set_level(pin, HIGH);         // set
+}
+
+// ticks until the next compare event (B match or TOP)
+static uint32_t t1_dist(uint8_t *is_b) {
+  uint32_t d_top;
+
+  if (TCNT1 <= OCR1A) d_top = (uint32_t)OCR1A + 1 - TCNT1;
+  else d_top = 0x10000L - TCNT1 + OCR1A + 1;      // missed TOP -> wrap at 0xFFFF
+
+  // like TOP, a match of B acts when the counter leaves OCR1B -> OCR1B == OCR1A: same edge
+  *is_b = 0;
+  if (!t1_b_done && (OCR1B >= TCNT1) && (OCR1B < OCR1A) && ((uint32_t)OCR1B + 1 - TCNT1 < d_top)) {
+    *is_b = 1;
+    return ((uint32_t)OCR1B + 1 - TCNT1);
+  }
+  return d_top;
+}
+
+static uint64_t t1_next_event() {
+  uint8_t is_b;
+  uint32_t prescale = t1_prescale();
+  if ((prescale == 0) || !(TCCR1B & (1 << WGM12))) return NEVER;
+  return now + (uint64_t)t1_dist(&is_b) * prescale - t1_sub;
+}
+
+// the pin actions see 'now' at the compare match (edge times of D9 / D10)
+static void t1_advance(uint64_t cycles) {
+  uint8_t is_b;
+  uint32_t d;
+  uint64_t ticks;
+  uint32_t prescale = t1_prescale();
+  uint64_t tick0 = now - t1_sub;                  // start of the current prescaler tick
+
+  if ((prescale == 0) || !(TCCR1B & (1 << WGM12))) return;
+  ticks = (t1_sub + cycles) / prescale;
+  t1_sub = (t1_sub + cycles) % prescale;
+  while (ticks) {
+    d = t1_dist(&is_b);
+    if (ticks < d) {
+      TCNT1 += ticks;
+      return;
+    }
+    ticks -= d;
+    tick0 += (uint64_t)d * prescale;
+    now = tick0;
+    if (is_b) {
+      TCNT1 = OCR1B + 1;
+      t1_b_done = 1;
+      TIFR1 |= (1 << OCF1B);
+      t1_pin_action((TCCR1A >> 4) & 3, 10);       // OC1B = D10
+    }
+    else {
+      if (!t1_b_done && (OCR1B == OCR1A)) {
+        TIFR1 |= (1 << OCF1B);
+        t1_pin_action((TCCR1A >> 4) & 3, 10);     // same match as A
+      }
+      TCNT1 = 0;                                  // CTC: clear on compare A
+      t1_b_done = 0;
+      TIFR1 |= (1 << OCF1A);
+      t1_pin_action((TCCR1A >> 6) & 3, 9);        // OC1A = D9
+    }
+  }
+}
+
+//----------------------------------------------------------------- timer2
+// only compare A in normal mode (the counter itself: timer0_sync)
+static uint64_t t2_next_event() {
+  uint64_t tick, k;
+
+  if (!(TCCR2B & 7) || !((TIMSK2 & (1 << OCIE2A)) || (TCCR2A & (3 << COM2A0)))) return NEVER;
+  tick = (now + 63) / 64;                         // first tick at or after now
+  k = tick - (tick & 0xFF) + OCR2A;
+  if (k < tick) k += 256;
+  if (k == t2_last) k += 256;                     // this match is done
+  return k * 64;
+}
+
+static void t2_match() {
+  t2_last = now / 64;
+  TIFR2.flags |= (1 << OCF2A);
+  t1_pin_action((TCCR2A >> 6) & 3, 11);          // OC2A = D11
+}
+
+//----------------------------------------------------------------- usart0
+static uint32_t uart_char_cycles() {
+  uint32_t ubrr = ((uint32_t)UBRR0H << 8) | UBRR0L;
+  uint32_t bits = 1 + 1;                          // start + stop
+  if (UCSR0B & (1 << UCSZ02)) bits += 9;
+  else bits += ((UCSR0C >> UCSZ00) & 3) + 5;
+  if (UCSR0C & (1 << USBS0)) bits++;
+  return bits * (u2x ? 8 : 16) * (ubrr + 1);
+}
+
+static void tx_start_shift() {
+  tx_shift = tx_udr;
+  tx_udr_full = 0;
+  tx_shift_end = now + uart_char_cycles();
+}
+
+static void tx_done() {
+  if (native_OnUartTx) native_OnUartTx(tx_shift, now);
+  tx_log[tx_log_write++] = tx_shift;
+  if (tx_log_fill < 256) tx_log_fill++;
+  else tx_log_read++;                           // log full, drop oldest
+  tx_shift_end = NEVER;
+  if (tx_udr_full) tx_start_shift();
+  else txc_flag = 1;
+}
+
+static void rx_deliver() {
+  if (UCSR0B & (1 << RXEN0)) {
+    rx_data = rx_queue[rx_read];
+    rx_full = 1;
+    if (rx_data & 0x100) UCSR0B |= (1 << RXB80);
+    else UCSR0B &= ~(1 << RXB80);
+  }
+  rx_read = (rx_read + 1) & 63;
+  rx_next = (rx_read != rx_write) ? now + uart_char_cycles() : NEVER;
+}
+
+native_ucsr0a::operator uint8_t() const {
+  return (rx_full << RXC0) | (txc_flag << TXC0) | ((!tx_udr_full) << UDRE0) | (u2x << U2X0);
+}
+
+native_ucsr0a &native_ucsr0a::operator=(uint8_t value) {
+  u2x = (value >> U2X0) & 1;
+  if (value & (1 << TXC0)) txc_flag = 0;        // write one to clear
+  return *this;
+}
+
+native_udr0::operator uint8_t() {
+  rx_full = 0;
+  return (uint8_t)rx_data;
+}
+
+native_udr0 &native_udr0::operator=(uint8_t value) {
+  tx_udr = value | ((UCSR0B & (1 << TXB80)) ? 0x100 : 0);
+  tx_udr_full = 1;
+  if (tx_shift_end == NEVER) tx_start_shift();
+  return *this;
+}
+
+void native_UartRx(uint16_t data) {
+  if (((rx_write + 1) & 63) == rx_read) return;   // queue full
+  rx_queue[rx_write] = data;
+  rx_write = (rx_write + 1) & 63;
+  if (rx_next == NEVER) rx_next = now + uart_char_cycles();
+}
+
+uint16_t native_UartTxCount() { return tx_log_fill; }
+
+uint16_t native_UartTxGet() {
+  if (tx_log_fill == 0) return 0xFFFF;
+  tx_log_fill--;
+  return tx_log[tx_log_read++];
+}
+
+//----------------------------------------------------------------- interrupts
+void cli() { SREG &= ~0x80; }
+
+void sei() { SREG |= 0x80; dispatch(); }
+
+// run pending ISRs in order of the AVR vector table
+static void dispatch() {
+  void (*vector)(void);
+  uint16_t n;
+
+  if (in_isr) return;
+  for (n = 0; (n < 1000) && (SREG & 0x80); n++) {
+    vector = NULL;
+    if (ext_pending[0] && ext_handler[0]) { ext_pending[0] = 0; vector = ext_handler[0]; }
+    else if (ext_pending[1] && ext_handler[1]) { ext_pending[1] = 0; vector = ext_handler[1]; }
+    else if ((TIFR2 & (1 << OCF2A)) && (TIMSK2 & (1 << OCIE2A)) && TIMER2_COMPA_vect) {
+      TIFR2.flags &= ~(1 << OCF2A);
+      vector = TIMER2_COMPA_vect;
+    }
+    else if ((TIFR1 & (1 << OCF1A)) && (TIMSK1 & (1 << OCIE1A)) && TIMER1_COMPA_vect) {
+      TIFR1 &= ~(1 << OCF1A);
+      vector = TIMER1_COMPA_vect;
+    }
+    else if ((TIFR1 & (1 << OCF1B)) && (TIMSK1 & (1 << OCIE1B)) && TIMER1_COMPB_vect) {
+      TIFR1 &= ~(1 << OCF1B);
+      vector = TIMER1_COMPB_vect;
+    }
+    else if (rx_full && (UCSR0B & (1 << RXCIE0)) && USART_RX_vect) vector = USART_RX_vect;
+    else if (!tx_udr_full && (UCSR0B & (1 << UDRIE0)) && USART_UDRE_vect) vector = USART_UDRE_vect;
+    else if (txc_flag && (UCSR0B & (1 << TXCIE0)) && USART_TX_vect) {
+      txc_flag = 0;
+      vector = USART_TX_vect;
+    }
+    if (vector == NULL) break;
+
+    in_isr = 1;
+    SREG &= ~0x80;
+    vector();
+    SREG |= 0x80;                               // reti
+    in_isr = 0;
+  }
+}
+
+// timer0 runs free with div 64 (arduino core), derived from the cycle count
+// timer2: only normal mode with div 64 (4us, see setup) is simulated
+static void timer0_sync() {
+  TCNT0 = (uint8_t)(now / 64);
+  timer0_overflow_count = (unsigned long)(now / (64 * 256));
+  if (TCCR2B & 7) TCNT2 = (uint8_t)(now / 64);
+}
+
+static void advance_cycles(uint64_t cycles) {
+  uint64_t target = now + cycles;
+  uint64_t next, t2;
+
+  dispatch();
+  while (now < target) {
+    next = target;
+    if (t1_next_event() < next) next = t1_next_event();
+    t2 = t2_next_event();
+    if (t2 < next) next = t2;
+    if (tx_shift_end < next) next = tx_shift_end;
+    if (rx_next < next) next = rx_next;
+
+    t1_advance(next - now);
+    now = next;
+    timer0_sync();
+    if (t2 <= now) t2_match();
+    if (tx_shift_end <= now) tx_done();
+    if (rx_next <= now) rx_deliver();
+    dispatch();
+  }
+}
+
+void native_Advance(uint32_t us) { advance_cycles((uint64_t)us * CYCLES_PER_US); }
+
+uint64_t native_Cycles() { return now; }
+
+void native_Idle() { advance_cycles(4 * CYCLES_PER_US); }
+
+uint32_t millis() {
+  advance_cycles(CYCLES_PER_US);                // a call is not for free
+  return (uint32_t)(now / (CYCLES_PER_US * 1000L));
+}
+
+uint32_t micros() {
+  advance_cycles(CYCLES_PER_US);
+  return (uint32_t)(now / CYCLES_PER_US);
+}
+
+void delay(uint32_t ms) { advance_cycles((uint64_t)ms * 1000L * CYCLES_PER_US); }
+
+void delayMicroseconds(unsigned int us) { advance_cycles((uint64_t)us * CYCLES_PER_US); }
+
+//----------------------------------------------------------------- dcc decoder
+// edges of D9, half bits: 1 = 52..64us, 0 = 90..10000us (NMRA S-9.1 with margin)
+
+static t_native_dcc_stat dcc_stat;
+static uint64_t dcc_last_edge;
+static uint8_t dcc_half;                        // 0: none, 1: one half of '1', 2: one half of '0'
+static uint8_t dcc_state;                       // 0: preamble, 1: data bits, 2: separator
+static uint8_t dcc_ones;
+static uint8_t dcc_bits;
+static uint8_t dcc_size;
+static uint8_t dcc_packet[16];
+
+static void dcc_bit(uint8_t bit) {
+  if (dcc_state == 0) {                         // preamble
+    if (bit) dcc_ones++;
+    else {
+      if (dcc_ones >= 10) {
+        dcc_state = 1;
+        dcc_size = 0;
+        dcc_bits = 0;
+      }
+      dcc_ones = 0;
+    }
+    return;
+  }
+  if (dcc_state == 1) {                         // data
+    dcc_packet[dcc_size] = (dcc_packet[dcc_size] << 1) | bit;
+    if (++dcc_bits == 8) {
+      dcc_bits = 0;
+      dcc_size++;
+      dcc_state = 2;
+    }
+    return;
+  }
+  // separator: 0 = next byte, 1 = packet end bit
+  if ((bit == 0) && (dcc_size < sizeof(dcc_packet))) {
+    dcc_state = 1;
+    return;
+  }
+  dcc_state = 0;
+  dcc_ones = bit;                               // end bit may count as preamble
+  if (bit && (dcc_size >= 3)) {
+    uint8_t i, x = 0;
+    for (i = 0; i < dcc_size; i++) x ^= dcc_packet[i];
+    if (x == 0) {
+      dcc_stat.packets++;
+      dcc_stat.last_end = now;
+      if ((dcc_packet[0] == 0xFF) && (dcc_packet[1] == 0x00)) dcc_stat.idle_packets++;
+      if (native_OnDccPacket) native_OnDccPacket(dcc_packet, dcc_size - 1, now);
+      return;
+    }
+  }
+  dcc_stat.errors++;
+}
+
+static void dcc_edge() {
+  uint64_t d = now - dcc_last_edge;
+  uint8_t half;
+
+  dcc_last_edge = now;
+  if ((d >= 52 * CYCLES_PER_US) && (d <= 64 * CYCLES_PER_US)) half = 1;
+  else if ((d >= 90 * CYCLES_PER_US) && (d <= 10000 * CYCLES_PER_US)) half = 2;
+  else {                                        // cutout or glitch: resync
+    dcc_half = 0;
+    dcc_state = 0;
+    dcc_ones = 0;
+    return;
+  }
+  if (dcc_half == half) {
+    dcc_half = 0;
+    dcc_bit(half == 1);
+  }
+  else dcc_half = half;                         // first half or resync
+}
+
+const t_native_dcc_stat *native_DccStat() { return &dcc_stat; }
+
+//----------------------------------------------------------------- eeprom
+static uint16_t ee_index(const void *addr) { return (uint16_t)((uintptr_t)addr % NATIVE_EEPROM_SIZE); }
+
+uint8_t eeprom_read_byte(const uint8_t *addr) { return eeprom[ee_index(addr)]; }
+
+uint16_t eeprom_read_word(const uint16_t *addr) {
+  return eeprom[ee_index(addr)] | (eeprom[ee_index((const uint8_t *)addr + 1)] << 8);
+}
+
+void eeprom_write_byte(uint8_t *addr, uint8_t value) { eeprom[ee_index(addr)] = value; }
+
+void eeprom_update_byte(uint8_t *addr, uint8_t value) { eeprom[ee_index(addr)] = value; }
+
+bool eeprom_is_ready() { return true; }
+
+void eeprom_write_word(uint16_t *addr, uint16_t value) {
+  eeprom[ee_index(addr)] = value & 0xFF;
+  eeprom[ee_index((uint8_t *)addr + 1)] = value >> 8;
+}
+
+void eeprom_update_word(uint16_t *addr, uint16_t value) { eeprom_write_word(addr, value); }
+
+void eeprom_read_block(void *dst, const void *src, size_t n) {
+  for (size_t i = 0; i < n; i++) ((uint8_t *)dst)[i] = eeprom[ee_index((const uint8_t *)src + i)];
+}
+
+void eeprom_update_block(const void *src, void *dst, size_t n) {
+  for (size_t i = 0; i < n; i++) eeprom[ee_index((uint8_t *)dst + i)] = ((const uint8_t *)src)[i];
+}
+
+uint8_t *native_Eeprom() { return eeprom; }
+
+//----------------------------------------------------------------- i2c eeprom (24C32)
+// 2 address bytes (high first), then data bytes to write or a read request;
+// after a write the chip does not acknowledge for 5 ms (write cycle);
+// every byte on the bus takes 90 us (100 kHz, 9 bits)
+#define EXT_WRITE_CYCLE   (F_CPU / 200)
+#define I2C_BYTE_CYCLES   (90 * CYCLES_PER_US)
+
+TwoWire Wire;
+
+static uint8_t i2c_device;
+static uint8_t i2c_count;                     // bytes written in this transmission
+static uint16_t i2c_addr;
+static bool i2c_written;
+static uint8_t i2c_rx_left;
+static uint64_t ext_busy_until;
+
+void TwoWire::begin() {}
+
+void TwoWire::beginTransmission(uint8_t address) {
+  advance_cycles(I2C_BYTE_CYCLES);
+  i2c_device = address;
+  i2c_count = 0;
+  i2c_written = false;
+}
+
+size_t TwoWire::write(uint8_t data) {
+  advance_cycles(I2C_BYTE_CYCLES);
+  if (i2c_count == 0) i2c_addr = data << 8;
+  else if (i2c_count == 1) i2c_addr |= data;
+  else {
+    ext_eeprom[i2c_addr % NATIVE_EXT_EEPROM_SIZE] = data;
+    i2c_addr = (i2c_addr & ~31) | ((i2c_addr + 1) & 31);    // wraps in the 32 byte page
+    i2c_written = true;
+  }
+  i2c_count++;
+  return 1;
+}
+
+uint8_t TwoWire::endTransmission() {
+  if ((i2c_device != NATIVE_EXT_EEPROM_ADDR) || (now < ext_busy_until)) return 2;
+  if (i2c_written) ext_busy_until = now + EXT_WRITE_CYCLE;
+  return 0;
+}
+
+uint8_t TwoWire::requestFrom(uint8_t address, uint8_t quantity) {
+  advance_cycles(I2C_BYTE_CYCLES * (1 + quantity));
+  i2c_rx_left = 0;
+  if ((address != NATIVE_EXT_EEPROM_ADDR) || (now < ext_busy_until)) return 0;
+  i2c_rx_left = quantity;
+  return quantity;
+}
+
+int TwoWire::available() { return i2c_rx_left; }
+
+int TwoWire::read() {
+  if (i2c_rx_left == 0) return -1;
+  i2c_rx_left--;
+  return ext_eeprom[i2c_addr++ % NATIVE_EXT_EEPROM_SIZE];
+}
+
+uint8_t *native_ExtEeprom() { return ext_eeprom; }
+
+//----------------------------------------------------------------- print, serial, lcd
+size_t Print::write(const char *s) {
+  size_t n = 0;
+  while (*s) n += write((uint8_t)*s++);
+  return n;
+}
+
+size_t Print::print(long n, int base) {
+  if (n < 0) return write((uint8_t)'-') + print((unsigned long)-n, base);
+  return print((unsigned long)n, base);
+}
+
+size_t Print::print(unsigned long n, int base) {
+  char buf[33];
+  char *p = &buf[32];
+  *p = 0;
+  if (base < 2) base = 10;
+  do {
+    uint8_t digit = n % base;
+    *--p = (digit < 10) ? ('0' + digit) : ('A' + digit - 10);
+    n /= base;
+  } while (n);
+  return write(p);
+}
+
+size_t HardwareSerial::write(uint8_t c) { putchar(c); return 1; }
+
+LiquidCrystal_I2C::LiquidCrystal_I2C(uint8_t lcd_Addr, uint8_t En, uint8_t Rw, uint8_t Rs,
+                                     uint8_t d4, uint8_t d5, uint8_t d6, uint8_t d7,
+                                     uint8_t backlighPin, t_backlighPol pol) : col(0), row(0) {
+  (void)lcd_Addr; (void)En; (void)Rw; (void)Rs; (void)d4; (void)d5; (void)d6; (void)d7;
+  (void)backlighPin; (void)pol;
+}
+
+void LiquidCrystal_I2C::begin(uint8_t cols, uint8_t rows) { (void)cols; (void)rows; clear(); }
+
+void LiquidCrystal_I2C::clear() {
+  for (uint8_t r = 0; r < 4; r++) {
+    memset(lcd_buf[r], ' ', 20);
+    lcd_buf[r][20] = 0;
+  }
+  home();
+}
+
+void LiquidCrystal_I2C::home() { col = 0; row = 0; }
+
+void LiquidCrystal_I2C::setCursor(uint8_t c, uint8_t r) { col = c; row = r; }
+
+void LiquidCrystal_I2C::createChar(uint8_t location, uint8_t charmap[]) { (void)location; (void)charmap; }
+
+void LiquidCrystal_I2C::setBacklight(uint8_t value) { (void)value; }
+
+size_t LiquidCrystal_I2C::write(uint8_t c) {
+  if ((row < 4) && (col < 20)) lcd_buf[row][col] = (c < 8) ? '*' : c;   // custom glyphs
+  col++;
+  return 1;
+}
+
+const char *native_LcdLine(uint8_t row) { return (row < 4) ? lcd_buf[row] : ""; }
+
+//----------------------------------------------------------------- init
+void native_Init() {
+  uint8_t i;
+
+  now = 0;
+  timer0_sync();
+  in_isr = 0;
+  SREG = 0x80;
+  memset(pin_level, 0, sizeof(pin_level));
+  memset(pin_driven, 0, sizeof(pin_driven));
+  memset(analog_value, 0, sizeof(analog_value));
+  for (i = 0; i < 2; i++) {
+    ext_handler[i] = NULL;
+    ext_pending[i] = 0;
+  }
+  t1_sub = 0;
+  t1_b_done = 0;
+  t2_last = NEVER;
+  TIFR2.flags = 0;
+  rx_read = rx_write = 0;
+  rx_next = NEVER;
+  rx_full = 0;
+  tx_udr_full = 0;
+  tx_shift_end = NEVER;
+  txc_flag = 0;
+  tx_log_read = tx_log_write = 0;
+  tx_log_fill = 0;
+  memset(&dcc_stat, 0, sizeof(dcc_stat));
+  dcc_half = dcc_state = dcc_ones = 0;
+
+  memset(eeprom, 0xFF, sizeof(eeprom));
+  if (&ee_mem_size && ee_mem) memcpy(eeprom, ee_mem, ee_mem_size);   // like uploading the .eep file
+  memset(ext_eeprom, 0xFF, sizeof(ext_eeprom));                     // new chip
+  ext_busy_until = 0;
+  for (i = 0; i < 4; i++) {
+    memset(lcd_buf[i], ' ', 20);
+    lcd_buf[i][20] = 0;
+  }
+}
@@ -0,0 +1,74 @@
+//-----------------------------------------------------------------
+//
+// OpenDCC - native build
+//
+// This source file is subject of the GNU general public license 2,
+// that is available at the world-wide-web at
+// http://www.gnu.org/licenses/gpl.txt
+//
+//-----------------------------------------------------------------
+//
+// file:      native_hal.h (lib/native_hal)
+// history:   2026-10-16 V0.1 started
+//            2026-10-16 V0.2 timer2, native_OnUartTx
+//            2026-10-16 V0.3 i2c eeprom
+//            2026-10-16 V0.4 native_OnDccEdge
+//            2026-10-16 V0.5 native_OnNdccEdge
+//            2026-10-16 V0.6 native_OnProgEdge
+//
+//-----------------------------------------------------------------
+//
+// purpose:   control of the simulated hardware (see Arduino.h)
+//            for test drivers and benchmarks on the host
+//
+//-----------------------------------------------------------------
+#ifndef _NATIVE_HAL_H_
+#define _NATIVE_HAL_H_
+
+#include "Arduino.h"
+
+void native_Init();                                 // reset simulation, load eeprom image
+uint64_t native_Cycles();                           // simulated cpu cycles since native_Init
+void native_Advance(uint32_t us);                   // let time pass, run due ISRs
+
+// pins
+void native_SetPin(uint8_t pin, uint8_t level);     // drive an input (INT0/INT1 on D2/D3)
+void native_SetAnalog(uint8_t pin, int value);
+
+// USART0 (Xpressnet / pc interface)
+void native_UartRx(uint16_t data);                  // queue a received character (bit 8 = 9th bit)
+uint16_t native_UartTxCount();                      // characters waiting in tx log
+uint16_t native_UartTxGet();                        // oldest transmitted character (bit 8 = 9th bit)
+// called when a character is completely transmitted (weak, may be overridden by a test driver),
+// a driver may answer with native_UartRx() - the answer starts right after this character
+void native_OnUartTx(uint16_t data, uint64_t cycles) __attribute__((weak));
+
+// DCC output (decoded from the OC1A edges on D9)
+typedef struct {
+  uint32_t packets;                                 // valid packets (xor ok)
+  uint32_t errors;                                  // xor or framing errors
+  uint32_t idle_packets;                            // 0xFF 0x00
+  uint64_t last_end;                                // cycle count at end bit of last packet
+} t_native_dcc_stat;
+
+const t_native_dcc_stat *native_DccStat();
+// called for every decoded packet (weak, may be overridden by a test driver)
+void native_OnDccPacket(const uint8_t *data, uint8_t size, uint64_t cycles) __attribute__((weak));
+// called for every edge of D9 (DCC), level after the edge (weak, for waveform checks)
+void native_OnDccEdge(uint8_t level, uint64_t cycles) __attribute__((weak));
+// same for D10 (NDCC); on a common edge NDCC is called first
+void native_OnNdccEdge(uint8_t level, uint64_t cycles) __attribute__((weak));
+// same for D11 (OC2A, PROG_DCC: programming track with PROG_TRACK_CONCURRENT)
+void native_OnProgEdge(uint8_t level, uint64_t cycles) __attribute__((weak));
+
+// lcd (20x4)
+const char *native_LcdLine(uint8_t row);
+
+// eeprom
+uint8_t *native_Eeprom();                           // NATIVE_EEPROM_SIZE bytes
+#define NATIVE_EEPROM_SIZE  1024
+uint8_t *native_ExtEeprom();                        // 24C32 on the i2c bus (Wire.h), NATIVE_EXT_EEPROM_SIZE bytes
+#define NATIVE_EXT_EEPROM_SIZE  4096
+#define NATIVE_EXT_EEPROM_ADDR  0x50
+
+#endif // _NATIVE_HAL_H_
@@ -0,0 +1,69 @@
+//-----------------------------------------------------------------
+//
+// OpenDCC - native build
+//
+// This source file is subject of the GNU general public license 2,
+// that is available at the world-wide-web at
+// http://www.gnu.org/licenses/gpl.txt
+//
+//-----------------------------------------------------------------
+//
+// file:      native_main.cpp (lib/native_hal)
+// history:   2026-10-16 V0.1 started
+//
+//-----------------------------------------------------------------
+//
+// purpose:   run setup() and loop() of the command station on the host
+// usage:     pio run -e native && .pio/build/native/program [seconds]
+//            not built with NATIVE_BENCH: the benchmark has its own main()
+//
+//-----------------------------------------------------------------
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "native_hal.h"
+#include "hardware.h"
+
+#ifndef NATIVE_BENCH
+
+#define NATIVE_LOOP_US  100          // simulated duration of one loop(), besides delays and waits
+
+void setup();
+void loop();
+
+int main(int argc, char **argv) {
+  uint32_t seconds = 10;
+  uint32_t loops = 0;
+  uint64_t end;
+  uint8_t row;
+  const t_native_dcc_stat *dcc;
+
+  if (argc > 1) seconds = atol(argv[1]);
+
+  native_Init();
+  // board defaults (see hardware.h): no short, no ack, no external stop
+  native_SetPin(NSHORT_MAIN, HIGH);
+  native_SetPin(NSHORT_PROG, HIGH);
+  native_SetPin(ACK_DETECTED, LOW);
+  native_SetPin(ROTENC_CLK, HIGH);
+  native_SetPin(ROTENC_DT, HIGH);
+  native_SetAnalog(EXT_STOP, 1023);
+  native_SetAnalog(A7, 4);
+
+  setup();
+  end = native_Cycles() + (uint64_t)seconds * F_CPU;
+  while (native_Cycles() < end) {
+    loop();
+    native_Advance(NATIVE_LOOP_US);
+    loops++;
+  }
+
+  dcc = native_DccStat();
+  printf("simulated %lu s, %lu loops\n", (unsigned long)seconds, (unsigned long)loops);
+  printf("dcc packets %lu (idle %lu), errors %lu\n",
+         (unsigned long)dcc->packets, (unsigned long)dcc->idle_packets, (unsigned long)dcc->errors);
+  for (row = 0; row < 4; row++) printf("lcd |%s|\n", native_LcdLine(row));
+  return 0;
+}
+
+#endif // NATIVE_BENCH
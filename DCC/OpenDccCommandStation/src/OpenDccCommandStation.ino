@@ -20,6 +20,9 @@
 // for the local UI
 #include "ui.h"
 #include "keys.h"
+#include "isrprof.h"
+#include "railcom.h"
+#include "progout.h"
 
 #if  (TIMER2_TICK_PERIOD != (64L * 1000000L / F_CPU))    // we use div 64 on timer 2 -> 4us
     #warning TIMER2_TICK_PERIOD does not match divider!
@@ -88,11 +91,39 @@ static void hardware_Init() {
   analogReference(INTERNAL);
 } // hardware_Init
 
+// eeprom of an older version: CVs added since then get their defaults, all other
+// CVs are kept; erased eeprom (the arduino ide does not upload the .eep): all defaults
+static void eeprom_Upgrade() {
+  uint8_t version = eeprom_read_byte((uint8_t *)eadr_OpenDCC_Version);
+
+  if (version == OPENDCC_VERSION) return;
+  if (version == 0xFF) config_LoadDefaults();
+  else if (version < 24) {                      // V0.24: refresh scheduler
+    eeprom_write_byte((uint8_t *)eadr_refresh_speed_run, REFRESH_WEIGHT_SPEED_RUN);
+    eeprom_write_byte((uint8_t *)eadr_refresh_speed_stop, REFRESH_WEIGHT_SPEED_STOP);
+    eeprom_write_byte((uint8_t *)eadr_refresh_func, REFRESH_WEIGHT_FUNC);
+    eeprom_write_byte((uint8_t *)eadr_refresh_func_high, REFRESH_WEIGHT_FUNC_HIGH);
+    eeprom_write_byte((uint8_t *)eadr_refresh_recent, REFRESH_RECENT_AGE);
+  }
+  eeprom_write_byte((uint8_t *)eadr_OpenDCC_Version, OPENDCC_VERSION);
+  eeprom_write_byte((uint8_t *)eadr_VersionMirror, OPENDCC_VERSION);
+} // eeprom_Upgrade
+
 void setup() {
   
   hardware_Init();          // all io's + globals
+  #if (ISR_PROFILING == 1)
+    isrprof_Reset();      // before the first ISR runs
+  #endif
+  eeprom_Upgrade();     // before the CVs are read
   database_Init();      // loco format and names
   dccout_Init();        // timing engine for dcc    
+  #if (PROG_TRACK_CONCURRENT == 1)
+    progout_Init();     // dcc for the programming track, on timer2
+  #endif
+  #if (RAILCOM_DETECTOR == 1)
+    railcom_Init();     // receiver for the cutout
+  #endif
 
   //SDS20160823-eeprom data voorlopig niet gebruiken in test arduino
   //rs232_Init((t_baud)eeprom_read_byte((uint8_t *)eadr_baudrate));   // 19200 is default for Lenz 3.0
@@ -117,11 +148,6 @@ void setup() {
                         // memory of loco speeds and types
   programmer_Init();    // State Engine des Programmers
   
-  if (eeprom_read_byte(eadr_OpenDCC_Version) != OPENDCC_VERSION) {
-    // oops, no data loaded or wrong version! 
-    // sds : todo :add something
-  }
-
   status_SetState(RUN_OKAY);  // start up with power enabled (or RUN_OFF, to start with power off)
   organizer_SendDccStartupMessages();   // issue defined power up sequence on tracks (sds: vreemd dat dit ook in de GOLD uitgecomment is..)
   
@@ -139,8 +165,9 @@ void loop() {
                           // it will execute normal track operation
                           // or programming
   programmer_Run();
-  #if (XPRESSNET_ENABLED == 1)
-    database_Run();                  // check transfer of loco database 
+  database_Run();                    // write-behind of the loco database, transfer on xpnet
+  #if (RAILCOM_DETECTOR == 1)
+    railcom_Run();                   // decode the answers of the decoders
   #endif
   #if (PARSER == LENZ)
     pcintf_Run();                    // check commands from pc
@@ -160,7 +187,7 @@ void status_EventNotify ( statusEvent_t event, void *data) {
     case STATUS_STATE_CHANGED :
       // t_opendcc_state commandStationState = *((t_opendcc_state*) data);
       // gewoon open_dcc_state gebruiken, want die is toch global
-      switch (opendcc_state) {
+      switch (main_track_state) {     // = opendcc_state, unless PROG_TRACK_CONCURRENT
         // TODO : cleanup, dit is voorlopig letterlijk overgenomen uit status_SetState
         // waar we de afhankelijkheid van organizer weg wilden
         case RUN_OKAY:
@@ -172,6 +199,8 @@ void status_EventNotify ( statusEvent_t event, void *data) {
         case RUN_PAUSE:       // DCC Running, all Engines Speed 0, SDS TODO : wordt nog niet gebruikt
           do_all_stop();
           break;
+        default:              // INIT, RUN_OFF, RUN_SHORT, PROG_SHORT, PROG_OFF: nothing to do for the organizer
+          break;
       }
       uiEvent.statusChanged = 1; // notify UI
       #if (XPRESSNET_ENABLED == 1)
@@ -185,7 +214,7 @@ void status_EventNotify ( statusEvent_t event, void *data) {
       //t_fast_clock *fastClock = (t_fast_clock*) data;
       // gewoon fast_clock global gebruiken om te lezen is ook ok
       // now send this to DCC (but not during programming or when stopped)
-      if (opendcc_state == RUN_OKAY) do_fast_clock(&fast_clock);
+      if (main_track_state == RUN_OKAY) do_fast_clock(&fast_clock);
 
       uiEvent.clockChanged = 1; // notify UI
       #if (XPRESSNET_ENABLED == 1)
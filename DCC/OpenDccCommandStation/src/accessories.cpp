@@ -30,6 +30,9 @@ static uint8_t accessoryBuffer[NUM_ACCESSORY_ADDRESSES]; // for inputs (feedback
 static uint8_t turnoutFeedbackBuffer[NUM_TURNOUTFEEDBACK_ADDRESSES]; // store feedback bits from feedbacked turnouts separately, 4 turnouts/address
 // need this for the TT bits
 static uint8_t feedbackDecoderAddresses[NUM_ACCESSORY_ADDRESSES>>3]; // true/false bit per accessory address
+// nibbles that changed since they were last broadcast, bit (decoderAddress*2 + nibble)
+static uint8_t feedbackChanged[NUM_ACCESSORY_ADDRESSES>>2];
+static uint8_t feedbackChangedNext;  // feedback_GetChanges starts here, so nobody waits forever
 
 /*****************************************************************************/
 /*    HELPERS                                                                */
@@ -62,6 +65,10 @@ static uint8_t getTurnoutFeedbackPosition(uint16_t turnoutAddress) {
   return retval;
 } // getTurnoutFeedbackPosition
 
+static void markFeedbackChanged(uint8_t index) { // index = decoderAddress*2 + nibble
+  feedbackChanged[index>>3] |= (1 << (index & 0x7));
+} // markFeedbackChanged
+
 static bool isFeedbackDecoderAddress(uint8_t decoderAddress) {
   uint8_t bitPos, bitVal;
   bitPos = decoderAddress & 0x7;
@@ -81,6 +88,7 @@ uint8_t feedback_update(uint8_t decoderAddress, uint8_t data) {
   bool dataChanged = false;
   uint8_t bitPos = decoderAddress & 0x7;
   uint8_t oldData;
+  if (decoderAddress >= NUM_ACCESSORY_ADDRESSES) return data; // not stored, nothing to broadcast
   feedbackDecoderAddresses[decoderAddress>>3] |= (1 << bitPos); // mark this address as a feedback decoder address
   // TODO : maak onderscheid ts de feedbacked turnouts en niet
   if (decoderAddress < NUM_TURNOUTFEEDBACK_ADDRESSES){
@@ -91,13 +99,39 @@ uint8_t feedback_update(uint8_t decoderAddress, uint8_t data) {
     oldData = accessoryBuffer[decoderAddress];
     accessoryBuffer[decoderAddress] = data;
   }
-  /* 
-   * hier nog een *msg vullen met de wijzigingen om te broadcasten?
-   * of laten we de caller 2x turnout_getInfo oproepen?
-   */
+  // the broadcast is done later by xpnet, several changes in one message (feedback_GetChanges)
+  if ((oldData ^ data) & 0x0F) markFeedbackChanged(decoderAddress << 1);
+  if ((oldData ^ data) & 0xF0) markFeedbackChanged((decoderAddress << 1) + 1);
   return oldData;
 } // feedback_update
 
+bool feedback_IsChanged() {
+  uint8_t i;
+  for (i = 0; i < sizeof(feedbackChanged); i++)
+    if (feedbackChanged[i]) return true;
+  return false;
+} // feedback_IsChanged
+
+// fills msg with up to maxPairs decoderAddress + ITTNZZZZ pairs of changed nibbles
+// (msg = ptr to the first data byte) and clears their change bits
+// return : number of pairs
+uint8_t feedback_GetChanges(uint8_t *msg, uint8_t maxPairs) {
+  uint8_t i, n = 0, index = feedbackChangedNext;
+
+  for (i = 0; (i < (NUM_ACCESSORY_ADDRESSES << 1)) && (n < maxPairs); i++) {
+    if (feedbackChanged[index>>3] & (1 << (index & 0x7))) {
+      feedbackChanged[index>>3] &= ~(1 << (index & 0x7));
+      accessory_getInfo(index >> 1, index & 0x1, msg);
+      msg += 2;
+      n++;
+    }
+    index++;
+    if (index == (NUM_ACCESSORY_ADDRESSES << 1)) index = 0;
+  }
+  feedbackChangedNext = index;
+  return n;
+} // feedback_GetChanges
+
 // vervangt save_turnout uit organizer
 // 2 bits per wissel in accessoryBuffer
 // even bit = coil 0 laatst actief, oneven bit = coil 1 laatst actief
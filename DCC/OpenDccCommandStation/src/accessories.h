@@ -9,6 +9,9 @@
 // store input data from a feedback decoder
 // return : previous contents for the decoderAddress, if changed xpnet knows it needs to broadcast the changes
 uint8_t feedback_update(uint8_t decoderAddress, uint8_t data);
+// changed nibbles are kept until xpnet broadcasts them, several in one message
+bool feedback_IsChanged();
+uint8_t feedback_GetChanges(uint8_t *msg, uint8_t maxPairs); // returns number of address/data pairs in msg
 
 
 // store output data from turnouts
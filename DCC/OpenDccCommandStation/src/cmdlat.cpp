@@ -0,0 +1,117 @@
+//----------------------------------------------------------------
+//
+// OpenDCC
+//
+// This source file is subject of the GNU general public license 2,
+// that is available at the world-wide-web at
+// http://www.gnu.org/licenses/gpl.txt
+//
+//-----------------------------------------------------------------
+//
+// file:      cmdlat.cpp
+// history:   2026-10-16 V0.1 started
+//
+//-----------------------------------------------------------------
+//
+// purpose:   lowcost central station for dcc
+// content:   command to rail latency per origin, see cmdlat.h
+//            readout: ui diagnostic page 2, xpnet vendor request 0x22 0xFB
+//
+//-----------------------------------------------------------------
+
+#include "Arduino.h"
+#include "config.h"
+#include "cmdlat.h"
+
+#if (CMD_LATENCY == 1)
+
+t_cmdlat_stamp cmdlat_pending = { CMDLAT_ORIGIN_NONE, 0 };
+
+static t_cmdlat cmdlat[CMDLAT_NUM_ORIGINS];
+static unsigned char cmdlat_used;            // entries of cmdlat[] in use
+
+void cmdlat_Accept(unsigned char origin) {
+  cli();                                      // timer0_overflow_count is changed by the ISR
+  cmdlat_pending.time = cmdlat_Now();
+  sei();
+  cmdlat_pending.origin = origin & ~CMDLAT_ORIGIN_DONE;
+} // cmdlat_Accept
+
+void cmdlat_Reset() {
+  cmdlat_used = 0;
+} // cmdlat_Reset
+
+void cmdlat_Record(t_cmdlat_stamp *stamp) {
+  unsigned char origin = stamp->origin & ~CMDLAT_ORIGIN_DONE;
+  uint16_t ticks = stamp->time;
+  t_cmdlat *p;
+  unsigned char i;
+  uint16_t t;
+
+  for (i=0; i<cmdlat_used; i++)
+    if (cmdlat[i].origin == origin) break;
+  if (i == cmdlat_used) {
+    if (cmdlat_used < CMDLAT_NUM_ORIGINS) {   // new origin
+      cmdlat_used++;
+      memset(&cmdlat[i], 0, sizeof(t_cmdlat));
+      cmdlat[i].origin = origin;
+      cmdlat[i].min = 0xFFFF;
+    }
+    else {                                    // full: the last entry counts all others
+      i = CMDLAT_NUM_ORIGINS - 1;
+      cmdlat[i].origin = CMDLAT_ORIGIN_OTHERS;
+    }
+  }
+  p = &cmdlat[i];
+
+  if (ticks < p->min) p->min = ticks;
+  if (ticks > p->max) p->max = ticks;
+  if (p->count == 0x8000) {                   // keep avg running, halve
+    p->count >>= 1;
+    p->sum >>= 1;
+  }
+  p->count++;
+  p->sum += ticks;
+
+  // bucket: < 8 ticks (2ms), < 16, ... , >= 512 (128ms)
+  i = 0;
+  t = ticks >> 3;
+  while (t && (i < CMDLAT_NUM_BUCKETS - 1)) {
+    t >>= 1;
+    i++;
+  }
+  if (p->bucket[i] == 0xFF) {                 // keep the distribution, halve
+    for (t=0; t<CMDLAT_NUM_BUCKETS; t++) p->bucket[t] >>= 1;
+  }
+  p->bucket[i]++;
+} // cmdlat_Record
+
+static uint16_t ticks_to_100us(uint32_t ticks) {
+  ticks = (ticks * (CMDLAT_TICK_US / 4) + 12) / 25;
+  if (ticks > 0xFFFF) ticks = 0xFFFF;
+  return((uint16_t)ticks);
+}
+
+bool cmdlat_Get(unsigned char n, t_cmdlat_result *result) {
+  t_cmdlat *p;
+  uint16_t total = 0, sum = 0;
+  unsigned char i;
+
+  if (n >= cmdlat_used) return(false);
+  p = &cmdlat[n];
+  result->origin = p->origin;
+  result->count = p->count;
+  result->min = ticks_to_100us(p->min);
+  result->avg = ticks_to_100us(p->sum / p->count);
+  result->max = ticks_to_100us(p->max);
+
+  for (i=0; i<CMDLAT_NUM_BUCKETS; i++) total += p->bucket[i];
+  for (i=0; i<CMDLAT_NUM_BUCKETS - 1; i++) {
+    sum += p->bucket[i];
+    if ((uint32_t)sum * 100 >= (uint32_t)total * 99) break;
+  }
+  result->p99 = (i < CMDLAT_NUM_BUCKETS - 1) ? (2 << i) : 255;
+  return(true);
+} // cmdlat_Get
+
+#endif // CMD_LATENCY
@@ -0,0 +1,94 @@
+//----------------------------------------------------------------
+//
+// OpenDCC
+//
+// This source file is subject of the GNU general public license 2,
+// that is available at the world-wide-web at
+// http://www.gnu.org/licenses/gpl.txt
+//
+//-----------------------------------------------------------------
+//
+// file:      cmdlat.h
+// history:   2026-10-16 V0.1 started
+//
+//-----------------------------------------------------------------
+//
+// purpose:   lowcost central station for dcc
+// content:   command to rail latency per origin (xpnet slot, pc, local ui)
+//            (compile switch CMD_LATENCY in config.h)
+//
+// how:       - the parser (or ui) calls CMDLAT_ACCEPT(slot) when a command
+//              arrives: cmdlat_pending gets origin and time.
+//            - the first message of this command that enters queue_hp or
+//              queue_lp takes the stamp (CMDLAT_TAKE), the organizer forwards
+//              it to the dcc_ring slot.
+//            - the dccout ISR replaces the arrival with the latency when it
+//              starts to send the slot (first transmission only).
+//            - when the organizer reuses the slot, the measured stamp is
+//              added to the statistics (cmdlat_Record) - nothing of this in the ISR.
+//            Repeats and refreshes carry no stamp.
+//
+//            time base: timer0 of the arduino core (millis), 256us per tick;
+//            a pending timer0 overflow is not seen -> rarely 1ms too short.
+//
+//-----------------------------------------------------------------
+#ifndef __CMDLAT_H__
+#define __CMDLAT_H__
+
+#define CMDLAT_ORIGIN_UI      0       // local ui (slot 0 for the organizer)
+#define CMDLAT_ORIGIN_OTHERS  0x7F    // statistics table full: all further origins
+#define CMDLAT_ORIGIN_DONE    0x80    // flag: latency is measured
+#define CMDLAT_ORIGIN_NONE    0xFF    // no command (repeat, refresh, ...)
+
+#define CMDLAT_TICK_US        256
+#define CMDLAT_NUM_ORIGINS    8       // statistics for this number of origins (19 bytes each)
+#define CMDLAT_NUM_BUCKETS    8       // < 2, 4, 8, 16, 32, 64, 128 ms, more
+
+typedef struct {
+  uint8_t  origin;
+  uint16_t min;                       // ticks
+  uint16_t max;
+  uint32_t sum;                       // sum / count = avg
+  uint16_t count;
+  uint8_t  bucket[CMDLAT_NUM_BUCKETS];  // relative, halved on overflow
+} t_cmdlat;
+
+typedef struct {
+  uint8_t  origin;
+  uint16_t count;
+  uint16_t min;                       // 0.1 ms
+  uint16_t avg;
+  uint16_t max;
+  uint8_t  p99;                       // ms, upper bound of the bucket; 255 = more than 128ms
+} t_cmdlat_result;
+
+#if (CMD_LATENCY == 1)
+
+extern "C" volatile unsigned long timer0_overflow_count;   // arduino core, wiring.c
+
+// cheap enough for the ISR: 1024us per overflow, TCNT0 counts 4us
+static inline uint16_t cmdlat_Now() __attribute__((always_inline));
+uint16_t cmdlat_Now() {
+  return ((uint16_t)timer0_overflow_count << 2) | (TCNT0 >> 6);
+}
+
+extern t_cmdlat_stamp cmdlat_pending;        // stamp of the command being parsed
+
+void cmdlat_Accept(unsigned char origin);    // a command arrives (parser, ui)
+void cmdlat_Record(t_cmdlat_stamp *stamp);   // organizer: add a measured stamp to the statistics
+void cmdlat_Reset();
+bool cmdlat_Get(unsigned char n, t_cmdlat_result *result);   // statistics of the n-th origin; false: unused
+
+#define CMDLAT_ACCEPT(origin)   cmdlat_Accept(origin)
+#define CMDLAT_CLEAR()          cmdlat_pending.origin = CMDLAT_ORIGIN_NONE
+#define CMDLAT_TAKE(stamp)      { stamp = cmdlat_pending; cmdlat_pending.origin = CMDLAT_ORIGIN_NONE; }
+
+#else
+
+#define CMDLAT_ACCEPT(origin)
+#define CMDLAT_CLEAR()
+#define CMDLAT_TAKE(stamp)
+
+#endif // CMD_LATENCY
+
+#endif // __CMDLAT_H__
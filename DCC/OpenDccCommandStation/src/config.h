@@ -53,6 +53,7 @@
 //            2010-02-16       Redirect switch for transfer Loco data base command
 //                             (virtual decoder is used for that)
 //            2010-03-01       Bugfix PoM on Xpressnet
+//            2026-10-16 V0.24 CV40..CV44 refresh weights, eeprom of V0.23 is upgraded at startup
 //
 //-------------------------------------------------------------------------------
 //
@@ -78,7 +79,7 @@
 #ifndef __CONFIG_H__
 #define __CONFIG_H__
 
-#define OPENDCC_VERSION     23
+#define OPENDCC_VERSION     24
 
 //------------------------------------------------------------------------
 // Timing Definitions (all values in us)
@@ -108,7 +109,13 @@
 
 // SDS: loco database in eeprom
 #define LOCODB_EEPROM_OFFSET    0x40        // SDS : moet voorbij de CV variables
-#define LOCODB_NUM_ENTRIES      10          // 10 entries, 12 bytes per entry (database.cpp)
+#define LOCODB_NUM_ENTRIES      10          // 10 entries, 12 bytes per entry (database.cpp), max. 254
+                                            // addresses and formats are kept in RAM too (2 bytes per entry)
+#define LOCODB_HASH_SIZE        0           // address index in RAM (power of 2, > LOCODB_NUM_ENTRIES, best >= 2*,
+                                            // max. 256), 0: search the RAM copy; worth it from about 32 entries
+#define LOCODB_EXT_EEPROM       0           // 1: database in an external i2c eeprom (24C32 .. 24C512),
+#define LOCODB_EXT_I2C_ADDR     0x50        //    at this address and starting at 0; for some hundred locos
+#define LOCODB_EXT_SIZE         4096        //    size in bytes (24C32)
 #define LOK_NAME_LENGTH         10          // no of char; multimaus uses 5
                                             // XP has a range of 1 to 10; more than 10 would break XP size.
                                             // these are the characters without any trailing 0
@@ -116,6 +123,16 @@
 //SDS : ofwel LENZ ofwel xpnet op atmega328
 #define XPRESSNET_ENABLED       1           // 0: classical OpenDCC
                                             // 1: if enabled, add code for Xpressnet (Requires Atmega644P)
+#define XP_ADAPTIVE_SLOTS       1           // 0: call all used slots in a fixed round, then one unused
+                                            // 1: call active slots more often (see xpnet.cpp, slot scheduler),
+                                            //    costs 68 bytes RAM
+#define XP_SLOT_STATS           0           // 1: call statistics of the slot scheduler via xpnet 0x22 0xFD
+                                            //    (diagnostics), costs another 102 bytes RAM
+#define XP_SLOT_MAX_INTERVAL    64          // a used slot is called at least every 64 inquiries
+#define XP_SLOT_SCAN_RATE       8           // every 8th inquiry calls an unused slot
+#define XP_SLOT_DECAY           250         // ms, activity of the slots decays by 1/8
+#define XP_FEEDBACK_INTERVAL    20          // ms, min. time between two feedback broadcasts; changes
+                                            // meanwhile are collected, up to 7 per broadcast
 #if (PARSER == LENZ)
   #define DEFAULT_BAUD      BAUD_19200      // supported: 2400, 4800, 9600, 19200, 38400, 57600, 115200         
 #endif
@@ -144,10 +161,49 @@
 
 #define DCC_F13_F28            1        // 1: add code for functions F13 up to F28
 
+#ifndef MAERKLIN_ENABLED                // (set by [env:native_mmout])
+#define MAERKLIN_ENABLED       0        // 1: add Maerklin Motorola locos (MM1, MM2; address 1..255), format per loco
+#endif                                  //    (xpnet 0x24 0xF7), sent by dccout between the dcc packets;
+                                        //    the database then stores Motorola as format code 01 (DCC27 -> DCC28),
+                                        //    costs 15 bytes RAM
+
+#define LOCOBUFFER_PACKET_CACHE  0      // 1: keep the refresh packets of every loco ready to send
+                                        //    (rebuilt only after a change), costs 31 bytes RAM per loco
+                                        //    (as much as 2 .. 3 more locos in the locobuffer, see 5.4)
+                                        //    off since the packed locobuffer: 48 locos would need 1488 bytes,
+                                        //    the refresh then builds the packets again (5 locos: 155 bytes)
+
 #define RAILCOM_ENABLED        1        // 1: add code to enable RailCom, 
                                         // SDS : deze bit wordt in eeprom opgeslagen, je moet dus ook de eep heropladen, anders werkt het niet
                                         // dit is de default waarde bij startup, je kan ook runtime de railcom activeren (zie dccout.cpp)
 
+#ifndef RAILCOM_DETECTOR                // (set by [env:native_railcom])
+#define RAILCOM_DETECTOR       0        // 1: receive the RailCom answers in the cutout (detector on RXD1, needs USART1:
+#endif                                  //    atmega644P only), 'seen on track' and pom cvrd results, see railcom.h,
+                                        //    costs 154 bytes RAM
+
+#ifndef PROG_TRACK_CONCURRENT           // (set by [env:native_waveform_prog])
+#define PROG_TRACK_CONCURRENT  0        // 1: the programming track gets a dcc output of its own (PROG_DCC, timer2), the
+#endif                                  //    main track keeps running during service mode, see progout.h;
+                                        //    the programming booster has to be connected to PROG_DCC, costs 23 bytes RAM
+
+#define DCCOUT_BITSTREAM       0        // 0: dccout ISR builds every bit with a state engine (preamble, bytes, xor)
+                                        // 1: packets are encoded ahead into a bit vector, the ISR only shifts
+                                        //    them out (shorter ISR), costs 12 bytes RAM per dcc_ring entry + 36
+                                        //    (next_message, estop and the packet in output, see RAM_DCC_RING)
+
+#define ISR_PROFILING          0        // 1: measure the cpu cycles of the ISRs (min/avg/max, missed deadline)
+                                        //    shown on ui page 'diag' and via xpnet 0x22 0xF8, costs 114 bytes RAM
+
+#ifndef PACKET_TRACE                    // (set by [env:native_bench])
+#define PACKET_TRACE           0        // 1: record the packets handed over to dccout (source, type, address, time)
+#endif                                  //    and count them per source, see pkttrace.h, costs 222 bytes RAM
+
+#ifndef CMD_LATENCY                     // (set by [env:native_bench])
+#define CMD_LATENCY            0        // 1: measure the time from accepting a command (xpnet slot, pc, ui) until
+#endif                                  //    dccout starts to send it; min/avg/max/p99 per slot, shown on
+                                        //    ui page 'diag' > and via xpnet 0x22 0xFB, costs 3 bytes per queue entry + 160
+
 #define DCC_SHORT_ADDR_LIMIT   112      // This is the maximum number for short addressing mode on DCC
 #define XP_SHORT_ADDR_LIMIT    99       // This is the maximum number for short addressing mode on Xpressnet
 
@@ -158,6 +214,16 @@
 #define NUM_DCC_FUNC_REPEAT    0        // Function Commands are repeated this number (--> CV)
 #define NUM_DCC_POM_REPEAT     3        // Program on the main are repeated this number (--> CV)
 
+// weights of the locobuffer refresh (--> CV), 1..127; 0 and 255 (erased eeprom) read as these defaults
+// the packet with the highest weight is refreshed every round, the others pro rata
+#define REFRESH_WEIGHT_SPEED_RUN   64   // speed packet of a moving loco
+#define REFRESH_WEIGHT_SPEED_STOP  16   // speed packet of a standing loco
+#define REFRESH_WEIGHT_FUNC        16   // function packets FL, F1..F12 (only if a function is on)
+#define REFRESH_WEIGHT_FUNC_HIGH    8   // function packets F13..F28 (only if a function is on)
+#define REFRESH_RECENT_AGE          2   // locos commanded more recently get double weight (age 0..15)
+#define REFRESH_SHARE               4   // busy rail (queues, repeats): at least every 4th packet is a refresh,
+                                        // 0: refresh only when there is nothing else to send
+
 // note: in addition, there is the locobuffer, where all commands are refreshed
 //       this locobuffer does not apply to accessory commands nor pom-commands
 
@@ -170,7 +236,8 @@ typedef enum {
   is_loco,      // standard dcc speed command
   is_acc,       // accessory command
   is_prog,      // service mode - longer preambles
-  is_prog_ack
+  is_prog_ack,
+  is_mm         // Maerklin Motorola: 3 bytes of trits (address, function, data), see dccout.cpp
 }  t_msg_type;
 
 typedef struct {
@@ -183,9 +250,34 @@ typedef struct {
     uint8_t qualifier;
   };
   uint8_t dcc[MAX_DCC_SIZE];  // the dcc content
+  uint16_t key;               // packet key, see below; 0 = none (never coalesced)
 } t_message;
 
-// define a structure for the loco memory (6 bytes)
+// origin and arrival time of a command on its way to the rails (CMD_LATENCY, see cmdlat.h)
+typedef struct {
+  uint8_t  origin;            // xpnet slot (0 = local ui); bit 7: latency measured; 0xFF = none
+  uint16_t time;              // arrival, once measured: latency (both in CMDLAT_TICK_US)
+} t_cmdlat_stamp;
+
+// The packet key is computed when a message is built; messages with the same key
+// supersede each other in the queues and the repeatbuffer.
+//   loco:      1 + class * KEY_LOCO_RANGE + loco address
+//   accessory: MSG_KEY_ACC_BASE + turnout (decoder address, output pair)
+// (0 = no key: out of range or not to be superseded)
+#define KEY_LOCO_RANGE    10240         // loco addresses 0..10239
+#define KEY_ACC_RANGE     4088          // turnouts 0..4087 (decoder addresses 1..1023, see organizer.cpp)
+#define KEY_SPEED         0             // instruction classes for loco messages
+#define KEY_FUNC_GRP1     1             // FL, F1..F4
+#define KEY_FUNC_GRP2     2             // F5..F8
+#define KEY_FUNC_GRP3     3             // F9..F12
+#define KEY_FUNC_GRP4     4             // F13..F20
+#define KEY_FUNC_GRP5     5             // F21..F28
+#define MSG_KEY_ACC_BASE  (1 + (KEY_FUNC_GRP5 + 1) * (uint16_t) KEY_LOCO_RANGE)
+#define MSG_KEY_ACC(turnout)  ((uint16_t)((turnout) < KEY_ACC_RANGE ? MSG_KEY_ACC_BASE + (turnout) : 0))
+
+// define a structure for the loco memory
+// note: this is the unpacked view of a locobuffer entry (lb_GetEntry);
+//       the locobuffer itself is kept packed, see organizer.cpp
 
 //SDS sick of compiler complaints
 //SDS typedef enum {DCC14 = 0, DCC27 = 1, DCC28 = 2, DCC128 = 3} t_format;
@@ -193,6 +285,8 @@ typedef struct {
 #define DCC27   1
 #define DCC28   2
 #define DCC128  3
+#define MM1     4               // Maerklin Motorola (MAERKLIN_ENABLED), 14 speed steps, relative direction
+#define MM2     5               //                                       absolute direction, F1..F4
 
 typedef uint8_t t_format;
 
@@ -209,15 +303,14 @@ typedef struct {
                                 // and only converted to the according format
                                 // when put on the rails or to xpressnet
 
-  t_format format: 2;           // 00 = 14, 01=27, 10=28, 11=128 speed steps.
-                                // DCC27 is not supported
+  t_format format: 3;           // 000 = 14, 001=27, 010=28, 011=128 speed steps,
+                                // 100 = MM1, 101 = MM2. DCC27 is not supported
   uint8_t active: 1;            // 1: lok is in refresh, 0: lok is not refreshed
   uint8_t slot: 5;              // loc is controlled by this xpressnet device (1..31: throttles, 0=local UI)
                                 // sds: lenz_parser will now also use this with a #defined slot (e.g. same as PcInterface hardware)
 
   union {
     #if (DCC_F13_F28)
-      #define SIZE_LOCOBUFFER_ENTRY_D 2
       uint32_t funcs;
     #else
       uint16_t funcs;
@@ -233,11 +326,9 @@ typedef struct {
       #endif
     };
   };
-  uint8_t refresh;              // refresh is used as level: 0 -> refreshed often
+  uint8_t refresh;              // age since the last command (0..15): 0 -> refreshed often
 } locomem;
 
-#define SIZE_LOCOBUFFER_ENTRY (7+SIZE_LOCOBUFFER_ENTRY_D)
-
 // Note on speed coding (downstream):
 //
 // Speed is always stored as 0..127.
@@ -271,13 +362,54 @@ typedef struct {
 //========================================================================
 // Globals
 extern const uint8_t opendcc_version PROGMEM;
+void config_LoadDefaults();                 // all CVs to their defaults (erased eeprom), config.cpp
 
-#define SIZE_QUEUE_PROG       6       // programming queue (7 bytes each entry)
-#define SIZE_QUEUE_LP        16       // low priority queue (7 bytes each entry)
-#define SIZE_QUEUE_HP         8       // high priority queue (7 bytes each entry)
-#define SIZE_REPEATBUFFER    32       // immediate repeat (7 bytes each entry)
-//SDS#define SIZE_LOCOBUFFER      64       // no of simult. active locos (6 bytes each entry)
-#define SIZE_LOCOBUFFER      5 //SDS, meer dan genoeg nu!! (gebruik ram voor een display)
+#define SIZE_QUEUE_PROG       6       // programming queue (5 bytes each entry + packet)
+#define SIZE_QUEUE_LP        24       // low priority queue (5 bytes each entry + packet)
+#define SIZE_QUEUE_HP        10       // high priority queue (5 bytes each entry + packet)
+#ifndef SIZE_REPEATBUFFER               // (set by [env:native_bench_rb128])
+#define SIZE_REPEATBUFFER    32       // immediate repeat (7 bytes each entry + packet)
+#endif
+#define SIZE_PKT_POOL_SMALL  40       // packet pool for queues and repeatbuffer: slots of 3 bytes
+#define SIZE_PKT_POOL_LARGE  16       //   and slots of MAX_DCC_SIZE bytes (small + large <= 254)
+#define NUM_REPEAT_BUCKETS   16       // repeatbuffer priority buckets, repeat counts >= 15 share the top bucket
+#define SIZE_DCC_RING         4       // packets prepared ahead for dccout (power of 2, one entry stays free, 9 bytes each entry)
+//SDS#define SIZE_LOCOBUFFER      5 //SDS, meer dan genoeg nu!! (gebruik ram voor een display)
+#ifndef SIZE_LOCOBUFFER                 // (packet_bench: -DSIZE_LOCOBUFFER=n for the lookup sweep)
+#define SIZE_LOCOBUFFER       5       // no of simult. active locos (10.5 bytes each entry + index)
+#endif                                // on the Nano this is what is left with the LCD, see RAM budget in 5.4;
+                                      // 48 locos (672 bytes) need a processor with 4k SRAM
+#define SIZE_LOCOBUFFER_FHIGH 4       // locos with F13..F28 on at the same time (5 bytes each entry)
+
+// bytes per locobuffer entry: address + format 2, speed 1, slot + active 1, FL..F12 2,
+// refresh deficits 4 (+ refresh age 4 bits, see RAM_LOCOBUFFER)
+#define SIZE_LOCOBUFFER_ENTRY  10
+
+// address index for the locobuffer (open addressing, 1 byte each entry)
+// must be a power of 2, at least 2x SIZE_LOCOBUFFER to keep the probe chains short
+#if (SIZE_LOCOBUFFER <= 8)
+  #define SIZE_LOCOBUFFER_HASH   16
+#elif (SIZE_LOCOBUFFER <= 16)
+  #define SIZE_LOCOBUFFER_HASH   32
+#elif (SIZE_LOCOBUFFER <= 32)
+  #define SIZE_LOCOBUFFER_HASH   64
+#elif (SIZE_LOCOBUFFER <= 64)
+  #define SIZE_LOCOBUFFER_HASH  128
+#elif (SIZE_LOCOBUFFER <= 128)
+  #define SIZE_LOCOBUFFER_HASH  256
+#else
+  #define SIZE_LOCOBUFFER_HASH  512
+#endif
+
+// key index for the repeatbuffer (open addressing, 1 byte each entry)
+// must be a power of 2, at least 2x SIZE_REPEATBUFFER and at most 256
+#if (SIZE_REPEATBUFFER <= 32)
+  #define SIZE_REPEATBUFFER_HASH  64
+#elif (SIZE_REPEATBUFFER <= 64)
+  #define SIZE_REPEATBUFFER_HASH 128
+#else
+  #define SIZE_REPEATBUFFER_HASH 256
+#endif
 
 //------------------------------------------------------------------------
 // 5.3. Memory Usage - EEPROM
@@ -346,6 +478,11 @@ extern const uint8_t opendcc_version PROGMEM;
 #define   eadr_ext_stop_deadtime        0x025  //    / CV37: external stop deadtime after status RUN 
 #define   eadr_reserved038              0x026  
 #define   eadr_serial_id                0x027  //    / CV39: serial number, must be > 1
+#define   eadr_refresh_speed_run        0x028  //    / CV40: refresh weight speed packet, loco moving
+#define   eadr_refresh_speed_stop       0x029  //    / CV41: refresh weight speed packet, loco stopped
+#define   eadr_refresh_func             0x02a  //    / CV42: refresh weight function packets FL, F1..F12
+#define   eadr_refresh_func_high        0x02b  //    / CV43: refresh weight function packets F13..F28
+#define   eadr_refresh_recent           0x02c  //    / CV44: weights are doubled for locos commanded less than this age
 
  // note SO33 (should return as 0 - reserved by IB)
 // XSOGet 0006)  -> is CTS a indicator for Power Off
@@ -373,7 +510,8 @@ extern uint8_t eemem[] __attribute__((section("EECV")));    // EEMEM
 // 5.4 Security Checks against wrong definitions
 //------------------------------------------------------------------------
 // TODO SDS2021 : SRAM_SIZE, EEPROM_SIZE etc staan in hardware.h, maar die afhankelijkheid wil ik niet hier
-// voorlopig komen dus gewoon warnings
+// -> the size checks are only done where hardware.h is included before config.h
+//    (OpenDccCommandStation.ino, tools/ram_report.cpp), the other files skip them
 
 #if (SIZE_LOCOBUFFER > 254)
 # warning: Locobuffer too large
@@ -381,22 +519,59 @@ extern uint8_t eemem[] __attribute__((section("EECV")));    // EEMEM
 # Warning: and need-s one extra for search
 #endif
 
+// RAM budget, in bytes on the AVR
+// USED_RAM: the buffers, RAM_MODULES: the other globals of the firmware, RAM_CORE: arduino core and
+// libraries, RAM_STACK: reserve for the stack (main loop + nested ISRs)
+// a listing is printed by tools/ram_report.cpp (pio run -e native_ramreport)
 // SDS 2021 dit is niet meer juist, want hier stond ook TURNOUTBUFFER bij
-#define USED_RAM (SIZE_QUEUE_PROG * 7 +   \
-                  SIZE_QUEUE_LP * 7 +   \
-                  SIZE_QUEUE_HP * 7 +   \
-                  SIZE_REPEATBUFFER  * 7  + \
-                  SIZE_LOCOBUFFER  * SIZE_LOCOBUFFER_ENTRY + \
-                  SIZE_S88_MAX * 2)
-
-#if USED_RAM > (SRAM_SIZE - 400)
+#define RAM_QUEUES          ((SIZE_QUEUE_PROG + SIZE_QUEUE_LP + SIZE_QUEUE_HP) * 5)
+#define RAM_PKT_POOL        (SIZE_PKT_POOL_SMALL * 3 + SIZE_PKT_POOL_LARGE * MAX_DCC_SIZE + 3)
+#define RAM_DCC_RING        (SIZE_DCC_RING * 9 + (SIZE_DCC_RING + 3) * DCCOUT_BITSTREAM * 12)
+#define RAM_REPEATBUFFER    (SIZE_REPEATBUFFER * 7 + SIZE_REPEATBUFFER_HASH + NUM_REPEAT_BUCKETS)
+#define RAM_LOCOBUFFER      (SIZE_LOCOBUFFER * SIZE_LOCOBUFFER_ENTRY + (SIZE_LOCOBUFFER + 1) / 2 + \
+                             SIZE_LOCOBUFFER_HASH + DCC_F13_F28 * SIZE_LOCOBUFFER_FHIGH * 5)
+#define RAM_PACKET_CACHE    (SIZE_LOCOBUFFER * LOCOBUFFER_PACKET_CACHE * (21 + DCC_F13_F28 * 10))
+#define RAM_DIAG            (ISR_PROFILING * 114 +   \
+                             PACKET_TRACE * 222 +   \
+                             CMD_LATENCY * ((SIZE_QUEUE_HP + SIZE_QUEUE_LP + SIZE_DCC_RING + 2) * 3 + 153))
+#define RAM_XP_SLOTS        (XPRESSNET_ENABLED * XP_ADAPTIVE_SLOTS * (68 + XP_SLOT_STATS * 102))
+#define RAM_DB_CACHE        (LOCODB_NUM_ENTRIES * 2 + LOCODB_HASH_SIZE + (LOCODB_NUM_ENTRIES + 7) / 8 + \
+                             LOK_NAME_LENGTH + 11)
+#define RAM_DB_XFER         6
+#define RAM_RAILCOM         (RAILCOM_DETECTOR * 154)
+#define RAM_MM              (MAERKLIN_ENABLED * 15)
+#define RAM_PROGOUT         (PROG_TRACK_CONCURRENT * 23)
+
+#define USED_RAM (RAM_QUEUES + RAM_PKT_POOL + RAM_DCC_RING + RAM_REPEATBUFFER + RAM_LOCOBUFFER + RAM_PACKET_CACHE + \
+                  RAM_DIAG + RAM_XP_SLOTS + RAM_DB_CACHE + RAM_DB_XFER + RAM_RAILCOM + \
+                  RAM_MM + RAM_PROGOUT)
+
+// the globals outside the buffers, counted at AVR sizes (int and pointer 2 bytes) from the
+// declarations, the strings of ui.cpp are in flash (F(), PROGMEM); recount after adding globals
+// xpnet 103, programmer 97, organizer 103 (without the buffers), ui 68 (lcd, menu, tx buffers),
+// rs485 50, accessories 45, keys 37, status 34, dccout 33, config 2 -> 572, rounded up
+#define RAM_MODULES         580
+// millis/micros 9, vtables ~30, Wire + twi (ui lcd, i2c eeprom) 201; HardwareSerial is not
+// linked with XPRESSNET_ENABLED (rs485 owns the USART)
+#define RAM_CORE            240
+#define RAM_STACK           256
+
+#if defined(SRAM_SIZE) && (USED_RAM + RAM_MODULES + RAM_CORE + RAM_STACK > SRAM_SIZE)
 #warning Buffers too large for current processor (see hardware.h)
 #endif
 
+#if (LOCODB_EXT_EEPROM == 1)
+#define USED_EEPROM  ( LOCODB_EEPROM_OFFSET )   // SDS : CV variables only
+
+#if (LOCODB_NUM_ENTRIES * 12) > (LOCODB_EXT_SIZE)
+#warning Loco database too large for the external EEPROM
+#endif
+#else
 #define USED_EEPROM  ( LOCODB_EEPROM_OFFSET + \
                       LOCODB_NUM_ENTRIES * 12 ) // SDS : database starts at offset after the CV variables  
+#endif
 
-#if USED_EEPROM > (EEPROM_SIZE)
+#if defined(EEPROM_SIZE) && (USED_EEPROM > (EEPROM_SIZE))
 #warning EEPROM usage too large for processor
 #endif
 
@@ -408,4 +583,10 @@ typedef union {
     uint8_t  as_uint8[2];
 } t_data16;
 
+// BUSY_WAIT: body of the busy wait loops (waiting for an ISR to finish something).
+// Empty on the AVR; the native build (lib/native_hal) lets simulated time pass here.
+#ifndef BUSY_WAIT
+  #define BUSY_WAIT()
+#endif
+
 #endif   // config.h
@@ -0,0 +1,87 @@
+//----------------------------------------------------------------
+//
+// OpenDCC
+//
+// This source file is subject of the GNU general public license 2,
+// that is available at the world-wide-web at
+// http://www.gnu.org/licenses/gpl.txt
+//
+//-----------------------------------------------------------------
+//
+// file:      config_eemem.h
+// history:   2026-10-16 V0.1 taken out of config.cpp
+//
+//-----------------------------------------------------------------
+//
+// purpose:   lowcost central station for dcc
+// content:   default values of the CVs (eeprom), as initializer;
+//            included twice by config.cpp: ee_mem (the eeprom image) and
+//            ee_defaults (flash, for an erased eeprom, see config_LoadDefaults).
+//            No include guard on purpose.
+//
+//-----------------------------------------------------------------
+
+{
+    [eadr_OpenDCC_Version]          = OPENDCC_VERSION,
+    [eadr_baudrate]                 = 1,                    // SDS DEFAULT_BAUD 19200, not used for xpnet version
+    [eadr_OpenDCC_Mode]             =                       
+                                      #if (XPRESSNET_ENABLED ==1)
+                                      (1 << 0) |            // Bit 0; 1 = Xpressnet Version
+                                      #else
+                                      (0 << 0) |            // Bit 0; 0 = Standard Version
+                                      #endif  
+                                      (0 << 1) |            // Bit 1; reserved
+                                      (0 << 2) |            // Bit 2; reserved
+                                      (0 << 3) |            // Bit 3; reserved
+                                      #if (DCC_FAST_CLOCK==1)
+                                      (1 << 4) |            // Bit 4; 1 = FAST CLOCK supported
+                                      #else
+                                      (0 << 4) |            // Bit 4; 0 = no FAST CLOCK
+                                      #endif
+                                      (1 << 5) |            // Bit 5; 1 = Named Lokdaten
+                                      (0 << 6) |            // Bit 6; reserved
+                                      (0 << 7),             // Bit 7; reserved
+    
+    [eadr_virtual_decoder_l]        = 0,                    // SDS : not longer used
+    [eadr_virtual_decoder_h]        = 0,                    // SDS : not longer used
+    [eadr_VersionMirror]            = OPENDCC_VERSION,      // mirror CV0
+    [eadr_CTS_usage]                = 0,                    // SDS : not longer used
+    [eadr_s88_mode]                 = 0,                    // SDS : not longer used
+    [eadr_s88_autoread]             = 0,                    // SDS : not longer used
+    [eadr_s88_size1]                = 0,                    // SDS : not longer used
+    [eadr_s88_size2]                = 0,                    // CV10 SDS : not longer used
+    [eadr_s88_size3]                = 0,                    // SDS : not longer used
+    [eadr_invert_accessory]         = 0,                    // SDS : not longer used
+    [eadr_dcc_acc_repeat]           = NUM_DCC_ACC_REPEAT,   // Accessory Command repeat counter
+    [eadr_dcc_acc_time]             = 0,                    // SDS : not longer used
+    [eadr_startmode_ibox]           = 0,                    // SDS : not longer used
+    [eadr_feedback_s88_offset]      = 0,                    // SDS : not longer used
+    [eadr_feedback_s88_type]        = 0,                    // SDS : not longer used
+    [eadr_extend_prog_resets]       = 3,                    // add this number the number of resets command during programming
+    [eadr_extend_prog_command]      = 3,                    // add this number the number of prog command to releave timing
+    [eadr_dcc_pom_repeat]           = NUM_DCC_POM_REPEAT,   // CV20:
+    [eadr_dcc_speed_repeat]         = NUM_DCC_SPEED_REPEAT, // CV21
+    [eadr_dcc_func_repeat]          = NUM_DCC_FUNC_REPEAT,
+    [eadr_reserved023]              = 0,
+    [eadr_dcc_default_format]       = DCC_DEFAULT_FORMAT,
+    [eadr_railcom_enabled]          = RAILCOM_ENABLED,      // CV25 - railcom, generate railcom cutout in dccout
+    [eadr_fast_clock_ratio]         = 8,                    // CV26 - fast clock
+    [eadr_reserved027]              = 0,
+    [eadr_reserved028]              = 0,
+    [eadr_xpressnet_feedback]       = 0,                    // SDS : not longer used
+    [eadr_s88_clk_timing]           = 0,                    // SDS : not longer used
+    [eadr_feedback_s88_size]        = 0,                    // SDS : not longer used
+    [eadr_s88_total_from_pc]        = 0,                    // SDS : not longer used
+    [eadr_I2C_present]              = 0,                    // SDS : not longer used
+    [eadr_short_turnoff_time]       = MAIN_SHORT_DEAD_TIME, // 34: Time until shutdown
+    [eadr_prog_short_toff_time]     = PROG_SHORT_DEAD_TIME,          
+    [eadr_ext_stop_enabled]         = 1,                    // 36: 0=default, 1=enable external Stop Input
+    [eadr_ext_stop_deadtime]        = EXT_STOP_DEAD_TIME,   // 37: dead time after RUN, in millis(), SDS        
+    [eadr_reserved038]              = 0,          
+    [eadr_serial_id]                = 0,                    // SDS : not longer used
+    [eadr_refresh_speed_run]        = REFRESH_WEIGHT_SPEED_RUN,   // CV40: refresh weights
+    [eadr_refresh_speed_stop]       = REFRESH_WEIGHT_SPEED_STOP,  // CV41
+    [eadr_refresh_func]             = REFRESH_WEIGHT_FUNC,        // CV42
+    [eadr_refresh_func_high]        = REFRESH_WEIGHT_FUNC_HIGH,   // CV43
+    [eadr_refresh_recent]           = REFRESH_RECENT_AGE,         // CV44
+}
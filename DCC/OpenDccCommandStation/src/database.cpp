@@ -33,6 +33,8 @@
 //        - upper 2 bits contain the loco format;
 //        - lower 14 bits contain the loco address.
 //        - if entry == 0x0000, the entry is void.
+//        - MAERKLIN_ENABLED: format 01 (DCC27, not supported) is Motorola:
+//          address in the lower 8 bits, bit 13: 0 = MM1, 1 = MM2
 // the name is stored as a 10-char string
 // Up to LOCODB_NUM_ENTRIES locos in the database
 
@@ -42,21 +44,18 @@
  *   en er zijn funcs die zoeken op loc address (database_GetLocoFormat / database_GetLocoName)
  *  ---> maak 1 func get_loco_data ?
  * - er is ook een vieze vlag database_XpnetMessageFlag die wordt gereset vanuit xpnet, en een global database_XpnetMessage eventueel via intf func
+ *   --> vervangen door database_XpnetFrame (streaming, twee frame buffers, profielen per client type)
  * - test ui met database entry zonder naam (bv nieuwe loc met adres 5 -> wordt in db opgeslagen met een zero string name)
 */
 
 #include "Arduino.h"
 #include "config.h"                // general structures and definitions
 #include "database.h"
-
-enum db_run_states { // actual state
-  IDLE,
-  DB_XMIT,
-  DB_XMIT1,
-  DB_XMIT2,
-  DB_XMIT3,
-  DB_XMIT4
-} db_run_state;
+#include "status.h"                // opendcc_state
+#include "xpnet.h"                 // CALL_ID, MESSAGE_ID
+#if (LOCODB_EXT_EEPROM == 1)
+  #include <Wire.h>
+#endif
 
 t_format dcc_default_format;            // dcc default: 0=DCC14, 2=DCC28, 3=DCC128
                                         // this value is read from eeprom
@@ -64,12 +63,40 @@ static unsigned char next_search_index;        // was asked continously - this i
 static unsigned char cur_database_entry;
 static unsigned char total_database_entry;
 
-// SDS2021 TODO : deze worden ook extern gebruikt in xpnet.cpp; kan beter?
-unsigned char database_XpnetMessage[17]; 
-unsigned char database_XpnetMessageFlag;
+//------------------------------------------------------------------------
+// xpnet transfer of the data base
+//------------------------------------------------------------------------
+// Every entry goes out as 0xE? 0xF1 AH AL entry total name, repeated as the profile
+// says: frame n is sent as CALL if bit n of 'pattern' is set, else as MESSAGE, with
+// at least 'gap' ms from one frame to the next. There is no frame buffer here: when a
+// frame is due, database_XpnetFrame builds it into the free tx buffer of xpnet.cpp
+// (the name comes from the eeprom or the write-behind cache), every repeat again.
+// A transfer to one slot sends the MESSAGE frames of the profile only (multimaus: M M):
+// a CALL frame without inquiry (the Roco hack, see xmit_locoentry) is for listeners
+// only, so it is left out. Frame 0 of every profile is a MESSAGE.
+typedef struct {
+  uint8_t pattern;                      // bit n set: frame n as CALL
+  uint8_t frames;                       // per entry (1..8)
+  uint8_t gap;                          // ms between two frames
+} t_db_profile;
+
+static const t_db_profile db_profiles[DB_NUM_PROFILES] PROGMEM = {
+  { 0x0A, 4, 50 },                      // DB_PROFILE_MULTIMAUS: M C M C, 50 ms (the OpenDCC timing)
+  { 0x02, 2, 10 },                      // DB_PROFILE_FAST:      M C, 10 ms
+  { 0x00, 1, 0  },                      // DB_PROFILE_SINGLE:    M, as fast as the bus allows
+};
 
-uint32_t db_lastMillis;                 // controls min delay between xpnet messages for database transmission
-#define DB_UPDATE_PERIOD  50L           // ms, like millis()
+#define DB_FRAME_SIZE     (6 + LOK_NAME_LENGTH)   // header F1 AH AL entry total name (xor by the isr)
+#define DB_XFER_IDLE      0xFF          // db_xfer_profile: no transfer
+#if (DB_FRAME_SIZE > 17)
+  #error LOK_NAME_LENGTH: a frame of the transfer must fit into the tx buffer of xpnet.cpp (17 bytes)
+#endif
+
+static uint8_t db_xfer_index;           // entry being sent (index in db_entry)
+static uint8_t db_xfer_count;           // frames of it sent
+static uint8_t db_xfer_slot;            // 0: broadcast
+static uint8_t db_xfer_profile = DB_XFER_IDLE;
+static uint16_t db_xfer_time;           // millis() of the last frame
 
 const locoentry_t locdb_defaults[] PROGMEM = {
   //  locAddress format        name
@@ -80,21 +107,331 @@ const locoentry_t locdb_defaults[] PROGMEM = {
 
 // we define locodb as a pointer, and make the compiler do all offset calculations
 // locodb is an eeprom address, so we should never dereference directly!!
+#if (LOCODB_EXT_EEPROM == 1)
+static locoentry_t *locodb = (locoentry_t *) 0;     // the external eeprom holds only the database
+#else
 static locoentry_t *locodb = (locoentry_t *) LOCODB_EEPROM_OFFSET;
+#endif
+
+#if (LOCODB_NUM_ENTRIES > 254)
+  #error LOCODB_NUM_ENTRIES too large (8 bit index, xpnet transfer counts the entries in one byte)
+#endif
+#if ((LOCODB_HASH_SIZE & (LOCODB_HASH_SIZE - 1)) || (LOCODB_HASH_SIZE && (LOCODB_HASH_SIZE <= LOCODB_NUM_ENTRIES)) || (LOCODB_HASH_SIZE > 256))
+  #error LOCODB_HASH_SIZE must be 0, or a power of 2, larger than LOCODB_NUM_ENTRIES and at most 256
+#endif
+
+#define DB_NONE           0xFF
+
+//------------------------------------------------------------------------
+// ram copy of the addresses and formats
+//------------------------------------------------------------------------
+// db_entry[i] is b[1]:b[0] of locodb[i]: format in bits 15..14, address in 13..0,
+// address 0 = empty entry. It is read at database_Init, from then on the eeprom
+// is only read for names: the format lookups of the organizer never touch the eeprom.
+// With LOCODB_HASH_SIZE the address is found in db_hash (open addressing),
+// otherwise db_entry is scanned (fast enough for a few dozen entries).
+static uint16_t db_entry[LOCODB_NUM_ENTRIES];
+
+#if (MAERKLIN_ENABLED == 1)
+#define DB_FORMAT_MM      1             // format code of the Motorola entries
+#define DB_MM2            0x2000
+
+static uint16_t db_addr(uint16_t entry) {
+  if ((entry >> 14) == DB_FORMAT_MM) return (entry & 0xFF);
+  return (entry & 0x3FFF);
+}
+
+static t_format db_format(uint16_t entry) {
+  if ((entry >> 14) == DB_FORMAT_MM) return ((entry & DB_MM2) ? MM2 : MM1);
+  return ((t_format)(entry >> 14));
+}
+
+static uint16_t db_make_entry(uint16_t locAddress, t_format format) {
+  if (format == DCC27) format = DCC28;
+  if (format == MM1) return (((uint16_t)DB_FORMAT_MM << 14) | (locAddress & 0xFF));
+  if (format == MM2) return (((uint16_t)DB_FORMAT_MM << 14) | DB_MM2 | (locAddress & 0xFF));
+  return (((uint16_t)format << 14) | (locAddress & 0x3FFF));
+}
+#else
+#define db_addr(entry)                   ((entry) & 0x3FFF)
+#define db_format(entry)                 ((t_format)((entry) >> 14))
+#define db_make_entry(locAddress, format) (((uint16_t)(format) << 14) | ((locAddress) & 0x3FFF))
+#endif
+
+#if (LOCODB_HASH_SIZE > 0)
+static uint8_t db_hash[LOCODB_HASH_SIZE];
+#define DB_HASH_MASK  (LOCODB_HASH_SIZE - 1)
+#endif
+
+//------------------------------------------------------------------------
+// write-behind cache
+//------------------------------------------------------------------------
+// database_PutLocoFormat/PutLocoName only change db_entry (and db_name) and mark the
+// entry in db_dirty; a second update of the same loco needs no second write.
+// database_Run writes the dirty entries, one byte per call and only if the eeprom is
+// ready, so the main loop never waits 3.3 ms for an eeprom write. Writing starts when
+// the data base was not used for DB_WRITE_DELAY, when an update waits for
+// DB_WRITE_MAXAGE, or at once if the track power is off (RUN_OFF, RUN_SHORT: may be
+// followed by a power down). Bytes that are already right are not written again.
+#define DB_WRITE_DELAY    1000          // ms
+#define DB_WRITE_MAXAGE   10000         // ms
+
+static uint8_t db_dirty[(LOCODB_NUM_ENTRIES + 7) / 8];   // entry must be written
+static uint8_t db_flush_index;          // entry being written, DB_NONE: take the next dirty one
+static uint8_t db_flush_step;           // next byte of it, see db_flush_byte
+static uint8_t db_name_index;           // entry with a new name in db_name[], DB_NONE: none
+static unsigned char db_name[LOK_NAME_LENGTH];
+static uint16_t db_lastAccess;          // millis() of the last call from outside (low 16 bits)
+static uint16_t db_pendSince;           // millis() when the first entry became dirty
+static uint16_t db_writes;              // eeprom bytes written (wear monitoring)
+static uint16_t db_saved;               // writes saved: byte already right
 
 /****************************************************************************************************/
 /*   HELPER FUNCTIONS                                                                               */
 /****************************************************************************************************/
+//-------------------------------------------------------------------- eeprom access
+#if (LOCODB_EXT_EEPROM == 1)
+// external i2c eeprom (24C32 .. 24C512), 16 bit address; shares the bus with the lcd
+static uint8_t db_read_byte(const uint8_t *eeAddress) {
+  uint16_t a = (uint16_t)(uintptr_t)eeAddress;
+
+  do {                                  // no acknowledge during a write cycle: again
+    Wire.beginTransmission(LOCODB_EXT_I2C_ADDR);
+    Wire.write(a >> 8);
+    Wire.write(a & 0xFF);
+  } while (Wire.endTransmission() != 0);
+  Wire.requestFrom(LOCODB_EXT_I2C_ADDR, 1);
+  return (Wire.available() ? Wire.read() : 0);
+} // db_read_byte
+
+static void db_write_byte(uint8_t *eeAddress, uint8_t value) {
+  uint16_t a = (uint16_t)(uintptr_t)eeAddress;
+
+  Wire.beginTransmission(LOCODB_EXT_I2C_ADDR);
+  Wire.write(a >> 8);
+  Wire.write(a & 0xFF);
+  Wire.write(value);
+  Wire.endTransmission();
+} // db_write_byte
+
+// acknowledge polling: the eeprom does not answer during its write cycle (5 ms)
+static bool db_is_ready() {
+  Wire.beginTransmission(LOCODB_EXT_I2C_ADDR);
+  return (Wire.endTransmission() == 0);
+} // db_is_ready
+
+static void db_wait_ready() {
+  while (!db_is_ready());
+} // db_wait_ready
+#else
+#define db_read_byte(eeAddress)         eeprom_read_byte(eeAddress)
+#define db_write_byte(eeAddress, value) eeprom_write_byte(eeAddress, value)
+#define db_is_ready()                   eeprom_is_ready()
+#define db_wait_ready()                 // eeprom_write_byte waits itself
+#endif
+
+// eeprom_update_byte, counting for wear monitoring
+static void db_update_byte(uint8_t *eeAddress, uint8_t value) {
+  if (db_read_byte(eeAddress) == value) {
+    db_saved++;
+    return;
+  }
+  db_wait_ready();
+  db_write_byte(eeAddress, value);
+  db_writes++;
+} // db_update_byte
+
+static uint16_t db_read_entry(uint8_t i) {
+  return (db_read_byte(&locodb[i].b[0]) | ((uint16_t)db_read_byte(&locodb[i].b[1]) << 8));
+}
+
+//-------------------------------------------------------------------- ram index
+#if (LOCODB_HASH_SIZE > 0)
+static inline uint8_t db_hash_home(uint16_t locAddress) {
+  return ((locAddress ^ (locAddress >> 5) ^ (locAddress >> 11)) & DB_HASH_MASK);
+}
+
+static void db_hash_add(uint8_t i) {
+  uint8_t h;
+
+  h = db_hash_home(db_addr(db_entry[i]));
+  while (db_hash[h] != DB_NONE) h = (h + 1) & DB_HASH_MASK;
+  db_hash[h] = i;
+} // db_hash_add
+#endif
+
+// index of the loco, DB_NONE if not stored
+static uint8_t db_find(uint16_t locAddress) {
+  uint8_t i;
+
+  if (locAddress == 0) return(DB_NONE);
+#if (LOCODB_HASH_SIZE > 0)
+  uint8_t h;
+  h = db_hash_home(locAddress);
+  while ((i = db_hash[h]) != DB_NONE) {
+    if (db_addr(db_entry[i]) == locAddress) return(i);
+    h = (h + 1) & DB_HASH_MASK;
+  }
+#else
+  for (i=0; i<LOCODB_NUM_ENTRIES; i++) {
+    if (db_addr(db_entry[i]) == locAddress) return(i);
+  }
+#endif
+  return(DB_NONE);
+} // db_find
+
+// take an empty entry for the loco, DB_NONE if full
+// (entries are never removed one by one, so the hash needs no deletion)
+static uint8_t db_add(uint16_t entry) {
+  uint8_t i;
+
+  for (i=0; i<LOCODB_NUM_ENTRIES; i++) {
+    if (db_addr(db_entry[i]) == 0) {
+      db_entry[i] = entry;
+#if (LOCODB_HASH_SIZE > 0)
+      db_hash_add(i);
+#endif
+      return(i);
+    }
+  }
+  return(DB_NONE);
+} // db_add
+
+// read the addresses and formats from the eeprom, drop pending updates
+static void db_load() {
+  uint8_t i;
+
+#if (LOCODB_HASH_SIZE > 0)
+  memset(db_hash, DB_NONE, sizeof(db_hash));
+#endif
+  for (i=0; i<LOCODB_NUM_ENTRIES; i++) {
+    db_entry[i] = db_read_entry(i);
+    if (db_entry[i] == 0xFFFF) db_entry[i] = 0;     // erased eeprom: empty
+#if (LOCODB_HASH_SIZE > 0)
+    if (db_addr(db_entry[i])) db_hash_add(i);
+#endif
+  }
+  memset(db_dirty, 0, sizeof(db_dirty));
+  db_flush_index = DB_NONE;
+  db_name_index = DB_NONE;
+} // db_load
+
+//-------------------------------------------------------------------- write-behind
+static bool db_is_dirty(uint8_t i) {
+  return ((db_dirty[i >> 3] & (1 << (i & 7))) != 0);
+}
+
+// something to write?
+static bool db_pending() {
+  uint8_t n;
+
+  if (db_flush_index != DB_NONE) return(1);
+  for (n=0; n<sizeof(db_dirty); n++) {
+    if (db_dirty[n]) return(1);
+  }
+  return(0);
+} // db_pending
+
+static void db_set_dirty(uint8_t i) {
+  if (!db_pending()) db_pendSince = millis();
+  db_dirty[i >> 3] |= 1 << (i & 7);
+} // db_set_dirty
+
+// the eeprom entry still belongs to another loco (or to none): its old name is void
+static bool db_is_new(uint8_t i) {
+  return (db_addr(db_read_entry(i)) != db_addr(db_entry[i]));
+}
+
+// byte 'step' of entry i and its new value: first the name (a new name up to the trailing 0
+// and the last char, or name[0] = 0 for a new entry), then the address: a loco appears with
+// its complete name. Returns DB_STEP_SKIP if this step has nothing to write.
+// (no NULL for that: with the external eeprom, locodb[0].b[0] is at address 0)
+#define DB_STEP_WRITE     0
+#define DB_STEP_SKIP      1
+#define DB_STEP_END       2
+
+static uint8_t db_flush_byte(uint8_t i, uint8_t step, uint8_t **eeAddress, uint8_t *value) {
+  *value = 0;
+  if (step < LOK_NAME_LENGTH) {
+    if (i == db_name_index) {
+      if ((step > 0) && (step < LOK_NAME_LENGTH-1) && (db_name[step-1] == 0)) return(DB_STEP_SKIP);
+      *value = db_name[step];
+    }
+    else if ((step > 0) || !db_is_new(i)) return(DB_STEP_SKIP);
+    *eeAddress = (uint8_t*)&locodb[i].name[step];
+  }
+  else if (step == LOK_NAME_LENGTH) {
+    *value = db_entry[i] >> 8;
+    *eeAddress = (uint8_t*)&locodb[i].b[1];
+  }
+  else if (step == LOK_NAME_LENGTH+1) {
+    *value = (uint8_t) db_entry[i];
+    *eeAddress = (uint8_t*)&locodb[i].b[0];
+  }
+  else return(DB_STEP_END);
+  return(DB_STEP_WRITE);
+} // db_flush_byte
+
+// write the next byte of a dirty entry to the eeprom (at most one write);
+// returns 0 if there is nothing to write
+static bool db_flush() {
+  uint8_t *eeAddress;
+  uint8_t value, i, r;
+
+  if (db_flush_index == DB_NONE) {
+    for (i=0; i<LOCODB_NUM_ENTRIES; i++) {
+      if (db_is_dirty(i)) break;
+    }
+    if (i == LOCODB_NUM_ENTRIES) return(0);
+    db_dirty[i >> 3] &= ~(1 << (i & 7));  // a change from now on marks it again
+    db_flush_index = i;
+    db_flush_step = 0;
+  }
+  while ((r = db_flush_byte(db_flush_index, db_flush_step, &eeAddress, &value)) != DB_STEP_END) {
+    db_flush_step++;
+    if (r == DB_STEP_WRITE) {
+      if (db_read_byte(eeAddress) != value) {
+        db_wait_ready();
+        db_write_byte(eeAddress, value);
+        db_writes++;
+        return(1);
+      }
+      db_saved++;
+    }
+  }
+  // entry complete
+  i = db_flush_index;
+  if ((i == db_name_index) && !db_is_dirty(i)) db_name_index = DB_NONE;
+  db_flush_index = DB_NONE;
+  db_pendSince = millis();
+  return(1);
+} // db_flush
+
+// name of entry i, also if it is not yet in the eeprom
+static void db_get_name(uint8_t i, uint8_t *name) {
+  uint8_t j;
+
+  if (i == db_name_index) {             // not yet in eeprom
+    memcpy(name, db_name, LOK_NAME_LENGTH);
+    return;
+  }
+  if (db_is_new(i)) {                   // not yet in eeprom, no name
+    name[0] = 0;
+    return;
+  }
+  for (j=0;j<LOK_NAME_LENGTH;j++){
+    name[j] = db_read_byte((uint8_t*)&locodb[i].name[j]);
+    if (name[j]== 0x0) break;
+  }
+} // db_get_name
+
 // SDS : telde enkel entries met non-null 'name'
 static void calc_database_size() {
-  unsigned char i, j0, j1;
+  unsigned char i;
 
   total_database_entry = 0;
   for (i=0; i<LOCODB_NUM_ENTRIES; i++) {
-    j0 = eeprom_read_byte(&locodb[i].b[0]);
-    j1 = eeprom_read_byte(&locodb[i].b[1]) & 0x3F;
-    j0 = j0 | j1;
-    if (j0) total_database_entry++;
+    if (db_addr(db_entry[i])) total_database_entry++;
   }
 } // calc_database_size
 
@@ -102,17 +439,14 @@ static void calc_database_size() {
 // This routine is used in parallel for dump and Xmit, but is not reentrant!
 // SDS : updates 'next_search_index'
 static unsigned char get_loco_data(locoentry_t* actual) {
-  unsigned char i,j;
+  unsigned char i;
 
   for (i=next_search_index; i<LOCODB_NUM_ENTRIES; i++) {
-    actual->b[0] = eeprom_read_byte((uint8_t*)&locodb[i].b[0]);
-    actual->b[1] = eeprom_read_byte((uint8_t*)&locodb[i].b[1]);
-    if (actual->w.addr != 0x00) {
+    actual->b[0] = (uint8_t) db_entry[i];
+    actual->b[1] = db_entry[i] >> 8;
+    if (db_addr(db_entry[i]) != 0x00) {
       next_search_index = i+1;
-      for (j=0;j<LOK_NAME_LENGTH;j++){
-        actual->name[j] = eeprom_read_byte((uint8_t*)&locodb[i].name[j]);
-        if (actual->name[j]== 0x0) break;
-      }
+      db_get_name(i, actual->name);
       return(1);            
     }
   }
@@ -120,27 +454,37 @@ static unsigned char get_loco_data(locoentry_t* actual) {
   return(0);
 } // get_loco_data
 
+// builds the frame of entry db_xfer_index in msg (DB_FRAME_SIZE bytes)
 // Note (Kufer): this message must be transmitted as CALL - like if it is transmitted from another client after a call!
-static void xmit_locoentry() {
-  locoentry_t report;
+static void xmit_locoentry(unsigned char *msg) {
+  uint8_t name[LOK_NAME_LENGTH];
   unsigned char i;
 
-  if (get_loco_data(&report)) {
-    // database_XpnetMessage[0] = 0xE0;                // see below
-    database_XpnetMessage[1] = 0xF1;
-    database_XpnetMessage[2] = report.b[1] & 0x3F;     // addr high
-    database_XpnetMessage[3] = report.b[0];            // addr low
-    database_XpnetMessage[4] = cur_database_entry;
-    database_XpnetMessage[5] = total_database_entry;
-    for (i=0;i<LOK_NAME_LENGTH;i++) {
-      database_XpnetMessage[6+i] = report.name[i];
-      if (report.name[i] == 0x0) break;
-    }
-    database_XpnetMessage[0] = 0xE0 + 5 + i;
-    database_XpnetMessageFlag = 1;        // tell xpressnet that we have a message
+  // msg[0] = 0xE0;                              // see below
+  msg[1] = 0xF1;
+  msg[2] = db_addr(db_entry[db_xfer_index]) >> 8;   // addr high
+  msg[3] = (uint8_t) db_entry[db_xfer_index];      // addr low
+  msg[4] = cur_database_entry;
+  msg[5] = total_database_entry;
+  db_get_name(db_xfer_index, name);
+  for (i=0;i<LOK_NAME_LENGTH;i++) {
+    msg[6+i] = name[i];
+    if (name[i] == 0x0) break;
   }
+  msg[0] = 0xE0 + 5 + i;
 } // xmit_locoentry
 
+// db_xfer_index to the next entry with an address, from i on; false: none left
+static bool xmit_next_entry(uint8_t i) {
+  for (; i<LOCODB_NUM_ENTRIES; i++) {
+    if (db_addr(db_entry[i]) != 0x00) {
+      db_xfer_index = i;
+      return(true);
+    }
+  }
+  return(false);
+} // xmit_next_entry
+
 static void database_Rewind() {
     next_search_index = 0;
 } // database_Rewind
@@ -151,150 +495,95 @@ static void database_Rewind() {
 /// database_GetLocoFormat returns the stored loco format, if loco was never
 //  used with a format different from default it is not stored.
 t_format database_GetLocoFormat(uint16_t locAddress) {
-  unsigned char stored_h, stored_l;
-	unsigned char i;
-	unsigned char addr_low, addr_high;
-
-	addr_low = (unsigned char) locAddress;
-	addr_high = (unsigned char) (locAddress>>8);
+  uint8_t i;
 
-  for (i=0; i<LOCODB_NUM_ENTRIES; i++) {
-    stored_l = eeprom_read_byte((uint8_t*)&locodb[i].b[0]);
-    if (stored_l == addr_low) {
-      stored_h = eeprom_read_byte((uint8_t*)&locodb[i].b[1]);
-      if ((stored_h & 0x3f) == addr_high) {
-          return ((t_format)(stored_h & 0xC0) >> 6);
-      }
-    }
-  }
+  db_lastAccess = millis();
+  i = db_find(locAddress);
+  if (i != DB_NONE) return (db_format(db_entry[i]));
   return(dcc_default_format); // not found - default format
 } // database_GetLocoFormat
 
 // sds temp??
 // caller provides memory for the name string
 uint8_t database_GetLocoName(uint16_t locAddress, uint8_t *name) {
-  unsigned char stored_h, stored_l;
-	unsigned char i,j;
-	unsigned char addr_low, addr_high;
+	unsigned char i;
 
 	if (locAddress==0) return 0;
 
-  addr_low = (unsigned char) locAddress;
-	addr_high = (unsigned char) (locAddress>>8);
-
-  for (i=0; i<LOCODB_NUM_ENTRIES; i++) {
-    stored_l = eeprom_read_byte((uint8_t*)&locodb[i].b[0]);
-    if (stored_l == addr_low) {
-      stored_h = eeprom_read_byte((uint8_t*)&locodb[i].b[1]);
-      if ((stored_h & 0x3f) == addr_high) {
-        for (j=0;j<LOK_NAME_LENGTH;j++){
-          name[j] = eeprom_read_byte((uint8_t*)&locodb[i].name[j]);
-          if (name[j]== 0x0) return(1);
-        }
-      }
-    }
-  }
-  // not found
-  return(0);
+  db_lastAccess = millis();
+  i = db_find(locAddress);
+  if (i == DB_NONE) return(0);          // not found
+  db_get_name(i, name);
+  return(1);
 }
 
 // SDS : aangepast : geen onderscheid meer tussen default format of niet, elke loc wordt opgeslagen
-// TODO SDS2021 : naar word size voor eeprom read gaan? code wordt dan eenvoudiger, maar trager
+// the eeprom is written later by database_Run (write-behind)
 unsigned char database_PutLocoFormat(uint16_t locAddress, t_format format) {
-  unsigned char i;
-  unsigned char stored_h, stored_l;
-  unsigned char my_h;
-  unsigned char addr_low, addr_high;
-
-  addr_low = (unsigned char) locAddress;
-  addr_high = (unsigned char) (locAddress>>8);
-  my_h = (format << 6) | addr_high;
-  
-  // search loco, if found: replace it
-  for (i=0; i<LOCODB_NUM_ENTRIES; i++) {
-    stored_l = eeprom_read_byte((uint8_t*)&locodb[i].b[0]);
-    if (stored_l == addr_low) {
-      stored_h = eeprom_read_byte((uint8_t*)&locodb[i].b[1]);
-      if ((stored_h & 0x3f) == addr_high) { // entry with same locAddress found
-        eeprom_update_byte((uint8_t*)&locodb[i].b[1], my_h);   // replace format
-        return(1);
-      }
-    }
+  uint16_t entry;
+  uint8_t i;
+
+  db_lastAccess = millis();
+  entry = db_make_entry(locAddress, format);
+
+  // search loco, if found: replace format
+  i = db_find(locAddress);
+  if (i != DB_NONE) {
+    if (db_entry[i] == entry) return(1);   // same format
+    db_entry[i] = entry;
   }
-  // if not found: search empty and store it
-  for (i=0; i<LOCODB_NUM_ENTRIES; i++) {
-    stored_h = eeprom_read_byte((uint8_t*)&locodb[i].b[1]);
-    if (stored_h == 0x00) {
-      stored_l = eeprom_read_byte((uint8_t*)&locodb[i].b[0]);
-      if (stored_l == 0x00) { // empty found
-        eeprom_write_byte((uint8_t*)&locodb[i].b[1], my_h);
-        eeprom_write_byte((uint8_t*)&locodb[i].b[0], addr_low);
-        eeprom_write_byte((uint8_t*)&locodb[i].name[0], 0);      // blank name for now
-        return(1);
-      }
-    }
+  else {
+    // if not found: search empty and store it
+    i = db_add(entry);
+    // others: error, database full!!!
+    // too many locos with extra format
+    if (i == DB_NONE) return(0);
   }
-  // others: error, database full!!!
-  // too many locos with extra format
-  return(0);
+  db_set_dirty(i);
+  return(1);
 } // database_PutLocoFormat
 
 unsigned char database_PutLocoName(uint16_t locAddress, uint8_t *locName) {
-  unsigned char i;
-  unsigned char stored_h, stored_l;
-  unsigned char addr_low, addr_high;
-
-  addr_low = (unsigned char) locAddress;
-  addr_high = (unsigned char) (locAddress>>8);
-
-  // search loco, if found: replace name
-  for (i=0; i<LOCODB_NUM_ENTRIES; i++) {
-    stored_l = eeprom_read_byte((uint8_t*)&locodb[i].b[0]);
-    if (stored_l == addr_low) {
-      stored_h = eeprom_read_byte((uint8_t*)&locodb[i].b[1]);
-      if ((stored_h & 0x3f) == addr_high) {
-        for (uint8_t c=0; c<LOK_NAME_LENGTH; c++) {
-          eeprom_update_byte((uint8_t*)&locodb[i].name[c], locName[c]);
-          if (locName[c] == 0x00)
-            break;
-        }
-        eeprom_update_byte((uint8_t*)&locodb[i].name[LOK_NAME_LENGTH-1], 0x0); // make sure there is always a trailing \0
-        return(1);
-      }
-    }
+  uint8_t i, c;
+
+  db_lastAccess = millis();
+  // search loco, if not found: search empty and store name & default dcc format
+  i = db_find(locAddress);
+  if (i == DB_NONE) {
+    i = db_add(db_make_entry(locAddress, dcc_default_format));
+    if (i == DB_NONE) return(0);       // too many locos with extra format -> error
+  }
+  while ((db_name_index != DB_NONE) && (db_name_index != i)) {
+    db_flush();                         // db_name[] still holds the name of another loco
   }
 
-  // if not found: search empty and store name & default dcc format
-  for (i=0; i<LOCODB_NUM_ENTRIES; i++) {
-    stored_h = eeprom_read_byte((uint8_t*)&locodb[i].b[1]);
-    if (stored_h == 0x00) {
-      stored_l = eeprom_read_byte((uint8_t*)&locodb[i].b[0]);
-      if (stored_l == 0x00) { // empty found
-        addr_high = addr_high | (dcc_default_format << 6);
-        eeprom_write_byte((uint8_t*)&locodb[i].b[1], addr_high);
-        eeprom_write_byte((uint8_t*)&locodb[i].b[0], addr_low);
-        for (uint8_t c=0; c<LOK_NAME_LENGTH; c++) {
-          eeprom_update_byte((uint8_t*)&locodb[i].name[c], locName[c]);
-          if (locName[c] == 0x00)
-            break;
-        }
-        eeprom_update_byte((uint8_t*)&locodb[i].name[LOK_NAME_LENGTH-1], 0x0); // make sure there is always a trailing \0
-        return(1);
-      }
-    }
+  for (c=0; c<LOK_NAME_LENGTH; c++) {
+    db_name[c] = locName[c];
+    if (locName[c] == 0x00) break;
   }
-  // too many locos with extra format -> error
-  return(0);
+  for (; c<LOK_NAME_LENGTH; c++) db_name[c] = 0x0;
+  db_name[LOK_NAME_LENGTH-1] = 0x0;     // make sure there is always a trailing \0
+  db_name_index = i;
+  if (db_flush_index == i) db_flush_step = 0;    // being written: start again
+  db_set_dirty(i);
+  return(1);
 } // database_PutLocoName
 
+// eeprom bytes written by the database since power up, and writes saved by the cache
+void database_GetWearStat(uint16_t *writes, uint16_t *saved) {
+  *writes = db_writes;
+  *saved = db_saved;
+} // database_GetWearStat
+
 // SDS : clear only the address/format field, that invalidates the entry
 void database_Clear() {
   unsigned char i;
 
   for (i=0; i<LOCODB_NUM_ENTRIES; i++) {
-    eeprom_update_byte((uint8_t*)&locodb[i].b[0], 0);
-    eeprom_update_byte((uint8_t*)&locodb[i].b[1], 0);
+    db_update_byte((uint8_t*)&locodb[i].b[0], 0);
+    db_update_byte((uint8_t*)&locodb[i].b[1], 0);
   }
+  db_load();                            // pending updates are void too
 } // database_Clear
 
 // SDS : reset defaults
@@ -304,8 +593,9 @@ void database_ResetDefaults() {
     memcpy_P(&dbEntry,&locdb_defaults[i],sizeof(locoentry_t)); // copy flash->ram first
     // byte per byte copy to eeprom
     for (uint8_t j=0; j < sizeof(locoentry_t);j++)
-      eeprom_update_byte(((uint8_t*)&locodb[i])+j,*(((uint8_t*)&dbEntry) + j));
+      db_update_byte(((uint8_t*)&locodb[i])+j,*(((uint8_t*)&dbEntry) + j));
   }
+  db_load();
 } // database_ResetDefaults
 
 /****************************************************************************************************/
@@ -331,60 +621,67 @@ void database_ResetDefaults() {
 
 void database_Init() {
   dcc_default_format = eeprom_read_byte((uint8_t*)eadr_dcc_default_format);
+#if (LOCODB_EXT_EEPROM == 1)
+  Wire.begin();
+#endif
   //database_ResetDefaults();
+  db_load();
   database_Rewind();
 } // database_Init
 
 void database_Run() {
-  switch (db_run_state) {
-    case IDLE:
-      break;
-
-    case DB_XMIT:
-      if (cur_database_entry >= total_database_entry) {
-        db_run_state = IDLE;
-        return;        // all done
-      }
-      xmit_locoentry();
-      cur_database_entry++;
-      db_lastMillis = millis();
-      db_run_state = DB_XMIT1;
-      break;
-
-    case DB_XMIT1:
-      // wait for flag reset by xpnet after transmission
-      if (database_XpnetMessageFlag || ((millis() - db_lastMillis) < DB_UPDATE_PERIOD)) return;
-      database_XpnetMessageFlag = 2;  // send again as call (is done by xpnet.cpp)
-      db_lastMillis = millis();
-      db_run_state = DB_XMIT2;
-      break;
-
-    case DB_XMIT2:
-      if (database_XpnetMessageFlag || ((millis() - db_lastMillis) < DB_UPDATE_PERIOD)) return;
-      database_XpnetMessageFlag = 1; // send again as message (is done by xpnet.cpp)
-      db_lastMillis = millis();
-      db_run_state = DB_XMIT3;
-      break;
-
-    case DB_XMIT3:
-      if (database_XpnetMessageFlag || ((millis() - db_lastMillis) < DB_UPDATE_PERIOD)) return;
-      database_XpnetMessageFlag = 2;  // send again as call (is done by xpnet.cpp)
-      db_lastMillis = millis();
-      db_run_state = DB_XMIT4;
-      break;
-
-    case DB_XMIT4:
-      if (database_XpnetMessageFlag || ((millis() - db_lastMillis) < DB_UPDATE_PERIOD)) return;
-      db_run_state = DB_XMIT;
-      break;
+  // write-behind: one eeprom byte per call, when the eeprom is idle
+  if (db_pending()) {
+    if (((uint16_t)((uint16_t)millis() - db_lastAccess) >= DB_WRITE_DELAY) ||
+        ((uint16_t)((uint16_t)millis() - db_pendSince) >= DB_WRITE_MAXAGE) ||
+        (opendcc_state == RUN_OFF) || (opendcc_state == RUN_SHORT)) {
+      if (db_is_ready()) db_flush();
+    }
   }
 } // database_Run
 
 // deze functie start de db broadcast transmission over xpnet
 void database_StartTransfer() {
-    if (db_run_state != IDLE) return;       // block reentry
-    db_run_state = DB_XMIT;
-    database_Rewind();
-    calc_database_size();
-    cur_database_entry = 0;                 // restart
+  database_StartTransferTo(0, DB_PROFILE_MULTIMAUS);
 } // database_StartTransfer
+
+// transfer to one slot (1..31) or to all (0), with the timing of a DB_PROFILE_...
+void database_StartTransferTo(uint8_t slot, uint8_t profile) {
+  if (db_xfer_profile != DB_XFER_IDLE) return;   // block reentry
+  if (profile >= DB_NUM_PROFILES) return;
+  calc_database_size();
+  if (!xmit_next_entry(0)) return;      // empty data base
+  cur_database_entry = 0;               // restart
+  db_xfer_slot = slot;
+  db_xfer_count = 0;
+  db_xfer_time = (uint16_t)millis() - 255;      // first frame at once (gap <= 255)
+  db_xfer_profile = profile;
+} // database_StartTransferTo
+
+uint8_t database_TransferBusy() {
+  return (db_xfer_profile != DB_XFER_IDLE);
+} // database_TransferBusy
+
+// builds the next frame of the transfer into msg (DB_FRAME_SIZE bytes, the free tx
+// buffer of xpnet.cpp), if it is due; false: none
+bool database_XpnetFrame(unsigned char *callByte, unsigned char *msg) {
+  uint8_t pattern, frames;
+
+  if (db_xfer_profile == DB_XFER_IDLE) return(false);
+  if ((uint16_t)((uint16_t)millis() - db_xfer_time) < pgm_read_byte(&db_profiles[db_xfer_profile].gap)) return(false);
+
+  pattern = pgm_read_byte(&db_profiles[db_xfer_profile].pattern);
+  frames = pgm_read_byte(&db_profiles[db_xfer_profile].frames);
+  if ((db_xfer_slot == 0) && (pattern & (1 << db_xfer_count))) *callByte = CALL_ID;
+  else *callByte = MESSAGE_ID | db_xfer_slot;
+  db_xfer_time = millis();              // before the name is read: the gaps stay the same
+  xmit_locoentry(msg);
+  do db_xfer_count++;                   // to one slot: skip the CALL frames
+  while ((db_xfer_slot != 0) && (db_xfer_count < frames) && (pattern & (1 << db_xfer_count)));
+  if (db_xfer_count == frames) {        // entry done, the next one
+    db_xfer_count = 0;
+    if ((++cur_database_entry >= total_database_entry) || !xmit_next_entry(db_xfer_index + 1))
+      db_xfer_profile = DB_XFER_IDLE;   // all done
+  }
+  return(true);
+} // database_XpnetFrame
@@ -37,21 +37,28 @@ typedef struct {
   unsigned char name[LOK_NAME_LENGTH];          // multiMaus supports up to 5 chars
 } locoentry_t;
 
-// TODO SDS2021 : steek dit in de public interface ipv global vars
-extern unsigned char database_XpnetMessage[17]; 
-extern unsigned char database_XpnetMessageFlag;            // interface flag to Xpressnet
+// timing of the transfer on Xpressnet, per client type (database.cpp)
+#define DB_PROFILE_MULTIMAUS  0         // every entry 4 times (MESSAGE CALL MESSAGE CALL), 50 ms
+                                        // (to one slot: the MESSAGE frames only)
+#define DB_PROFILE_FAST       1         // 2 times (MESSAGE CALL), 10 ms
+#define DB_PROFILE_SINGLE     2         // once (MESSAGE), back to back
+#define DB_NUM_PROFILES       3
 
 void database_Init();           // at power up
-void database_Run();            // multitask replacement, call in loop
-void database_StartTransfer();        // start transfer on Xpressnet
+void database_Run();            // multitask replacement, call in loop (writes the eeprom, xpnet transfer)
+void database_StartTransfer();        // start transfer on Xpressnet (broadcast, DB_PROFILE_MULTIMAUS)
+void database_StartTransferTo(uint8_t slot, uint8_t profile);   // slot 0: broadcast
+uint8_t database_TransferBusy();
+bool database_XpnetFrame(unsigned char *callByte, unsigned char *msg);   // next frame into msg, false: none due
 void database_Clear();     // delete all entries
 void database_ResetDefaults();     // factory reset the entries
-t_format database_GetLocoFormat(unsigned int addr);   // if loco not in data base - we return default format
+t_format database_GetLocoFormat(uint16_t addr);   // if loco not in data base - we return default format
 //TODO SDS2021, is het niet beter om een get_loco_data (addr, locoentry_t*) te hebben??
 // we willen de data ook voor local ui makkelijk uit de db halen
-uint8_t database_GetLocoName(unsigned int addr, uint8_t *name); // sds temp??
-unsigned char database_PutLocoFormat(unsigned int addr, t_format format);
-unsigned char database_PutLocoName(unsigned int addr, unsigned char * name);
+uint8_t database_GetLocoName(uint16_t addr, uint8_t *name); // sds temp??
+unsigned char database_PutLocoFormat(uint16_t addr, t_format format);
+unsigned char database_PutLocoName(uint16_t addr, uint8_t *name);
+void database_GetWearStat(uint16_t *writes, uint16_t *saved);   // eeprom bytes written / writes saved since power up
 
 
 
@@ -18,6 +18,10 @@
 //                            register optimiert.
 //            2008-08-29 V0.3 railcom
 //            2009-06-23 V0.4 MAX_DCC_SIZE
+//            2026-10-16 V0.5 dcc_ring: packets prepared ahead by the organizer
+//            2026-10-16 V0.6 DCCOUT_BITSTREAM: pre-encoded packets
+//            2026-10-16 V0.7 CMD_LATENCY: stamp in dcc_slot_s
+//            2026-10-16 V0.8 dccout_EmergencyStop, dccout_RingPending
 //
 //-----------------------------------------------------------------
 //
@@ -40,6 +44,49 @@ volatile extern unsigned char next_message_count;     // load message and set co
                                                // if > 1 -> output next_message
 											   // if = 0 -> ready for next_message
 
+#if (DCCOUT_BITSTREAM == 1)
+// a packet as it goes to the rails: 1 bit per DCC bit, msb first.
+// 1 + preamble, 0, bytes (each with start bit 0), 0, xor, end bit 1, 2 cutout bits (1)
+#define DCC_BITS_MAX   (1 + 17 + (MAX_DCC_SIZE + 1) * 9 + 1 + 2)
+#define DCC_BITS_SIZE  ((DCC_BITS_MAX + 7) / 8)
+
+struct dcc_bits_s
+  {
+    unsigned char nbits;                 // total number of bits
+    unsigned char bits[DCC_BITS_SIZE];
+  };
+
+extern struct dcc_bits_s next_bits;      // next_message, encoded
+
+void dccout_Encode(struct dcc_bits_s *out, struct next_message_s *msg);  // not from ISR
+#endif
+
+// ring of packets prepared ahead (single producer: organizer, single consumer: ISR)
+// next_message has priority; the ring is read when next_message_count is 0.
+struct dcc_slot_s
+  {
+    unsigned char count;                 // repeat, decremented by the ISR
+    struct next_message_s msg;
+#if (DCCOUT_BITSTREAM == 1)
+    struct dcc_bits_s bits;              // msg, encoded by dccout_RingCommit()
+#endif
+#if (CMD_LATENCY == 1)
+    t_cmdlat_stamp stamp;                // arrival -> latency at first transmission
+#endif
+  };
+
+extern struct dcc_slot_s dcc_ring[SIZE_DCC_RING];
+
+bool dccout_RingFull();
+bool dccout_RingEmpty();
+struct dcc_slot_s *dccout_RingSlot();   // slot to fill, only if not full
+struct dcc_slot_s *dccout_RingPending(unsigned char i);   // i-th slot not sent yet, NULL: no more
+                                        // (change it only with interrupts off)
+void dccout_RingCommit();               // hand the filled slot over to the ISR
+uint16_t dccout_GetUnderruns();         // times the ISR found nothing to send
+
+void dccout_EmergencyStop(unsigned char count);   // broadcast stop ahead of all other packets, 0: cancel
+
 void dccout_Init();                      // call once at boot up
 void dccout_EnableCutout();             // create railcom cutout
 void dccout_DisableCutout();
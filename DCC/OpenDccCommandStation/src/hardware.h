@@ -56,6 +56,11 @@
   #define SRAM_SIZE    2048
   #define EEPROM_SIZE  1024
   #define EEPROM_BASE  0x810000L
+#elif defined(NATIVE_HAL)
+  // host build (lib/native_hal): simulated atmega328p
+  #define SRAM_SIZE    2048
+  #define EEPROM_SIZE  1024
+  #define EEPROM_BASE  0x810000L
 #else 
   #warning: severe: no supported processor  
 #endif
@@ -124,8 +129,9 @@
 #define ROTENC_SW       7     // D7,in, drukknop op de rotary enc
 #define DCC             9     // out,sds D9
 #define NDCC            10     // out,sds D10
+#define PROG_DCC        11     // out, D11 (OC2A): dcc of the programming track, only with PROG_TRACK_CONCURRENT
 //D12 vrij --> button 3 & 4 voorzien!!
-//D13 vrij
+//D13 vrij, met PROG_TRACK_CONCURRENT: KEY_3 (zie keys.h)
 
 #define NSHORT_PROG     14     // in,sds A0
 #define NSHORT_MAIN     15     // in,sds A1
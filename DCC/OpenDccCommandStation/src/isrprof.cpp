@@ -0,0 +1,79 @@
+//----------------------------------------------------------------
+//
+// OpenDCC
+//
+// This source file is subject of the GNU general public license 2,
+// that is available at the world-wide-web at
+// http://www.gnu.org/licenses/gpl.txt
+//
+//-----------------------------------------------------------------
+//
+// file:      isrprof.cpp
+// history:   2026-10-16 V0.1 started
+//
+//-----------------------------------------------------------------
+//
+// purpose:   lowcost central station for dcc
+// content:   cycle budget of the interrupt service routines, see isrprof.h
+//            readout: ui diagnostic page, xpnet vendor request 0x22 0xF8 / 0xF9,
+//            host histogram of captured samples: tools/isr_histogram.cpp
+//
+//-----------------------------------------------------------------
+
+#include "Arduino.h"
+#include "config.h"
+#include "isrprof.h"
+
+#if (ISR_PROFILING == 1)
+
+t_isrprof isrprof[ISRPROF_NUM];
+uint16_t isrprof_samples[SIZE_ISRPROF_SAMPLES];
+unsigned char isrprof_capture_id = ISRPROF_DCC;
+volatile unsigned char isrprof_capture_fill;
+
+void isrprof_Reset() {
+  unsigned char i;
+
+  cli();
+  for (i=0; i<ISRPROF_NUM; i++) {
+    isrprof[i].min = 0xFFFF;
+    isrprof[i].max = 0;
+    isrprof[i].sum = 0;
+    isrprof[i].count = 0;
+    isrprof[i].missed = 0;
+  }
+  sei();
+} // isrprof_Reset
+
+void isrprof_Get(unsigned char id, t_isrprof *copy) {
+  if (id >= ISRPROF_NUM) id = 0;
+  cli();
+  memcpy(copy, &isrprof[id], sizeof(t_isrprof));
+  sei();
+} // isrprof_Get
+
+uint16_t isrprof_GetAvg(t_isrprof *p) {
+  if (p->count == 0) return(0);
+  return((uint16_t)(p->sum / p->count));
+} // isrprof_GetAvg
+
+void isrprof_Capture(unsigned char id) {
+  cli();
+  isrprof_capture_id = id;
+  isrprof_capture_fill = 0;    // ISRs fill the samples until full
+  sei();
+} // isrprof_Capture
+
+unsigned char isrprof_GetSamples(uint16_t *samples, unsigned char first, unsigned char num) {
+  unsigned char i;
+
+  for (i=0; i<num; i++) {
+    if ((first + i) >= isrprof_capture_fill) break;   // only the captured ones
+    cli();
+    samples[i] = isrprof_samples[first + i];
+    sei();
+  }
+  return(i);
+} // isrprof_GetSamples
+
+#endif // ISR_PROFILING
@@ -0,0 +1,98 @@
+//----------------------------------------------------------------
+//
+// OpenDCC
+//
+// This source file is subject of the GNU general public license 2,
+// that is available at the world-wide-web at
+// http://www.gnu.org/licenses/gpl.txt
+//
+//-----------------------------------------------------------------
+//
+// file:      isrprof.h
+// history:   2026-10-16 V0.1 started
+//
+//-----------------------------------------------------------------
+//
+// purpose:   lowcost central station for dcc
+// content:   cycle budget of the interrupt service routines
+//            (compile switch ISR_PROFILING in config.h)
+//
+// how:       Timer1 runs without prescaler (CTC, TOP = OCR1A, see dccout.cpp),
+//            so TCNT1 counts cpu cycles. For the dccout ISR TCNT1 was cleared
+//            by the compare match -> we measure latency + duration.
+//            For all other ISRs we take the difference between entry and exit;
+//            a wrap at TOP is corrected with OCR1A (ISRs don't nest on AVR,
+//            so the DCC ISR can't change OCR1A in between).
+//
+//-----------------------------------------------------------------
+#ifndef __ISRPROF_H__
+#define __ISRPROF_H__
+
+#define ISRPROF_DCC        0        // ISR(TIMER1_COMPA_vect), dccout
+#define ISRPROF_UART_RX    1        // ISR(USART_RX_vect), rs485 / rs232
+#define ISRPROF_UART_UDRE  2        // ISR(USART_UDRE_vect), rs485 / rs232
+#define ISRPROF_ROTARY     3        // isr(), rotary encoder in keys.cpp
+#define ISRPROF_NUM        4
+
+// DCC must not be blocked more then 50us (see dccout.cpp),
+// a ISR longer than this delays the next dcc edge -> missed deadline
+#define ISRPROF_DEADLINE   (F_CPU / 1000000L * 50)
+
+#define SIZE_ISRPROF_SAMPLES  32    // captured durations of one ISR (2 bytes each)
+
+#if (ISR_PROFILING == 1)
+
+typedef struct {
+  uint16_t min;                     // cycles
+  uint16_t max;
+  uint32_t sum;                     // sum / count = avg
+  uint16_t count;
+  uint16_t missed;                  // > ISRPROF_DEADLINE
+} t_isrprof;
+
+extern t_isrprof isrprof[ISRPROF_NUM];
+extern uint16_t isrprof_samples[SIZE_ISRPROF_SAMPLES];
+extern unsigned char isrprof_capture_id;    // capture samples of this ISR
+extern volatile unsigned char isrprof_capture_fill;
+
+static inline void isrprof_Stop(unsigned char id, uint16_t t0) __attribute__((always_inline));
+void isrprof_Stop(unsigned char id, uint16_t t0) {
+  uint16_t cycles = TCNT1;
+  t_isrprof *p = &isrprof[id];
+
+  if (cycles >= t0) cycles = cycles - t0;
+  else cycles = cycles + OCR1A + 1 - t0;   // TCNT1 was cleared at TOP
+
+  if (cycles < p->min) p->min = cycles;
+  if (cycles > p->max) p->max = cycles;
+  if (cycles > ISRPROF_DEADLINE) p->missed++;
+  if (p->count == 0x8000) {                // keep avg running, halve
+    p->count >>= 1;
+    p->sum >>= 1;
+  }
+  p->count++;
+  p->sum += cycles;
+
+  if ((id == isrprof_capture_id) && (isrprof_capture_fill < SIZE_ISRPROF_SAMPLES))
+    isrprof_samples[isrprof_capture_fill++] = cycles;
+}
+
+#define ISRPROF_START()           uint16_t isrprof_t0 = TCNT1
+#define ISRPROF_START_AT_MATCH()  uint16_t isrprof_t0 = 0
+#define ISRPROF_STOP(id)          isrprof_Stop(id, isrprof_t0)
+
+void isrprof_Reset();                                 // clear all statistics
+void isrprof_Get(unsigned char id, t_isrprof *copy);  // consistent copy (cli)
+uint16_t isrprof_GetAvg(t_isrprof *p);
+void isrprof_Capture(unsigned char id);               // (re)start capture of samples for ISR id
+unsigned char isrprof_GetSamples(uint16_t *samples, unsigned char first, unsigned char num); // ret: number copied
+
+#else
+
+#define ISRPROF_START()
+#define ISRPROF_START_AT_MATCH()
+#define ISRPROF_STOP(id)
+
+#endif // ISR_PROFILING
+
+#endif // __ISRPROF_H__
@@ -1,5 +1,7 @@
 #include "Arduino.h"
+#include "config.h"
 #include "keys.h"
+#include "isrprof.h"
 /*
  * CLK = pin D2 (verplicht,gelinkt aan int0)
  * DT = pin D6 (vrij)
@@ -27,12 +29,14 @@ static void detect_keys ();
 void isr () {
   int clk; 
   int dt;
+  ISRPROF_START();
   clk = digitalRead(PIN_ROT_CLK); 
   dt = digitalRead(PIN_ROT_DT);
   if (clk == dt)
     turns--;
   else
     turns++;
+  ISRPROF_STOP(ISRPROF_ROTARY);
 } // ROT_CLK isr
 
 /****************************************************************************************/
@@ -8,7 +8,13 @@
 #define PIN_ROT_DT      6                   // Used for reading DT signal
 #define PIN_ROT_SW      7                   // Used for the push button switch (dit is een gedebouncete key, hieronder)
 
+#if (PROG_TRACK_CONCURRENT == 1)
+// D11 is PROG_DCC (OC2A) -> KEY_3 op D13; de 'L' led van de nano op D13 weghalen
+// of een externe pullup (4K7) voorzien, anders leest de key altijd LOW
+#define KEYPINS  {7, 5, 8, 13, 12}
+#else
 #define KEYPINS  {7, 5, 8, 11, 12}
+#endif
 
 // keyCode moet bruikbaar zijn als idx in een interne array, daarom geen enum type
 #define KEY_ENTER   0
@@ -92,6 +92,8 @@
 #include "organizer.h"
 #include "lenz_parser.h"
 #include "accessories.h"
+#include "cmdlat.h"
+#include "railcom.h"                // pom cvrd result
 
 // TODO SDS20201 : we parkeren dat event voorlopig hier ipv in status
 typedef struct {
@@ -259,6 +261,36 @@ static void pc_send_ServiceModeInformationResponse() {
     }
 } // pc_send_ServiceModeInformationResponse
 
+#if (RAILCOM_DETECTOR == 1)
+// result of a pom cvrd, read with RailCom; sent like the result of a service mode read
+// ret: 0 if there was no pom cvrd
+static unsigned char pc_send_PomResponse() {
+  unsigned int cv;
+  unsigned char data;
+
+  switch (railcom_GetPomResult(&cv, &data)) {
+    case RC_POM_BUSY:
+      tx_message[0] = 0x61;
+      tx_message[1] = 0x1f;
+      break;
+    case RC_POM_OKAY:
+      tx_message[0] = 0x63;
+      tx_message[1] = 0x14 | ((cv >> 8) & 0x03);   // code: 0x14 .. 0x17
+      tx_message[2] = cv;
+      tx_message[3] = data;
+      break;
+    case RC_POM_NOANSWER:
+      tx_message[0] = 0x61;
+      tx_message[1] = 0x13;                        // not found
+      break;
+    default:
+      return(0);
+  }
+  pcintf_SendMessage(tx_ptr = tx_message);
+  return(1);
+} // pc_send_PomResponse
+#endif
+
 static void pc_send_CommandStationStatusIndicationResponse() {
   // Format: Headerbyte Daten 1 Daten 2 X-Or-Byte
   // Hex : 0x62 0x22 S X-Or-Byte
@@ -305,11 +337,13 @@ static void pc_send_LocInformationResponse(unsigned int locAddress) {
   unsigned char data, speed;
   uint32_t retval = 0;
   locomem *lbData;
-  uint8_t convert_format[4] = {
+  uint8_t convert_format[6] = {
     0b000,      // DCC14
     0b001,      // DCC27
     0b010,      // DCC28
     0b100,      // DCC128
+    0b000,      // MM1 (MAERKLIN_ENABLED), 14 steps
+    0b000,      // MM2
   };
 
   tx_message[0] = 0xE4; // Headerbyte = 0xE4
@@ -328,6 +362,8 @@ static void pc_send_LocInformationResponse(unsigned int locAddress) {
 
     speed = convert_speed_to_rail(lbData->speed, lbData->format);
     switch(lbData->format) {
+      case MM1:
+      case MM2:
       case DCC14:
         tx_message[2] = speed;    //Byte2 = Speed = R000 VVVV;
         break;
@@ -463,6 +499,9 @@ static void pcintf_parser() {
             break;
         case 0x10: 
           // Prog.-Ergebnis anfordern 0x21 0x10 0x31
+          #if (RAILCOM_DETECTOR == 1)
+          if (pc_send_PomResponse()) return;
+          #endif
           if (opendcc_state >= PROG_OKAY) {
             pc_send_ServiceModeInformationResponse();
             return;
@@ -806,7 +845,8 @@ static void pcintf_parser() {
               if (organizer_IsReady()) {
                 #if (DCC_F13_F28 == 1)
                 retval = do_loco_func_grp4(0, addr, pcc[4]);
-                pcintf_SendMessage(tx_ptr = pcm_ack);
+                if (retval & ORGZ_FHIGH_FULL) pcintf_SendMessage(tx_ptr = pcm_busy);   // no F13..F28 entry free
+                else pcintf_SendMessage(tx_ptr = pcm_ack);
                 // TODO SDS2021 : check if this works!
                 if (retval & ORGZ_STOLEN) {
                   pcintf_SendLocStolen(addr); // loc stolen by local UI
@@ -833,7 +873,8 @@ static void pcintf_parser() {
               if (organizer_IsReady()) {
                 #if (DCC_F13_F28 == 1)
                 retval = do_loco_func_grp5(0, addr, pcc[4]);
-                pcintf_SendMessage(tx_ptr = pcm_ack);
+                if (retval & ORGZ_FHIGH_FULL) pcintf_SendMessage(tx_ptr = pcm_busy);   // no F13..F28 entry free
+                else pcintf_SendMessage(tx_ptr = pcm_ack);
                 // TODO SDS2021 : check if this works!
                 if (retval & ORGZ_STOLEN) {
                   pcintf_SendLocStolen(addr); // loc stolen by local UI
@@ -989,7 +1030,7 @@ static void pcintf_parser() {
           if ((pcc[2] < 1) || (pcc[2] > 4)) pcc[2] = 1;
           pcintf_SendMessage(&pcc[0]);
 
-          while(!rs232_is_all_sent());  // busy waiting until all sent
+          while(!rs232_is_all_sent()) BUSY_WAIT();  // busy waiting until all sent
           rs232_Init((t_baud)pcc[2]);   // jetzt umschalten und fifos flushen
           return;
       }
@@ -1081,7 +1122,9 @@ void pcintf_Run() {
         return;
       }
       
+      CMDLAT_ACCEPT(PCINTF_SLOT);
       pcintf_parser();       // analyze received message and send code
+      CMDLAT_CLEAR();
       parser_state = IDLE;
       break;
   }
@@ -1095,7 +1138,7 @@ void pcintf_SendMessage(unsigned char *msg) { // vorläufig kein Timeout
   n = 0;
   my_xor = msg[0];
   total = msg[0] & 0x0F;
-  while (!rs232_tx_ready());             // busy waiting!
+  while (!rs232_tx_ready()) BUSY_WAIT();             // busy waiting!
 
   rs232_send_byte(msg[0]);                   // send header
   while (n != total) {
@@ -46,6 +46,7 @@
 //
 // downstream:
 //            uses "next_message..." flags to interact with dccout
+//            (PROG_TRACK_CONCURRENT: "next_prog_message..." with progout)
 //
 //------------------------------------------------------------------------------
 /*
@@ -62,16 +63,22 @@
  * locobuffer accesses : check eeprom accesses ihb, 
  * --> kan problematisch zijn als 2 devices met verschillend format dezelfde loc sturen 
  * --> want dan wordt elke keer eeprom geschreven (database_PutLocoFormat) met het laatst aangestuurde format
+ * --> database.cpp houdt de updates nu eerst in ram (write-behind), database_Run schrijft later
+ * --> formats staan ook in ram (db_entry), database_GetLocoFormat leest de eeprom niet meer
 */
 
 #include "Arduino.h"
 #include "config.h"                // general structures and definitions
 #include "database.h"
 #include "dccout.h"
+#include "progout.h"               // PROG_TRACK_CONCURRENT: next_prog_message
 #include "status.h"                // opendcc_state
 #include "organizer.h" 
 #include "programmer.h"           // for prog_event.busy() -> TODO SDS2021 : is dit echt nodig??
 #include "accessories.h"          // for turnout_Update()
+#include "pkttrace.h"              // PKTTRACE()
+#include "cmdlat.h"                // CMD_LATENCY
+#include "railcom.h"               // RAILCOM_EXPECT_POM()
 
 // TODO SDS2021 : is dit nog nodig?
 typedef struct {
@@ -86,29 +93,52 @@ static t_organizer_state organizer_state = {
 //------------------------------------------------------------------------
 // define a structure for DCC messages
 //------------------------------------------------------------------------
+// queues and repeatbuffer keep only the header of a t_message; the dcc bytes
+// are stored at their real length in pkt_pool (see chapter 5)
+typedef struct {
+  uint8_t repeat;
+  union {
+    struct {
+      uint8_t     size: 4;
+      t_msg_type  type: 4;
+    };
+    uint8_t qualifier;
+  };
+  uint16_t key;
+  uint8_t pkt;                // slot in pkt_pool, PKT_NONE = no dcc bytes
+} t_qentry;
+
 //-------------------------------------- programming command buffer (fifo)
-static t_message queue_prog[SIZE_QUEUE_PROG];
+static t_qentry queue_prog[SIZE_QUEUE_PROG];
 //-------------------------------------- high priority command buffer (fifo)
-static t_message queue_hp[SIZE_QUEUE_HP];
+static t_qentry queue_hp[SIZE_QUEUE_HP];
 //-------------------------------------- low priority command buffer (fifo)
-static t_message queue_lp[SIZE_QUEUE_LP];
+static t_qentry queue_lp[SIZE_QUEUE_LP];
 //-------------------------------------- repeat buffer
-static t_message repeatbuffer[SIZE_REPEATBUFFER];
-static locomem locobuffer[SIZE_LOCOBUFFER];
+static t_qentry repeatbuffer[SIZE_REPEATBUFFER];
 
 #if (SIZE_LOCOBUFFER > 254)
   #error SIZE_LOCOBUFFER too large
 #endif
+#if (SIZE_REPEATBUFFER > 254)
+  #error SIZE_REPEATBUFFER too large
+#endif
+#if (SIZE_PKT_POOL_SMALL + SIZE_PKT_POOL_LARGE > 254)
+  #error packet pool too large
+#endif
+#if ((SIZE_REPEATBUFFER_HASH & (SIZE_REPEATBUFFER_HASH - 1)) || (SIZE_REPEATBUFFER_HASH < 2 * SIZE_REPEATBUFFER) || (SIZE_REPEATBUFFER_HASH > 256))
+  #error SIZE_REPEATBUFFER_HASH must be a power of 2, at least 2 * SIZE_REPEATBUFFER and at most 256
+#endif
 
 // ---------------------------------------------------------------------
 // predefined messages
 // stored in bss, copied at start to sram
-//                       {repeat, size, type, data} 
+//                       {repeat, size, type, data, key} 
 t_message DCC_Reset    = {1,  {{ 2,  is_void}}, {0x00, 0x00}};    // DCC-Reset-Paket
 t_message DCC_Idle     = {1,  {{ 2,  is_void}}, {0xFF, 0x00}};    // DCC-Idle-Paket
-t_message DCC_BC_Stop  = {1,  {{ 2,  is_stop}}, {0x00, 0x71}};    // Broadcast Motor off, SDS : EmergencyStop (=geen remvertraging)
+t_message DCC_BC_Stop  = {1,  {{ 2,  is_stop}}, {0x00, 0x71}, 1 + KEY_SPEED};    // Broadcast Motor off, SDS : EmergencyStop (=geen remvertraging)
                                                                     // 01DC000S :D=x, C=1 (ignore D)
-t_message DCC_BC_Brake = {1,  {{ 2,  is_stop}}, {0x00, 0x70}};    // Broadcast Slow down, SDS : Stop (=decoder doet ev. remvertraging)
+t_message DCC_BC_Brake = {1,  {{ 2,  is_stop}}, {0x00, 0x70}, 1 + KEY_SPEED};  // Broadcast Slow down, SDS : Stop (=decoder doet ev. remvertraging)
                                                                   // if S=0: slow down
 
 static unsigned char dcc_acc_repeat;    // dcc accessory commands are repeated this time
@@ -129,6 +159,16 @@ static unsigned char dcc_func_repeat;   // dcc func commands are repeated this t
 //
 //=====================================================================================
 
+#if (1 + (KEY_FUNC_GRP5 + 1) * KEY_LOCO_RANGE + KEY_ACC_RANGE > 0x10000)
+  #error the packet keys (loco classes + accessories) do not fit into 16 bits
+#endif
+
+// packet key for loco messages (see config.h); 0 if the address is out of range
+static inline uint16_t msg_key_loco(uint8_t iclass, unsigned int nr) {
+  if (nr >= KEY_LOCO_RANGE) return (0);
+  return (1 + iclass * (uint16_t) KEY_LOCO_RANGE + nr);
+}
+
 /// build short address and 14 speed steps; neg. speed = forward, pos speed = revers
 /// 0AAAAAAA 01DUSSSS
 ///
@@ -139,6 +179,7 @@ static void build_loko_7a14s(unsigned int nr, signed char speed, t_message *new_
   unsigned char mydata;
   new_message->repeat = dcc_speed_repeat;
   new_message->type = is_loco;
+  new_message->key = msg_key_loco(KEY_SPEED, nr & 0x7F);
   new_message->size = 2;
   new_message->dcc[0] = (nr & 0x7F);
   // build up data: -> 01DUSSSS
@@ -157,6 +198,7 @@ static void build_loko_7a28s(unsigned int nr, signed char speed, t_message *new_
   unsigned char mydata;
   new_message->repeat = dcc_speed_repeat;
   new_message->type = is_loco;
+  new_message->key = msg_key_loco(KEY_SPEED, nr & 0x7F);
   new_message->size = 2;
   new_message->dcc[0] = (nr & 0x7F);
   // build up data: -> 01DCSSSS
@@ -179,6 +221,7 @@ static void build_loko_7a128s(unsigned int nr, signed char speed, t_message *new
 
   new_message->repeat = dcc_speed_repeat;
   new_message->type = is_loco;
+  new_message->key = msg_key_loco(KEY_SPEED, nr & 0x7F);
   new_message->size = 3;
   new_message->dcc[0] = (nr & 0x7F);
   new_message->dcc[1] = 0b00111111;
@@ -194,6 +237,7 @@ static void build_loko_14a14s(unsigned int nr, signed char speed, t_message *new
   unsigned char mydata;
   new_message->repeat = dcc_speed_repeat;
   new_message->type = is_loco;
+  new_message->key = msg_key_loco(KEY_SPEED, nr);
   new_message->size = 3;
   new_message->dcc[0] = 0xC0 | ( (unsigned char)(nr / 256) & 0x3F);
   new_message->dcc[1] = (char)(nr & 0xFF);
@@ -210,6 +254,7 @@ static void build_loko_14a28s(unsigned int nr, signed char speed, t_message *new
   unsigned char mydata;
   new_message->repeat = dcc_speed_repeat;
   new_message->type = is_loco;
+  new_message->key = msg_key_loco(KEY_SPEED, nr);
   new_message->size = 3;
   new_message->dcc[0] = 0xC0 | ( (unsigned char)(nr / 256) & 0x3F);
   new_message->dcc[1] = (char)(nr & 0xFF);
@@ -232,6 +277,7 @@ static void build_loko_14a128s(unsigned int nr, signed char speed, t_message *ne
 
   new_message->repeat = dcc_speed_repeat;
   new_message->type = is_loco;
+  new_message->key = msg_key_loco(KEY_SPEED, nr);
   new_message->size = 4;
   new_message->dcc[0] = 0xC0 | ( (unsigned char)(nr / 256) & 0x3F);
   new_message->dcc[1] = (char)(nr & 0xFF);
@@ -262,6 +308,7 @@ static void build_nmra_basic_accessory(unsigned int turnoutAddress, unsigned cha
 
   new_message->repeat = dcc_acc_repeat;
   new_message->type = is_acc;
+  new_message->key = MSG_KEY_ACC(turnoutAddress);
   new_message->size = 2;
   new_message->dcc[0] = 0x80 | (decoderAddress & 0x3F);
   new_message->dcc[1] = 0x80 | ( ((decoderAddress / 0x40) ^ 0x07) * 0x10);    // shift down, invert, shift up
@@ -280,6 +327,7 @@ static void build_nmra_extended_accessory(unsigned int addr, char aspect, t_mess
 
   new_message->repeat = dcc_acc_repeat;
   new_message->type = is_acc;
+  new_message->key = 0;
   new_message->size = 3;
   new_message->dcc[0]  = 0x80 | ((addr & 0xFC) >> 2); // SDS : hier stond 0x3C??
   new_message->dcc[1]  = (((addr >> 8) ^ 0x07) << 4);    // shift down, invert, shift up
@@ -291,6 +339,7 @@ static void build_nmra_extended_accessory(unsigned int addr, char aspect, t_mess
 static void build_nmra_raw(unsigned char *msg, unsigned char msgSize, t_message *new_message) {
   new_message->repeat = dcc_pom_repeat; // dcc_acc_repeat
   new_message->type = is_prog; // PoM needs immediate repeat, accessories don't mind
+  new_message->key = 0;
   if (msgSize > 6) msgSize = 6;
   new_message->size = msgSize;
   for (unsigned char i=0; i< msgSize; i++) {
@@ -305,6 +354,7 @@ static void build_function_7a_grp1(int nr, unsigned char func, t_message *new_me
 
   new_message->repeat = dcc_func_repeat;
   new_message->type = is_void;
+  new_message->key = msg_key_loco(KEY_FUNC_GRP1, nr & 0x7F);
   new_message->size = 2;
   new_message->dcc[0] = (nr & 0x7F);
   // build up data: -> 100FFFFF
@@ -318,6 +368,7 @@ static void build_function_7a_grp2(int nr, unsigned char func, t_message *new_me
 
   new_message->repeat = dcc_func_repeat;
   new_message->type = is_void;
+  new_message->key = msg_key_loco(KEY_FUNC_GRP2, nr & 0x7F);
   new_message->size = 2;
   new_message->dcc[0] = (nr & 0x7F);
   // build up data: -> 1011FFFF
@@ -331,6 +382,7 @@ static void build_function_7a_grp3(int nr, unsigned char func, t_message *new_me
 
   new_message->repeat = dcc_func_repeat;
   new_message->type = is_void;
+  new_message->key = msg_key_loco(KEY_FUNC_GRP3, nr & 0x7F);
   new_message->size = 2;
   new_message->dcc[0] = (nr & 0x7F);
   // build up data: -> 1010FFFF
@@ -345,6 +397,7 @@ static void build_function_7a_grp4(int nr, unsigned char func, t_message *new_me
 
   new_message->repeat = dcc_func_repeat;
   new_message->type = is_void;
+  new_message->key = msg_key_loco(KEY_FUNC_GRP4, nr & 0x7F);
   new_message->size = 3;
   new_message->dcc[0] = (nr & 0x7F);
   new_message->dcc[1] = 0b11011110;
@@ -358,6 +411,7 @@ static void build_function_7a_grp5(int nr, unsigned char func, t_message *new_me
 
   new_message->repeat = dcc_func_repeat;
   new_message->type = is_void;
+  new_message->key = msg_key_loco(KEY_FUNC_GRP5, nr & 0x7F);
   new_message->size = 3;
   new_message->dcc[0] = (nr & 0x7F);
   new_message->dcc[1] = 0b11011111;
@@ -372,6 +426,7 @@ static void build_function_14a_grp1(int nr, unsigned char func, t_message *new_m
 
   new_message->repeat = dcc_func_repeat;
   new_message->type = is_void;
+  new_message->key = msg_key_loco(KEY_FUNC_GRP1, nr);
   new_message->size = 3;
   new_message->dcc[0] = 0xC0 | ( (unsigned char)(nr / 256) & 0x3F);
   new_message->dcc[1] = (char)(nr & 0xFF);
@@ -386,6 +441,7 @@ static void build_function_14a_grp2(int nr, unsigned char func, t_message *new_m
 
   new_message->repeat = dcc_func_repeat;
   new_message->type = is_void;
+  new_message->key = msg_key_loco(KEY_FUNC_GRP2, nr);
   new_message->size = 3;
   new_message->dcc[0] = 0xC0 | ( (unsigned char)(nr / 256) & 0x3F);
   new_message->dcc[1] = (char)(nr & 0xFF);
@@ -400,6 +456,7 @@ static void build_function_14a_grp3(int nr, unsigned char func, t_message *new_m
 
   new_message->repeat = dcc_func_repeat;
   new_message->type = is_void;
+  new_message->key = msg_key_loco(KEY_FUNC_GRP3, nr);
   new_message->size = 3;
   new_message->dcc[0] = 0xC0 | ( (unsigned char)(nr / 256) & 0x3F);
   new_message->dcc[1] = (char)(nr & 0xFF);
@@ -415,6 +472,7 @@ static void build_function_14a_grp4(int nr, unsigned char func, t_message *new_m
 
   new_message->repeat = dcc_func_repeat;
   new_message->type = is_void;
+  new_message->key = msg_key_loco(KEY_FUNC_GRP4, nr);
   new_message->size = 4;
   new_message->dcc[0] = 0xC0 | ( (unsigned char)(nr / 256) & 0x3F);
   new_message->dcc[1] = (char)(nr & 0xFF);
@@ -429,6 +487,7 @@ static void build_function_14a_grp5(int nr, unsigned char func, t_message *new_m
 
   new_message->repeat = dcc_func_repeat;
   new_message->type = is_void;
+  new_message->key = msg_key_loco(KEY_FUNC_GRP5, nr);
   new_message->size = 4;
   new_message->dcc[0] = 0xC0 | ( (unsigned char)(nr / 256) & 0x3F);
   new_message->dcc[1] = (char)(nr & 0xFF);
@@ -445,6 +504,7 @@ static void build_binstate_7a(int nr, unsigned int binstates, t_message *new_mes
   
   new_message->repeat = 1;   // not repeated
   new_message->type = is_void;
+  new_message->key = 0;
   new_message->dcc[0] = new_message->dcc[0] = (nr & 0x7F);
   if (binstates & 0xFF00)
     {  // long form
@@ -468,6 +528,7 @@ static void build_binstate_14a(int nr, unsigned int binstates, t_message *new_me
   
   new_message->repeat = 1;   // not repeated
   new_message->type = is_void;
+  new_message->key = 0;
   new_message->dcc[0] = 0xC0 | ( (unsigned char)(nr / 256) & 0x3F);
   new_message->dcc[1] = (char)(nr & 0xFF);
   if (binstates & 0xFF00)
@@ -508,6 +569,7 @@ static void build_pom_14a(int nr, unsigned int cv, unsigned char data, t_message
     
   new_message->repeat = dcc_pom_repeat;
   new_message->type = is_prog;
+  new_message->key = 0;
   new_message->size = 5;
   new_message->dcc[0] = 0xC0 | ( (unsigned char)(nr / 256) & 0x3F);
   new_message->dcc[1] = (char)(nr & 0xFF);
@@ -539,6 +601,7 @@ static void build_pom_7a(int nr, unsigned int cv, unsigned char data, t_message
     
   new_message->repeat = dcc_pom_repeat;
   new_message->type = is_prog;
+  new_message->key = 0;
   new_message->size = 4;
   new_message->dcc[0] = (nr & 0x7F);
   // build up data: -> 1110CCAA
@@ -564,6 +627,7 @@ static void build_pom_cvrd_14a(int nr, unsigned int cv, t_message *new_message)
     
   new_message->repeat = dcc_pom_repeat;
   new_message->type = is_prog;
+  new_message->key = 0;
   new_message->size = 5;
   new_message->dcc[0] = 0xC0 | ( (unsigned char)(nr / 256) & 0x3F);
   new_message->dcc[1] = (char)(nr & 0xFF);
@@ -590,6 +654,7 @@ static void build_pom_cvrd_7a(int nr, unsigned int cv, t_message *new_message)
     
   new_message->repeat = dcc_pom_repeat;
   new_message->type = is_prog;
+  new_message->key = 0;
   new_message->size = 4;
   new_message->dcc[0] = (nr & 0x7F);
   // build up data: -> 1110CCAA
@@ -616,6 +681,7 @@ static void build_pom_accessory(int nr, unsigned int cv, unsigned char data, t_m
     
   new_message->repeat = dcc_pom_repeat;
   new_message->type = is_prog;
+  new_message->key = 0;
   new_message->size = 5;
 
   new_message->dcc[0] = 0x80 | (nr & 0x3F);
@@ -644,6 +710,7 @@ static void build_pom_accessory_cvrd(int nr, unsigned int cv, t_message *new_mes
     
   new_message->repeat = dcc_pom_repeat;
   new_message->type = is_prog;
+  new_message->key = 0;
   new_message->size = 5;
 
   new_message->dcc[0] = 0x80 | (nr & 0x3F);
@@ -671,6 +738,7 @@ static void build_pom_ext_accessory(int addr, unsigned int cv, unsigned char dat
   
   new_message->repeat = dcc_pom_repeat;
   new_message->type = is_prog;
+  new_message->key = 0;
   new_message->size = 5;
   
   new_message->dcc[0] = 0x80 | ((addr & 0x3C) >> 2);
@@ -702,6 +770,7 @@ static void build_pom_ext_accessory_cvrd(int addr, unsigned int cv, t_message *n
   
   new_message->repeat = dcc_pom_repeat;
   new_message->type = is_prog;
+  new_message->key = 0;
   new_message->size = 5;
   
   new_message->dcc[0] = 0x80 | ((addr & 0x3C) >> 2);
@@ -727,6 +796,7 @@ static void build_dcc_fast_clock(t_fast_clock *my_clock, t_message *new_message)
 
   new_message->repeat = 0;
   new_message->type = is_void;
+  new_message->key = 0;
   new_message->size = 6;
   #if (6 > MAX_DCC_SIZE)
     #error wrong config, MAX_DCC_SIZE too small
@@ -750,6 +820,7 @@ static void build_loko_7a_restricted(unsigned int nr, unsigned char res_speed, t
 
   new_message->repeat = dcc_speed_repeat;
   new_message->type = is_loco;
+  new_message->key = 0;
   new_message->size = 3;
   new_message->dcc[0] = (nr & 0x7F);
   new_message->dcc[1] = 0b00111110;
@@ -763,6 +834,7 @@ static void build_loko_14a_restricted(unsigned int nr, unsigned char res_speed,
 
   new_message->repeat = dcc_speed_repeat;
   new_message->type = is_loco;
+  new_message->key = 0;
   new_message->size = 4;
   new_message->dcc[0] = 0xC0 | ( (unsigned char)(nr / 256) & 0x3F);
   new_message->dcc[1] = (char)(nr & 0xFF);
@@ -773,32 +845,777 @@ static void build_loko_14a_restricted(unsigned int nr, unsigned char res_speed,
 
 #endif
 
+#if (MAERKLIN_ENABLED == 1)
+//--------------------------------------------------------------------------------------------
+// Maerklin Motorola (MM1, MM2), type is_mm: 9 trits = 18 bits, msb first, put out by dccout (mm_isr)
+//   dcc[0]: address (4 trits), dcc[1] bit 7..6: function trit (FL), dcc[2]: data (4 trits)
+// data: MM1: speed step 0..14 (1 = direction change, relative direction)
+//       MM2: speed step and direction, or speed step and one of F1..F4
+// speed steps are the DCC14 rail steps (convert_speed_to_rail): 0 = stop, 2..15 = step 1..14;
+// Motorola has no emergency stop, it becomes stop.
+//--------------------------------------------------------------------------------------------
+
+// Adresserweiterung gemäss Intellibox
+// Entnommen aus: http://home.arcor.de/dr.koenig/digital/verbess.htm
+// Dort auch Vorschläge für Zwischenfahrstufen
+//
+// Diese Tabelle codiert aus der Adresse die im MM-Format verwendete
+// Bitfolge; Adresse 0..80 ist mit den normalen trinären Zuständen
+// codiert, ab Adresse 81 kommt der ursprünglich nicht vorhandene
+// Zustand 01 (hier mit short bezeichnet) dazu.
+//
+// Die Ausgabe erfolgt MSB first
+//
+
+static const unsigned char mm_addr_2_trit[256] PROGMEM =
+    {
+      //code    Adresse       Bitfolge    Trit: o=open, 0, 1, s=short
+        0xAA,   // adr00   = '10101010' = o o o o  -> eigentlich adr80
+        0xC0,   // adr01   = '11000000' = 1 0 0 0
+        0x80,   // adr02   = '10000000' = o 0 0 0
+        0x30,   // adr03   = '00110000' = 0 1 0 0
+        0xF0,   // adr04   = '11110000' = 1 1 0 0
+        0xB0,   // adr05   = '10110000' = o 1 0 0
+        0x20,   // adr06   = '00100000' = 0 o 0 0
+        0xE0,   // adr07   = '11100000' = 1 o 0 0
+        0xA0,   // adr08   = '10100000' = o o 0 0
+        0x0C,   // adr09   = '00001100' = 0 0 1 0
+        0xCC,   // adr10   = '11001100' = 1 0 1 0
+        0x8C,   // adr11   = '10001100' = o 0 1 0
+        0x3C,   // adr12   = '00111100' = 0 1 1 0
+        0xFC,   // adr13   = '11111100' = 1 1 1 0
+        0xBC,   // adr14   = '10111100' = o 1 1 0
+        0x2C,   // adr15   = '00101100' = 0 o 1 0
+        0xEC,   // adr16   = '11101100' = 1 o 1 0
+        0xAC,   // adr17   = '10101100' = o o 1 0
+        0x08,   // adr18   = '00001000' = 0 0 o 0
+        0xC8,   // adr19   = '11001000' = 1 0 o 0
+        0x88,   // adr20   = '10001000' = o 0 o 0
+        0x38,   // adr21   = '00111000' = 0 1 o 0
+        0xF8,   // adr22   = '11111000' = 1 1 o 0
+        0xB8,   // adr23   = '10111000' = o 1 o 0
+        0x28,   // adr24   = '00101000' = 0 o o 0
+        0xE8,   // adr25   = '11101000' = 1 o o 0
+        0xA8,   // adr26   = '10101000' = o o o 0
+        0x03,   // adr27   = '00000011' = 0 0 0 1
+        0xC3,   // adr28   = '11000011' = 1 0 0 1
+        0x83,   // adr29   = '10000011' = o 0 0 1
+        0x33,   // adr30   = '00110011' = 0 1 0 1
+        0xF3,   // adr31   = '11110011' = 1 1 0 1
+        0xB3,   // adr32   = '10110011' = o 1 0 1
+        0x23,   // adr33   = '00100011' = 0 o 0 1
+        0xE3,   // adr34   = '11100011' = 1 o 0 1
+        0xA3,   // adr35   = '10100011' = o o 0 1
+        0x0F,   // adr36   = '00001111' = 0 0 1 1
+        0xCF,   // adr37   = '11001111' = 1 0 1 1
+        0x8F,   // adr38   = '10001111' = o 0 1 1
+        0x3F,   // adr39   = '00111111' = 0 1 1 1
+        0xFF,   // adr40   = '11111111' = 1 1 1 1
+        0xBF,   // adr41   = '10111111' = o 1 1 1
+        0x2F,   // adr42   = '00101111' = 0 o 1 1
+        0xEF,   // adr43   = '11101111' = 1 o 1 1
+        0xAF,   // adr44   = '10101111' = o o 1 1
+        0x0B,   // adr45   = '00001011' = 0 0 o 1
+        0xCB,   // adr46   = '11001011' = 1 0 o 1
+        0x8B,   // adr47   = '10001011' = o 0 o 1
+        0x3B,   // adr48   = '00111011' = 0 1 o 1
+        0xFB,   // adr49   = '11111011' = 1 1 o 1
+        0xBB,   // adr50   = '10111011' = o 1 o 1
+        0x2B,   // adr51   = '00101011' = 0 o o 1
+        0xEB,   // adr52   = '11101011' = 1 o o 1
+        0xAB,   // adr53   = '10101011' = o o o 1
+        0x02,   // adr54   = '00000010' = 0 0 0 o
+        0xC2,   // adr55   = '11000010' = 1 0 0 o
+        0x82,   // adr56   = '10000010' = o 0 0 o
+        0x32,   // adr57   = '00110010' = 0 1 0 o
+        0xF2,   // adr58   = '11110010' = 1 1 0 o
+        0xB2,   // adr59   = '10110010' = o 1 0 o
+        0x22,   // adr60   = '00100010' = 0 o 0 o
+        0xE2,   // adr61   = '11100010' = 1 o 0 o
+        0xA2,   // adr62   = '10100010' = o o 0 o
+        0x0E,   // adr63   = '00001110' = 0 0 1 o
+        0xCE,   // adr64   = '11001110' = 1 0 1 o
+        0x8E,   // adr65   = '10001110' = o 0 1 o
+        0x3E,   // adr66   = '00111110' = 0 1 1 o
+        0xFE,   // adr67   = '11111110' = 1 1 1 o
+        0xBE,   // adr68   = '10111110' = o 1 1 o
+        0x2E,   // adr69   = '00101110' = 0 o 1 o
+        0xEE,   // adr70   = '11101110' = 1 o 1 o
+        0xAE,   // adr71   = '10101110' = o o 1 o
+        0x0A,   // adr72   = '00001010' = 0 0 o o
+        0xCA,   // adr73   = '11001010' = 1 0 o o
+        0x8A,   // adr74   = '10001010' = o 0 o o
+        0x3A,   // adr75   = '00111010' = 0 1 o o
+        0xFA,   // adr76   = '11111010' = 1 1 o o
+        0xBA,   // adr77   = '10111010' = o 1 o o
+        0x2A,   // adr78   = '00101010' = 0 o o o
+        0xEA,   // adr79   = '11101010' = 1 o o o
+        0x00,   // adr80   = '00000000' = 0 0 0 0
+        0x40,   // adr81   = '01000000' = s 0 0 0
+        0x60,   // adr82   = '01100000' = s o 0 0
+        0x97,   // adr83   = '10010111' = o s s 1
+        0x70,   // adr84   = '01110000' = s 1 0 0
+        0x48,   // adr85   = '01001000' = s 0 o 0
+        0x68,   // adr86   = '01101000' = s o o 0
+        0x58,   // adr87   = '01011000' = s s o 0
+        0x78,   // adr88   = '01111000' = s 1 o 0
+        0x44,   // adr89   = '01000100' = s 0 s 0
+        0x64,   // adr90   = '01100100' = s o s 0
+        0x54,   // adr91   = '01010100' = s s s 0
+        0x74,   // adr92   = '01110100' = s 1 s 0
+        0x4C,   // adr93   = '01001100' = s 0 1 0
+        0x6C,   // adr94   = '01101100' = s o 1 0
+        0x5C,   // adr95   = '01011100' = s s 1 0
+        0x7C,   // adr96   = '01111100' = s 1 1 0
+        0x42,   // adr97   = '01000010' = s 0 0 o
+        0x62,   // adr98   = '01100010' = s o 0 o
+        0x52,   // adr99   = '01010010' = s s 0 o
+        0x72,   // adr100  = '01110010' = s 1 0 o
+        0x4A,   // adr101  = '01001010' = s 0 o o
+        0x6A,   // adr102  = '01101010' = s o o o
+        0x5A,   // adr103  = '01011010' = s s o o
+        0x7A,   // adr104  = '01111010' = s 1 o o
+        0x46,   // adr105  = '01000110' = s 0 s o
+        0x66,   // adr106  = '01100110' = s o s o
+        0x56,   // adr107  = '01010110' = s s s o
+        0x76,   // adr108  = '01110110' = s 1 s o
+        0x4E,   // adr109  = '01001110' = s 0 1 o
+        0x6E,   // adr110  = '01101110' = s o 1 o
+        0x5E,   // adr111  = '01011110' = s s 1 o
+        0x7E,   // adr112  = '01111110' = s 1 1 o
+        0x41,   // adr113  = '01000001' = s 0 0 s
+        0x61,   // adr114  = '01100001' = s o 0 s
+        0x51,   // adr115  = '01010001' = s s 0 s
+        0x71,   // adr116  = '01110001' = s 1 0 s
+        0x49,   // adr117  = '01001001' = s 0 o s
+        0x69,   // adr118  = '01101001' = s o o s
+        0x59,   // adr119  = '01011001' = s s o s
+        0x79,   // adr120  = '01111001' = s 1 o s
+        0x45,   // adr121  = '01000101' = s 0 s s
+        0x65,   // adr122  = '01100101' = s o s s
+        0x9F,   // adr123  = '10011111' = o s 1 1
+        0x75,   // adr124  = '01110101' = s 1 s s
+        0x4D,   // adr125  = '01001101' = s 0 1 s
+        0x6D,   // adr126  = '01101101' = s o 1 s
+        0x5D,   // adr127  = '01011101' = s s 1 s
+        0x7D,   // adr128  = '01111101' = s 1 1 s
+        0x43,   // adr129  = '01000011' = s 0 0 1
+        0x63,   // adr130  = '01100011' = s o 0 1
+        0x53,   // adr131  = '01010011' = s s 0 1
+        0x73,   // adr132  = '01110011' = s 1 0 1
+        0x4B,   // adr133  = '01001011' = s 0 o 1
+        0x6B,   // adr134  = '01101011' = s o o 1
+        0x5B,   // adr135  = '01011011' = s s o 1
+        0x7B,   // adr136  = '01111011' = s 1 o 1
+        0x47,   // adr137  = '01000111' = s 0 s 1
+        0x67,   // adr138  = '01100111' = s o s 1
+        0x57,   // adr139  = '01010111' = s s s 1
+        0x77,   // adr140  = '01110111' = s 1 s 1
+        0x4F,   // adr141  = '01001111' = s 0 1 1
+        0x6F,   // adr142  = '01101111' = s o 1 1
+        0x5F,   // adr143  = '01011111' = s s 1 1
+        0x7F,   // adr144  = '01111111' = s 1 1 1
+        0x10,   // adr145  = '00010000' = 0 s 0 0
+        0x18,   // adr146  = '00011000' = 0 s o 0
+        0x14,   // adr147  = '00010100' = 0 s s 0
+        0x1C,   // adr148  = '00011100' = 0 s 1 0
+        0x12,   // adr149  = '00010010' = 0 s 0 o
+        0x1A,   // adr150  = '00011010' = 0 s o o
+        0x16,   // adr151  = '00010110' = 0 s s o
+        0x1E,   // adr152  = '00011110' = 0 s 1 o
+        0x11,   // adr153  = '00010001' = 0 s 0 s
+        0x19,   // adr154  = '00011001' = 0 s o s
+        0x15,   // adr155  = '00010101' = 0 s s s
+        0x1D,   // adr156  = '00011101' = 0 s 1 s
+        0x13,   // adr157  = '00010011' = 0 s 0 1
+        0x1B,   // adr158  = '00011011' = 0 s o 1
+        0x17,   // adr159  = '00010111' = 0 s s 1
+        0x1F,   // adr160  = '00011111' = 0 s 1 1
+        0xD0,   // adr161  = '11010000' = 1 s 0 0
+        0xD8,   // adr162  = '11011000' = 1 s o 0
+        0xD4,   // adr163  = '11010100' = 1 s s 0
+        0xDC,   // adr164  = '11011100' = 1 s 1 0
+        0xD2,   // adr165  = '11010010' = 1 s 0 o
+        0xDA,   // adr166  = '11011010' = 1 s o o
+        0xD6,   // adr167  = '11010110' = 1 s s o
+        0xDE,   // adr168  = '11011110' = 1 s 1 o
+        0xD1,   // adr169  = '11010001' = 1 s 0 s
+        0xD9,   // adr170  = '11011001' = 1 s o s
+        0xD5,   // adr171  = '11010101' = 1 s s s
+        0xDD,   // adr172  = '11011101' = 1 s 1 s
+        0xD3,   // adr173  = '11010011' = 1 s 0 1
+        0xDB,   // adr174  = '11011011' = 1 s o 1
+        0xD7,   // adr175  = '11010111' = 1 s s 1
+        0xDF,   // adr176  = '11011111' = 1 s 1 1
+        0x90,   // adr177  = '10010000' = o s 0 0
+        0x98,   // adr178  = '10011000' = o s o 0
+        0x94,   // adr179  = '10010100' = o s s 0
+        0x9C,   // adr180  = '10011100' = o s 1 0
+        0x92,   // adr181  = '10010010' = o s 0 o
+        0x9A,   // adr182  = '10011010' = o s o o
+        0x96,   // adr183  = '10010110' = o s s o
+        0x9E,   // adr184  = '10011110' = o s 1 o
+        0x91,   // adr185  = '10010001' = o s 0 s
+        0x99,   // adr186  = '10011001' = o s o s
+        0x95,   // adr187  = '10010101' = o s s s
+        0x9D,   // adr188  = '10011101' = o s 1 s
+        0x93,   // adr189  = '10010011' = o s 0 1
+        0x9B,   // adr190  = '10011011' = o s o 1
+        0x50,   // adr191  = '01010000' = s s 0 0
+        0x55,   // adr192  = '01010101' = s s s s
+        0x04,   // adr193  = '00000100' = 0 0 s 0
+        0x06,   // adr194  = '00000110' = 0 0 s o
+        0x05,   // adr195  = '00000101' = 0 0 s s
+        0x07,   // adr196  = '00000111' = 0 0 s 1
+        0xC4,   // adr197  = '11000100' = 1 0 s 0
+        0xC6,   // adr198  = '11000110' = 1 0 s o
+        0xC5,   // adr199  = '11000101' = 1 0 s s
+        0xC7,   // adr200  = '11000111' = 1 0 s 1
+        0x84,   // adr201  = '10000100' = o 0 s 0
+        0x86,   // adr202  = '10000110' = o 0 s o
+        0x85,   // adr203  = '10000101' = o 0 s s
+        0x87,   // adr204  = '10000111' = o 0 s 1
+        0x34,   // adr205  = '00110100' = 0 1 s 0
+        0x36,   // adr206  = '00110110' = 0 1 s o
+        0x35,   // adr207  = '00110101' = 0 1 s s
+        0x37,   // adr208  = '00110111' = 0 1 s 1
+        0xF4,   // adr209  = '11110100' = 1 1 s 0
+        0xF6,   // adr210  = '11110110' = 1 1 s o
+        0xF5,   // adr211  = '11110101' = 1 1 s s
+        0xF7,   // adr212  = '11110111' = 1 1 s 1
+        0xB4,   // adr213  = '10110100' = o 1 s 0
+        0xB6,   // adr214  = '10110110' = o 1 s o
+        0xB5,   // adr215  = '10110101' = o 1 s s
+        0xB7,   // adr216  = '10110111' = o 1 s 1
+        0x24,   // adr217  = '00100100' = 0 o s 0
+        0x26,   // adr218  = '00100110' = 0 o s o
+        0x25,   // adr219  = '00100101' = 0 o s s
+        0x27,   // adr220  = '00100111' = 0 o s 1
+        0xE4,   // adr221  = '11100100' = 1 o s 0
+        0xE6,   // adr222  = '11100110' = 1 o s o
+        0xE5,   // adr223  = '11100101' = 1 o s s
+        0xE7,   // adr224  = '11100111' = 1 o s 1
+        0xA4,   // adr225  = '10100100' = o o s 0
+        0xA6,   // adr226  = '10100110' = o o s o
+        0xA5,   // adr227  = '10100101' = o o s s
+        0xA7,   // adr228  = '10100111' = o o s 1
+        0x01,   // adr229  = '00000001' = 0 0 0 s
+        0xC1,   // adr230  = '11000001' = 1 0 0 s
+        0x81,   // adr231  = '10000001' = o 0 0 s
+        0x31,   // adr232  = '00110001' = 0 1 0 s
+        0xF1,   // adr233  = '11110001' = 1 1 0 s
+        0xB1,   // adr234  = '10110001' = o 1 0 s
+        0x21,   // adr235  = '00100001' = 0 o 0 s
+        0xE1,   // adr236  = '11100001' = 1 o 0 s
+        0xA1,   // adr237  = '10100001' = o o 0 s
+        0x0D,   // adr238  = '00001101' = 0 0 1 s
+        0xCD,   // adr239  = '11001101' = 1 0 1 s
+        0x8D,   // adr240  = '10001101' = o 0 1 s
+        0x3D,   // adr241  = '00111101' = 0 1 1 s
+        0xFD,   // adr242  = '11111101' = 1 1 1 s
+        0xBD,   // adr243  = '10111101' = o 1 1 s
+        0x2D,   // adr244  = '00101101' = 0 o 1 s
+        0xED,   // adr245  = '11101101' = 1 o 1 s
+        0xAD,   // adr246  = '10101101' = o o 1 s
+        0x09,   // adr247  = '00001001' = 0 0 o s
+        0xC9,   // adr248  = '11001001' = 1 0 o s
+        0x89,   // adr249  = '10001001' = o 0 o s
+        0x39,   // adr250  = '00111001' = 0 1 o s
+        0xF9,   // adr251  = '11111001' = 1 1 o s
+        0xB9,   // adr252  = '10111001' = o 1 o s
+        0x29,   // adr253  = '00101001' = 0 o o s
+        0xE9,   // adr254  = '11101001' = 1 o o s
+        0xA9,   // adr255  = '10101001' = o o o s
+    };
+
+
+// übersetzung von Speed nach Trit für das alte MM1 Format
+
+static const unsigned char mm_speed_2_trit[16] PROGMEM =
+    {
+      //code    Speed         Bitfolge    Trit: o=open, 0, 1, s=short
+        0x00,   // 00      = '00000000' = 0 0 0 0
+        0xC0,   // DIR     = '11000000' = 1 0 0 0
+        0x30,   // 01      = '00110000' = 0 1 0 0
+        0xF0,   // 02      = '11110000' = 1 1 0 0
+        0x0C,   // 03      = '00001100' = 0 0 1 0
+        0xCC,   // 04      = '11001100' = 1 0 1 0
+        0x3C,   // 05      = '00111100' = 0 1 1 0
+        0xFC,   // 06      = '11111100' = 1 1 1 0
+        0x03,   // 07      = '00000011' = 0 0 0 1
+        0xC3,   // 08      = '11000011' = 1 0 0 1
+        0x33,   // 09      = '00110011' = 0 1 0 1
+        0xF3,   // 10      = '11110011' = 1 1 0 1
+        0x0F,   // 11      = '00001111' = 0 0 1 1
+        0xCF,   // 12      = '11001111' = 1 0 1 1
+        0x3F,   // 13      = '00111111' = 0 1 1 1
+        0xFF,   // 14      = '11111111' = 1 1 1 1
+     };
+
+
+// Bei MM2 sind folgende Neuerungen dazugekommen:
+// Die Zustände open und short werden auch bei den Datenbits
+// mitverwendet und für folgende Codierung verwendet:
+// 1. Speed und Direction
+// 2. Speed und Funktion f1
+// 3. Speed und Funktion f2
+// 4. Speed und Funktion f3
+// 5. Speed und Funktion f4
+//
+// Damit ergibt sich zwei neue Tabelle mit folgenden Adressen:
+//
+//  Speedtabelle:     4 Bit:  Speed
+//                    1 Bit:  Direction
+//
+//  Funktiontabelle:  4 Bit:  Speed
+//                    2 Bit:  Funktion (f1 ... f4)
+//                    1 Bit:  Zustand der Funktion
+//
+// Diese Tabellen werden hier als Array abgelegt:
+// Zugriff mit: mm2_speed_dir_2_trit[speed][dir]
+// dir = 0: vorwärts (nicht wie DCC); 1=rückwärts
+//
+static const unsigned char mm2_speed_dir_2_trit[16][2] PROGMEM =
+  {
+   {0x11, 0x45},   // + 0, - 0 ; 00010001 = 0 s 0 s  01000101 = s 0 s s
+   {0x91, 0xc5},   // + r, - r ; 10010001 = o s 0 s  11000101 = 1 0 s s
+   {0x31, 0x65},   // + 1, - 1 ; 00110001 = 0 1 0 s  01100101 = s o s s
+   {0xb1, 0xe5},   // + 2, - 2 ; 10110001 = o 1 0 s  11100101 = 1 o s s
+   {0x19, 0x4d},   // + 3, - 3 ; 00011001 = 0 s o s  01001101 = s 0 1 s
+   {0x99, 0xcd},   // + 4, - 4 ; 10011001 = o s o s  11001101 = 1 0 1 s
+   {0x39, 0x6d},   // + 5, - 5 ; 00111001 = 0 1 o s  01101101 = s o 1 s
+   {0xb9, 0xed},   // + 6, - 6 ; 10111001 = o 1 o s  11101101 = 1 o 1 s
+   {0x12, 0x46},   // + 7, - 7 ; 00010010 = 0 s 0 o  01000110 = s 0 s o
+   {0x92, 0xc6},   // + 8, - 8 ; 10010010 = o s 0 o  11000110 = 1 0 s o
+   {0x32, 0x66},   // + 9, - 9 ; 00110010 = 0 1 0 o  01100110 = s o s o
+   {0xb2, 0xe6},   // +10, -10 ; 10110010 = o 1 0 o  11100110 = 1 o s o
+   {0x1a, 0x4e},   // +11, -11 ; 00011010 = 0 s o o  01001110 = s 0 1 o
+   {0x9a, 0xce},   // +12, -12 ; 10011010 = o s o o  11001110 = 1 0 1 o
+   {0x3a, 0x6e},   // +13, -13 ; 00111010 = 0 1 o o  01101110 = s o 1 o
+   {0xba, 0xee},   // +14, -14 ; 10111010 = o 1 o o  11101110 = 1 o 1 o
+  };
+
+//
+// Tabelle zur Umsetzung der Funktion zusammen mit der Speed.
+// Die nachfolgende Tabelle berücksichtigt auch die Ausnahmen.
+// Zugriff mit: mm2_speed_funct_2_trit[speed][func][state]
+// func = f1,f2,f3,f4, state = on off
+
+static const unsigned char mm2_speed_funct_2_trit[16][4][2] PROGMEM =
+  {
+   {{0x50, 0x51}, // speed  0 f1  01010000 = s s 0 0   01010001 = s s 0 s
+    {0x04, 0x05}, // speed  0 f2  00000100 = 0 0 s 0   00000101 = 0 0 s s
+    {0x14, 0x15}, // speed  0 f3  00010100 = 0 s s 0   00010101 = 0 s s s
+    {0x54, 0x55}, // speed  0 f4  01010100 = s s s 0   01010101 = s s s s
+   },
+   {{0xd0, 0xd1}, // speed  r f1  11010000 = 1 s 0 0   11010001 = 1 s 0 s
+    {0x84, 0x85}, // speed  r f2  10000100 = o 0 s 0   10000101 = o 0 s s
+    {0x94, 0x95}, // speed  r f3  10010100 = o s s 0   10010101 = o s s s
+    {0xd4, 0xd5}, // speed  r f4  11010100 = 1 s s 0   11010101 = 1 s s s
+   },
+   {{0x70, 0x71}, // speed  1 f1  01110000 = s 1 0 0   01110001 = s 1 0 s
+    {0x24, 0x25}, // speed  1 f2  00100100 = 0 o s 0   00100101 = 0 o s s
+    {0x34, 0x35}, // speed  1 f3  00110100 = 0 1 s 0   00110101 = 0 1 s s
+    {0x74, 0x75}, // speed  1 f4  01110100 = s 1 s 0   01110101 = s 1 s s
+   },
+   {{0xe4, 0xf1}, // speed  2 f1  11100100 = 1 o s 0   11110001 = 1 1 0 s  // f1=off jetzt 1010
+    {0xa4, 0xa5}, // speed  2 f2  10100100 = o o s 0   10100101 = o o s s
+    {0xb4, 0xb5}, // speed  2 f3  10110100 = o 1 s 0   10110101 = o 1 s s
+    {0xf4, 0xf5}, // speed  2 f4  11110100 = 1 1 s 0   11110101 = 1 1 s s
+   },
+   {{0x58, 0x59}, // speed  3 f1  01011000 = s s o 0   01011001 = s s o s
+    {0x4c, 0x0d}, // speed  3 f2  01001100 = s 0 1 0   00001101 = 0 0 1 s  // f2=off jetzt 1010
+    {0x1c, 0x1d}, // speed  3 f3  00011100 = 0 s 1 0   00011101 = 0 s 1 s
+    {0x5c, 0x5d}, // speed  3 f4  01011100 = s s 1 0   01011101 = s s 1 s
+   },
+   {{0xd8, 0xd9}, // speed  4 f1  11011000 = 1 s o 0   11011001 = 1 s o s
+    {0x8c, 0x8d}, // speed  4 f2  10001100 = o 0 1 0   10001101 = o 0 1 s
+    {0x9c, 0x9d}, // speed  4 f3  10011100 = o s 1 0   10011101 = o s 1 s
+    {0xdc, 0xdd}, // speed  4 f4  11011100 = 1 s 1 0   11011101 = 1 s 1 s
+   },
+   {{0x78, 0x79}, // speed  5 f1  01111000 = s 1 o 0   01111001 = s 1 o s
+    {0x2c, 0x2d}, // speed  5 f2  00101100 = 0 o 1 0   00101101 = 0 o 1 s
+    {0x6c, 0x3d}, // speed  5 f3  01101100 = s o 1 0   00111101 = 0 1 1 s  // f3=off jetzt 1010
+    {0x7c, 0x7d}, // speed  5 f4  01111100 = s 1 1 0   01111101 = s 1 1 s
+   },
+   {{0xf8, 0xf9}, // speed  6 f1  11111000 = 1 1 o 0   11111001 = 1 1 o s
+    {0xac, 0xad}, // speed  6 f2  10101100 = o o 1 0   10101101 = o o 1 s
+    {0xbc, 0xbd}, // speed  6 f3  10111100 = o 1 1 0   10111101 = o 1 1 s
+    {0xec, 0xfd}, // speed  6 f4  11101100 = 1 o 1 0   11111101 = 1 1 1 s  // f4=off jetzt 1010
+   },
+   {{0x52, 0x53}, // speed  7 f1  01010010 = s s 0 o   01010011 = s s 0 1
+    {0x06, 0x07}, // speed  7 f2  00000110 = 0 0 s o   00000111 = 0 0 s 1
+    {0x16, 0x17}, // speed  7 f3  00010110 = 0 s s o   00010111 = 0 s s 1
+    {0x56, 0x57}, // speed  7 f4  01010110 = s s s o   01010111 = s s s 1
+   },
+   {{0xd2, 0xd3}, // speed  8 f1  11010010 = 1 s 0 o   11010011 = 1 s 0 1
+    {0x86, 0x87}, // speed  8 f2  10000110 = o 0 s o   10000111 = o 0 s 1
+    {0x96, 0x97}, // speed  8 f3  10010110 = o s s o   10010111 = o s s 1
+    {0xd6, 0xd7}, // speed  8 f4  11010110 = 1 s s o   11010111 = 1 s s 1
+   },
+   {{0x72, 0x73}, // speed  9 f1  01110010 = s 1 0 o   01110011 = s 1 0 1
+    {0x26, 0x27}, // speed  9 f2  00100110 = 0 o s o   00100111 = 0 o s 1
+    {0x36, 0x37}, // speed  9 f3  00110110 = 0 1 s o   00110111 = 0 1 s 1
+    {0x76, 0x77}, // speed  9 f4  01110110 = s 1 s o   01110111 = s 1 s 1
+   },
+   {{0xf2, 0xb3}, // speed 10 f1  11110010 = 1 1 0 o   10110011 = o 1 0 1 // f1=on jetzt 0101
+    {0xa6, 0xa7}, // speed 10 f2  10100110 = o o s o   10100111 = o o s 1
+    {0xb6, 0xb7}, // speed 10 f3  10110110 = o 1 s o   10110111 = o 1 s 1
+    {0xf6, 0xf7}, // speed 10 f4  11110110 = 1 1 s o   11110111 = 1 1 s 1
+   },
+   {{0x5a, 0x5b}, // speed 11 f1  01011010 = s s o o   01011011 = s s o 1
+    {0x0e, 0x1b}, // speed 11 f2  00001110 = 0 0 1 o   00011011 = 0 s o 1 // f2=on jetzt 0101
+    {0x1e, 0x1f}, // speed 11 f3  00011110 = 0 s 1 o   00011111 = 0 s 1 1
+    {0x5e, 0x5f}, // speed 11 f4  01011110 = s s 1 o   01011111 = s s 1 1
+   },
+   {{0xda, 0xdb}, // speed 12 f1  11011010 = 1 s o o   11011011 = 1 s o 1
+    {0x8e, 0x8f}, // speed 12 f2  10001110 = o 0 1 o   10001111 = o 0 1 1
+    {0x9e, 0x9f}, // speed 12 f3  10011110 = o s 1 o   10011111 = o s 1 1
+    {0xde, 0xdf}, // speed 12 f4  11011110 = 1 s 1 o   11011111 = 1 s 1 1
+   },
+   {{0x7a, 0x7b}, // speed 13 f1  01111010 = s 1 o o   01111011 = s 1 o 1
+    {0x2e, 0x2f}, // speed 13 f2  00101110 = 0 o 1 o   00101111 = 0 o 1 1
+    {0x3e, 0x3b}, // speed 13 f3  00111110 = 0 1 1 o   00111011 = 0 1 o 1 // f3=on jetzt 0101
+    {0x7e, 0x7f}, // speed 13 f4  01111110 = s 1 1 o   01111111 = s 1 1 1
+   },
+   {{0xfa, 0xfb}, // speed 14 f1  11111010 = 1 1 o o   11111011 = 1 1 o 1
+    {0xae, 0xaf}, // speed 14 f2  10101110 = o o 1 o   10101111 = o o 1 1
+    {0xbe, 0xbf}, // speed 14 f3  10111110 = o 1 1 o   10111111 = o 1 1 1
+    {0xfe, 0xbb}, // speed 14 f4  11111110 = 1 1 1 o   10111011 = o 1 o 1 // f4=on jetzt 0101
+   },
+  };
+
+
+static inline uint8_t mm_speed_index(unsigned char speed) {
+  speed &= 0x7F;
+  if (speed == 1) speed = 0;              // e-stop
+  return (speed & 0x0F);
+}
+
+static void build_mm_loco(unsigned int nr, unsigned char fl, t_message *new_message)
+{
+  new_message->type = is_mm;
+  new_message->size = 3;
+  new_message->dcc[0] = pgm_read_byte(&mm_addr_2_trit[nr & 0xFF]);
+  new_message->dcc[1] = fl ? 0xC0 : 0x00;
+}
+
+// step: 0..15, see mm_speed_2_trit (1 = direction change)
+static void build_mm1_loco(unsigned int nr, unsigned char fl, unsigned char step, t_message *new_message)
+{
+  new_message->repeat = dcc_speed_repeat;
+  new_message->key = msg_key_loco(KEY_SPEED, nr);
+  build_mm_loco(nr, fl, new_message);
+  new_message->dcc[2] = pgm_read_byte(&mm_speed_2_trit[step & 0x0F]);
+}
+
+// speed: rail speed (DCC14), msb = direction (1 = forward, as DCC)
+static void build_mm2_loco(unsigned int nr, unsigned char fl, unsigned char speed, t_message *new_message)
+{
+  new_message->repeat = dcc_speed_repeat;
+  new_message->key = msg_key_loco(KEY_SPEED, nr);
+  build_mm_loco(nr, fl, new_message);
+  new_message->dcc[2] = pgm_read_byte(&mm2_speed_dir_2_trit[mm_speed_index(speed)][(speed & 0x80) ? 0 : 1]);
+}
+
+// func: 0..3 = F1..F4, state: 0 = off, 1 = on; every function has its own packet key
+static void build_mm2_function(unsigned int nr, unsigned char fl, unsigned char speed,
+                               unsigned char func, unsigned char state, t_message *new_message)
+{
+  new_message->repeat = dcc_func_repeat;
+  new_message->key = msg_key_loco(KEY_FUNC_GRP1 + func, nr);
+  build_mm_loco(nr, fl, new_message);
+  new_message->dcc[2] = pgm_read_byte(&mm2_speed_funct_2_trit[mm_speed_index(speed)][func & 3][state & 1]);
+}
+#endif // MAERKLIN_ENABLED
+
 //============================================================================
 //
 // 4. LOCAL FUNCTIONS for locobuffer manipulation
 //
 //============================================================================
 
-// TODO SDS2021 : cur_i  dat is een soort state VIES weg ermee
-static unsigned char cur_i;             // this locobuffer entry is currently used
-static unsigned char cur_ref_level;     // level = 0
-
 static t_message loco_search;
 static t_message *loco_search_ptr;
 static t_message locobuff_mes;
 static t_message *locobuff_mes_ptr;
 
-static void init_locobuffer() {
-  unsigned char j;
+// The locobuffer is kept packed, one array per field (structure of arrays):
+//   lb_addr:   bit 13..0: loco address (0 = empty), bit 15..14: format (DCC14 .. DCC128)
+//   lb_speed:  speed, 128 steps + direction (see locomem)
+//   lb_state:  bit 4..0: slot, bit 5: active (in refresh), bit 6: F13..F28 kept in lb_fh,
+//              bit 7: Motorola (format MM1, MM2: bit 2 of the format, MAERKLIN_ENABLED)
+//   lb_func:   bit 0: FL, bit 4..1: F4..F1, bit 8..5: F8..F5, bit 12..9: F12..F9
+//   lb_age:    refresh age, 4 bits per loco (even index: low nibble), counts up to 15
+// F13..F28 are kept only for locos which have one of them on, in a small pool (lb_fh).
+// Other modules get an unpacked copy (locomem) with lb_GetEntry.
+#define LB_ADDR_MASK     0x3FFF
+#define LB_FORMAT_SHIFT  14
+#define LB_SLOT_MASK     0x1F
+#define LB_ACTIVE        0x20
+#define LB_FHIGH         0x40
+#define LB_MM            0x80
+#define LB_FL            0x0001
+#define LB_F_GRP1        0x001F         // FL, F1..F4
+#define LB_F_GRP2        0x01E0
+#define LB_F_GRP3        0x1E00
+#define LB_AGE_MAX       15
+#define LB_NONE          0xFF
+
+static uint16_t lb_addr[SIZE_LOCOBUFFER];
+static uint8_t lb_speed[SIZE_LOCOBUFFER];
+static uint8_t lb_state[SIZE_LOCOBUFFER];
+static uint16_t lb_func[SIZE_LOCOBUFFER];
+static uint8_t lb_age[(SIZE_LOCOBUFFER + 1) / 2];
+
+#if (DCC_F13_F28 == 1)
+static uint8_t lb_fh_owner[SIZE_LOCOBUFFER_FHIGH];      // locobuffer index, LB_NONE = free
+static uint8_t lb_fh_func[SIZE_LOCOBUFFER_FHIGH][2];    // F20..F13, F28..F21
+static uint8_t lb_fh_deficit[SIZE_LOCOBUFFER_FHIGH][2]; // refresh scheduler, see below
+#endif
+
+static locomem lb_view;                 // unpacked copy of one entry
+
+#if (MAERKLIN_ENABLED == 1)
+static uint8_t mm_fchanged;             // F4..F1 changed by the last enter_func_to_locobuffer (grp 1)
+static uint8_t mm2_frot;                // refresh: MM2 function sent last (0..3 = F1..F4)
+#endif
+
+static inline uint16_t lb_address(uint8_t i) {
+  return (lb_addr[i] & LB_ADDR_MASK);
+}
+
+#if (MAERKLIN_ENABLED == 1)
+static inline t_format lb_format(uint8_t i) {
+  return ((lb_addr[i] >> LB_FORMAT_SHIFT) | ((lb_state[i] & LB_MM) ? MM1 : 0));
+}
+
+static inline void lb_set_format(uint8_t i, t_format format) {
+  lb_addr[i] = (lb_addr[i] & LB_ADDR_MASK) | ((uint16_t)(format & 3) << LB_FORMAT_SHIFT);
+  if (format >= MM1) lb_state[i] |= LB_MM;
+  else lb_state[i] &= ~LB_MM;
+}
+#else
+static inline t_format lb_format(uint8_t i) {
+  return (lb_addr[i] >> LB_FORMAT_SHIFT);
+}
+
+static inline void lb_set_format(uint8_t i, t_format format) {
+  lb_addr[i] = (lb_addr[i] & LB_ADDR_MASK) | ((uint16_t)format << LB_FORMAT_SHIFT);
+}
+#endif
+
+static inline uint8_t lb_get_age(uint8_t i) {
+  if (i & 1) return (lb_age[i >> 1] >> 4);
+  return (lb_age[i >> 1] & 0x0F);
+}
+
+static inline void lb_clear_age(uint8_t i) {
+  if (i & 1) lb_age[i >> 1] &= 0x0F;
+  else lb_age[i >> 1] &= 0xF0;
+}
+
+// refresh packets per loco: speed + function groups, indexed by instruction class
+#if (DCC_F13_F28 == 1)
+  #define LB_NUM_PKT    6
+#else
+  #define LB_NUM_PKT    4
+#endif
+
+#if (LOCOBUFFER_PACKET_CACHE == 1)
+// refresh packet cache: every locobuffer entry keeps its speed and function packets
+// ready to send, indexed by instruction class (KEY_SPEED, KEY_FUNC_GRPx).
+// A packet is rebuilt only after enter_xxx_to_locobuffer has changed the loco.
+// (no xor here, dccout adds it on the fly)
+
+typedef struct {
+  uint8_t size;
+  uint8_t dcc[4];               // loco packets are max. 4 bytes
+} t_lb_pkt;
+
+static t_lb_pkt lb_pkt[SIZE_LOCOBUFFER][LB_NUM_PKT];
+static uint8_t lb_pkt_valid[SIZE_LOCOBUFFER];     // bit n set: lb_pkt[][n] is up to date
+
+#define LB_PKT_BIT(iclass)  (1 << (iclass))
+#define lb_pkt_invalidate(lbIndex, mask)  lb_pkt_valid[lbIndex] &= ~(mask)
+#else
+#define lb_pkt_invalidate(lbIndex, mask)
+#endif
+
+// address index for the locobuffer
+// lb_hash:   address -> locobuffer index, open addressing with linear probing
+// lb_fill:   number of used locobuffer entries; entries are filled from 0 upwards
+//            and are never emptied again (only replaced), so 0..lb_fill-1 are in use
+#define LB_HASH_EMPTY   0xFF
+#define LB_HASH_MASK    (SIZE_LOCOBUFFER_HASH - 1)
+
+static uint8_t lb_hash[SIZE_LOCOBUFFER_HASH];
+static uint8_t lb_fill;
+
+static inline uint16_t lb_hash_home(uint16_t locAddress) {
+  return ((locAddress ^ (locAddress >> 7)) & LB_HASH_MASK);
+}
+
+#ifdef NATIVE_BENCH
+// host benchmark only: cost of the searches, see organizer_GetProbes()
+static t_probe_stat probe_stat[PROBE_NUM];
+
+static void probe_count(t_probe_stat *stat, uint8_t n) {
+  stat->lookups++;
+  stat->probes += n;
+  if (n > stat->max) stat->max = n;
+}
+  #define PROBE_START()       uint8_t probes = 1
+  #define PROBE_NEXT()        probes++
+  #define PROBE_DONE(which)   probe_count(&probe_stat[which], probes)
+#else
+  #define PROBE_START()
+  #define PROBE_NEXT()
+  #define PROBE_DONE(which)
+#endif
+
+// return locobuffer index for this address, LB_HASH_EMPTY if not in locobuffer
+static uint8_t lb_hash_find(uint16_t locAddress) {
+  uint16_t h;
+  uint8_t lbIndex;
+  PROBE_START();
+
+  h = lb_hash_home(locAddress);
+  while ((lbIndex = lb_hash[h]) != LB_HASH_EMPTY) {
+    if (lb_address(lbIndex) == locAddress) {
+      PROBE_DONE(PROBE_LB);
+      return (lbIndex);
+    }
+    h = (h + 1) & LB_HASH_MASK;
+    PROBE_NEXT();
+  }
+  PROBE_DONE(PROBE_LB);
+  return (LB_HASH_EMPTY);
+} // lb_hash_find
+
+// add locobuffer entry to the index, its address must be set
+static void lb_index_add(uint8_t lbIndex) {
+  uint16_t h;
+
+  h = lb_hash_home(lb_address(lbIndex));
+  while (lb_hash[h] != LB_HASH_EMPTY) h = (h + 1) & LB_HASH_MASK;
+  lb_hash[h] = lbIndex;
+} // lb_index_add
+
+// remove locobuffer entry from the index, call before its address is overwritten
+// deletion by backward shift -> no tombstones, probe chains stay intact
+static void lb_index_remove(uint8_t lbIndex) {
+  uint16_t h, next, home;
+
+  h = lb_hash_home(lb_address(lbIndex));
+  while (lb_hash[h] != lbIndex) h = (h + 1) & LB_HASH_MASK;
+  next = h;
+  while (1) {
+    next = (next + 1) & LB_HASH_MASK;
+    if (lb_hash[next] == LB_HASH_EMPTY) break;
+    home = lb_hash_home(lb_address(lb_hash[next]));
+    // move up, unless its home lies cyclically between the hole and next
+    if (((next - home) & LB_HASH_MASK) >= ((next - h) & LB_HASH_MASK)) {
+      lb_hash[h] = lb_hash[next];
+      h = next;
+    }
+  }
+  lb_hash[h] = LB_HASH_EMPTY;
+} // lb_index_remove
+
+#if (DCC_F13_F28 == 1)
+// F13..F28 pool: returns the pool entry of this loco, LB_NONE if it has none
+static uint8_t lb_fh_find(uint8_t lbIndex) {
+  uint8_t j;
+
+  if (!(lb_state[lbIndex] & LB_FHIGH)) return (LB_NONE);
+  for (j=0; j<SIZE_LOCOBUFFER_FHIGH; j++)
+    if (lb_fh_owner[j] == lbIndex) return (j);
+  return (LB_NONE);
+} // lb_fh_find
+
+static void lb_fh_free(uint8_t fh) {
+  lb_state[lb_fh_owner[fh]] &= ~LB_FHIGH;
+  lb_fh_owner[fh] = LB_NONE;
+} // lb_fh_free
+
+// get a pool entry for this loco (F13..F28 all off);
+// if the pool is full, the entry of a released loco is taken, the oldest first (its F13..F28 are lost).
+// returns LB_NONE if all entries belong to active locos: they keep their functions
+static uint8_t lb_fh_alloc(uint8_t lbIndex) {
+  uint8_t j, k, age, best = LB_NONE, best_age = 0;
+
+  for (j=0; j<SIZE_LOCOBUFFER_FHIGH; j++) {
+    k = lb_fh_owner[j];
+    if (k == LB_NONE) {
+      best = j;
+      break;
+    }
+    if (lb_state[k] & LB_ACTIVE) continue;
+    age = lb_get_age(k);
+    if ((best == LB_NONE) || (age > best_age)) {
+      best = j;
+      best_age = age;
+    }
+  }
+  if (best == LB_NONE) return (LB_NONE);
+  if (lb_fh_owner[best] != LB_NONE) {
+    lb_pkt_invalidate(lb_fh_owner[best], LB_PKT_BIT(KEY_FUNC_GRP4) | LB_PKT_BIT(KEY_FUNC_GRP5));
+    lb_fh_free(best);
+  }
+  lb_fh_owner[best] = lbIndex;
+  lb_fh_func[best][0] = 0;
+  lb_fh_func[best][1] = 0;
+  lb_fh_deficit[best][0] = 0;
+  lb_fh_deficit[best][1] = 0;
+  lb_state[lbIndex] |= LB_FHIGH;
+  return (best);
+} // lb_fh_alloc
+#endif // DCC_F13_F28
+
+// unpack a locobuffer entry to lb_view
+static locomem * lb_load(uint8_t lbIndex) {
+  uint16_t f = lb_func[lbIndex];
+  #if (DCC_F13_F28 == 1)
+    uint8_t fh;
+  #endif
+
+  lb_view.address = lb_address(lbIndex);
+  lb_view.speed = lb_speed[lbIndex];
+  lb_view.format = lb_format(lbIndex);
+  lb_view.active = (lb_state[lbIndex] & LB_ACTIVE) ? 1 : 0;
+  lb_view.slot = lb_state[lbIndex] & LB_SLOT_MASK;
+  lb_view.funcs = 0;
+  lb_view.fl = f & LB_FL;
+  lb_view.f4_f1 = (f >> 1) & 0x0F;
+  lb_view.f8_f5 = (f >> 5) & 0x0F;
+  lb_view.f12_f9 = (f >> 9) & 0x0F;
+  #if (DCC_F13_F28 == 1)
+    fh = lb_fh_find(lbIndex);
+    if (fh != LB_NONE) {
+      lb_view.f20_f13 = lb_fh_func[fh][0];
+      lb_view.f28_f21 = lb_fh_func[fh][1];
+    }
+  #endif
+  lb_view.refresh = lb_get_age(lbIndex);
+  return (&lb_view);
+} // lb_load
 
-  cur_i = 0;                                           // refresh index
-  cur_ref_level = 0;
+static void init_locobuffer() {
   loco_search_ptr = &loco_search;
   locobuff_mes_ptr = &locobuff_mes;
 
-  for (j=0; j<SIZE_LOCOBUFFER; j++)  {
-    locobuffer[j].address = 0;
-  }
+  memset(lb_addr, 0, sizeof(lb_addr));
+  memset(lb_state, 0, sizeof(lb_state));
+  memset(lb_age, 0, sizeof(lb_age));
+  memset(lb_hash, LB_HASH_EMPTY, sizeof(lb_hash));
+  lb_fill = 0;
+  #if (DCC_F13_F28 == 1)
+    memset(lb_fh_owner, LB_NONE, sizeof(lb_fh_owner));
+  #endif
+  #if (LOCOBUFFER_PACKET_CACHE == 1)
+    memset(lb_pkt_valid, 0, sizeof(lb_pkt_valid));
+  #endif
 } // init_locobuffer
 
 #if (XPRESSNET_ENABLED == 1)
@@ -818,9 +1635,9 @@ void print_lbData(locomem *lbData) {
 
 void print_locobuffer() {
   Serial.println("locobuffer:");
-  for (int i=0;i<SIZE_LOCOBUFFER;i++) {
+  for (int i=0;i<lb_fill;i++) {
     Serial.print(i);Serial.print(": ");
-    print_lbData(&locobuffer[i]);
+    print_lbData(lb_load(i));
     Serial.println();
   }
 }
@@ -830,71 +1647,64 @@ void print_locobuffer() {
 // return:  char: Bit 1 (ORGZ_STOLEN)     1 Falls owner changed
 //          note: .active is not set - thus this loco is not yet in the refresh buffer
 // slot: the new owner, requesting this loco; slot = 0: Host
-// TODO SDS2021 remove code duplication
-static unsigned char lb_PutLocAddress(unsigned char slot, unsigned int locAddress, locomem **lbDataPtr) {
-  unsigned char i, found_i, found_r;
+static unsigned char lb_PutLocAddress(unsigned char slot, unsigned int locAddress, uint8_t *lbIndexPtr) {
+  unsigned char i, r, found_r;
   unsigned char retval = 0;
   uint8_t lbIndex;
 
-  for (i=0; i<SIZE_LOCOBUFFER; i++) { // find same entry
-    if (locobuffer[i].address == locAddress) {
-      lbIndex = i;
-      *lbDataPtr = &locobuffer[lbIndex];
-      if (locobuffer[lbIndex].active) {
-        // check for stolen loc
-        if (locobuffer[lbIndex].slot != slot) { // stealing from another device
-          #if (XPRESSNET_ENABLED == 1)
-            orgz_old_lok_owner = locobuffer[lbIndex].slot;    // save for notify
-          #endif
-          locobuffer[lbIndex].slot = slot;
-          retval = ORGZ_STOLEN;
-        }
-        return(retval);
-      }
-      else {
-        locobuffer[lbIndex].slot = slot;
-        locobuffer[lbIndex].address = locAddress;
-        locobuffer[lbIndex].refresh = 0;
-        locobuffer[lbIndex].format = database_GetLocoFormat(locAddress);
-        //locobuffer[lbIndex].speed = 0; // sds commented 2021 -> reuse settings from when loc was last active (left by previous owner)
-        //locobuffer[lbIndex].funcs = 0;
-        retval = ORGZ_NEW;
-        return(retval);
+  lbIndex = lb_hash_find(locAddress);
+  if (lbIndex != LB_HASH_EMPTY) { // same entry
+    *lbIndexPtr = lbIndex;
+    if (lb_state[lbIndex] & LB_ACTIVE) {
+      // check for stolen loc
+      if ((lb_state[lbIndex] & LB_SLOT_MASK) != slot) { // stealing from another device
+        #if (XPRESSNET_ENABLED == 1)
+          orgz_old_lok_owner = lb_state[lbIndex] & LB_SLOT_MASK;    // save for notify
+        #endif
+        lb_state[lbIndex] = (lb_state[lbIndex] & ~LB_SLOT_MASK) | slot;
+        retval = ORGZ_STOLEN;
       }
+      return(retval);
     }
+    lb_state[lbIndex] = (lb_state[lbIndex] & ~LB_SLOT_MASK) | slot;
+    lb_clear_age(lbIndex);
+    lb_set_format(lbIndex, database_GetLocoFormat(locAddress));
+    lb_pkt_invalidate(lbIndex, LB_PKT_BIT(KEY_SPEED));
+    // speed and functions remain: reuse settings from when loc was last active (left by previous owner)
+    return(ORGZ_NEW);
   }
-  // does not yet exist -> find either empty entry or replace oldest one
-  // find an empty entry
-  for (i=0; i<SIZE_LOCOBUFFER; i++) {
-    if (locobuffer[i].address == 0) {
-      lbIndex = i;
-      *lbDataPtr = &locobuffer[lbIndex];
-      locobuffer[lbIndex].slot = slot;
-      locobuffer[lbIndex].address = locAddress;
-      locobuffer[lbIndex].refresh = 0;
-      locobuffer[lbIndex].format = database_GetLocoFormat(locAddress);
-      locobuffer[lbIndex].speed = 0;
-      locobuffer[lbIndex].funcs = 0;
-      retval = ORGZ_NEW;
-      return(retval);
+  // does not yet exist -> take next empty entry or replace oldest one
+  if (lb_fill < SIZE_LOCOBUFFER) {
+    lbIndex = lb_fill;
+    lb_fill++;
+  }
+  else {
+    // no empty entries available -> overwrite oldest entry, released locos first
+    // (only scan left, and only when a new loco enters a full locobuffer)
+    lbIndex = 0; found_r = 0;
+    for (i=0; i<SIZE_LOCOBUFFER; i++) {
+      r = (lb_get_age(i) << 1) | ((lb_state[i] & LB_ACTIVE) ? 0 : 1);
+      if (r > found_r) {
+        lbIndex = i;
+        found_r = r;
+      }
     }
+    lb_index_remove(lbIndex); // okay, is probably stolen, but who cares? (it is our oldest loco)
+    #if (DCC_F13_F28 == 1)
+      i = lb_fh_find(lbIndex);
+      if (i != LB_NONE) lb_fh_free(i);
+    #endif
   }
-  // no empty entries available -> overwrite oldest entry
-  found_i = 0; found_r = 0;
-  for (i=0; i<SIZE_LOCOBUFFER; i++) {
-    if (locobuffer[i].refresh > found_r)
-      found_i = i; found_r = locobuffer[i].refresh;
-  }
-  lbIndex = found_i;
-  *lbDataPtr = &locobuffer[lbIndex];
-  locobuffer[lbIndex].slot = slot;
-
-  locobuffer[lbIndex].address = locAddress;
-  locobuffer[lbIndex].refresh = 0;
-  locobuffer[lbIndex].format = database_GetLocoFormat(locAddress);
-  locobuffer[lbIndex].speed = 0;
-  locobuffer[lbIndex].funcs = 0;
-  retval = ORGZ_NEW;  // okay, is probably stolen, but who cares? (it is our oldest loco)
+  *lbIndexPtr = lbIndex;
+  lb_addr[lbIndex] = locAddress & LB_ADDR_MASK;
+  lb_state[lbIndex] = slot;
+  lb_set_format(lbIndex, database_GetLocoFormat(locAddress));
+  lb_clear_age(lbIndex);
+  lb_speed[lbIndex] = 0;
+  lb_func[lbIndex] = 0;
+  lb_pkt_invalidate(lbIndex, 0xFF);
+  lb_index_add(lbIndex);
+  retval = ORGZ_NEW;
   return(retval);
 } // lb_PutLocAddress
 
@@ -904,34 +1714,39 @@ static unsigned char lb_PutLocAddress(unsigned char slot, unsigned int locAddres
 //                                        1 falls Richtungswechsel
 //                                        0 falls neue Speed >= alte Speed.
 //                Bit 1 (ORGZ_STOLEN)       1 Falls owner changed
+//                Bit 3 (ORGZ_DIR_CHANGE)   1 falls Richtungswechsel
 // damit kann der Caller den Befehl zum Bremsen in einer anderen queue ablegen.
 static unsigned char enter_speed_f_to_locobuffer(unsigned char slot, unsigned int locAddress,
                                                  unsigned char speed, t_format format, 
-                                                 locomem **lbDataPtr)  
+                                                 uint8_t *lbIndexPtr)  
 {
   unsigned char retval = 0;
-  locomem *lbData;
+  uint8_t i;
 
-  retval = lb_PutLocAddress(slot, locAddress, lbDataPtr);
-  lbData = *lbDataPtr;
-  lbData->active = 1;
+  retval = lb_PutLocAddress(slot, locAddress, lbIndexPtr);
+  i = *lbIndexPtr;
+  lb_state[i] |= LB_ACTIVE;
+  #if (MAERKLIN_ENABLED == 1)
+    if (lb_format(i) >= MM1) format = lb_format(i);   // Motorola is only set by do_loco_format
+  #endif
 
+  lb_pkt_invalidate(i, LB_PKT_BIT(KEY_SPEED));
   if (retval & ORGZ_NEW) {
-    lbData->format = format;
+    lb_set_format(i, format);
     database_PutLocoFormat(locAddress, format);          // !!! unhandled, if store fails!
-    lbData->speed = speed;
+    lb_speed[i] = speed;
     return(retval);
   }
   // same entry
-  if (lbData->format != format) { // got new format -> store it
-    lbData->format = format;                   
+  if (lb_format(i) != format) { // got new format -> store it
+    lb_set_format(i, format);
     database_PutLocoFormat(locAddress, format);          // !!! unhandled, if store fails!
   }
-  lbData->refresh = 0;
-  if ((speed ^ lbData->speed) & 0x80) retval |= ORGZ_SLOW_DOWN;      // dir changed
-  if ((speed & 0x7F) < (lbData->speed & 0x7F)) retval |= ORGZ_SLOW_DOWN;   // brake
+  lb_clear_age(i);
+  if ((speed ^ lb_speed[i]) & 0x80) retval |= ORGZ_SLOW_DOWN | ORGZ_DIR_CHANGE;
+  if ((speed & 0x7F) < (lb_speed[i] & 0x7F)) retval |= ORGZ_SLOW_DOWN;   // brake
   
-  lbData->speed = speed;
+  lb_speed[i] = speed;
   return(retval);
 } // enter_speed_f_to_locobuffer
 
@@ -943,23 +1758,24 @@ static unsigned char enter_speed_f_to_locobuffer(unsigned char slot, unsigned in
 // damit kann der Caller den Befehl zum Bremsen in einer anderen queue ablegen.
 static unsigned char enter_speed_to_locobuffer(unsigned char slot, unsigned int locAddress,
                                                unsigned char speed, 
-                                               locomem **lbDataPtr)  
+                                               uint8_t *lbIndexPtr)  
 {
   unsigned char retval = 0;
-  locomem *lbData;
+  uint8_t i;
 
-  retval = lb_PutLocAddress(slot, locAddress, lbDataPtr);
-  lbData = *lbDataPtr;
-  lbData->active = 1;
+  retval = lb_PutLocAddress(slot, locAddress, lbIndexPtr);
+  i = *lbIndexPtr;
+  lb_state[i] |= LB_ACTIVE;
       
+  lb_pkt_invalidate(i, LB_PKT_BIT(KEY_SPEED));
   // same entry -> check for slow down (dcc commands will be put in high-priority Q)
   if (!(retval & ORGZ_NEW)) {
-    lbData->refresh = 0;
-    if ((speed ^ lbData->speed) & 0x80) retval |= ORGZ_SLOW_DOWN;      // dir changed
-    if ((speed & 0x7F) < (lbData->speed & 0x7F)) retval |= ORGZ_SLOW_DOWN;   // brake
+    lb_clear_age(i);
+    if ((speed ^ lb_speed[i]) & 0x80) retval |= ORGZ_SLOW_DOWN | ORGZ_DIR_CHANGE;
+    if ((speed & 0x7F) < (lb_speed[i] & 0x7F)) retval |= ORGZ_SLOW_DOWN;   // brake
   }
 
-  lbData->speed = speed;
+  lb_speed[i] = speed;
   return(retval);
 } // enter_speed_to_locobuffer
 
@@ -971,26 +1787,49 @@ static unsigned char enter_speed_to_locobuffer(unsigned char slot, unsigned int
 //        1 = f1 - f4
 //        2 = f5 - f8
 //        3 = f9 - f12
+//        4 = f13 - f20 (8 bits), 5 = f21 - f28 (8 bits)
 // return:  byte:  Errorcode - (stolen...)
 static unsigned char enter_func_to_locobuffer(unsigned char slot, unsigned int locAddress, 
                                               unsigned char func, unsigned char grp,
-                                              locomem **lbDataPtr)
+                                              uint8_t *lbIndexPtr)
 {
   unsigned char retval = 0;
-  locomem *lbData;
+  uint8_t i;
+  #if (DCC_F13_F28 == 1)
+    uint8_t fh;
+  #endif
 
-  retval = lb_PutLocAddress(slot, locAddress, lbDataPtr);
-  lbData = *lbDataPtr;
-  lbData->active = 1;
+  retval = lb_PutLocAddress(slot, locAddress, lbIndexPtr);
+  i = *lbIndexPtr;
+  lb_state[i] |= LB_ACTIVE;
   switch (grp) {
     default: break;
-    case 0: lbData->fl = func & 0x01; break;
-    case 1: lbData->f4_f1 = func & 0x0F; break;
-    case 2: lbData->f8_f5 = func & 0x0F; break;
-    case 3: lbData->f12_f9 = func & 0x0F; break;
+    case 0: lb_func[i] = (lb_func[i] & ~LB_FL) | (func & 0x01);   // light is also part of the DCC14 speed packet
+            lb_pkt_invalidate(i, LB_PKT_BIT(KEY_FUNC_GRP1) | LB_PKT_BIT(KEY_SPEED)); break;
+    case 1:
+            #if (MAERKLIN_ENABLED == 1)
+              mm_fchanged = ((lb_func[i] >> 1) ^ func) & 0x0F;
+            #endif
+            lb_func[i] = (lb_func[i] & ~0x001E) | ((uint16_t)(func & 0x0F) << 1);
+            lb_pkt_invalidate(i, LB_PKT_BIT(KEY_FUNC_GRP1)); break;
+    case 2: lb_func[i] = (lb_func[i] & ~LB_F_GRP2) | ((uint16_t)(func & 0x0F) << 5);
+            lb_pkt_invalidate(i, LB_PKT_BIT(KEY_FUNC_GRP2)); break;
+    case 3: lb_func[i] = (lb_func[i] & ~LB_F_GRP3) | ((uint16_t)(func & 0x0F) << 9);
+            lb_pkt_invalidate(i, LB_PKT_BIT(KEY_FUNC_GRP3)); break;
     #if (DCC_F13_F28 == 1)
-    case 4: lbData->f20_f13 = func; break;
-    case 5: lbData->f28_f21 = func; break;
+    case 4:
+    case 5:
+      fh = lb_fh_find(i);
+      if ((fh == LB_NONE) && func) {
+        fh = lb_fh_alloc(i);
+        if (fh == LB_NONE) return (retval | ORGZ_FHIGH_FULL);   // rejected, F13..F28 stay off
+      }
+      if (fh != LB_NONE) {
+        lb_fh_func[fh][grp - 4] = func;
+        if ((lb_fh_func[fh][0] | lb_fh_func[fh][1]) == 0) lb_fh_free(fh);   // all off
+      }
+      lb_pkt_invalidate(i, LB_PKT_BIT(KEY_FUNC_GRP4 + grp - 4));
+      break;
     #endif
   }
   return(retval);
@@ -1087,103 +1926,302 @@ static t_message * build_f5_message_from_locobuffer(locomem *lbData) {
 }
 #endif
 
-#if (DCC_F13_F28 == 1)
-  #define CUR_REF_LEVEL_MAX  10
-#else
-  #define CUR_REF_LEVEL_MAX  6
+#if (MAERKLIN_ENABLED == 1)
+//--------------------------------------------------------------------------------------------
+// Motorola: every packet carries speed and FL. For MM2, KEY_FUNC_GRP1 gives one function packet
+// of the functions which are on (F1..F4 in turn, the decoder keeps the others); all other
+// classes give the speed packet (MM1 has no F1..F4, Motorola has no F5 and up).
+static t_message * build_mm_message_from_locobuffer(uint8_t lbIndex, uint8_t iclass) {
+  unsigned int nr = lb_address(lbIndex);
+  uint8_t fl = lb_func[lbIndex] & LB_FL;
+  uint8_t speed = convert_speed_to_rail(lb_speed[lbIndex], MM2);
+  uint8_t f, j;
+
+  if (lb_format(lbIndex) == MM1) {
+    build_mm1_loco(nr, fl, mm_speed_index(speed), locobuff_mes_ptr);
+    return (locobuff_mes_ptr);
+  }
+  f = (lb_func[lbIndex] >> 1) & 0x0F;     // F4..F1
+  if ((iclass == KEY_FUNC_GRP1) && f) {
+    for (j=0; j<4; j++) {
+      mm2_frot = (mm2_frot + 1) & 3;
+      if (f & (1 << mm2_frot)) break;
+    }
+    build_mm2_function(nr, fl, speed, mm2_frot, 1, locobuff_mes_ptr);
+    return (locobuff_mes_ptr);
+  }
+  build_mm2_loco(nr, fl, speed, locobuff_mes_ptr);
+  return (locobuff_mes_ptr);
+} // build_mm_message_from_locobuffer
 #endif
 
+//--------------------------------------------------------------------------------------------
+// returns the dcc message of this instruction class (KEY_SPEED, KEY_FUNC_GRPx) for a loco,
+// taken from the refresh packet cache if the loco has not changed since it was built.
+// (Motorola locos are built each time, see build_mm_message_from_locobuffer)
+static t_message * get_message_from_locobuffer(uint8_t lbIndex, uint8_t iclass) {
+  t_message *msg;
+  locomem *lbData;
+
+  #if (MAERKLIN_ENABLED == 1)
+    if (lb_format(lbIndex) >= MM1) return (build_mm_message_from_locobuffer(lbIndex, iclass));
+  #endif
+  #if (LOCOBUFFER_PACKET_CACHE == 1)
+    t_lb_pkt *pkt = &lb_pkt[lbIndex][iclass];
+
+    if (lb_pkt_valid[lbIndex] & LB_PKT_BIT(iclass)) {
+      locobuff_mes_ptr->size = pkt->size;
+      memcpy(locobuff_mes_ptr->dcc, pkt->dcc, sizeof(pkt->dcc));
+      if (iclass == KEY_SPEED) {
+        locobuff_mes_ptr->repeat = dcc_speed_repeat;
+        locobuff_mes_ptr->type = is_loco;
+      }
+      else {
+        locobuff_mes_ptr->repeat = dcc_func_repeat;
+        locobuff_mes_ptr->type = is_void;
+      }
+      locobuff_mes_ptr->key = msg_key_loco(iclass, lb_address(lbIndex));
+      return (locobuff_mes_ptr);
+    }
+  #endif
 
-///-----------------------------------------------------------------------------------
-// search_locobuffer returns pointer to dcc message
-// The search result depends on the current searchlevel:
-// level 0..3: refresh only new locos -> speed
-// level 4: refresh all locos -> speed
-// level 5: refresh all locos -> func grp 1
-// level 6: refresh all locos -> speed
-// level 7: refresh all locos -> func grp 2
-// level 8: refresh all locos -> speed
-// level 9: refresh all locos -> func grp 3
-//
+  lbData = lb_load(lbIndex);
+  switch (iclass) {
+    default:
+    case KEY_SPEED:     msg = build_speed_message_from_locobuffer(lbData); break;
+    case KEY_FUNC_GRP1: msg = build_f1_message_from_locobuffer(lbData); break;
+    case KEY_FUNC_GRP2: msg = build_f2_message_from_locobuffer(lbData); break;
+    case KEY_FUNC_GRP3: msg = build_f3_message_from_locobuffer(lbData); break;
+  #if (DCC_F13_F28 == 1)
+    case KEY_FUNC_GRP4: msg = build_f4_message_from_locobuffer(lbData); break;
+    case KEY_FUNC_GRP5: msg = build_f5_message_from_locobuffer(lbData); break;
+  #endif
+  }
+
+  #if (LOCOBUFFER_PACKET_CACHE == 1)
+    if (msg == locobuff_mes_ptr) { // not for idle (unknown format)
+      pkt->size = msg->size;
+      memcpy(pkt->dcc, msg->dcc, sizeof(pkt->dcc));
+      lb_pkt_valid[lbIndex] |= LB_PKT_BIT(iclass);
+    }
+  #endif
+  return (msg);
+} // get_message_from_locobuffer
+
+//--------------------------------------------------------------------------------------------
+// refresh scheduler (weighted round robin with deficit counter)
 //
-// TODO SDS2021 : cleanup mogelijk? cur_i etc is vies!!
-static t_message * get_next_item_from_locobuffer() {
-  unsigned char wrap = 0;
+// Every loco in the locobuffer has one refresh flow per packet type (speed, function groups).
+// The weight of a flow depends on the packet type, on motion (speed != 0) and on recency
+// (age in lb_age), see the CVs eadr_refresh_xxx. Function groups that are all off have
+// weight 0, they are not refreshed.
+// The scheduler runs round robin over all flows; each visit adds the weight to the deficit
+// of the flow; a packet is sent when the deficit has reached rs_cost. rs_cost is the highest
+// weight of the previous round, so the heaviest flow is sent every round and the others
+// pro rata -> no flow starves, and the rail is never left idle while there is work.
+// A loco is not refreshed twice in a row (decoder needs some time between its packets).
+// Only the used entries (0..lb_fill-1) are visited; the deficits of F13..F28 are kept in
+// the pool (lb_fh_deficit).
+
+#define RS_NUM_DEFICIT    4             // flows with a deficit per loco: speed, FL..F12
+#define RS_WEIGHT_MAX     127           // deficit + weight must fit into a byte
+#define RS_AGE_ROUNDS     10            // age all locos every 10 rounds
+#define RS_NONE           0xFF
+
+static uint8_t rs_deficit[SIZE_LOCOBUFFER][RS_NUM_DEFICIT];
+static uint8_t rs_loco;                 // current flow: locobuffer index
+static uint8_t rs_class;                //               instruction class
+static uint8_t rs_last_loco;            // loco of the previous refresh packet
+static uint8_t rs_cost;                 // deficit needed to send a packet
+static uint8_t rs_wmax;                 // highest weight seen in this round
+static uint8_t rs_round;                // round counter, for aging
+static bool rs_dummy;                   // toggles, to send a railcom dummy packet now and then
+static uint8_t rs_queued;               // packets from queues and repeatbuffer since the last refresh
+
+static uint8_t rs_weight_speed_run;     // from eeprom
+static uint8_t rs_weight_speed_stop;
+static uint8_t rs_weight_func;
+static uint8_t rs_weight_func_high;
+static uint8_t rs_recent;
+
+// the RAM budget in config.h must match the storage of the locobuffer
+#if (DCC_F13_F28 == 1)
+  #define LB_FH_SIZE  (sizeof(lb_fh_owner) + sizeof(lb_fh_func) + sizeof(lb_fh_deficit))
+#else
+  #define LB_FH_SIZE  0
+#endif
+static_assert(sizeof(lb_addr) + sizeof(lb_speed) + sizeof(lb_state) + sizeof(lb_func) + sizeof(rs_deficit) +
+              sizeof(lb_age) + sizeof(lb_hash) + LB_FH_SIZE == RAM_LOCOBUFFER,
+              "RAM_LOCOBUFFER / SIZE_LOCOBUFFER_ENTRY (config.h) do not match the locobuffer");
+
+// 0 (would never refresh) and 0xFF (erased eeprom) -> default weight
+static uint8_t rs_read_weight(unsigned char *eadr, uint8_t dflt) {
+  uint8_t w = eeprom_read_byte(eadr);
+  if ((w == 0) || (w == 0xFF)) return (dflt);
+  return (w > RS_WEIGHT_MAX ? RS_WEIGHT_MAX : w);
+}
 
-  loco_search_ptr = &loco_search;
-  while(1) {
-    cur_i += 1;
-    if (cur_i >= SIZE_LOCOBUFFER) {
-      if (wrap > 1) { // a complete line was empty
-        cur_i = SIZE_LOCOBUFFER;
-        if (cur_ref_level <= 2) { // no lok at all
-          build_loko_7a28s(3, 0, loco_search_ptr);    // dummy to enable railcom feedback
-          return(loco_search_ptr);
-        }
-        return(&DCC_Idle);
+static void init_refresh_scheduler() {
+  rs_weight_speed_run = rs_read_weight((unsigned char *)eadr_refresh_speed_run, REFRESH_WEIGHT_SPEED_RUN);
+  rs_weight_speed_stop = rs_read_weight((unsigned char *)eadr_refresh_speed_stop, REFRESH_WEIGHT_SPEED_STOP);
+  rs_weight_func = rs_read_weight((unsigned char *)eadr_refresh_func, REFRESH_WEIGHT_FUNC);
+  rs_weight_func_high = rs_read_weight((unsigned char *)eadr_refresh_func_high, REFRESH_WEIGHT_FUNC_HIGH);
+  rs_recent = eeprom_read_byte((unsigned char *)eadr_refresh_recent);
+  if (rs_recent > LB_AGE_MAX) rs_recent = LB_AGE_MAX;
+
+  memset(rs_deficit, 0, sizeof(rs_deficit));
+  rs_loco = 0;
+  rs_class = 0;
+  rs_last_loco = RS_NONE;
+  rs_cost = 1;
+  rs_wmax = 0;
+  rs_round = 0;
+  rs_queued = 0;
+} // init_refresh_scheduler
+
+// weight of a refresh flow, 0 = nothing to refresh
+// fh: pool entry of the loco (only for KEY_FUNC_GRP4, KEY_FUNC_GRP5)
+static uint8_t rs_weight(uint8_t lbIndex, uint8_t iclass, uint8_t fh) {
+  uint8_t w;
+
+  switch (iclass) {
+    default:
+    case KEY_SPEED:
+      w = (lb_speed[lbIndex] & 0x7F) ? rs_weight_speed_run : rs_weight_speed_stop;
+      break;
+    case KEY_FUNC_GRP1:
+      if (!(lb_func[lbIndex] & LB_F_GRP1)) return (0);
+      w = rs_weight_func;
+      break;
+    case KEY_FUNC_GRP2:
+      if (!(lb_func[lbIndex] & LB_F_GRP2)) return (0);
+      w = rs_weight_func;
+      break;
+    case KEY_FUNC_GRP3:
+      if (!(lb_func[lbIndex] & LB_F_GRP3)) return (0);
+      w = rs_weight_func;
+      break;
+  #if (DCC_F13_F28 == 1)
+    case KEY_FUNC_GRP4:
+    case KEY_FUNC_GRP5:
+      if (lb_fh_func[fh][iclass - KEY_FUNC_GRP4] == 0) return (0);
+      w = rs_weight_func_high;
+      break;
+  #endif
+  }
+  #if (MAERKLIN_ENABLED == 1)
+    if (lb_state[lbIndex] & LB_MM) {
+      // Motorola: FL is in the speed packet, only MM2 has F1..F4; a packet pair takes
+      // the rail about twice as long as a dcc packet -> half the weight, same share of the rail
+      if (iclass != KEY_SPEED) {
+        if ((iclass != KEY_FUNC_GRP1) || (lb_format(lbIndex) != MM2) || !(lb_func[lbIndex] & (LB_F_GRP1 & ~LB_FL)))
+          return (0);
       }
-      cur_i = 0;
-      wrap++;
-      cur_ref_level++;   // with higher level
-      if (cur_ref_level == CUR_REF_LEVEL_MAX) {
-        // level has reached top: now fade out all refresh levels.
-        cur_ref_level = 0;
-        unsigned char j; 
-        for (j=0; j<SIZE_LOCOBUFFER; j++) {
-          unsigned char temp;
-          temp = locobuffer[j].refresh + 1;         // nicht elegant, aber schnell
-          if (temp > 200) temp = 200;
-          locobuffer[j].refresh = temp;
-        }
+      w = (w + 1) >> 1;
+    }
+  #endif
+  if (lb_get_age(lbIndex) < rs_recent) {  // recently commanded -> double weight
+    w = w << 1;
+    if (w > RS_WEIGHT_MAX) w = RS_WEIGHT_MAX;
+  }
+  return (w);
+} // rs_weight
+
+// end of a round: adapt cost, age the locos (two per byte, each saturates at LB_AGE_MAX)
+static void rs_next_round() {
+  unsigned char j, a;
+
+  rs_cost = rs_wmax ? rs_wmax : 1;
+  rs_wmax = 0;
+  rs_round++;
+  if (rs_round == RS_AGE_ROUNDS) {
+    rs_round = 0;
+    for (j=0; j<sizeof(lb_age); j++) {
+      a = lb_age[j];
+      if ((a & 0x0F) != LB_AGE_MAX) a += 0x01;
+      if ((a & 0xF0) != (LB_AGE_MAX << 4)) a += 0x10;
+      lb_age[j] = a;
+    }
+  }
+} // rs_next_round
+
+///-----------------------------------------------------------------------------------
+// search_locobuffer returns pointer to the next dcc refresh message
+// at most two rounds are visited: the heaviest flow sends at least once per round.
+// returns idle, if the only loco due is the one refreshed just before.
+// idle = false: called between queued packets (REFRESH_SHARE), returns NULL instead of idle
+static t_message * search_locobuffer(bool idle) {
+  uint16_t visits;
+  uint8_t w, d, fh = LB_NONE;
+  uint8_t *deficit;
+  bool found = false;                   // any loco to refresh?
+  uint8_t held_loco = RS_NONE, held_class = 0;    // first flow due, but same loco as before
+
+  if (rs_loco >= lb_fill) rs_loco = 0;  // after organizer_Init
+  if (rs_queued) rs_last_loco = RS_NONE;  // other packets in between
+  for (visits = 0; visits < 2 * LB_NUM_PKT * (uint16_t)lb_fill; visits++) {
+    rs_class++;
+    if (rs_class >= LB_NUM_PKT) {
+      rs_class = 0;
+      rs_loco++;
+      if (rs_loco >= lb_fill) {
+        rs_loco = 0;
+        rs_next_round();
       }
     }
-    if (locobuffer[cur_i].active && (locobuffer[cur_i].address != 0)) {
-      if (cur_ref_level & 0x01) {
-        switch (cur_ref_level >> 1) {
-          default:
-            case 0:
-              if ((locobuffer[cur_i].fl != 0) || (locobuffer[cur_i].f4_f1 != 0))
-                return(build_f1_message_from_locobuffer(&locobuffer[cur_i]));
-              break;
-            case 1:
-              if (locobuffer[cur_i].f8_f5 != 0)
-                return(build_f2_message_from_locobuffer(&locobuffer[cur_i]));
-              break;
-            case 2:
-              if (locobuffer[cur_i].f12_f9 != 0)
-                return(build_f3_message_from_locobuffer(&locobuffer[cur_i]));
-              break;
-          #if (DCC_F13_F28 == 1)
-            case 3:
-              if (locobuffer[cur_i].f20_f13 != 0)
-                return(build_f4_message_from_locobuffer(&locobuffer[cur_i]));
-              break;
-            case 4:
-              if (locobuffer[cur_i].f28_f21 != 0)
-                return(build_f5_message_from_locobuffer(&locobuffer[cur_i]));
-              break;
-          #endif
-        }
+    if (!(lb_state[rs_loco] & LB_ACTIVE)) {       // released: skip all flows of this loco
+      memset(rs_deficit[rs_loco], 0, RS_NUM_DEFICIT);
+      rs_class = LB_NUM_PKT - 1;
+      continue;
+    }
+  #if (DCC_F13_F28 == 1)
+    if (rs_class >= KEY_FUNC_GRP4) {
+      fh = lb_fh_find(rs_loco);
+      if (fh == LB_NONE) continue;              // F13..F28 all off
+      deficit = &lb_fh_deficit[fh][rs_class - KEY_FUNC_GRP4];
+    }
+    else
+  #endif
+      deficit = &rs_deficit[rs_loco][rs_class];
+    w = rs_weight(rs_loco, rs_class, fh);
+    if (w == 0) {
+      *deficit = 0;
+      continue;
+    }
+    found = true;
+    if (w > rs_wmax) rs_wmax = w;
+    d = *deficit;
+    if (d < rs_cost) d += w;
+    if (d >= rs_cost) {
+      if (rs_loco != rs_last_loco) {
+        *deficit = d - rs_cost;
+        rs_last_loco = rs_loco;
+        return (get_message_from_locobuffer(rs_loco, rs_class));
+      }
+      if (held_loco == RS_NONE) {
+        held_loco = rs_loco;
+        held_class = rs_class;
       }
-      else
-        return(build_speed_message_from_locobuffer(&locobuffer[cur_i]));
     }
+    *deficit = d;                         // keep the credit
   }
-//     return (&DCC_Idle);                   // void
-} // get_next_item_from_locobuffer
 
-static t_message * search_locobuffer() {
-  t_message *my_search_ptr;
-  unsigned char old_i;
-
-  old_i = cur_i;
-  my_search_ptr = get_next_item_from_locobuffer();
-  if (old_i == cur_i) {
-    if (cur_ref_level > 0) cur_ref_level--;     // back one level
-    cur_i = SIZE_LOCOBUFFER+1;                  // set to max -> void
-    return(&DCC_Idle);
+  if (held_loco != RS_NONE) {           // next search starts with the held flow, otherwise
+    rs_loco = held_loco;                // a single loco would always send the same flow
+    rs_class = held_class - 1;          // (incremented first, 0 - 1 wraps to 0xFF -> 0)
+  }
+  if (!idle) {                          // a queued packet follows, try again after REFRESH_SHARE
+    rs_queued = 0;
+    return (NULL);
+  }
+  rs_last_loco = RS_NONE;
+  rs_dummy = !rs_dummy;
+  if (!found && rs_dummy) { // no lok at all, every other packet
+    loco_search_ptr = &loco_search;
+    build_loko_7a28s(3, 0, loco_search_ptr);    // dummy to enable railcom feedback
+    return (loco_search_ptr);
   }
-  return(my_search_ptr);
+  return (&DCC_Idle);
 } // search_locobuffer
 
 //==========================================================================================
@@ -1206,51 +2244,161 @@ static unsigned char hp_write;    // points to next write
 
 static unsigned char lp_read;     // points to next read
 static unsigned char lp_write;    // points to next write
+
+#if (CMD_LATENCY == 1)
+static t_cmdlat_stamp hp_stamp[SIZE_QUEUE_HP];   // origin and arrival of queue_hp[]
+static t_cmdlat_stamp lp_stamp[SIZE_QUEUE_LP];
+static t_cmdlat_stamp ring_stamp;                // for the next put_in_dcc_ring()
+#define CMDLAT_FORWARD(stamp)   ring_stamp = stamp
+#else
+#define CMDLAT_FORWARD(stamp)
+#endif
                                   // rd = wr: queue empty
                                   // rd = wr + 1: queue full
 
+//-----------------------------------------------------------------------------------
+// packet pool: the dcc bytes of the queue and repeatbuffer entries
+//
+// two slot classes: small slots take packets up to 3 bytes (short address speed and
+// functions, accessories), large slots MAX_DCC_SIZE (long address, pom, 128 steps).
+// A small packet takes a large slot if the small ones are out. Free slots are linked
+// through their first byte. A slot has one owner: the queue entry, then the
+// repeatbuffer entry the message moves to, until its repeats are done.
+// If the pool is exhausted, the repeatbuffer gives up the entry with the lowest
+// repeat count (rb_evict). organizer_IsReady() keeps PKT_RESERVE large slots out of
+// the queues, thus an accepted command always gets its slot.
+#define PKT_NONE        0xFF
+#define PKT_SMALL_SIZE  3
+#define PKT_LARGE       SIZE_PKT_POOL_SMALL       // index of the first large slot
+#define PKT_SLOTS       (SIZE_PKT_POOL_SMALL + SIZE_PKT_POOL_LARGE)
+#define PKT_RESERVE     2                         // one command + one broadcast
+
+static uint8_t pkt_pool[SIZE_PKT_POOL_SMALL * PKT_SMALL_SIZE + SIZE_PKT_POOL_LARGE * MAX_DCC_SIZE];
+static uint8_t pkt_free_small;    // head of the free lists
+static uint8_t pkt_free_large;
+static uint8_t pkt_queued_large;  // large slots held by the queues (not by the repeatbuffer)
+#ifdef NATIVE_BENCH
+static uint16_t pkt_evictions;
+#endif
+
+static bool rb_evict(bool large);
+
+static inline uint8_t *pkt_data(uint8_t p) {
+  if (p < PKT_LARGE) return (&pkt_pool[p * PKT_SMALL_SIZE]);
+  return (&pkt_pool[SIZE_PKT_POOL_SMALL * PKT_SMALL_SIZE + (p - PKT_LARGE) * MAX_DCC_SIZE]);
+}
+
+static void pkt_free(uint8_t p) {
+  if (p == PKT_NONE) return;
+  if (p < PKT_LARGE) {
+    *pkt_data(p) = pkt_free_small;
+    pkt_free_small = p;
+  }
+  else {
+    *pkt_data(p) = pkt_free_large;
+    pkt_free_large = p;
+  }
+} // pkt_free
+
+static uint8_t pkt_alloc(uint8_t size) {
+  uint8_t p;
+
+  while (1) {
+    if ((size <= PKT_SMALL_SIZE) && (pkt_free_small != PKT_NONE)) {
+      p = pkt_free_small;
+      pkt_free_small = *pkt_data(p);
+      return (p);
+    }
+    if (pkt_free_large != PKT_NONE) {
+      p = pkt_free_large;
+      pkt_free_large = *pkt_data(p);
+      return (p);
+    }
+    if (!rb_evict(size > PKT_SMALL_SIZE)) return (PKT_NONE);
+  }
+} // pkt_alloc
+
+static void init_pkt_pool() {
+  uint8_t p;
+
+  pkt_free_small = PKT_NONE;
+  pkt_free_large = PKT_NONE;
+  for (p = 0; p < PKT_SLOTS; p++) pkt_free(p);
+  pkt_queued_large = 0;
+#ifdef NATIVE_BENCH
+  pkt_evictions = 0;
+#endif
+} // init_pkt_pool
+
+// store the message in a queue entry; returns 0 if the pool is exhausted
+static bool qentry_put(t_qentry *entry, t_message *new_message) {
+  uint8_t p;
+
+  p = pkt_alloc(new_message->size);
+  if (p == PKT_NONE) return(0);
+  if (p >= PKT_LARGE) pkt_queued_large++;
+  memcpy(pkt_data(p), new_message->dcc, new_message->size);
+  entry->repeat = new_message->repeat;
+  entry->qualifier = new_message->qualifier;   // both type and size
+  entry->key = new_message->key;
+  entry->pkt = p;
+  return(1);
+} // qentry_put
+
+// replace the message of a queue entry (same key); returns 0 if the pool is exhausted
+static bool qentry_replace(t_qentry *entry, t_message *new_message) {
+  uint8_t p;
+
+  p = entry->pkt;
+  if ((new_message->size > PKT_SMALL_SIZE) && (p < PKT_LARGE)) {   // does not fit any more
+    p = pkt_alloc(new_message->size);
+    if (p == PKT_NONE) return(0);
+    pkt_free(entry->pkt);
+    pkt_queued_large++;
+    entry->pkt = p;
+  }
+  memcpy(pkt_data(p), new_message->dcc, new_message->size);
+  entry->repeat = new_message->repeat;
+  entry->qualifier = new_message->qualifier;
+  return(1);
+} // qentry_replace
+
+// the queue gives up the packet of this entry (to the repeatbuffer or to the pool)
+static uint8_t qentry_take(t_qentry *entry) {
+  uint8_t p;
+
+  p = entry->pkt;
+  if ((p >= PKT_LARGE) && (p != PKT_NONE)) pkt_queued_large--;
+  entry->pkt = PKT_NONE;
+  return(p);
+} // qentry_take
+
+static void qentry_get(t_qentry *entry, t_message *msg) {
+  msg->repeat = entry->repeat;
+  msg->qualifier = entry->qualifier;
+  msg->key = entry->key;
+  memcpy(msg->dcc, pkt_data(entry->pkt), entry->size);
+} // qentry_get
+
+// a put despite full has overwritten the queue (rd = wr): all its packets go back to the pool
+static void flush_queue(t_qentry *queue, uint8_t num) {
+  uint8_t i;
+
+  for (i = 0; i < num; i++) pkt_free(qentry_take(&queue[i]));
+} // flush_queue
 
 // return TRUE if found and replaced, return false, if not found
+// only loco messages are coalesced, accessory commands must all reach the rail
 static bool find_in_queue_lp(t_message *new_message) {
   unsigned char my_i;
 
+  if ((new_message->key == 0) || (new_message->key >= MSG_KEY_ACC_BASE)) return(0);
   my_i = lp_read;
   while (my_i != lp_write) {
-    if (queue_lp[my_i].dcc[0] == new_message->dcc[0]) {
-      // same adr found, is it short / long? and is it speed command?
-      // if yes, replace it and return
-      if (queue_lp[my_i].dcc[0] < 112) {               // short adr.
-        if ( (queue_lp[my_i].dcc[1] == 0x3F)  &&   // (128 Speed Steps)
-             (new_message->dcc[1] == 0x3F) ) 
-        {
-          queue_lp[my_i].dcc[2] = new_message->dcc[2]; 
-          return(1);
-        }
-        else if ( ((queue_lp[my_i].dcc[1] & 0x40) == 0x40) &&   // (28 Speed Steps)
-                  ((new_message->dcc[1] & 0x40) == 0x40) )
-        {
-          queue_lp[my_i].dcc[1] = new_message->dcc[1];
-          return(1);
-        }
-      }
-      else if ( (queue_lp[my_i].dcc[0] >= 192) &&
-                (queue_lp[my_i].dcc[0] < 232)  )
-      {
-        if (queue_lp[my_i].dcc[1] == new_message->dcc[1]) { // long addr
-          if ( (queue_lp[my_i].dcc[2] == 0x3F)  &&   // (128 Speed Steps)
-                (new_message->dcc[2] == 0x3F) ) 
-          {
-            queue_lp[my_i].dcc[3] = new_message->dcc[3]; 
-            return(1);
-          }
-          else if ( ((queue_lp[my_i].dcc[2] & 0x40) == 0x40) &&   // (28 Speed Steps)
-                    ((new_message->dcc[2] & 0x40) == 0x40) )
-          {
-            queue_lp[my_i].dcc[2] = new_message->dcc[2];
-            return(1);
-          }
-        }
-      }
+    if (queue_lp[my_i].key == new_message->key) { // same loco, same instruction -> replace it
+      if (!qentry_replace(&queue_lp[my_i], new_message)) return(0);
+      CMDLAT_TAKE(lp_stamp[my_i]);
+      return(1);
     }
     my_i++;
     if (my_i == SIZE_QUEUE_LP) my_i = 0;
@@ -1269,13 +2417,12 @@ static unsigned char put_in_queue_lp(t_message *new_message) {
   if (find_in_queue_lp(new_message)) return(0);
 
   // now feed in queue_lp
-  // queue_lp[lp_write].repeat = new_message->repeat;
-  // queue_lp[lp_write].qualifier = new_message->qualifier;   // both type and size
-  // memcpy(queue_lp[lp_write].dcc, new_message->dcc, new_message->size);
-  memcpy(&queue_lp[lp_write], new_message, sizeof(t_message));
+  if (!qentry_put(&queue_lp[lp_write], new_message)) return(ORGZ_FULL);   // packet pool exhausted
+  CMDLAT_TAKE(lp_stamp[lp_write]);
 
   lp_write++;
   if (lp_write == SIZE_QUEUE_LP) lp_write = 0;
+  if (lp_write == lp_read) flush_queue(queue_lp, SIZE_QUEUE_LP);
 
   // check for full (with reserved entry)
   i = lp_write+1;
@@ -1289,46 +2436,17 @@ static unsigned char put_in_queue_lp(t_message *new_message) {
 } // put_in_queue_lp
 
 // return TRUE if found and replaced, return false, if not found
+// only loco messages are coalesced, accessory commands must all reach the rail
 static bool find_in_queue_hp(t_message *new_message) {
   unsigned char my_i;
 
+  if ((new_message->key == 0) || (new_message->key >= MSG_KEY_ACC_BASE)) return(0);
   my_i = hp_read;
   while (my_i != hp_write) {
-    if (queue_hp[my_i].dcc[0] == new_message->dcc[0]) {
-      // same adr found, is it short / long? and is it speed command?
-      // if yes, replace it and return
-      if (queue_hp[my_i].dcc[0] < 112) { // short adr.
-        if ( (queue_hp[my_i].dcc[1] == 0x3F)  &&   // (128 Speed Steps)
-              (new_message->dcc[1] == 0x3F) ) 
-        {
-          queue_hp[my_i].dcc[2] = new_message->dcc[2]; 
-          return(1);
-        }
-        else if ( ((queue_hp[my_i].dcc[1] & 0x40) == 0x40) &&   // (28 Speed Steps)
-                  ((new_message->dcc[1] & 0x40) == 0x40) )
-        {
-          queue_hp[my_i].dcc[1] = new_message->dcc[1];
-          return(1);
-        }
-      }
-      else if ( (queue_hp[my_i].dcc[0] >= 192) &&
-                (queue_hp[my_i].dcc[0] < 232)  )
-      {
-        if (queue_hp[my_i].dcc[1] == new_message->dcc[1]) { // long addr
-          if ( (queue_hp[my_i].dcc[2] == 0x3F)  &&   // (128 Speed Steps)
-                (new_message->dcc[2] == 0x3F) ) 
-          {
-            queue_hp[my_i].dcc[3] = new_message->dcc[3]; 
-            return(1);
-          }
-          else if ( ((queue_hp[my_i].dcc[2] & 0x40) == 0x40) &&   // (28 Speed Steps)
-                    ((new_message->dcc[2] & 0x40) == 0x40) )
-          {
-            queue_hp[my_i].dcc[2] = new_message->dcc[2];
-            return(1);
-          }
-        }
-      }
+    if (queue_hp[my_i].key == new_message->key) { // same loco, same instruction -> replace it
+      if (!qentry_replace(&queue_hp[my_i], new_message)) return(0);
+      CMDLAT_TAKE(hp_stamp[my_i]);
+      return(1);
     }
     my_i++;
     if (my_i == SIZE_QUEUE_HP) my_i = 0;
@@ -1347,13 +2465,12 @@ static unsigned char put_in_queue_hp(t_message *new_message) {
   if (find_in_queue_hp(new_message)) return(0);
 
   // now feed in queue hp (high priority)
-  // queue_hp[hp_write].repeat = new_message->repeat;
-  // queue_hp[hp_write].qualifier = new_message->qualifier;
-  // memcpy(queue_hp[hp_write].dcc, new_message->dcc, new_message->size);
-  memcpy(&queue_hp[hp_write], new_message, sizeof(t_message));
+  if (!qentry_put(&queue_hp[hp_write], new_message)) return(ORGZ_FULL);   // packet pool exhausted
+  CMDLAT_TAKE(hp_stamp[hp_write]);   // the first message of a command takes the stamp
 
   hp_write++;
   if (hp_write == SIZE_QUEUE_HP) hp_write = 0;
+  if (hp_write == hp_read) flush_queue(queue_hp, SIZE_QUEUE_HP);
 
   // check for full (with reserved entry)
   i = hp_write + 1;
@@ -1369,7 +2486,7 @@ static unsigned char put_in_queue_hp(t_message *new_message) {
 static unsigned char put_in_queue_low(t_message *new_message) {
   bool retval = 0;
 
-  switch(opendcc_state) {
+  switch(main_track_state) {      // PROG_TRACK_CONCURRENT: always RUN_xxx
     case RUN_OKAY:             // DCC running
     case RUN_STOP:             // DCC Running, all Engines Emergency Stop
     case RUN_OFF:              // Output disabled (2*Taste, PC)
@@ -1385,153 +2502,252 @@ static unsigned char put_in_queue_low(t_message *new_message) {
       if (!prog_event.busy)   // wenn da gerade nichts lauft, dann konnen wir.
         retval = put_in_queue_prog(new_message);
       break;
+
+    case INIT:                 // not yet started, nothing is queued
+      break;
   }
   return(retval);
 } // put_in_queue_low
 
 //-----------------------------------------------------------------------------------
-// search_repeatbuffer: scans the repeat queue for the message with the highest repeat req.
+// repeatbuffer priority structure
+//
+// every repeatbuffer entry is linked into the bucket of its remaining repeat count
+// (circular double linked list, new entries at the tail); bucket 0 holds the free entries.
+// repeat counts >= NUM_REPEAT_BUCKETS-1 share the top bucket and are served round robin.
+// Messages with a packet key are found in rb_hash (open addressing) for replacement.
+// Thus selecting the next repeat and replacing a message need no scan of the repeatbuffer.
+#define RB_NONE   0xFF
+#define RB_HASH_MASK    (SIZE_REPEATBUFFER_HASH - 1)
+
+static uint8_t rb_next[SIZE_REPEATBUFFER];
+static uint8_t rb_prev[SIZE_REPEATBUFFER];
+static uint8_t rb_head[NUM_REPEAT_BUCKETS];
+static uint8_t rb_top;                          // highest bucket that may be non empty
+static uint8_t rb_hash[SIZE_REPEATBUFFER_HASH];
+
+static inline uint8_t rb_bucket(uint8_t repeat) {
+  return (repeat < (NUM_REPEAT_BUCKETS - 1) ? repeat : (NUM_REPEAT_BUCKETS - 1));
+}
+
+static inline uint8_t rb_hash_home(uint16_t key) {
+  return ((key ^ (key >> 5) ^ (key >> 11)) & RB_HASH_MASK);
+}
+
+static uint8_t rb_hash_find(uint16_t key) {
+  uint8_t h, i;
+  PROBE_START();
+
+  h = rb_hash_home(key);
+  while ((i = rb_hash[h]) != RB_NONE) {
+    if (repeatbuffer[i].key == key) {
+      PROBE_DONE(PROBE_RB_FIND);
+      return (i);
+    }
+    h = (h + 1) & RB_HASH_MASK;
+    PROBE_NEXT();
+  }
+  PROBE_DONE(PROBE_RB_FIND);
+  return (RB_NONE);
+} // rb_hash_find
+
+static void rb_hash_add(uint8_t i, uint16_t key) {
+  uint8_t h;
+
+  h = rb_hash_home(key);
+  while (rb_hash[h] != RB_NONE) h = (h + 1) & RB_HASH_MASK;
+  rb_hash[h] = i;
+} // rb_hash_add
+
+// call before repeatbuffer[i] is overwritten; backward shift deletion, no tombstones
+static void rb_hash_remove(uint8_t i) {
+  uint16_t key;
+  uint8_t h, next, home;
+
+  key = repeatbuffer[i].key;
+  if (key == 0) return;
+  h = rb_hash_home(key);
+  while (rb_hash[h] != i) h = (h + 1) & RB_HASH_MASK;
+  next = h;
+  while (1) {
+    next = (next + 1) & RB_HASH_MASK;
+    if (rb_hash[next] == RB_NONE) break;
+    home = rb_hash_home(repeatbuffer[rb_hash[next]].key);
+    if (((next - home) & RB_HASH_MASK) >= ((next - h) & RB_HASH_MASK)) {
+      rb_hash[h] = rb_hash[next];
+      h = next;
+    }
+  }
+  rb_hash[h] = RB_NONE;
+} // rb_hash_remove
+
+// remove entry from its bucket; .repeat must be unchanged since rb_link
+static void rb_unlink(uint8_t i) {
+  uint8_t b = rb_bucket(repeatbuffer[i].repeat);
+
+  if (rb_next[i] == i) {
+    rb_head[b] = RB_NONE;
+  }
+  else {
+    rb_next[rb_prev[i]] = rb_next[i];
+    rb_prev[rb_next[i]] = rb_prev[i];
+    if (rb_head[b] == i) rb_head[b] = rb_next[i];
+  }
+} // rb_unlink
+
+// append entry at the tail of the bucket for its .repeat
+static void rb_link(uint8_t i) {
+  uint8_t b = rb_bucket(repeatbuffer[i].repeat);
+  uint8_t h = rb_head[b];
+
+  if (h == RB_NONE) {
+    rb_head[b] = i;
+    rb_next[i] = i;
+    rb_prev[i] = i;
+  }
+  else {
+    rb_next[rb_prev[h]] = i;
+    rb_prev[i] = rb_prev[h];
+    rb_next[i] = h;
+    rb_prev[h] = i;
+  }
+  if (b > rb_top) rb_top = b;
+} // rb_link
+
+static void init_repeatbuffer() {
+  unsigned char i;
+
+  memset(rb_head, RB_NONE, sizeof(rb_head));
+  memset(rb_hash, RB_NONE, sizeof(rb_hash));
+  rb_top = 0;
+  for (i=0; i<SIZE_REPEATBUFFER; i++) {
+    repeatbuffer[i].repeat = 0;
+    repeatbuffer[i].type   = is_void;
+    repeatbuffer[i].key    = 0;
+    repeatbuffer[i].pkt    = PKT_NONE;
+    rb_link(i);
+  }
+} // init_repeatbuffer
+
+//-----------------------------------------------------------------------------------
+// search_repeatbuffer: takes the message with the highest repeat req. from the repeat queue
 // returns this entry in *mysearch and the repeat count as value;
 // if return==0 then repeatbuffer is empty
 
 static unsigned char search_repeatbuffer(t_message *mysearch) {
-unsigned char run_repeat = 0;
-unsigned char i; unsigned char found_i=0;
+  unsigned char run_repeat;
+  unsigned char i;
+  PROBE_START();
 
-  for (i=0; i<SIZE_REPEATBUFFER; i++)
-  {
-    if (repeatbuffer[i].repeat > run_repeat)
-    {
-      run_repeat = repeatbuffer[i].repeat;
-      found_i = i;
-    }
+  while ((rb_top > 0) && (rb_head[rb_top] == RB_NONE)) {
+    rb_top--;
+    PROBE_NEXT();
   }
-  if (run_repeat > 0)
-  {
-    repeatbuffer[found_i].repeat--;
-    mysearch->qualifier = repeatbuffer[found_i].qualifier;  // both type and size
-    memcpy(mysearch->dcc, repeatbuffer[found_i].dcc, repeatbuffer[found_i].size);
+  PROBE_DONE(PROBE_RB_NEXT);
+  if (rb_top == 0) return(0);
+
+  i = rb_head[rb_top];
+  run_repeat = repeatbuffer[i].repeat;
+  mysearch->qualifier = repeatbuffer[i].qualifier;  // both type and size
+  memcpy(mysearch->dcc, pkt_data(repeatbuffer[i].pkt), repeatbuffer[i].size);
+
+  rb_unlink(i);
+  if (run_repeat == 1) {                    // entry becomes free
+    rb_hash_remove(i);
+    pkt_free(repeatbuffer[i].pkt);
+    repeatbuffer[i].pkt = PKT_NONE;
   }
+  repeatbuffer[i].repeat--;
+  rb_link(i);
   return(run_repeat);
-}
-
-static void update_repeatbuffer(t_message *new_message) {
-  unsigned char run_repeat = 255;
-  unsigned char i; unsigned char found_i=0;
+} // search_repeatbuffer
 
-  if (new_message->repeat == 0) return;    // der will gar keinen repeat haben
-  if (new_message->type == is_prog) return;  // der soll keinen repeat haben (nur immediate)
+// the message leaves its queue: the repeatbuffer takes over the packet, or the pool gets it back
+static void update_repeatbuffer(t_qentry *new_entry) {
+  unsigned char i, b;
+  uint16_t key;
 
-  for (i=0; i<SIZE_REPEATBUFFER; i++)
-  {
-    if (repeatbuffer[i].dcc[0] == new_message->dcc[0]) {
-      // same adr found, is it short / long? and is it speed command?
-      // if yes, replace it and return
-      if (repeatbuffer[i].dcc[0] < 112)                   // short adr.
-      {
-        if (repeatbuffer[i].dcc[1] == 0x3F)             // (128 Speed Steps)
-        {
-          memcpy(&repeatbuffer[i], new_message, sizeof(t_message));
-          return;
-        }
-        else if (repeatbuffer[i].dcc[1] & 0x40)         // (28 Speed Steps)
-        {
-          memcpy(&repeatbuffer[i], new_message, sizeof(t_message));
-          return;
-        }
-      }
-      else if (repeatbuffer[i].dcc[0] < 128)
-      {
-      }
-      else if (repeatbuffer[i].dcc[0] < 192)
-      {
-        unsigned char test;
-        test = repeatbuffer[i].dcc[1] ^ new_message->dcc[1];
-        if (!(test & 0x76))  // upper addr equal 
-        {
-          memcpy(&repeatbuffer[i], new_message, sizeof(t_message));
-          return;
-        } 
-      } 
-      else if (repeatbuffer[i].dcc[0] < 232)              // long addr
-      {
-        if (repeatbuffer[i].dcc[1] == new_message->dcc[1])  // long addr
-        {
-          if (repeatbuffer[i].dcc[2] == 0x3F)             // (128 Speed Steps)
-          {
-            memcpy(&repeatbuffer[i], new_message, sizeof(t_message));
-            return;
-          }
-          else if (repeatbuffer[i].dcc[2] & 0x40)         // (28 Speed Steps)
-          {
-            memcpy(&repeatbuffer[i], new_message, sizeof(t_message));
-            return;
-          }
-        }
-      }
-    }
+  if ((new_entry->repeat == 0) ||          // der will gar keinen repeat haben
+      (new_entry->type == is_prog)) {      // der soll keinen repeat haben (nur immediate)
+    pkt_free(qentry_take(new_entry));
+    return;
   }
 
-  // no command found to be replaced, so search for lowest refresh
-  for (i=0; i<SIZE_REPEATBUFFER; i++)
-  {
-    if (repeatbuffer[i].repeat < run_repeat)
-    {
-      found_i = i;
-      run_repeat = repeatbuffer[i].repeat;
+  // same loco and instruction / same turnout found? -> replace it and return
+  key = new_entry->key;
+  if (key) {
+    i = rb_hash_find(key);
+    if (i != RB_NONE) {
+      rb_unlink(i);
+      pkt_free(repeatbuffer[i].pkt);
+      repeatbuffer[i] = *new_entry;
+      qentry_take(new_entry);
+      rb_link(i);
+      return;
     }
   }
 
-  // repeatbuffer[found_i].repeat = new_message->repeat;
-  // repeatbuffer[found_i].qualifier = new_message->qualifier;   // both type and size
-  // memcpy(repeatbuffer[found_i].dcc, new_message->dcc, new_message->size);
-  memcpy(&repeatbuffer[found_i], new_message, sizeof(t_message));
+  // no command found to be replaced, so take a free entry or the oldest with lowest refresh
+  for (b=0; b<NUM_REPEAT_BUCKETS; b++) {
+    if (rb_head[b] != RB_NONE) break;
+  }
+  #ifdef NATIVE_BENCH
+    probe_count(&probe_stat[PROBE_RB_FREE], b + 1);
+  #endif
+  i = rb_head[b];
+  rb_unlink(i);
+  if (b != 0) rb_hash_remove(i);
+  pkt_free(repeatbuffer[i].pkt);
+  repeatbuffer[i] = *new_entry;
+  qentry_take(new_entry);
+  if (key) rb_hash_add(i, key);
+  rb_link(i);
 } // update_repeatbuffer
 
-// remove commands to this loco from repeatbuffer
+// packet pool exhausted: give up the entry with the lowest repeat count
+// (oldest first) that holds a slot of the wanted class
+static bool rb_evict(bool large) {
+  unsigned char i, b;
+
+  for (b=1; b<=rb_top; b++) {
+    i = rb_head[b];
+    if (i == RB_NONE) continue;
+    do {
+      if (!large || (repeatbuffer[i].pkt >= PKT_LARGE)) {
+        rb_unlink(i);
+        rb_hash_remove(i);
+        pkt_free(repeatbuffer[i].pkt);
+        repeatbuffer[i].pkt = PKT_NONE;
+        repeatbuffer[i].repeat = 0;
+        rb_link(i);
+  #ifdef NATIVE_BENCH
+        pkt_evictions++;
+  #endif
+        return(1);
+      }
+      i = rb_next[i];
+    } while (i != rb_head[b]);
+  }
+  return(0);
+} // rb_evict
+
+// remove the message with the same key (same loco, same instruction) from repeatbuffer
 // to get rid of old settings in case the loco is updated
 
 static void clear_from_repeatbuffer(t_message *new_message) {
   unsigned char i;
-
-  for (i=0; i<SIZE_REPEATBUFFER; i++)
-  {
-    if (repeatbuffer[i].dcc[0] == new_message->dcc[0])
-    {
-      // same adr found, is it short / long? and is it speed command?
-      // if yes, replace it and return
-      if (repeatbuffer[i].dcc[0] < 112)                   // short adr.
-      {
-        if (repeatbuffer[i].dcc[1] == 0x3F)             // (128 Speed Steps)
-        {
-          repeatbuffer[i].repeat = 0;
-          return;
-        }
-        else if (repeatbuffer[i].dcc[1] & 0x40)         // (28 Speed Steps)
-        {
-          repeatbuffer[i].repeat = 0;
-          return;
-        }
-      }
-      else if ( (repeatbuffer[i].dcc[0] >= 192) &&
-                (repeatbuffer[i].dcc[0] < 232)  )
-      {
-        if (repeatbuffer[i].dcc[1] == new_message->dcc[1])  // long addr
-        {
-          if (repeatbuffer[i].dcc[2] == 0x3F)             // (128 Speed Steps)
-          {
-            repeatbuffer[i].repeat = 0;
-            return;
-          }
-          else if (repeatbuffer[i].dcc[2] & 0x40)         // (28 Speed Steps)
-          {
-            repeatbuffer[i].repeat = 0;
-            return;
-          }
-        }
-      }
-    }
-  }
+  uint16_t key;
+
+  key = new_message->key;
+  if (key == 0) return;
+  i = rb_hash_find(key);
+  if (i == RB_NONE) return;
+  rb_unlink(i);
+  rb_hash_remove(i);
+  pkt_free(repeatbuffer[i].pkt);
+  repeatbuffer[i].pkt = PKT_NONE;
+  repeatbuffer[i].repeat = 0;
+  rb_link(i);
 } // clear_from_repeatbuffer
 
 //----------------------------------------------------------------------------------
@@ -1545,39 +2761,77 @@ static void clear_from_repeatbuffer(t_message *new_message) {
 // next_message_count is the flag of DCCOUT - a new message has arrived
 // SDS : next_message is een struct in dccout.cpp!
 
-void set_next_message (t_message *newmsg) {
-  unsigned char my_repeat;
-  memcpy(next_message.dcc, newmsg->dcc, newmsg->size);
-  // now scan this message for speed command and replaces the speed value depending
-  // on organizer_halt_state
-  if (organizer_state.halted) {
-    if ( (next_message.dcc[0] > 0) &&
-          (next_message.dcc[0] < 112) ) // short adr.
+// now scan this message for speed command and replaces the speed value depending
+// on organizer_halt_state
+static void mask_halted_speed(unsigned char *dcc, unsigned char type) {
+  #if (MAERKLIN_ENABLED == 1)
+    if (type == is_mm) {
+      dcc[2] = 0;           // speed step 0 (MM1 format, MM2 decoders take it too)
+      return;
+    }
+  #endif
+  if ( (dcc[0] > 0) &&
+        (dcc[0] < 112) ) // short adr.
+  {
+    if (dcc[1] == 0x3F)  // (128 Speed Steps)
     {
-      if (next_message.dcc[1] == 0x3F)  // (128 Speed Steps)
-      {
-        // next_message.dcc[2] (msb=dir, 7 bit=speed, 0=stop, 1=e-stop)
-        next_message.dcc[2] &= 0x80; // keep dir
-      }
-      else if ((next_message.dcc[1] & 0x40) == 0x40)
-        next_message.dcc[1] &= 0xF0; // keep dir
+      // dcc[2] (msb=dir, 7 bit=speed, 0=stop, 1=e-stop)
+      dcc[2] &= 0x80; // keep dir
     }
-    if ((next_message.dcc[0] >= 192)  && // long adr. 
-        (next_message.dcc[0] < 232))
+    else if ((dcc[1] & 0x40) == 0x40)
+      dcc[1] &= 0xF0; // keep dir
+  }
+  if ((dcc[0] >= 192)  && // long adr. 
+      (dcc[0] < 232))
+  {
+    if (dcc[2] == 0x3F)  // (128 Speed Steps)
     {
-      if (next_message.dcc[2] == 0x3F)  // (128 Speed Steps)
-      {
-        // next_message.dcc[3] (msb=dir, 7 bit=speed, 0=stop, 1=e-stop)
-        next_message.dcc[3] &= 0x80; // keep dir
-      }
-      else if ((next_message.dcc[2] & 0x40) == 0x40)
-          next_message.dcc[2] &= 0xF0; // keep dir
+      // dcc[3] (msb=dir, 7 bit=speed, 0=stop, 1=e-stop)
+      dcc[3] &= 0x80; // keep dir
     }
+    else if ((dcc[2] & 0x40) == 0x40)
+        dcc[2] &= 0xF0; // keep dir
   }
+} // mask_halted_speed
+
+// the packets already in dcc_ring were prepared before the halt: mask them as well.
+// The ISR copies a slot when it starts to send it -> write the slot with interrupts off.
+static void mask_halted_ring() {
+  struct dcc_slot_s *slot;
+  struct next_message_s msg;
+#if (DCCOUT_BITSTREAM == 1)
+  struct dcc_bits_s bits;
+#endif
+  unsigned char i;
+
+  for (i = 0; (slot = dccout_RingPending(i)) != NULL; i++) {
+    msg = slot->msg;
+    mask_halted_speed(msg.dcc, msg.type);
+#if (DCCOUT_BITSTREAM == 1)
+    dccout_Encode(&bits, &msg);
+#endif
+    cli();
+    slot->msg = msg;
+#if (DCCOUT_BITSTREAM == 1)
+    slot->bits = bits;
+#endif
+    sei();
+  }
+} // mask_halted_ring
+
+void set_next_message (t_message *newmsg) {
+  unsigned char my_repeat;
+  PKTTRACE(TRACE_SRC_DIRECT, newmsg);
+  memcpy(next_message.dcc, newmsg->dcc, newmsg->size);
+  if (organizer_state.halted) mask_halted_speed(next_message.dcc, newmsg->type);
 
   next_message.size = newmsg->size;
   next_message.type = newmsg->type;
 
+#if (DCCOUT_BITSTREAM == 1)
+  dccout_Encode(&next_bits, &next_message);
+#endif
+
   if (newmsg->type == is_prog)
   {                                      // prog commands keep their repeat
     my_repeat = newmsg->repeat;             // immediate repeat
@@ -1597,11 +2851,70 @@ static void set_next_message_and_repeat (t_message *newmsg) {
   next_message.size = newmsg->size;
   next_message.type = newmsg->type;
 
+#if (DCCOUT_BITSTREAM == 1)
+  dccout_Encode(&next_bits, &next_message);
+#endif
+
   my_repeat = newmsg->repeat;             //immediate repeat
   if (my_repeat == 0) my_repeat = 1;
   next_message_count = my_repeat;
 } // set_next_message_and_repeat
 
+// put_in_dcc_ring: same as set_next_message, but the message is queued in dcc_ring
+// -> the organizer can run ahead of dccout, dccout does not run dry if the main loop stalls.
+// only call if !dccout_RingFull()
+static unsigned char last_dcc0;   // address byte of the last message put in dcc_ring
+
+static void put_in_dcc_ring(t_message *newmsg) {
+  struct dcc_slot_s *slot;
+
+  slot = dccout_RingSlot();
+  memcpy(slot->msg.dcc, newmsg->dcc, newmsg->size);
+  if (organizer_state.halted) mask_halted_speed(slot->msg.dcc, newmsg->type);
+  slot->msg.size = newmsg->size;
+  slot->msg.type = newmsg->type;
+
+  slot->count = 1;                        // all other command have no repeat
+  if ((newmsg->type == is_prog) && (newmsg->repeat != 0))
+    slot->count = newmsg->repeat;         // prog commands keep their repeat
+
+#if (CMD_LATENCY == 1)
+  if ((slot->stamp.origin & CMDLAT_ORIGIN_DONE) && (slot->stamp.origin != CMDLAT_ORIGIN_NONE))
+    cmdlat_Record(&slot->stamp);          // measured by dccout when it was sent
+  slot->stamp = ring_stamp;
+  ring_stamp.origin = CMDLAT_ORIGIN_NONE;
+#endif
+
+  last_dcc0 = newmsg->dcc[0];
+  dccout_RingCommit();
+} // put_in_dcc_ring
+
+#if (PROG_TRACK_CONCURRENT == 1)
+// the programming track has its own output: queue_prog -> progout, whatever the main track does.
+// only in service mode, else the programming track is off and progout keeps sending the preamble.
+static void run_prog_track() {
+  t_message prog_message;
+  t_message *my_ptr = &prog_message;
+
+  if (next_prog_count != 0) return;        // progout busy
+  if (!status_IsProgState()) return;
+
+  if (prog_write != prog_read) {           // read message from queue_prog
+    qentry_get(&queue_prog[prog_read], my_ptr);
+    PKTTRACE(TRACE_SRC_PROG, my_ptr);
+    pkt_free(qentry_take(&queue_prog[prog_read]));
+    prog_read++;
+    if (prog_read == SIZE_QUEUE_PROG) prog_read = 0;   // advance pointer
+  }
+  else my_ptr = &DCC_Idle;                 // nichts gefunden, dann halt idle
+
+  memcpy(next_prog_message.dcc, my_ptr->dcc, my_ptr->size);
+  next_prog_message.size = my_ptr->size;
+  next_prog_message.type = my_ptr->type;
+  next_prog_count = (my_ptr->repeat == 0) ? 1 : my_ptr->repeat;   // repeat as often as in message
+} // run_prog_track
+#endif
+
 
 //=======================================================================================
 //
@@ -1677,28 +2990,32 @@ static void set_next_message_and_repeat (t_message *newmsg) {
 //
 
 void organizer_Init() {
-  unsigned char i;
+  prog_read = 0;
+  prog_write = 0;
   hp_read = 0;
   hp_write = 0;
   lp_read = 0;
   lp_write = 0;
   organizer_state.halted = 0;
+#if (CMD_LATENCY == 1)
+  ring_stamp.origin = CMDLAT_ORIGIN_NONE;
+  CMDLAT_CLEAR();
+#endif
 
-  for (i=0; i<SIZE_REPEATBUFFER; i++) {
-    repeatbuffer[i].repeat = 0;
-    repeatbuffer[i].type   = is_void;
-  }
-
+  init_pkt_pool();
+  init_repeatbuffer();
   init_locobuffer();
 
   dcc_acc_repeat = eeprom_read_byte((unsigned char *)eadr_dcc_acc_repeat); 
   dcc_pom_repeat = eeprom_read_byte((unsigned char *)eadr_dcc_pom_repeat); 
   dcc_func_repeat = eeprom_read_byte((unsigned char *)eadr_dcc_func_repeat); 
   dcc_speed_repeat = eeprom_read_byte((unsigned char *)eadr_dcc_speed_repeat); 
+  init_refresh_scheduler();
 } // organizer_Init
 
 void organizer_Restart() {
   organizer_state.halted = 0;
+  dccout_EmergencyStop(0);            // stops not sent yet are void
 } // organizer_Restart
 
 //---------------------------------------------------------------------------------
@@ -1726,67 +3043,88 @@ void organizer_Restart() {
 //
 // PROG_ERROR:  only queue_prog                                // Prog-Mode, Fehler beim Programmieren
 //              no repeatbuffer, no locobuffer        
+//
+// PROG_TRACK_CONCURRENT: queue_prog goes to progout (run_prog_track), the main track
+//              runs on with main_track_state (RUN_xxx) during the PROG_xxx states
 
 // Achtung: organizer lauft zur Zeit bei RUN_OKAY
 void organizer_Run() {
   t_message *my_search_ptr;
-  t_message *next_mess_ptr;
   t_message search_message;
 
   my_search_ptr = &search_message;
 
-  // is DCC_OUT ready?
+#if (PROG_TRACK_CONCURRENT == 1)
+  run_prog_track();
+#endif
+
+  // is DCC_OUT ready? (busy with a direct message: startup, programming)
   if (next_message_count != 0) return;
 
-  // we can now put the next message on the tracks
+  // we can now put the next messages on the tracks
 
-  switch(opendcc_state) {
+  switch(main_track_state) {
     case RUN_OKAY:      // all running
     case RUN_PAUSE:     // slow down
     case RUN_STOP:      // speed 0		
-      // check queue_hp
-      if ((hp_write != hp_read) &&
-          (queue_hp[hp_read].dcc[0] != next_message.dcc[0])) 
-      { // read message from queue_hp
-        next_mess_ptr = &queue_hp[hp_read];
-        set_next_message(next_mess_ptr);
-        hp_read++;
-        if (hp_read == SIZE_QUEUE_HP) hp_read = 0;   // advance pointer
-
-        // put this message to repeatbuffer
-        update_repeatbuffer(next_mess_ptr);
-      }
-      else { // check queue_lp
-        if ((lp_write != lp_read) &&
-            (queue_lp[lp_read].dcc[0] != next_message.dcc[0]))
-        {
-          // read message from queue_lp
-          next_mess_ptr = &queue_lp[lp_read];
-          set_next_message(next_mess_ptr);
-          lp_read++;
-          if (lp_read == SIZE_QUEUE_LP) lp_read = 0;   // advance pointer
+      // fill dcc_ring, the rail keeps busy with useful packets if the main loop stalls
+      while (!dccout_RingFull()) {
+        // check queue_hp
+        if ((hp_write != hp_read) &&
+            (*pkt_data(queue_hp[hp_read].pkt) != last_dcc0)) 
+        { // read message from queue_hp
+          qentry_get(&queue_hp[hp_read], my_search_ptr);
+          PKTTRACE(TRACE_SRC_HP, my_search_ptr);
+          CMDLAT_FORWARD(hp_stamp[hp_read]);
+          put_in_dcc_ring(my_search_ptr);
 
           // put this message to repeatbuffer
-          update_repeatbuffer(next_mess_ptr);
+          update_repeatbuffer(&queue_hp[hp_read]);
+          hp_read++;
+          if (hp_read == SIZE_QUEUE_HP) hp_read = 0;   // advance pointer
+          rs_queued++;
         }
-        else {
-          if (search_repeatbuffer(my_search_ptr) &&
-              (search_message.dcc[0] != next_message.dcc[0]))
+        else if ((REFRESH_SHARE != 0) && (rs_queued >= REFRESH_SHARE - 1) &&
+                 ((my_search_ptr = search_locobuffer(false)) != NULL))
+        { // busy rail: the refresh gets its share, otherwise a loco may wait for seconds
+          PKTTRACE(TRACE_SRC_LOCOBUFFER, my_search_ptr);
+          put_in_dcc_ring(my_search_ptr);
+          my_search_ptr = &search_message;
+          rs_queued = 0;
+        }
+        else { // check queue_lp
+          my_search_ptr = &search_message;
+          if ((lp_write != lp_read) &&
+              (*pkt_data(queue_lp[lp_read].pkt) != last_dcc0))
           {
-            // read this message from repeatbuffer
-            set_next_message(my_search_ptr);
+            // read message from queue_lp
+            qentry_get(&queue_lp[lp_read], my_search_ptr);
+            PKTTRACE(TRACE_SRC_LP, my_search_ptr);
+            CMDLAT_FORWARD(lp_stamp[lp_read]);
+            put_in_dcc_ring(my_search_ptr);
+
+            // put this message to repeatbuffer
+            update_repeatbuffer(&queue_lp[lp_read]);
+            lp_read++;
+            if (lp_read == SIZE_QUEUE_LP) lp_read = 0;   // advance pointer
+            rs_queued++;
           }
           else {
-            my_search_ptr = search_locobuffer();
-            set_next_message(my_search_ptr);
-            // if (my_search_ptr->dcc[0] != next_message.dcc[0])
-            //  {
-            //    set_next_message(my_search_ptr);
-            //  }
-            // else
-            //  { // nichts gefunden, dann halt idle
-            //    set_next_message(&DCC_Idle);
-            //  }
+            if (search_repeatbuffer(my_search_ptr) &&
+                (search_message.dcc[0] != last_dcc0))
+            {
+              // read this message from repeatbuffer
+              PKTTRACE(TRACE_SRC_REPEAT, my_search_ptr);
+              put_in_dcc_ring(my_search_ptr);
+              rs_queued++;
+            }
+            else {
+              my_search_ptr = search_locobuffer(true);
+              PKTTRACE(TRACE_SRC_LOCOBUFFER, my_search_ptr);
+              put_in_dcc_ring(my_search_ptr);
+              my_search_ptr = &search_message;
+              rs_queued = 0;
+            }
           }
         }
       }
@@ -1808,10 +3146,13 @@ void organizer_Run() {
     case PROG_SHORT:
     case PROG_OFF:
     case PROG_ERROR:
+      if (!dccout_RingEmpty()) return;    // let dccout finish the packets of run mode first
       // run prog queue
       if (prog_write != prog_read) { // read message from queue_prog
-        next_mess_ptr = &queue_prog[prog_read];
-        set_next_message_and_repeat(next_mess_ptr);        // repeat as often as in message
+        qentry_get(&queue_prog[prog_read], my_search_ptr);
+        PKTTRACE(TRACE_SRC_PROG, my_search_ptr);
+        set_next_message_and_repeat(my_search_ptr);        // repeat as often as in message
+        pkt_free(qentry_take(&queue_prog[prog_read]));
         prog_read++;
         if (prog_read == SIZE_QUEUE_PROG) prog_read = 0;   // advance pointer
       }
@@ -1820,6 +3161,9 @@ void organizer_Run() {
         set_next_message(my_search_ptr);
       }
       break;
+
+    case INIT:          // not yet started
+      break;
   }
 } // organizer_Run
 
@@ -1842,9 +3186,65 @@ bool organizer_IsReady() {
   if (i == SIZE_QUEUE_LP) i = 0;
   if (i == lp_read) return(0);         // one left -> say full, keep one extra
 
+  if (SIZE_PKT_POOL_LARGE - pkt_queued_large < PKT_RESERVE) return(0);  // packet pool
+
   return(1);                            // both queues have space
 } // organizer_IsReady
 
+#ifdef NATIVE_BENCH
+// host benchmark only: consistency of the packet pool. Every slot must be on its
+// free list or have exactly one owner (queue entry or repeatbuffer entry).
+// returns the number of faults; *evictions: repeats given up since organizer_Init()
+static void check_owner(uint8_t *owner, uint8_t p, uint8_t *faults) {
+  if (p >= PKT_SLOTS) (*faults)++;
+  else owner[p]++;
+}
+
+static uint8_t check_queue(t_qentry *queue, uint8_t num, uint8_t rd, uint8_t wr, uint8_t *owner, uint8_t *faults) {
+  uint8_t large = 0;
+
+  while (rd != wr) {
+    check_owner(owner, queue[rd].pkt, faults);
+    if ((queue[rd].pkt >= PKT_LARGE) && (queue[rd].pkt < PKT_SLOTS)) large++;
+    if (++rd == num) rd = 0;
+  }
+  return(large);
+}
+
+uint8_t organizer_CheckPool(uint16_t *evictions) {
+  uint8_t owner[PKT_SLOTS];
+  uint8_t p, n, i, large, faults = 0;
+
+  memset(owner, 0, sizeof(owner));
+  for (p = pkt_free_small, n = 0; (p != PKT_NONE) && (n <= PKT_SLOTS); p = *pkt_data(p), n++) {
+    if (p >= PKT_LARGE) { faults++; break; }
+    owner[p]++;
+  }
+  for (p = pkt_free_large, n = 0; (p != PKT_NONE) && (n <= PKT_SLOTS); p = *pkt_data(p), n++) {
+    if ((p < PKT_LARGE) || (p >= PKT_SLOTS)) { faults++; break; }
+    owner[p]++;
+  }
+  large  = check_queue(queue_prog, SIZE_QUEUE_PROG, prog_read, prog_write, owner, &faults);
+  large += check_queue(queue_hp, SIZE_QUEUE_HP, hp_read, hp_write, owner, &faults);
+  large += check_queue(queue_lp, SIZE_QUEUE_LP, lp_read, lp_write, owner, &faults);
+  if (large != pkt_queued_large) faults++;
+  for (i = 0; i < SIZE_REPEATBUFFER; i++) {
+    if (repeatbuffer[i].repeat) check_owner(owner, repeatbuffer[i].pkt, &faults);
+    else if (repeatbuffer[i].pkt != PKT_NONE) faults++;
+  }
+  for (p = 0; p < PKT_SLOTS; p++)
+    if (owner[p] != 1) faults++;          // leaked or shared
+  *evictions = pkt_evictions;
+  return(faults);
+} // organizer_CheckPool
+
+// number and length of the searches since the last call
+void organizer_GetProbes(t_probe_stat *stat) {
+  memcpy(stat, probe_stat, sizeof(probe_stat));
+  memset(probe_stat, 0, sizeof(probe_stat));
+} // organizer_GetProbes
+#endif
+
 void organizer_SendDccStartupMessages () {
   t_message testmess;
   t_message *testmessptr;
@@ -1875,6 +3275,44 @@ void organizer_SendDccStartupMessages () {
 // PUBLIC INTERFACE to add messages to the ORGANIZER
 //-----------------------------------------------------------------------------------
 
+#if (MAERKLIN_ENABLED == 1)
+// Motorola speed change:
+// MM1 has a relative direction: a direction change is sent as speed step 1, once, in front of the new speed.
+// MM2 function packets carry the speed too -> remove the repeats of the old ones.
+static unsigned char mm_speed_changed(uint8_t lbIndex, unsigned char retval) {
+  unsigned char j;
+
+  if (lb_format(lbIndex) == MM1) {
+    if (!(retval & ORGZ_DIR_CHANGE)) return (0);
+    build_mm1_loco(lb_address(lbIndex), lb_func[lbIndex] & LB_FL, 1, locobuff_mes_ptr);
+    locobuff_mes_ptr->key = 0;            // not to be replaced by the new speed
+    locobuff_mes_ptr->repeat = 0;         // a second one would turn back
+    return (put_in_queue_hp(locobuff_mes_ptr));
+  }
+  for (j=0; j<4; j++) {
+    locobuff_mes_ptr->key = msg_key_loco(KEY_FUNC_GRP1 + j, lb_address(lbIndex));
+    clear_from_repeatbuffer(locobuff_mes_ptr);
+  }
+  return (0);
+} // mm_speed_changed
+
+// MM2 F1..F4: one packet per changed function (MM1: none)
+static unsigned char mm_func_changed(uint8_t lbIndex) {
+  unsigned char retval = 0;
+  unsigned char j;
+  uint8_t f = (lb_func[lbIndex] >> 1) & 0x0F;
+
+  if (lb_format(lbIndex) != MM2) return (0);
+  for (j=0; j<4; j++) {
+    if (!(mm_fchanged & (1 << j))) continue;
+    build_mm2_function(lb_address(lbIndex), lb_func[lbIndex] & LB_FL,
+                       convert_speed_to_rail(lb_speed[lbIndex], MM2), j, (f >> j) & 1, locobuff_mes_ptr);
+    retval |= put_in_queue_low(locobuff_mes_ptr);
+  }
+  return (retval);
+} // mm_func_changed
+#endif
+
 // Speed einstellen: dieses Kommando geht auch in die high priority queue falls gebremst wird;
 // immer in low priority queue, von dort wird es nach dem Ausgeben in repeatbuffer
 // übernommen.
@@ -1886,10 +3324,13 @@ void organizer_SendDccStartupMessages () {
 unsigned char do_loco_speed_f(unsigned char slot, unsigned int locAddress, unsigned char speed, t_format format) {
   unsigned char retval;
   t_message *my_message;
-  locomem *lbData;
+  uint8_t lbIndex;
 
-  retval = enter_speed_f_to_locobuffer(slot, locAddress, speed, format, &lbData);
-  my_message = build_speed_message_from_locobuffer(lbData);
+  retval = enter_speed_f_to_locobuffer(slot, locAddress, speed, format, &lbIndex);
+  #if (MAERKLIN_ENABLED == 1)
+    if (lb_state[lbIndex] & LB_MM) retval |= mm_speed_changed(lbIndex, retval);
+  #endif
+  my_message = get_message_from_locobuffer(lbIndex, KEY_SPEED);
   if (retval & ORGZ_SLOW_DOWN) {  // slow down or direction change
     retval |= put_in_queue_hp(my_message);
     retval |= put_in_queue_low(my_message);
@@ -1909,10 +3350,13 @@ unsigned char do_loco_speed_f(unsigned char slot, unsigned int locAddress, unsig
 unsigned char do_loco_speed(unsigned char slot, unsigned int locAddress, unsigned char speed) {
   unsigned char retval;
   t_message *my_message;
-  locomem *lbData;
+  uint8_t lbIndex;
 
-  retval = enter_speed_to_locobuffer(slot, locAddress, speed, &lbData);
-  my_message = build_speed_message_from_locobuffer(lbData);
+  retval = enter_speed_to_locobuffer(slot, locAddress, speed, &lbIndex);
+  #if (MAERKLIN_ENABLED == 1)
+    if (lb_state[lbIndex] & LB_MM) retval |= mm_speed_changed(lbIndex, retval);
+  #endif
+  my_message = get_message_from_locobuffer(lbIndex, KEY_SPEED);
   if (retval & ORGZ_SLOW_DOWN) {  // slow down or direction change
     retval |= put_in_queue_hp(my_message);
     retval |= put_in_queue_low(my_message);
@@ -1928,56 +3372,65 @@ unsigned char do_loco_speed(unsigned char slot, unsigned int locAddress, unsigne
 // Loco function einstellen
 unsigned char do_loco_func_grp0(unsigned char slot, unsigned int locAddress, unsigned char func) {
   unsigned char retval;
-  locomem *lbData;
+  uint8_t lbIndex;
 
-  retval = enter_func_to_locobuffer(slot, locAddress, func, 0, &lbData);
-  retval |= put_in_queue_low(build_f1_message_from_locobuffer(lbData));   // grp 0 = light
+  retval = enter_func_to_locobuffer(slot, locAddress, func, 0, &lbIndex);
+  #if (MAERKLIN_ENABLED == 1)
+    if (lb_state[lbIndex] & LB_MM)      // Motorola: light is in the speed packet
+      return (retval | put_in_queue_low(get_message_from_locobuffer(lbIndex, KEY_SPEED)));
+  #endif
+  retval |= put_in_queue_low(get_message_from_locobuffer(lbIndex, KEY_FUNC_GRP1));   // grp 0 = light
   return(retval);
 }
 
 unsigned char do_loco_func_grp1(unsigned char slot, unsigned int locAddress, unsigned char func) {
   unsigned char retval;
-  locomem *lbData;
+  uint8_t lbIndex;
 
-  retval = enter_func_to_locobuffer(slot, locAddress, func, 1, &lbData);
-  retval |= put_in_queue_low(build_f1_message_from_locobuffer(lbData));   // grp 1
+  retval = enter_func_to_locobuffer(slot, locAddress, func, 1, &lbIndex);
+  #if (MAERKLIN_ENABLED == 1)
+    if (lb_state[lbIndex] & LB_MM) return (retval | mm_func_changed(lbIndex));
+  #endif
+  retval |= put_in_queue_low(get_message_from_locobuffer(lbIndex, KEY_FUNC_GRP1));   // grp 1
   return(retval);
 }
 
 unsigned char do_loco_func_grp2(unsigned char slot, unsigned int locAddress, unsigned char func) {
   unsigned char retval;
-  locomem *lbData;
+  uint8_t lbIndex;
 
-  retval = enter_func_to_locobuffer(slot, locAddress, func, 2, &lbData);
-  retval |= put_in_queue_low(build_f2_message_from_locobuffer(lbData));   // grp 2
+  retval = enter_func_to_locobuffer(slot, locAddress, func, 2, &lbIndex);
+  retval |= put_in_queue_low(get_message_from_locobuffer(lbIndex, KEY_FUNC_GRP2));   // grp 2
   return(retval);
 }
 
 unsigned char do_loco_func_grp3(unsigned char slot, unsigned int locAddress, unsigned char func) {
   unsigned char retval;
-  locomem *lbData;
+  uint8_t lbIndex;
 
-  retval = enter_func_to_locobuffer(slot, locAddress, func, 3, &lbData);
-  retval |= put_in_queue_low(build_f3_message_from_locobuffer(lbData));   // grp 3
+  retval = enter_func_to_locobuffer(slot, locAddress, func, 3, &lbIndex);
+  retval |= put_in_queue_low(get_message_from_locobuffer(lbIndex, KEY_FUNC_GRP3));   // grp 3
   return(retval);
 }
 
 #if (DCC_F13_F28 == 1)
 unsigned char do_loco_func_grp4(unsigned char slot, unsigned int locAddress, unsigned char func) {
   unsigned char retval;
-  locomem *lbData;
+  uint8_t lbIndex;
 
-  retval = enter_func_to_locobuffer(slot, locAddress, func, 4, &lbData);
-  retval |= put_in_queue_low(build_f4_message_from_locobuffer(lbData));   // grp 4
+  retval = enter_func_to_locobuffer(slot, locAddress, func, 4, &lbIndex);
+  if (retval & ORGZ_FHIGH_FULL) return(retval);    // not stored, not sent
+  retval |= put_in_queue_low(get_message_from_locobuffer(lbIndex, KEY_FUNC_GRP4));   // grp 4
   return(retval);
 }
 
 unsigned char do_loco_func_grp5(unsigned char slot, unsigned int locAddress, unsigned char func) {
   unsigned char retval;
-  locomem *lbData;
+  uint8_t lbIndex;
 
-  retval = enter_func_to_locobuffer(slot, locAddress, func, 5, &lbData);
-  retval |= put_in_queue_low(build_f5_message_from_locobuffer(lbData));   // grp 5
+  retval = enter_func_to_locobuffer(slot, locAddress, func, 5, &lbIndex);
+  if (retval & ORGZ_FHIGH_FULL) return(retval);    // not stored, not sent
+  retval |= put_in_queue_low(get_message_from_locobuffer(lbIndex, KEY_FUNC_GRP5));   // grp 5
   return(retval);
 }
 #endif
@@ -2009,6 +3462,25 @@ bool do_loco_restricted_speed(unsigned int locAddress, unsigned char data)
 }
 #endif
 
+#if (MAERKLIN_ENABLED == 1)
+// set the format of a loco (the speed commands only carry dcc formats, and do not change a Motorola loco)
+// Motorola needs address 1..255
+// return: 1 = okay, 0 = not possible (address, format, database full)
+unsigned char do_loco_format(unsigned int locAddress, t_format format) {
+  uint8_t lbIndex;
+
+  if ((format == DCC27) || (format > MM2) || (locAddress == 0) || (locAddress >= KEY_LOCO_RANGE)) return (0);
+  if ((format >= MM1) && (locAddress > 255)) return (0);
+  if (!database_PutLocoFormat(locAddress, format)) return (0);
+  lbIndex = lb_hash_find(locAddress);
+  if (lbIndex != LB_HASH_EMPTY) {
+    lb_set_format(lbIndex, format);
+    lb_pkt_invalidate(lbIndex, 0xFF);
+  }
+  return (1);
+} // do_loco_format
+#endif
+
 // programming on the main (locos)
 //
 // parameters: addr:     loco
@@ -2039,6 +3511,7 @@ uint8_t do_pom_loco_cvrd(unsigned int addr, unsigned int cv)
   else
     build_pom_cvrd_7a(addr, cv, locobuff_mes_ptr);
   retval = put_in_queue_low(locobuff_mes_ptr);
+  RAILCOM_EXPECT_POM(addr, cv);   // the decoder answers in the cutout (channel 2, ID0)
   return(retval);
 }
 
@@ -2125,9 +3598,12 @@ uint8_t do_fast_clock(t_fast_clock* my_clock) {
 void do_all_stop() {
   // SDS : RUN_STOP sends emergency stop, not soft stop ('brake')
   // in line with xpnet spec 2.2.4 Stop all locomotives request = emergency stop all locs
-  DCC_BC_Stop.repeat = 10;
-  put_in_queue_hp(&DCC_BC_Stop);
+  dccout_EmergencyStop(2);            // the first two directly by the ISR: no wait for queue_hp,
+                                      // dcc_ring and the main loop
   organizer_state.halted = 1;
+  mask_halted_ring();                 // prepared before the stop, must not start the locos again
+  DCC_BC_Stop.repeat = 10;            // the repetitions
+  put_in_queue_hp(&DCC_BC_Stop);
 
   /*
   // future idea: we could also do a soft stop. (softhalt)
@@ -2150,6 +3626,8 @@ unsigned char convert_speed_to_rail(unsigned char speed128, t_format format) {
   direction = speed128 & 0x80;
   
   switch(format) {
+    case MM1:   // Motorola: 14 steps, as DCC14
+    case MM2:
     case DCC14:
         if (myspeed > 1) 
           {
@@ -2179,6 +3657,8 @@ unsigned char convert_speed_from_rail(unsigned char speed, t_format format) {
   direction = speed & 0x80;
 
   switch(format) {
+    case MM1:
+    case MM2:
     case DCC14:
         if (myspeed > 1) 
           {
@@ -2222,13 +3702,11 @@ unsigned char put_in_queue_prog(t_message *new_message) {
   unsigned char i;
 
   // now feed in queue_prog
-  // queue_prog[prog_write].repeat = new_message->repeat;
-  // queue_prog[prog_write].qualifier = new_message->qualifier;
-  // memcpy(queue_prog[prog_write].dcc, new_message->dcc, new_message->size);
-  memcpy(&queue_prog[prog_write], new_message, sizeof(t_message));
+  if (!qentry_put(&queue_prog[prog_write], new_message)) return(ORGZ_FULL);   // packet pool exhausted
 
   prog_write++;
   if (prog_write == SIZE_QUEUE_PROG) prog_write = 0;
+  if (prog_write == prog_read) flush_queue(queue_prog, SIZE_QUEUE_PROG);
 
   // check for full (with reserved entry)
   i = prog_write + 1;
@@ -2246,58 +3724,46 @@ unsigned char put_in_queue_prog(t_message *new_message) {
 //-----------------------------------------------------------------------------------
 
 // return : 0 : OK, 0xFF = NOK
+// *lbEntry: unpacked copy of the entry, valid until the next call
 uint8_t lb_GetEntry (uint16_t locAddress, locomem **lbEntry) {
+  uint8_t lbIndex;
   if (locAddress == 0) return (0xFF);
 
-  for (uint8_t i=0;i<SIZE_LOCOBUFFER;i++) {
-    if (locobuffer[i].address == locAddress){
-      *lbEntry = &locobuffer[i];
-      return(0);
-    } 
-  }
-  return (0xFF);
+  lbIndex = lb_hash_find(locAddress);
+  if (lbIndex == LB_HASH_EMPTY) return (0xFF);
+  *lbEntry = lb_load(lbIndex);
+  return(0);
 } // lb_GetEntry
 
 void lb_ReleaseLoc(uint16_t locAddress) {
-  uint8_t i;
+  uint8_t lbIndex;
   if (locAddress == 0) return;
-  
-  for (i=0; i<SIZE_LOCOBUFFER; i++) {
-    if (locobuffer[i].address == locAddress) {
-      locobuffer[i].active = 0; // the loc will no longer be refreshed, but current settings remain in the locobuffer
-    }
+
+  lbIndex = lb_hash_find(locAddress);
+  if (lbIndex != LB_HASH_EMPTY) {
+    lb_state[lbIndex] &= ~LB_ACTIVE; // the loc will no longer be refreshed, but current settings remain in the locobuffer
   }
 } // lb_DeleteEntry
 //-----------------------------------------------------------------------------------
-// scan locobuffer and return the next address; 0 if not found
+// return the next address in the locobuffer; 0 if not found
 // note: we do not return the locobuffer directly, but we sort the answer
 //       according to the loco address.
 //       dir=1: scan forward - returns the next higher loco addr;
-//              if there is not higher addr - return the same.
 //       dir=0: scan backward - returns the next lower.
-// This function is used by xpressnet
-unsigned int lb_FindNextAddress(unsigned int locAddress, unsigned char searchDirection)    //
+// This function is used by xpressnet (rarely), so a scan of the used entries is good enough.
+uint16_t lb_FindNextAddress(uint16_t locAddress, unsigned char searchDirection)    //
 {
-  unsigned char i;
-  unsigned int next_addr;
+  uint16_t addr, found = 0;
+  uint8_t i;
 
-  if (searchDirection) { // forward
-    next_addr = 0xffff;    
-    for (i=0; i<SIZE_LOCOBUFFER; i++) {
-      if ((locobuffer[i].address > locAddress) && (locobuffer[i].address < next_addr)) {
-        next_addr = locobuffer[i].address;
-      }
+  for (i=0; i<lb_fill; i++) {
+    addr = lb_address(i);
+    if (searchDirection) { // forward: smallest above
+      if ((addr > locAddress) && ((found == 0) || (addr < found))) found = addr;
     }
-    if (next_addr == 0xffff) next_addr = 0;
-  }
-  else { // reverse
-    next_addr = 0;    
-    for (i=0; i<SIZE_LOCOBUFFER; i++) {
-      if ((locobuffer[i].address < locAddress) && (locobuffer[i].address > next_addr)) {
-        next_addr = locobuffer[i].address;
-      }
+    else { // reverse: largest below
+      if ((addr < locAddress) && (addr > found)) found = addr;
     }
-    if (next_addr == 0) next_addr = 0;
   }
-  return(next_addr);
+  return(found);
 } // lb_FindNextAddress
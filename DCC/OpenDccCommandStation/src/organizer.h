@@ -49,6 +49,20 @@ void organizer_Run();   // must be called in a loop!
 void organizer_Restart(); // TODO SDS2021 : voorlopig toegevoegd om direct access naar organizer_state via global door status.cpp weg te werken
 extern unsigned char orgz_old_lok_owner;
 bool organizer_IsReady();                                     // true if command can be accepted
+#ifdef NATIVE_BENCH
+uint8_t organizer_CheckPool(uint16_t *evictions);            // packet pool consistency (tools/packet_bench.cpp)
+typedef struct {
+  uint32_t lookups;                                           // calls of the search
+  uint32_t probes;                                            // index entries / buckets looked at
+  uint8_t max;                                                // longest search
+} t_probe_stat;
+#define PROBE_LB        0                                     // locobuffer: address index
+#define PROBE_RB_FIND   1                                     // repeatbuffer: key index
+#define PROBE_RB_NEXT   2                                     //   next repeat (search_repeatbuffer), buckets
+#define PROBE_RB_FREE   3                                     //   entry for a new message, buckets
+#define PROBE_NUM       4
+void organizer_GetProbes(t_probe_stat *stat);                // [PROBE_NUM], and reset (tools/packet_bench.cpp)
+#endif
 void organizer_SendDccStartupMessages (); // stond in opendcc uncommented, lijkt geen verschil te maken?
 
 unsigned char convert_speed_to_rail(unsigned char speed128, t_format format);
@@ -59,6 +73,8 @@ unsigned char convert_speed_from_rail(unsigned char speed, t_format format);
 #define ORGZ_SLOW_DOWN  0x1    // Bit 0: last entry to locobuffer slowed down
 #define ORGZ_STOLEN     0x2    // Bit 1: locomotive has been stolen
 #define ORGZ_NEW        0x4    // Bit 2: new entry created for locomotive
+#define ORGZ_DIR_CHANGE 0x8    // Bit 3: last entry to locobuffer changed the direction
+#define ORGZ_FHIGH_FULL 0x10   // Bit 4: F13..F28 rejected, the pool (SIZE_LOCOBUFFER_FHIGH) is held by active locos
 #define ORGZ_FULL       0x80   // Bit 7: organizer fully loaded
 
 // Note on stolen locomotives:
@@ -83,6 +99,9 @@ unsigned char do_loco_func_grp3(unsigned char slot, unsigned int locAddress, uns
 #if (DCC_XLIMIT==1)
  bool do_loco_restricted_speed(unsigned int locAddress, unsigned char data);
 #endif
+#if (MAERKLIN_ENABLED == 1)
+ unsigned char do_loco_format(unsigned int locAddress, t_format format);   // DCC14..DCC128, MM1, MM2; 0: not possible
+#endif
 
 void do_all_stop();
 uint8_t do_accessory(unsigned int turnoutAddress, unsigned char coil, unsigned char activate);
@@ -119,6 +138,8 @@ unsigned char put_in_queue_prog(t_message *new_message);
 //
 // how:       every speed command is entered to locobuffer to be refreshed.
 //            "younger" locos are refreshed more often.
+//            the locobuffer is kept packed; lb_GetEntry returns an unpacked copy
+//            (read only, valid until the next call)
 uint8_t lb_GetEntry (uint16_t locAddress, locomem **lbEntry);
 void lb_ReleaseLoc(uint16_t locAddress);
 // searchDirection : 0 = forward, 1 = reverse
@@ -0,0 +1,73 @@
+//----------------------------------------------------------------
+//
+// OpenDCC
+//
+// This source file is subject of the GNU general public license 2,
+// that is available at the world-wide-web at
+// http://www.gnu.org/licenses/gpl.txt
+//
+//-----------------------------------------------------------------
+//
+// file:      pkttrace.cpp
+// history:   2026-10-16 V0.1 started
+//
+//-----------------------------------------------------------------
+//
+// purpose:   lowcost central station for dcc
+// content:   trace of the packets handed over to dccout, see pkttrace.h
+//
+//-----------------------------------------------------------------
+
+#include "Arduino.h"
+#include "config.h"
+#include "pkttrace.h"
+
+#if (PACKET_TRACE == 1)
+
+static t_pkttrace pkttrace[SIZE_PACKET_TRACE];
+static unsigned char pkttrace_write;         // next entry to write
+static unsigned char pkttrace_fill;          // valid entries
+static uint32_t pkttrace_count[TRACE_SRC_NUM];
+
+void pkttrace_Reset() {
+  unsigned char i;
+
+  pkttrace_write = 0;
+  pkttrace_fill = 0;
+  for (i=0; i<TRACE_SRC_NUM; i++) pkttrace_count[i] = 0;
+} // pkttrace_Reset
+
+void pkttrace_Record(unsigned char source, t_message *msg) {
+  t_pkttrace *entry;
+
+  if ((msg->dcc[0] == 0xFF) && (msg->size == 2)) source = TRACE_SRC_IDLE;
+  pkttrace_count[source]++;
+
+  entry = &pkttrace[pkttrace_write];
+  entry->time = (uint16_t)millis();
+  entry->source_type = (source << 4) | msg->type;
+  entry->size = msg->size;
+  entry->dcc[0] = msg->dcc[0];
+  entry->dcc[1] = msg->dcc[1];
+  pkttrace_write = (pkttrace_write + 1) & (SIZE_PACKET_TRACE - 1);
+  if (pkttrace_fill < SIZE_PACKET_TRACE) pkttrace_fill++;
+} // pkttrace_Record
+
+unsigned char pkttrace_Get(t_pkttrace *entries, unsigned char num) {
+  unsigned char i, index;
+
+  if (num > pkttrace_fill) num = pkttrace_fill;
+  index = (pkttrace_write - num) & (SIZE_PACKET_TRACE - 1);
+  for (i=0; i<num; i++) {
+    entries[i] = pkttrace[index];
+    index = (index + 1) & (SIZE_PACKET_TRACE - 1);
+  }
+  return(num);
+} // pkttrace_Get
+
+uint32_t pkttrace_GetCount(unsigned char source) {
+  if (source >= TRACE_SRC_NUM) return(0);
+  return(pkttrace_count[source]);
+} // pkttrace_GetCount
+
+#endif // PACKET_TRACE
@@ -0,0 +1,65 @@
+//----------------------------------------------------------------
+//
+// OpenDCC
+//
+// This source file is subject of the GNU general public license 2,
+// that is available at the world-wide-web at
+// http://www.gnu.org/licenses/gpl.txt
+//
+//-----------------------------------------------------------------
+//
+// file:      pkttrace.h
+// history:   2026-10-16 V0.1 started
+//
+//-----------------------------------------------------------------
+//
+// purpose:   lowcost central station for dcc
+// content:   trace of the packets the organizer hands over to dccout
+//            (compile switch PACKET_TRACE in config.h)
+//
+// how:       organizer_Run records every packet with its source (queue),
+//            type, address and time in a ring of SIZE_PACKET_TRACE entries
+//            and counts the packets per source.
+//            Idle packets are counted as TRACE_SRC_IDLE, whatever queue they come from.
+//            Idle packets dccout sends by itself (dcc_ring empty) are not traced,
+//            see dccout_GetUnderruns().
+//            Host benchmark: tools/packet_bench.cpp ([env:native_bench])
+//
+//-----------------------------------------------------------------
+#ifndef __PKTTRACE_H__
+#define __PKTTRACE_H__
+
+#define TRACE_SRC_HP          0     // queue_hp
+#define TRACE_SRC_LP          1     // queue_lp
+#define TRACE_SRC_REPEAT      2     // repeatbuffer
+#define TRACE_SRC_LOCOBUFFER  3     // refresh
+#define TRACE_SRC_IDLE        4     // idle packet
+#define TRACE_SRC_PROG        5     // queue_prog
+#define TRACE_SRC_DIRECT      6     // set_next_message() (startup)
+#define TRACE_SRC_NUM         7
+
+#define SIZE_PACKET_TRACE     32    // must be power of 2
+
+typedef struct {
+  uint16_t time;                    // millis(), lower 16 bits
+  uint8_t  source_type;             // source << 4 | t_msg_type
+  uint8_t  size;
+  uint8_t  dcc[2];                  // address (short: dcc[0], long: dcc[0..1])
+} t_pkttrace;
+
+#if (PACKET_TRACE == 1)
+
+void pkttrace_Reset();
+void pkttrace_Record(unsigned char source, t_message *msg);     // organizer only, not from ISR
+unsigned char pkttrace_Get(t_pkttrace *entries, unsigned char num); // last num entries, oldest first; ret: number copied
+uint32_t pkttrace_GetCount(unsigned char source);               // packets since reset
+
+#define PKTTRACE(source, msg)   pkttrace_Record(source, msg)
+
+#else
+
+#define PKTTRACE(source, msg)
+
+#endif // PACKET_TRACE
+
+#endif // __PKTTRACE_H__
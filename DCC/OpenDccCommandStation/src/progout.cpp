@@ -0,0 +1,126 @@
+//----------------------------------------------------------------
+//
+// OpenDCC
+//
+// This source file is subject of the GNU general public license 2,
+// that is available at the world-wide-web at
+// http://www.gnu.org/licenses/gpl.txt
+//
+//-----------------------------------------------------------------
+//
+// file:      progout.cpp
+// history:   2026-10-16 V0.1 started
+//
+//-----------------------------------------------------------------
+//
+// purpose:   lowcost central station for dcc
+// content:   ISR for the dcc output of the programming track, see progout.h
+//
+//-----------------------------------------------------------------
+
+#include "Arduino.h"
+#include "hardware.h"               // PROG_DCC
+#include "config.h"                 // general structures and definitions
+#include "dccout.h"                 // struct next_message_s
+#include "progout.h"                // import own header
+
+#if (PROG_TRACK_CONCURRENT == 1)
+
+#if (TIMER2_TICK_PERIOD != 4)
+#error progout needs timer2 with div 64 (4us), see timer2_Init()
+#endif
+
+#define PROG_PREAMBLE  20                                                  // service mode: at least 20 (S-9.2.3)
+#define PO_HALF_1      ((58 + TIMER2_TICK_PERIOD - 1) / TIMER2_TICK_PERIOD)  // 60us, S-9.1: 55..61us
+#define PO_HALF_0      (116 / TIMER2_TICK_PERIOD)                          // 116us, same as dccout
+
+struct next_message_s next_prog_message;    // see progout.h
+
+volatile unsigned char next_prog_count;
+
+typedef enum { PO_PREAMBLE, PO_BSTART, PO_BYTE, PO_XOR, PO_END_BIT } t_po_state;
+
+static struct {
+  unsigned char state;              // t_po_state
+  unsigned char bits;               // preamble: ones still to send, byte / xor: bits left
+  unsigned char mid;                // 1: the next compare match is in the middle of the bit
+  unsigned char ticks;              // half bit of the current bit
+  unsigned char bytes_in_message;
+  unsigned char ibyte;
+  unsigned char cur_byte;
+  unsigned char xor_byte;
+  unsigned char current_dcc[MAX_DCC_SIZE];
+} po;
+
+// the next bit on the rails, advances the state engine
+static inline unsigned char po_next_bit() __attribute__((always_inline));
+unsigned char po_next_bit() {
+  unsigned char bit;
+
+  switch (po.state) {
+    case PO_PREAMBLE:
+      if (po.bits != 0) {
+        po.bits--;
+        return (1);
+      }
+      if (next_prog_count == 0) return (1);       // nothing to send, longer preamble
+      memcpy(po.current_dcc, next_prog_message.dcc, sizeof(po.current_dcc));
+      po.bytes_in_message = next_prog_message.size;
+      po.ibyte = 0;
+      po.xor_byte = 0;
+      next_prog_count--;
+      // fall through: packet start bit
+    case PO_BSTART:
+      if (po.bytes_in_message == 0) {             // message done, goto xor
+        po.cur_byte = po.xor_byte;
+        po.state = PO_XOR;
+      }
+      else {                                      // get next addr or data
+        po.bytes_in_message--;
+        po.cur_byte = po.current_dcc[po.ibyte++];
+        po.xor_byte ^= po.cur_byte;
+        po.state = PO_BYTE;
+      }
+      po.bits = 8;
+      return (0);
+    case PO_BYTE:
+    case PO_XOR:
+      bit = (po.cur_byte & 0x80) ? 1 : 0;
+      po.cur_byte <<= 1;
+      if (--po.bits == 0) po.state = (po.state == PO_XOR) ? PO_END_BIT : PO_BSTART;
+      return (bit);
+    default:                                      // PO_END_BIT
+      po.state = PO_PREAMBLE;
+      po.bits = PROG_PREAMBLE;
+      return (1);
+  }
+} // po_next_bit
+
+// OC2A has just toggled: set the compare for the next edge. A bit starts with
+// the rising edge (OC2A is low after progout_Init), both halves have the same length.
+ISR(TIMER2_COMPA_vect) {
+  if (po.mid) po.mid = 0;
+  else {
+    po.mid = 1;
+    po.ticks = po_next_bit() ? PO_HALF_1 : PO_HALF_0;
+  }
+  OCR2A += po.ticks;                // timer2 runs free, wraps at 0xFF
+} // ISR
+
+void progout_Init() {
+  next_prog_count = 0;
+  next_prog_message.size = 2;
+  po.state = PO_PREAMBLE;
+  po.bits = PROG_PREAMBLE;
+  po.mid = 0;
+  po.ticks = PO_HALF_1;
+
+  pinMode(PROG_DCC, OUTPUT);
+  OCR2A = TCNT2 + PO_HALF_1;         // first edge (rising): start of the first bit
+  TCCR2A |= (0<< COM2A1)             // 01 = toggle OC2A (=PROG_DCC) on compare match,
+          | (1<< COM2A0);            //      normal mode: timer2 keeps running free
+  TIFR2 = (1<< OCF2A);
+  TIMSK2 |= (1<< OCIE2A);
+} // progout_Init
+
+#endif // PROG_TRACK_CONCURRENT
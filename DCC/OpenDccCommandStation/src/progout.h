@@ -0,0 +1,50 @@
+//----------------------------------------------------------------
+//
+// OpenDCC
+//
+// This source file is subject of the GNU general public license 2,
+// that is available at the world-wide-web at
+// http://www.gnu.org/licenses/gpl.txt
+//
+//-----------------------------------------------------------------
+//
+// file:      progout.h
+// history:   2026-10-16 V0.1 started
+//
+//-----------------------------------------------------------------
+//
+// purpose:   lowcost central station for dcc
+// content:   second dcc output for the programming track
+//            (compile switch PROG_TRACK_CONCURRENT in config.h)
+//
+// how:       Timer2 keeps running free with div 64 (4us, xpnet and status
+//            read TCNT2); its compare unit A toggles OC2A (= PROG_DCC, D11)
+//            in hardware, ISR(TIMER2_COMPA_vect) only moves OCR2A on by the
+//            next half bit: '1' 15 ticks (60us), '0' 29 ticks (116us).
+//            The programming track booster is fed from PROG_DCC (DIR input,
+//            or an inverter for its second input), the main track booster
+//            stays on DCC / NDCC (timer1, dccout).
+//            Interface like next_message of dccout: the organizer copies a
+//            packet of queue_prog into next_prog_message and sets
+//            next_prog_count to the number of repetitions; the ISR takes a
+//            copy at the end of the preamble (20 bits, service mode) and
+//            decrements the count. Nothing to send: the preamble goes on.
+//            There is no cutout on the programming track.
+//            Host test: tools/dcc_waveform.cpp ([env:native_waveform_prog]).
+//
+//-----------------------------------------------------------------
+#ifndef __PROGOUT_H__
+#define __PROGOUT_H__
+
+#if (PROG_TRACK_CONCURRENT == 1)
+
+// include dccout.h before (struct next_message_s)
+extern struct next_message_s next_prog_message;
+volatile extern unsigned char next_prog_count;     // > 0: next_prog_message is sent this often
+                                                   // = 0: ready for the next packet
+
+void progout_Init();                               // call once at boot up, after timer2_Init
+
+#endif // PROG_TRACK_CONCURRENT
+
+#endif // __PROGOUT_H__
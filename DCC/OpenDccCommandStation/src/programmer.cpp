@@ -31,6 +31,8 @@
 //            2008-08-12 V0.09 Bugfix in XPT_TERM
 //            2008-09-05 V0.10 Added prog_qualifier to satisfy lenz protocol
 //            2010-07-18 V0.11 page mode wird nicht mehr auf direct mode gemapped
+//            2026-10-16 V0.12 PROG_TRACK_CONCURRENT: packets go to progout, the main
+//                             track keeps running
 //
 //---------------------------------------------------------------------------
 //
@@ -57,6 +59,7 @@
 #include "hardware.h"              // hardware definitions (ack detection)
 #include "status.h"                // timeout engine, set_state
 #include "dccout.h"                // next message
+#include "progout.h"               // next prog message (PROG_TRACK_CONCURRENT)
 #include "organizer.h"
 #include "programmer.h"
 
@@ -278,6 +281,15 @@ static t_message *prog_message_ptr = &prog_message;
 static t_message page_preset    = {1, {{ 2, is_void}}, {0b01111101, 0b00000001}};
 static t_message *page_preset_ptr = &page_preset;
 
+// the output that sends the service mode packets
+#if (PROG_TRACK_CONCURRENT == 1)
+  #define PROG_MESSAGE_COUNT    next_prog_count                  // progout, programming track only
+  #define PROG_OUTPUT_BUSY()    (next_prog_count != 0)
+#else
+  #define PROG_MESSAGE_COUNT    next_message_count               // dccout, both tracks
+  #define PROG_OUTPUT_BUSY()    ((next_message_count != 0) || !dccout_RingEmpty())
+#endif
+
 //-----------------------------------------------------------------------------------------------
 /// switch opendcc to progmode
 /// does nothing if already in progmode, else puts a power cycle on the track
@@ -297,7 +309,7 @@ static void programmer_EnterProgMode() {
     case RUN_SHORT:                 // Kurzschluss
     case RUN_PAUSE:                 // DCC Running, all Engines Speed 0
       opendcc_state_before_prog = opendcc_state;
-      while (next_message_count != 0);    // busy wait for current message to terminate
+      while (PROG_OUTPUT_BUSY()) BUSY_WAIT();    // busy wait for current message to terminate
                                           // do not allow organizer to load next command!
       status_SetState(PROG_OKAY);
       pDCC_Reset.repeat = 20;             // 20 reset packets -> power on cycle	 
@@ -308,7 +320,7 @@ static void programmer_EnterProgMode() {
     case PROG_SHORT:                //
     case PROG_OFF:
     case PROG_ERROR:
-      while (next_message_count != 0);    // busy wait for current message to terminate
+      while (PROG_OUTPUT_BUSY()) BUSY_WAIT();    // busy wait for current message to terminate
       status_SetState(PROG_OKAY);
       pDCC_Reset.repeat = 20;             // 20 reset packets -> power on cycle	 
       put_in_queue_prog(dcc_reset_ptr);
@@ -317,8 +329,11 @@ static void programmer_EnterProgMode() {
 } // programmer_EnterProgMode
 
 static void programmer_LeaveProgMode() {
-  while (next_message_count != 0);  // busy wait for current message to terminate
+  while (PROG_OUTPUT_BUSY()) BUSY_WAIT();  // busy wait for current message to terminate
                                     // do not allow organizer to load next command!
+#if (PROG_TRACK_CONCURRENT == 1)
+  opendcc_state_before_prog = main_track_state;   // the main track may have changed meanwhile (short)
+#endif
   switch(opendcc_state_before_prog) {
     case RUN_OKAY:
     case RUN_STOP:             // DCC Running, all Engines Emergency Stop
@@ -527,7 +542,7 @@ static void run_prog_inner_task() {
 
         cli();
         // skip further repetitions -> fool dccout - this is dirty! 
-        if (next_message_count>1) next_message_count=1;     
+        if (PROG_MESSAGE_COUNT>1) PROG_MESSAGE_COUNT=1;     
         sei();
         
         pi_result = PT_OKAY;              // 0 = we got a result
@@ -536,7 +551,7 @@ static void run_prog_inner_task() {
         return;
       }
       //sds LED_CTRL_OFF;
-      if (next_message_count > 1) return;   // again dirty: we ask the communication flag
+      if (PROG_MESSAGE_COUNT > 1) return;   // again dirty: we ask the communication flag
                                             // our message goes with rep 5, so 5...1
                                             // is our time to wait for ACK;                                               
 
@@ -0,0 +1,326 @@
+//----------------------------------------------------------------
+//
+// OpenDCC
+//
+// This source file is subject of the GNU general public license 2,
+// that is available at the world-wide-web at
+// http://www.gnu.org/licenses/gpl.txt
+//
+//-----------------------------------------------------------------
+//
+// file:      railcom.cpp
+// history:   2026-10-16 V0.1 started
+//
+//-----------------------------------------------------------------
+//
+// purpose:   lowcost central station for dcc
+// content:   RailCom receiver and decoder, see railcom.h
+//
+//-----------------------------------------------------------------
+
+#include "Arduino.h"
+#include "config.h"
+#include "railcom.h"
+
+#if (RAILCOM_DETECTOR == 1)
+
+#if !defined(NATIVE_HAL) && !(__AVR_ATmega644P__)
+#error RAILCOM_DETECTOR needs USART1 (atmega644P), USART0 is used by xpressnet
+#endif
+#if (RAILCOM_ENABLED == 0)
+#error RAILCOM_DETECTOR needs RAILCOM_ENABLED (the cutout)
+#endif
+
+// 4 of 8 code -> 6 bit value (RCN-217), 0x87 and 0xC3 are not used
+#define INV  RC_INVALID
+#define ACK  RC_ACK
+#define NAK  RC_NACK
+#define BSY  RC_BUSY
+static const uint8_t rc_decode[256] PROGMEM = {
+  INV,INV,INV,INV,INV,INV,INV,INV,INV,INV,INV,INV,INV,INV,INV,ACK,  // 00 .. 0F
+  INV,INV,INV,INV,INV,INV,INV, 51,INV,INV,INV, 52,INV, 53, 54,INV,  // 10 .. 1F
+  INV,INV,INV,INV,INV,INV,INV, 58,INV,INV,INV, 59,INV, 60, 55,INV,  // 20 .. 2F
+  INV,INV,INV, 63,INV, 61, 56,INV,INV, 62, 57,INV,NAK,INV,INV,INV,  // 30 .. 3F
+  INV,INV,INV,INV,INV,INV,INV, 36,INV,INV,INV, 35,INV, 34, 33,INV,  // 40 .. 4F
+  INV,INV,INV, 31,INV, 30, 32,INV,INV, 29, 28,INV, 27,INV,INV,INV,  // 50 .. 5F
+  INV,INV,INV, 25,INV, 24, 26,INV,INV, 23, 22,INV, 21,INV,INV,INV,  // 60 .. 6F
+  INV, 37, 20,INV, 19,INV,INV,INV, 50,INV,INV,INV,INV,INV,INV,INV,  // 70 .. 7F
+  INV,INV,INV,INV,INV,INV,INV,INV,INV,INV,INV, 14,INV, 13, 12,INV,  // 80 .. 8F
+  INV,INV,INV, 10,INV,  9, 11,INV,INV,  8,  7,INV,  6,INV,INV,INV,  // 90 .. 9F
+  INV,INV,INV,  4,INV,  3,  5,INV,INV,  2,  1,INV,  0,INV,INV,INV,  // A0 .. AF
+  INV, 15, 16,INV, 17,INV,INV,INV, 18,INV,INV,INV,INV,INV,INV,INV,  // B0 .. BF
+  INV,INV,INV,INV,INV, 43, 48,INV,INV, 42, 47,INV, 49,INV,INV,INV,  // C0 .. CF
+  INV, 41, 46,INV, 45,INV,INV,INV, 44,INV,INV,INV,INV,INV,INV,INV,  // D0 .. DF
+  INV,BSY, 40,INV, 39,INV,INV,INV, 38,INV,INV,INV,INV,INV,INV,INV,  // E0 .. EF
+  ACK,INV,INV,INV,INV,INV,INV,INV,INV,INV,INV,INV,INV,INV,INV,INV,  // F0 .. FF
+};
+#undef INV
+#undef ACK
+#undef NAK
+#undef BSY
+
+volatile uint8_t railcom_armed;
+uint8_t railcom_dcc[4];
+
+static t_railcom_cutout rc_ring[SIZE_RAILCOM_RING];
+static volatile uint8_t rc_write;            // next cutout to receive (ISR)
+static uint8_t rc_read;                      // next cutout to decode (railcom_Run)
+static t_railcom_cutout *rc_rx;              // being received
+static t_railcom_stat rc_stat;               // cutouts, overruns: ISR
+
+typedef struct {
+  uint16_t addr;                             // 0: free
+  uint16_t time;                             // millis() of the last answer
+} t_rc_seen;
+
+static t_rc_seen rc_seen[SIZE_RAILCOM_SEEN];
+static uint8_t rc_seen_age;                  // entry checked for timeout by the next railcom_Run
+static uint8_t rc_adr_high;                  // channel 1: ADR_HIGH of a previous cutout, 0xFF: none
+static unsigned int rc_channel1;             // channel 1: last complete address
+
+static t_railcom_pom rc_pom_state;
+static unsigned int rc_pom_addr;
+static unsigned int rc_pom_cv;
+static uint8_t rc_pom_data;
+static uint16_t rc_pom_since;
+
+#define RC_ID_POM       0                    // channel 2: cv value of a pom read / write
+#define RC_ID_ADR_HIGH  1                    // channel 1
+#define RC_ID_ADR_LOW   2                    // channel 1
+
+//---------------------------------------------------------------------------------
+// ISR side: receiver on during the cutout only
+//---------------------------------------------------------------------------------
+
+static inline void rc_receive(uint8_t c, uint16_t ticks) __attribute__((always_inline));
+void rc_receive(uint8_t c, uint16_t ticks) {
+  t_railcom_cutout *rec = rc_rx;
+
+  if (rec->n < sizeof(rec->data)) {
+    rec->data[rec->n++] = c;
+    if (ticks < RAILCOM_CH2_TICKS) rec->ch1 = rec->n;
+  }
+}
+
+#ifdef NATIVE_HAL
+// no USART1 in native_hal: a recording from railcom_Replay() is received by the next cutout
+static const uint16_t *rc_replay_us;
+static const uint8_t *rc_replay_bytes;
+static uint8_t rc_replay_n;
+
+void railcom_Replay(const uint16_t *us, const uint8_t *bytes, uint8_t n) {
+  rc_replay_us = us;
+  rc_replay_bytes = bytes;
+  rc_replay_n = n;
+}
+
+static void rc_rx_on() {
+  uint8_t i;
+
+  for (i=0; i<rc_replay_n; i++)          // rx interrupt 40us (10 bits) after the start bit
+    rc_receive(rc_replay_bytes[i], (rc_replay_us[i] + 40) * (F_CPU / 1000000L));
+  rc_replay_n = 0;
+}
+#define RC_RX_ON()   rc_rx_on()
+#define RC_RX_OFF()
+#else
+#define RC_RX_ON()   UCSR1B = (1<<RXEN1) | (1<<RXCIE1)
+#define RC_RX_OFF()  UCSR1B = 0             // also flushes the receiver
+
+ISR(USART1_RX_vect) {
+  uint8_t status = UCSR1A;
+  uint8_t c = UDR1;
+
+  if (status & ((1<<FE1) | (1<<DOR1))) c = 0;     // no 4 of 8 code -> counted as error
+  if (railcom_armed) rc_receive(c, TCNT1);        // TCNT1 was cleared at the start of the cutout
+} // USART1_RX_vect
+#endif
+
+void railcom_CutoutBegin(uint8_t type, uint8_t *dcc) {
+  t_railcom_cutout *rec;
+
+  rc_stat.cutouts++;
+  if (((rc_write + 1) & (SIZE_RAILCOM_RING - 1)) == rc_read) {
+    rc_stat.overruns++;
+    return;
+  }
+  rec = &rc_ring[rc_write];
+  rec->type = type;
+  memcpy(rec->dcc, dcc, sizeof(rec->dcc));
+  rec->n = 0;
+  rec->ch1 = 0;
+  rc_rx = rec;
+  railcom_armed = 1;
+  RC_RX_ON();
+} // railcom_CutoutBegin
+
+void railcom_CutoutEnd() {
+  RC_RX_OFF();
+  railcom_armed = 0;
+  if (rc_rx->n) rc_write = (rc_write + 1) & (SIZE_RAILCOM_RING - 1);   // nothing received: no record
+} // railcom_CutoutEnd
+
+//---------------------------------------------------------------------------------
+// main loop side
+//---------------------------------------------------------------------------------
+
+void railcom_Init() {
+#ifndef NATIVE_HAL
+  UBRR1H = 0;
+  UBRR1L = F_CPU / 16 / 250000L - 1;           // 250 kBaud
+  UCSR1A = 0;
+  UCSR1C = (1<<UCSZ11) | (1<<UCSZ10);          // 8N1
+  UCSR1B = 0;                                  // off until the first cutout
+#endif
+  railcom_armed = 0;
+  rc_write = 0;
+  rc_read = 0;
+  memset(&rc_stat, 0, sizeof(rc_stat));
+  memset(rc_seen, 0, sizeof(rc_seen));
+  rc_seen_age = 0;
+  rc_adr_high = 0xFF;
+  rc_channel1 = 0;
+  rc_pom_state = RC_POM_NONE;
+} // railcom_Init
+
+static void rc_set_seen(unsigned int addr) {
+  uint8_t i, oldest = 0;
+  uint16_t now = millis();
+
+  for (i=0; i<SIZE_RAILCOM_SEEN; i++) {
+    if (rc_seen[i].addr == addr) break;
+    if (rc_seen[i].addr == 0) oldest = i;                 // free entry: take it
+    else if ((rc_seen[oldest].addr != 0) &&
+             ((uint16_t)(now - rc_seen[i].time) > (uint16_t)(now - rc_seen[oldest].time))) oldest = i;
+  }
+  if (i == SIZE_RAILCOM_SEEN) {                          // new loco, replaces the oldest one
+    i = oldest;
+    rc_seen[i].addr = addr;
+  }
+  rc_seen[i].time = now;
+} // rc_set_seen
+
+bool railcom_IsOnTrack(unsigned int addr) {
+  uint8_t i;
+
+  for (i=0; i<SIZE_RAILCOM_SEEN; i++) {
+    if (rc_seen[i].addr == addr)
+      return ((uint16_t)((uint16_t)millis() - rc_seen[i].time) <= RAILCOM_SEEN_TIMEOUT);
+  }
+  return(false);
+} // railcom_IsOnTrack
+
+unsigned int railcom_GetChannel1() {
+  return(rc_channel1);
+}
+
+void railcom_GetStat(t_railcom_stat *stat) {
+  cli();
+  *stat = rc_stat;
+  sei();
+}
+
+void railcom_ExpectPom(unsigned int addr, unsigned int cv) {
+  rc_pom_addr = addr;
+  rc_pom_cv = cv;
+  rc_pom_since = millis();
+  rc_pom_state = RC_POM_BUSY;
+} // railcom_ExpectPom
+
+t_railcom_pom railcom_GetPomResult(unsigned int *cv, uint8_t *data) {
+  t_railcom_pom result = rc_pom_state;
+
+  *cv = rc_pom_cv;
+  *data = rc_pom_data;
+  if (result != RC_POM_BUSY) rc_pom_state = RC_POM_NONE;
+  return(result);
+} // railcom_GetPomResult
+
+// loco address of the packet before the cutout (doi.type and the first bytes),
+// 0: no loco packet; *instr: index of the instruction byte in dcc[]
+static unsigned int rc_packet_addr(t_railcom_cutout *rec, uint8_t *instr) {
+  if ((rec->type == is_acc) || (rec->type == is_stop)) return(0);
+  if ((rec->dcc[0] >= 1) && (rec->dcc[0] <= DCC_SHORT_ADDR_LIMIT)) {
+    *instr = 1;
+    return(rec->dcc[0]);
+  }
+  if ((rec->dcc[0] >= 0xC0) && (rec->dcc[0] <= 0xE7)) {     // long address
+    *instr = 2;
+    return(((rec->dcc[0] & 0x3F) << 8) | rec->dcc[1]);
+  }
+  return(0);
+} // rc_packet_addr
+
+// channel 1: 12 bits, ID and 8 bits data
+static void rc_channel1_datagram(uint8_t id, uint8_t data) {
+  if (id == RC_ID_ADR_HIGH) {
+    rc_adr_high = data;
+  }
+  else if ((id == RC_ID_ADR_LOW) && (rc_adr_high != 0xFF)) {
+    if (rc_adr_high == 0) rc_channel1 = data;                          // short address
+    else if ((rc_adr_high & 0xC0) == 0x80) rc_channel1 = ((rc_adr_high & 0x3F) << 8) | data;
+    else return;                                                       // consist address etc.
+    rc_adr_high = 0xFF;
+    if (rc_channel1) rc_set_seen(rc_channel1);
+  }
+} // rc_channel1_datagram
+
+// channel 2, ID0 after 'pom cvrd' (1110 01VV VVVVVVVV) to the loco we wait for
+static void rc_pom_answer(t_railcom_cutout *rec, unsigned int addr, uint8_t instr, uint8_t data) {
+  unsigned int cv;
+
+  if ((rc_pom_state != RC_POM_BUSY) || (rec->type != is_prog) || (addr != rc_pom_addr)) return;
+  if ((rec->dcc[instr] & 0xFC) != 0xE4) return;            // pom write also answers with ID0
+  cv = (((rec->dcc[instr] & 0x03) << 8) | rec->dcc[instr + 1]) + 1;
+  if (cv != rc_pom_cv) return;
+  rc_pom_data = data;
+  rc_pom_state = RC_POM_OKAY;
+} // rc_pom_answer
+
+static void rc_decode_cutout(t_railcom_cutout *rec) {
+  uint8_t sym[sizeof(rec->data)];
+  uint8_t i, valid = 0;
+  uint8_t instr;
+  unsigned int addr;
+
+  for (i=0; i<rec->n; i++) {
+    sym[i] = pgm_read_byte(&rc_decode[rec->data[i]]);
+    if (sym[i] == RC_INVALID) rc_stat.errors++;
+    else valid = 1;
+  }
+  if (!valid) return;
+  rc_stat.answers++;
+
+  if ((rec->ch1 == 2) && (sym[0] < 64) && (sym[1] < 64))
+    rc_channel1_datagram(sym[0] >> 2, ((sym[0] & 0x03) << 6) | sym[1]);
+
+  if (rec->n == rec->ch1) return;                         // nothing in channel 2
+  addr = rc_packet_addr(rec, &instr);
+  if (addr == 0) return;
+  i = rec->ch1;
+  if ((sym[i] == RC_ACK) || (sym[i] == RC_NACK) || (sym[i] == RC_BUSY)) {
+    rc_set_seen(addr);                                    // only the addressed decoder uses channel 2
+  }
+  else if ((rec->n - i >= 2) && (sym[i] < 64) && (sym[i+1] < 64)) {
+    rc_set_seen(addr);
+    if ((sym[i] >> 2) == RC_ID_POM)
+      rc_pom_answer(rec, addr, instr, ((sym[i] & 0x03) << 6) | sym[i+1]);
+  }
+} // rc_decode_cutout
+
+void railcom_Run() {
+  t_rc_seen *seen;
+
+  seen = &rc_seen[rc_seen_age];                           // one entry per call: millis() is only 16 bits here
+  if (seen->addr && ((uint16_t)((uint16_t)millis() - seen->time) > RAILCOM_SEEN_TIMEOUT)) seen->addr = 0;
+  rc_seen_age = (rc_seen_age + 1) & (SIZE_RAILCOM_SEEN - 1);
+
+  if ((rc_pom_state == RC_POM_BUSY) && ((uint16_t)((uint16_t)millis() - rc_pom_since) > RAILCOM_POM_TIMEOUT))
+    rc_pom_state = RC_POM_NOANSWER;
+
+  if (rc_read == rc_write) return;
+  rc_decode_cutout(&rc_ring[rc_read]);
+  rc_read = (rc_read + 1) & (SIZE_RAILCOM_RING - 1);
+} // railcom_Run
+
+#endif // RAILCOM_DETECTOR
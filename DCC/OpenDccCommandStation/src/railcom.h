@@ -0,0 +1,117 @@
+//----------------------------------------------------------------
+//
+// OpenDCC
+//
+// This source file is subject of the GNU general public license 2,
+// that is available at the world-wide-web at
+// http://www.gnu.org/licenses/gpl.txt
+//
+//-----------------------------------------------------------------
+//
+// file:      railcom.h
+// history:   2026-10-16 V0.1 started
+//
+//-----------------------------------------------------------------
+//
+// purpose:   lowcost central station for dcc
+// content:   receiver for the RailCom answers of the decoders
+//            (compile switch RAILCOM_DETECTOR in config.h)
+//
+// how:       A RailCom detector (current sense in the cutout, comparator)
+//            is connected to RXD1: USART1 of the atmega644P, 250 kBaud 8N1.
+//            dccout switches the receiver on when the cutout starts and off
+//            when it ends (RAILCOM_CUTOUT_BEGIN / RAILCOM_CUTOUT_END). The
+//            rx ISR only stores the raw bytes with the channel, taken from
+//            TCNT1 (timer1 is cleared at the start of the cutout).
+//            A cutout goes into a ring of SIZE_RAILCOM_RING records, together
+//            with type and first bytes of the packet before it (doi.type,
+//            doi.current_dcc).
+//            railcom_Run (main loop) decodes the 4 of 8 code (table in flash):
+//            - channel 1: ADR_HIGH / ADR_LOW (alternating) -> address of the loco
+//              in the section (meaningful with one loco per detector)
+//            - channel 2: only the addressed decoder answers -> this loco is on
+//              the track; ID0 (POM) after a pom cvrd packet is the cv value.
+//            Both update the 'seen' table (railcom_IsOnTrack).
+//            do_pom_loco_cvrd registers the cv it asks for (RAILCOM_EXPECT_POM),
+//            the answer is reported as service mode result (xpnet 0x21 0x10).
+//            Host test: tools/railcom_replay.cpp ([env:native_railcom]),
+//            native_hal has no USART1, the bytes come from railcom_Replay().
+//
+//-----------------------------------------------------------------
+#ifndef __RAILCOM_H__
+#define __RAILCOM_H__
+
+#define SIZE_RAILCOM_RING     4     // cutouts waiting for railcom_Run, must be power of 2
+#define SIZE_RAILCOM_SEEN     16    // locos in the 'seen' table, must be power of 2
+#define RAILCOM_SEEN_TIMEOUT  5000  // ms: no answer since -> no longer on track
+#define RAILCOM_POM_TIMEOUT   500   // ms: no ID0 for the expected cv -> not found
+
+// channel 1 ends 177us, channel 2 starts 193us after the end bit, the cutout
+// starts CUTOUT_GAP (30us, dccout.cpp) after the end bit; a byte is complete 40us
+// after its start -> split in the middle of 177 .. 233us.
+#define RAILCOM_CH2_TICKS     (F_CPU / 1000000L * (205 - 30))
+
+// decoded 4 of 8 symbols: 0..63 data, then:
+#define RC_ACK                0x40
+#define RC_NACK               0x41
+#define RC_BUSY               0x42
+#define RC_INVALID            0xFF
+
+typedef struct {
+  uint8_t type;                     // t_msg_type of the packet before the cutout
+  uint8_t dcc[4];                   // its first bytes (address, instruction, cv)
+  uint8_t n;                        // bytes received
+  uint8_t ch1;                      // of these in channel 1
+  uint8_t data[8];                  // raw, 4 of 8 coded
+} t_railcom_cutout;
+
+typedef struct {
+  uint16_t cutouts;                 // receiver armed
+  uint16_t answers;                 // cutouts with at least one valid symbol
+  uint16_t errors;                  // invalid symbols (not 4 of 8, framing)
+  uint16_t overruns;                // ring full, cutout not received
+} t_railcom_stat;
+
+typedef enum {
+  RC_POM_NONE,                      // nothing asked
+  RC_POM_BUSY,                      // waiting for the decoder
+  RC_POM_OKAY,                      // cv and data valid
+  RC_POM_NOANSWER                   // no ID0 within RAILCOM_POM_TIMEOUT
+} t_railcom_pom;
+
+#if (RAILCOM_DETECTOR == 1)
+
+extern volatile uint8_t railcom_armed;     // receiver is on (cutout running)
+extern uint8_t railcom_dcc[4];             // DCCOUT_BITSTREAM: copy of the packet being sent
+
+void railcom_Init();
+void railcom_Run();
+void railcom_CutoutBegin(uint8_t type, uint8_t *dcc);    // dccout ISR only
+void railcom_CutoutEnd();                                // dccout ISR only
+
+void railcom_ExpectPom(unsigned int addr, unsigned int cv);         // cv 1...1024
+t_railcom_pom railcom_GetPomResult(unsigned int *cv, uint8_t *data); // OKAY / NOANSWER are reported once
+bool railcom_IsOnTrack(unsigned int addr);                           // answered within RAILCOM_SEEN_TIMEOUT
+unsigned int railcom_GetChannel1();                                  // last address of channel 1, 0: none
+void railcom_GetStat(t_railcom_stat *stat);
+
+#ifdef NATIVE_HAL
+// recorded detector output (us after start of the cutout, byte), received in the next cutout
+void railcom_Replay(const uint16_t *us, const uint8_t *bytes, uint8_t n);
+#endif
+
+#define RAILCOM_CUTOUT_BEGIN(type, dcc)  railcom_CutoutBegin(type, dcc)
+#define RAILCOM_CUTOUT_END()             if (railcom_armed) railcom_CutoutEnd()
+#define RAILCOM_LOAD(msg_dcc)            memcpy(railcom_dcc, msg_dcc, sizeof(railcom_dcc))
+#define RAILCOM_EXPECT_POM(addr, cv)     railcom_ExpectPom(addr, cv)
+
+#else
+
+#define RAILCOM_CUTOUT_BEGIN(type, dcc)
+#define RAILCOM_CUTOUT_END()
+#define RAILCOM_LOAD(msg_dcc)
+#define RAILCOM_EXPECT_POM(addr, cv)
+
+#endif // RAILCOM_DETECTOR
+
+#endif // __RAILCOM_H__
@@ -47,6 +47,7 @@
 //nodig? #include "hardware.h"
 //TODO 2021 : nodig ? #include "status.h"
 #include "rs232.h"
+#include "isrprof.h"
 
 
 #define my_UCSRA  UCSR0A
@@ -216,6 +217,7 @@ void rs232_Init(t_baud new_baud) {
 //
 
 ISR(USART_RX_vect) {
+  ISRPROF_START();
   if (my_UCSRA & (1<< my_FE)) { // Frame Error 
     rs232_parser_reset_needed = true; // set flag for parser and discard 
 
@@ -237,6 +239,7 @@ ISR(USART_RX_vect) {
         // removed here done with polling of CTS in status.c
     }
   }
+  ISRPROF_STOP(ISRPROF_UART_RX);
 } // ISR USART_RX_vect
 
 //----------------------------------------------------------------------------
@@ -247,6 +250,7 @@ ISR(USART_RX_vect) {
 // Bei 9 Bit konnte noch ein Stopbit erzeugt werden: UCSRB |= (1<<TXB8);
 
 ISR(USART_UDRE_vect) {
+  ISRPROF_START();
   if (tx_read_ptr != tx_write_ptr) {
     my_UCSRA |= (1 << my_TXC);              // writing a one clears any existing tx complete flag
     my_UDR = TxBuffer[tx_read_ptr];
@@ -257,6 +261,7 @@ ISR(USART_UDRE_vect) {
   else {
     my_UCSRB &= ~(1 << my_UDRIE);           // disable further TxINT
   }
+  ISRPROF_STOP(ISRPROF_UART_UDRE);
 } // ISR USART_UDRE_vect
 
 //=============================================================================
@@ -17,6 +17,8 @@
 //                            Xpressnet
 //            2008-08-17 V0.2 changed TxBuff to int.;
 //                            Broadcasts could be buffered
+//            2026-10-16 V0.3 RX: frames are assembled in the ISR (no rx fifo)
+//            2026-10-16 V0.4 TX: queue of messages, sent from the callers buffer
 //
 //------------------------------------------------------------------------
 //
@@ -24,7 +26,7 @@
 // content:   routines for RS485
 //            see also:
 //            xpressnet definition
-//            here: RX and TX Fifos
+//            here: TX message queue, RX frame
 //                  Control of line direction 
 //
 //------------------------------------------------------------------------
@@ -34,6 +36,7 @@
 #if (XPRESSNET_ENABLED == 1)
 
 #include "rs485.h"
+#include "isrprof.h"
 //=====================================================================
 //
 // RS485 --> gebruikt UART0 van de arduino
@@ -44,25 +47,39 @@
 // how:       uart acts with interrupt on fifos.
 //            ohter programs access only the fifos.
 //            hardware flowcontrol (direction pin)
+//            TX: the queue holds call byte and a pointer to the message
+//            (header + data); the UDRE ISR sends it byte by byte directly
+//            from there and adds the xor. No copy, no per byte cli/sei.
+//            RX: the ISR puts the bytes of one request (header, data, xor)
+//            together and checks the xor on the fly; the length comes
+//            with the header. The main loop only sees complete frames.
 //
 // interface: see rs485.h
 //
 //=====================================================================
 
-// FIFO objects for RX and TX
-// max. Size: 255
+// queue of messages for TX, frame for RX
 
-#define X_RxBuffer_Size  32              // mind. 16
-#define X_TxBuffer_Size  32
-static unsigned char X_RxBuffer[X_RxBuffer_Size];
-static unsigned int X_TxBuffer[X_TxBuffer_Size];       // this is int, we have 9 bits
+#define X_TxQueue_Size   8               // must be 2^n, one entry stays free
+#define X_RxFrame_Size   17              // header + 15 data + xor
 
-static unsigned char X_rx_read_ptr = 0;                // point to next read
-static unsigned char X_rx_write_ptr = 0;               // point to next write
-static unsigned char X_rx_fill = 0;
-static unsigned char X_tx_read_ptr = 0;
-static unsigned char X_tx_write_ptr = 0;
-static unsigned char X_tx_fill = 0;
+typedef struct {
+  unsigned char call;                    // call byte, parity included (9th bit is added by the isr)
+  const unsigned char *msg;              // header + data, NULL: call byte only
+} t_xp_tx_entry;
+
+static t_xp_tx_entry X_TxQueue[X_TxQueue_Size];
+static unsigned char X_RxFrame[X_RxFrame_Size];
+
+static unsigned char X_rx_index = 0;                   // next byte of the frame
+static unsigned char X_rx_size = 0;                    // bytes of the frame (from the header)
+static unsigned char X_rx_xor = 0;
+static volatile unsigned char X_rx_state = XP_FRAME_EMPTY;
+static volatile unsigned char X_tx_read_ptr = 0;     // entry on the way (isr)
+static volatile unsigned char X_tx_write_ptr = 0;    // next free entry (main)
+static unsigned char X_tx_pos = 0;                   // 0: call byte, 1..n+1: header+data, n+2: xor
+static unsigned char X_tx_last;                      // position of the last data byte
+static unsigned char X_tx_xor;
 
 static inline void set_XP_to_receive()
 {
@@ -82,9 +99,8 @@ static void XP_flush_rx() { // Flush Receive-Buffer
 
   UCSR0B &= ~(1 << RXEN0);
   UCSR0B |= (1 << RXEN0);
-  X_rx_read_ptr = 0;      
-  X_rx_write_ptr = 0;
-  X_rx_fill = 0; 
+  X_rx_index = 0;
+  X_rx_state = XP_FRAME_EMPTY;
   sei();
 } // XP_flush_rx
 
@@ -107,7 +123,7 @@ void rs485_Init() {
   // FIFOs für Ein- und Ausgabe initialisieren
   X_tx_read_ptr = 0;
   X_tx_write_ptr = 0;
-  X_tx_fill = 0;
+  X_tx_pos = 0;
 
   // UART Receiver und Transmitter anschalten, Receive-Interrupt aktivieren
   // Data mode 9N1, asynchron
@@ -145,42 +161,63 @@ ISR(USART_TX_vect) {
 } // USART_TX_vect
 
 //----------------------------------------------------------------------------
-// Ein Zeichen aus der Ausgabe-FIFO lesen und ausgeben
+// Das nächste Zeichen der aktuellen Meldung ausgeben: Call Byte (9. Bit = 1),
+// Header und Daten direkt aus dem Puffer des Aufrufers, zum Schluss XOR.
 // Ist das Zeichen fertig ausgegeben, wird ein neuer SIG_UART_DATA-IRQ getriggert
-// Ist das FIFO leer, deaktiviert die ISR ihren eigenen IRQ.
+// Ist die Queue leer, deaktiviert die ISR ihren eigenen IRQ.
 
 // We transmit 9 bits
 //sds aangepast voor uart0 ipv uart1
 ISR(USART_UDRE_vect) {
-  union {
-    unsigned int w;
-    unsigned char b[sizeof(unsigned int)];
-  } tdat;
+  t_xp_tx_entry *entry;
+  unsigned char c;
+  ISRPROF_START();
 
   if (X_tx_read_ptr != X_tx_write_ptr) {
     // sds : niet gecomment in rs232.cpp, 
     // allicht omdat we hier de TXC int systematisch gebruiken, 
     // en dan wordt TXC flag automatisch gereset
     // UCSR0A |= (1 << TXC0);   
-    tdat.w = X_TxBuffer[X_tx_read_ptr];
-    if (tdat.b[1]) UCSR0B |= (1<<TXB80);               // set bit 8
-    else           UCSR0B &= ~(1<<TXB80);              // clear bit 8
-    
-    UDR0 = tdat.b[0];
-    X_tx_read_ptr++;
-    if (X_tx_read_ptr == X_TxBuffer_Size) X_tx_read_ptr=0;
-    X_tx_fill--;
+    entry = &X_TxQueue[X_tx_read_ptr];
+    if (X_tx_pos == 0) {
+      UCSR0B |= (1<<TXB80);                            // set bit 8
+      UDR0 = entry->call;
+      if (entry->msg) {
+        X_tx_last = (entry->msg[0] & 0x0F) + 1;
+        X_tx_xor = 0;
+        X_tx_pos = 1;
+      }
+      else X_tx_read_ptr = (X_tx_read_ptr + 1) & (X_TxQueue_Size - 1);
+    }
+    else {
+      UCSR0B &= ~(1<<TXB80);                           // clear bit 8
+      if (X_tx_pos <= X_tx_last) {
+        c = entry->msg[X_tx_pos - 1];
+        X_tx_xor ^= c;
+        UDR0 = c;
+        X_tx_pos++;
+      }
+      else {
+        UDR0 = X_tx_xor;
+        X_tx_pos = 0;
+        X_tx_read_ptr = (X_tx_read_ptr + 1) & (X_TxQueue_Size - 1);
+      }
+    }
   }
   else
     UCSR0B &= ~(1 << UDRIE0);           // disable further TxINT
+  ISRPROF_STOP(ISRPROF_UART_UDRE);
 } // USART_UDRE_vect
 
 //---------------------------------------------------------------------------
-// Empfangene Zeichen werden in die Eingabgs-FIFO gespeichert und warten dort
-// keine überlaufsicherung, da ja wir Master sind.
+// Empfangene Zeichen werden zu einem Frame zusammengesetzt und warten dort,
+// bis der Frame abgeholt ist (XP_rx_frame_reset); was danach kommt, geht verloren.
+// Keine weitere Überlaufsicherung, da ja wir Master sind.
 //
 // sds aangepast voor uart0 ipv uart1
 ISR(USART_RX_vect) {
+  unsigned char c;
+  ISRPROF_START();
   if (UCSR0A & (1<< FE0)) { // Frame Error
     UDR0;  // zumindest lesen, damit der INT stirbt
 	}
@@ -189,11 +226,22 @@ ISR(USART_RX_vect) {
       // !!! 
     }
 
-    X_RxBuffer[X_rx_write_ptr] = UDR0;
-    X_rx_write_ptr++;
-    if (X_rx_write_ptr == X_RxBuffer_Size) X_rx_write_ptr=0;
-    X_rx_fill++; // no check for full, we just do an overrun!
+    c = UDR0;
+    if (X_rx_state <= XP_FRAME_BUSY) {
+      if (X_rx_index == 0) {
+        X_rx_size = (c & 0x0F) + 2;       // header and xor are not counted in the header
+        X_rx_xor = 0;
+        X_rx_state = XP_FRAME_BUSY;
+      }
+      X_RxFrame[X_rx_index++] = c;
+      X_rx_xor ^= c;
+      if (X_rx_index == X_rx_size) {
+        if (X_rx_xor == 0) X_rx_state = XP_FRAME_OK;
+        else X_rx_state = XP_FRAME_BAD;
+      }
+    }
   }
+  ISRPROF_STOP(ISRPROF_UART_RX);
 } // USART_RX_vect
 
 //=============================================================================
@@ -201,40 +249,13 @@ ISR(USART_RX_vect) {
 //-----------------------------------------------------------------------------
 // TX:
 bool XP_tx_ready () {
-  if (X_tx_fill < (X_TxBuffer_Size-18)) { // keep space for one complete message (16)
-    return(true);  // true if enough room
+  if (((X_tx_write_ptr + 1) & (X_TxQueue_Size - 1)) != X_tx_read_ptr) {
+    return(true);  // true if room for one more message
   }
   else return(false);
 } // XP_tx_ready
 
-// ret 1 if full
-// This goes with fifo (up to 32), bit 8 is 0.
-bool XP_send_word (const unsigned int c) {
-  X_TxBuffer[X_tx_write_ptr] = c;
-
-  X_tx_write_ptr++;
-  if (X_tx_write_ptr == X_TxBuffer_Size) X_tx_write_ptr=0;
-
-  cli();
-  X_tx_fill++;
-  sei();
-
-  set_XP_to_transmit();
-  UCSR0A |= (1 << TXC0);      // clear any pending tx complete flag
-  UCSR0B |= (1 << TXEN0);     // enable TX
-  UCSR0B |= (1 << UDRIE0);    // enable TxINT
-  UCSR0B |= (1 << TXCIE0);    // enable TX complete --> sds : dit gaat de ISR(USART_TX_vect) voeden
-
-//    if (X_tx_fill < (X_TxBuffer_Size-18)) // sds : is dit juist???
-  if (X_tx_fill > (X_TxBuffer_Size-18)) return(true);
-  return(false);
-} // XP_send_word
-
-bool XP_send_byte (const unsigned char c) {
-  return(XP_send_word(c));
-} // XP_send_byte
-
-bool XP_send_call_byte (const unsigned char c) {
+static unsigned char call_byte_parity (const unsigned char c) {
   unsigned char my_c, temp;
 
   my_c = c & 0x7F;
@@ -245,35 +266,55 @@ bool XP_send_call_byte (const unsigned char c) {
   
   // alternative: my_c = c & 0x7F;
   // alternative: if (parity_even_bit(my_c)) my_c |= 0x80;
+  return(my_c);
+} // call_byte_parity
+
+// the entry becomes visible to the isr with the write pointer (one byte, no cli needed)
+static void XP_send_entry (const unsigned char call, const unsigned char *msg) {
+  X_TxQueue[X_tx_write_ptr].call = call_byte_parity(call);
+  X_TxQueue[X_tx_write_ptr].msg = msg;
+  X_tx_write_ptr = (X_tx_write_ptr + 1) & (X_TxQueue_Size - 1);
+
+  set_XP_to_transmit();
+  UCSR0A |= (1 << TXC0);      // clear any pending tx complete flag
+  UCSR0B |= (1 << TXEN0);     // enable TX
+  UCSR0B |= (1 << UDRIE0);    // enable TxINT
+  UCSR0B |= (1 << TXCIE0);    // enable TX complete --> sds : dit gaat de ISR(USART_TX_vect) voeden
+} // XP_send_entry
 
-  return(XP_send_word(my_c | 0x100)); //bit 9 op 1 zetten in de call byte
+// only call with XP_tx_ready()
+void XP_send_message (const unsigned char call, const unsigned char *msg) {
+  XP_send_entry(call, msg);
+} // XP_send_message
+
+void XP_send_call_byte (const unsigned char c) {
+  XP_send_entry(c, NULL);
 } // XP_send_call_byte
 
+bool XP_tx_pending (const unsigned char *msg) {
+  unsigned char i;
+
+  for (i = X_tx_read_ptr; i != X_tx_write_ptr; i = (i + 1) & (X_TxQueue_Size - 1)) {
+    if (X_TxQueue[i].msg == msg) return(true);
+  }
+  return(false);
+} // XP_tx_pending
+
 //------------------------------------------------------------------------------
 // RX:
-bool XP_rx_ready () {
-  if (X_rx_read_ptr != X_rx_write_ptr)
-    return(true);     // there is something
-  else return(false);  
-} // XP_rx_ready
-
-//-------------------------------------------------------------------
-// XP_rx_read gets one char from the input fifo
-//
-// there is no check whether a char is ready, this must be
-// done before calling with a call to XP_rx_ready();
-unsigned char XP_rx_read () {
-  unsigned char retval;
+unsigned char XP_rx_frame_state () {
+  return(X_rx_state);
+} // XP_rx_frame_state
 
-  retval = X_RxBuffer[X_rx_read_ptr];
-  X_rx_read_ptr++;
-  if (X_rx_read_ptr == X_RxBuffer_Size) X_rx_read_ptr=0;
+unsigned char *XP_rx_frame () {
+  return(X_RxFrame);
+} // XP_rx_frame
 
+void XP_rx_frame_reset () {
   cli();
-  X_rx_fill--;
+  X_rx_index = 0;
+  X_rx_state = XP_FRAME_EMPTY;
   sei();
-      
-  return(retval);
-} // XP_rx_read
+} // XP_rx_frame_reset
 
 #endif // (XPRESSNET_ENABLED ==1)
@@ -8,16 +8,26 @@
 
 void rs485_Init();
 
-bool XP_send_byte (const unsigned char c);       // sends one byte with isr and fifo, bit 8 = 0
-bool XP_send_call_byte (const unsigned char c);
+// TX: messages are sent by the isr directly from the buffer of the caller (header + data,
+// the xor is added), the buffer must stay unchanged as long as XP_tx_pending() is true.
+void XP_send_message (const unsigned char call, const unsigned char *msg);   // only if XP_tx_ready()
+void XP_send_call_byte (const unsigned char c);                             // only if XP_tx_ready()
+bool XP_tx_pending (const unsigned char *msg);  // msg is queued or being sent
 
 inline __attribute__((always_inline))
 bool XP_is_all_sent () // true if fifo is empty and all data are sent
 {
   return (digitalRead(RS485_DERE) != RS485Transmit);  // just look at driver bit
 }
-bool XP_tx_ready ();    // true if byte can be sent
-uint8_t XP_rx_read ();  // reads one byte
-bool XP_rx_ready ();    // true if one byte can be read
+bool XP_tx_ready ();    // true if a message can be queued
+
+// RX: the ISR assembles one request (header, data, xor), the length is taken from the header
+#define XP_FRAME_EMPTY  0       // nothing received
+#define XP_FRAME_BUSY   1       // header received, rest is coming
+#define XP_FRAME_OK     2       // complete, xor okay
+#define XP_FRAME_BAD    3       // complete, xor wrong
+unsigned char XP_rx_frame_state ();
+unsigned char *XP_rx_frame ();  // the frame (up to 17 bytes), stays until XP_rx_frame_reset
+void XP_rx_frame_reset ();      // ready for the next frame
 
 #endif  // __RS485_H__
@@ -29,6 +29,8 @@
 //                             previous file saved to ..\backup
 //                             dcc fast clock command requires an exact timebase
 //            2010-04-03 V0.14 PROG_TRACK_OFF also stops any programmer task
+//            2026-10-16 V0.15 PROG_TRACK_CONCURRENT: main_track_state, the main track
+//                             is not switched off in service mode
 //
 //-----------------------------------------------------------------
 //
@@ -52,6 +54,9 @@
 
 // TODO SDS2021 : dit houden we voorlopig global zodat iedereen kan lezen, schrijven moet via SetState!
 t_opendcc_state opendcc_state;            // this is the current running state
+#if (PROG_TRACK_CONCURRENT == 1)
+t_opendcc_state main_track_state;         // RUN_xxx, also during service mode
+#endif
 
 //---------------------------------------------------------------------------
 // data for timeout and debounce
@@ -313,14 +318,23 @@ void status_SetState(t_opendcc_state next) {
     case PROG_OKAY:
     case PROG_ERROR:
       SET_PROG_TRACK_ON;
+      #if (PROG_TRACK_CONCURRENT == 0)
       SET_MAIN_TRACK_OFF;
+      #endif
       break;
     case PROG_SHORT:                // short on programming track
     case PROG_OFF:
       SET_PROG_TRACK_OFF;
+      #if (PROG_TRACK_CONCURRENT == 0)
       SET_MAIN_TRACK_OFF;
+      #endif
+      break;
+    case INIT:                      // only the start value, never set
       break;
   }
+  #if (PROG_TRACK_CONCURRENT == 1)
+  if (next < PROG_OKAY) main_track_state = next;   // service mode: main track stays as it was
+  #endif
   // notify state change
   status_EventNotify(STATUS_STATE_CHANGED, (void*) &opendcc_state);
 } // status_SetState
@@ -330,6 +344,17 @@ void status_SetFastClock(t_fast_clock *newClock) {
   status_EventNotify(STATUS_CLOCK_CHANGED, (void*) &fast_clock);
 } // status_SetFastClock
 
+#if (PROG_TRACK_CONCURRENT == 1)
+// short on the main track during service mode: programming goes on
+static void main_track_off() {
+  if (main_track_state == RUN_OFF) return;
+  main_track_state = RUN_OFF;
+  SET_MAIN_TRACK_OFF;
+  status_EventNotify(STATUS_STATE_CHANGED, (void*) &opendcc_state);
+  status_EventNotify(STATUS_MAIN_SHORT,NULL);
+} // main_track_off
+#endif
+
 // SDS TODO 2021: als er EXT_STOP is én een short, dan flippert de run_state continu tussen de RUN_OFF en RUN_SHORT
 // en krijgen we massaal veel events -> opgelost door hier RUN_SHORT niet meer te gebruiken!
 // SDS TODO 2O21 : RUN_SHORT, PROG_SHORT states nog nodig? willen we een andere afhandeling dan voor RUN_OFF / PROG_OFF?
@@ -337,8 +362,14 @@ void status_Run() {
   // check main short
   if ((opendcc_state != RUN_OFF) && (opendcc_state != PROG_OFF)) {
     if (main_short_check() == true) {
-      status_SetState(RUN_OFF);
-      status_EventNotify(STATUS_MAIN_SHORT,NULL);
+      #if (PROG_TRACK_CONCURRENT == 1)
+      if (status_IsProgState()) main_track_off();
+      else
+      #endif
+      {
+        status_SetState(RUN_OFF);
+        status_EventNotify(STATUS_MAIN_SHORT,NULL);
+      }
     }
     // check prog short
     if (prog_short_check() == true) {
@@ -388,6 +419,8 @@ bool status_IsProgState() {
   case PROG_ERROR:
     retval = true;
     break;
+  case INIT:
+    break;
   }
   return(retval);
 } // status_IsProgState
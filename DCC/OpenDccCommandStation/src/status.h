@@ -64,6 +64,11 @@ typedef enum {
 } statusEvent_t;
 
 extern t_opendcc_state opendcc_state; // this is the current state of the box
+#if (PROG_TRACK_CONCURRENT == 1)
+extern t_opendcc_state main_track_state; // RUN_xxx: the main track, it keeps running in service mode (PROG_xxx)
+#else
+#define main_track_state opendcc_state  // service mode takes both tracks
+#endif
 // TODO SDS2021 : no_timeout nog enkel nodig voor lenz_parser -> te vervangen door een millis() implementatie in lenz_parser!
 //
 //extern t_no_timeout no_timeout;
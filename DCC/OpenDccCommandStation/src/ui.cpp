@@ -9,9 +9,13 @@
 #include "database.h" // for loc database access
 #include "accessories.h" // turnout status
 #include "programmer.h" // programming from UI
+#include "dccout.h" // underruns on diag page
+#include "isrprof.h" // isr cycle budget on diag page
+#include "cmdlat.h" // command latency on diag page 2
 
 #if (XPRESSNET_ENABLED == 1)
   #include "xpnet.h" // send events to xpnet (loc stolen)
+  #include "rs485.h" // XP_tx_pending
 #endif
 #if (PARSER == LENZ)
   #include "lenz_parser.h" // send event to pc intf (loc stolen)
@@ -47,6 +51,8 @@
 #define UISTATE_PROG_SELECT_VAL     15
 #define UISTATE_PROG_EXECUTE        16
 #define UISTATE_PROG_DONE           17
+#define UISTATE_DIAG_PAGE1          18
+#define UISTATE_DIAG_PAGE2          19
 
 // dit is volgens DCC128
 #define DIRECTION_FORWARD 0x80
@@ -127,12 +133,14 @@ uiEvent_t uiEvent; // events to show on display
 
 // ui fixed text in progmem
 static const char navHomePage1[] PROGMEM = "main  pwr test   >  ";
-static const char navHomePage2[] PROGMEM = "prog setup  >";
+static const char navHomePage2[] PROGMEM = "prog setup diag   > ";
 static const char navRunMain[] PROGMEM = "menu  fx  loc  acc  ";
 static const char navRunLocChange[] PROGMEM = "back   " STR(ARROW_LEFT_CHAR) "   " STR(ARROW_RIGHT_CHAR) "   OK  ";
 static const char navRunLocFuncOrTurnoutChange[] PROGMEM = "back   " STR(ARROW_LEFT_CHAR) "   " STR(ARROW_RIGHT_CHAR) "  toggle";
 static const char navTest[] PROGMEM = "back sig1 sig2 DB TX";
 static const char navPowerPage[] PROGMEM = "back main prog      ";
+static const char navDiag[] PROGMEM = "back next rst   >   ";
+static const char navDiag2[] PROGMEM = "back next rst   <   ";
 //TODO dawerktnie static const char *navProg PROGMEM                    = navRunLocChange;
 static const char navProg[] PROGMEM = "back   " STR(ARROW_LEFT_CHAR) "   " STR(ARROW_RIGHT_CHAR) "   OK  ";
 
@@ -172,7 +180,7 @@ static const char progTypePomLocWrite[] PROGMEM = "W-LOC(PoM)";
 static const char progTypePomAccWrite[] PROGMEM = "W-ACC(PoM)";
 static const char progTypeCsCvWrite[] PROGMEM   = "W-CV (CS) ";
 static const char progTypeCsCvRead[] PROGMEM    = "R-CV (CS) ";
-static const char *progTypeTxt[] = {
+static const char *const progTypeTxt[] PROGMEM = {    // like charBitmap: the table is in flash too
   progTypeCvWrite,progTypeCvRead,
   progTypePomLocWrite,progTypePomAccWrite,
   progTypeCsCvWrite,progTypeCsCvRead
@@ -197,6 +205,8 @@ static bool ui_RunMenuHandler (uint8_t event, uint8_t code);
 static bool ui_PowerMenuHandler (uint8_t event, uint8_t code);
 static bool ui_TestMenuHandler (uint8_t event, uint8_t code);
 static bool ui_SetupMenuHandler (uint8_t event, uint8_t code);
+static bool ui_DiagMenuHandler (uint8_t event, uint8_t code);
+static bool ui_Diag2MenuHandler (uint8_t event, uint8_t code);
 static bool ui_ProgMenuHandler (uint8_t event, uint8_t code);
 static bool ui_EventHandler (uint8_t event, uint8_t code);
 static bool ui_LocSpeedHandler (uint8_t event, uint8_t code); // generic loc speed handling with rotary key, used by all menus that don't use the rotary key differently
@@ -214,7 +224,7 @@ static void lcd_Init() {
   // init special characters
   for (int i = 0; i < charBitmapSize; i++) {
     uint8_t aBuffer[8];
-    memcpy_P ((void*)aBuffer,(void*)pgm_read_word(&(charBitmap[i])),8); // eerst data copiëren van flash->sram
+    memcpy_P ((void*)aBuffer,pgm_read_ptr(&(charBitmap[i])),8); // eerst data copiëren van flash->sram
     lcd.createChar (i, aBuffer);
   }
   lcd.home();
@@ -243,10 +253,10 @@ static void clearLine (uint8_t line, uint8_t startPos=0) {
 
 // helper to print values on a fixed width, eg. loc address as '003', cv value as ' 15', etc.
 static void printValueFixedWidth(uint16_t aValue, uint8_t aWidth, uint8_t fillChar) {
-  uint16_t maxValues[] = {0,10,100,1000,10000};
+  static const uint16_t maxValues[] PROGMEM = {0,10,100,1000,10000};   // flash, the initializer would take RAM
   if (aWidth > 5) aWidth = 5;
   for (uint8_t i = aWidth; i > 1;i--) {
-    if (aValue < maxValues[i-1])
+    if (aValue < pgm_read_word(&maxValues[i-1]))
       lcd.write(fillChar);
   }
   lcd.print(aValue);
@@ -366,7 +376,7 @@ static void ui_ShowCurrent() {
   else {
     if (mA < 100) lcd.write(' ');
     if (mA < 10) lcd.write(' ');
-    lcd.print(mA);lcd.print("mA");
+    lcd.print(mA);lcd.print(F("mA"));
   }
 } // ui_ShowCurrent
 
@@ -452,7 +462,9 @@ static void ui_SetLocSpeed (uint16_t locAddress, uint8_t locSpeed) {
   if (!organizer_IsReady()) // can't send anything to organizer for now
     return;
 
+  CMDLAT_ACCEPT(LOCAL_UI_SLOT);
   retval = do_loco_speed (LOCAL_UI_SLOT,locAddress, locSpeed);
+  CMDLAT_CLEAR();
   if (retval & ORGZ_STOLEN) {
     #if (XPRESSNET_ENABLED == 1)
       xpnet_SendLocStolen(orgz_old_lok_owner,locAddress);
@@ -472,11 +484,13 @@ static void ui_SetLocSpeed (uint16_t locAddress, uint8_t locSpeed) {
 // func 0 = light
 // f1 ->f28 
 // on = 1-bit, off = 0-bit
-static void ui_SetLocFunction (uint16_t locAddress, uint8_t func, uint32_t allFuncs) {
-  uint8_t retval;
+// returns false if the command was not accepted (organizer busy, no room for F13..F28)
+static bool ui_SetLocFunction (uint16_t locAddress, uint8_t func, uint32_t allFuncs) {
+  uint8_t retval = 0;
   if (!organizer_IsReady()) // can't send anything to organizer for now
-    return;
+    return false;
 
+  CMDLAT_ACCEPT(LOCAL_UI_SLOT);
   if (func==0)
     retval= do_loco_func_grp0 (LOCAL_UI_SLOT,locAddress, allFuncs & 0xFF); // grp0 = f0 = fl
   else if ((func >=1) && (func <= 4))
@@ -491,6 +505,7 @@ static void ui_SetLocFunction (uint16_t locAddress, uint8_t func, uint32_t allFu
   else if ((func >=21) && (func <= 28))
     retval= do_loco_func_grp5 (LOCAL_UI_SLOT,locAddress, (allFuncs >> 21));
 #endif
+  CMDLAT_CLEAR();
   if (retval & ORGZ_STOLEN) {
     #if (XPRESSNET_ENABLED == 1)
       xpnet_SendLocStolen(orgz_old_lok_owner,locAddress);
@@ -499,6 +514,7 @@ static void ui_SetLocFunction (uint16_t locAddress, uint8_t func, uint32_t allFu
       pcintf_SendLocStolen(locAddress);
     #endif
   }
+  return ((retval & ORGZ_FHIGH_FULL) == 0);
 } // ui_SetLocFunction
 
 // TODO : return value needed to handle failed do_accessory(...) cmd?
@@ -520,9 +536,21 @@ static void ui_ToggleTurnout (uint16_t turnoutAddress, bool activate) {
   // turnoutStatus=10=red -> disactivate coil 1
   coil = (uint8_t) (!activate);
   coil = (coil^turnoutStatus) & 0x1;
+  CMDLAT_ACCEPT(LOCAL_UI_SLOT);
   retval = do_accessory(turnoutAddress,coil,activate); // retval==0 means OK
+  CMDLAT_CLEAR();
   if (activate && (retval==0)) { // only notify the 'on' command, not the 'off'
-    unsigned char tx_message[3];
+    // xpnet sends from the buffer itself: two of them, so a second toggle can't
+    // overwrite a broadcast that is still queued (same as tx_buffer in xpnet.cpp)
+    static unsigned char tx_buffer[2][3];
+    static uint8_t tx_index;
+    unsigned char *tx_message;
+
+    tx_index ^= 1;
+    tx_message = tx_buffer[tx_index];
+    #if (XPRESSNET_ENABLED == 1)
+      while (XP_tx_pending(tx_message)) BUSY_WAIT(); // both on the way (shouldn't happen)
+    #endif
     tx_message[0] = 0x42;
     turnout_getInfo(turnoutAddress,&tx_message[1]);
     #if (XPRESSNET_ENABLED == 1)
@@ -537,7 +565,9 @@ static void ui_ToggleTurnout (uint16_t turnoutAddress, bool activate) {
 static void ui_SetExtendedAccessory (uint16_t decoderAddress, uint8_t signalId, uint8_t signalAspect) {
   if (!organizer_IsReady())
     return;
+  CMDLAT_ACCEPT(LOCAL_UI_SLOT);
   do_signal_accessory(decoderAddress,signalId, signalAspect); // retval==0 means OK
+  CMDLAT_CLEAR();
 } // ui_SetExtendedAccessory
 
 /*****************************************************************************/
@@ -552,7 +582,6 @@ static bool ui_HomeMenuHandler (uint8_t event, uint8_t code) {
       if (ui_State == UISTATE_HOME_PAGE1) ui_ShowNav(navHomePage1);
       else if (ui_State == UISTATE_HOME_PAGE2) {
         ui_ShowNav(navHomePage2);
-        clearLine(3,13); // TODO improve
       }
     }
     return false; // ui_Update will add common display elements
@@ -589,6 +618,10 @@ static bool ui_HomeMenuHandler (uint8_t event, uint8_t code) {
       ui_State = UISTATE_SETUP_PAGE1;
       ui_ActiveMenuHandler = ui_SetupMenuHandler;
     }
+    else if (keyCode == KEY_3) {
+      ui_State = UISTATE_DIAG_PAGE1;
+      ui_ActiveMenuHandler = ui_DiagMenuHandler;
+    }
     else ui_State = UISTATE_HOME_PAGE1;
   }
   return (true);
@@ -701,13 +734,13 @@ bool ui_RunMenuHandler (uint8_t event, uint8_t code) {
       clearLine(2,9);
       lcd.setCursor(10,2);
       if (retval || (!newLocActive)) // not in locobuffer, or not active in locobuffer
-        lcd.print ("FREE");
+        lcd.print(F("FREE"));
       else if (newLocData->slot == LOCAL_UI_SLOT)
-        lcd.print("IN USE[CS]");
+        lcd.print(F("IN USE[CS]"));
       else {
-        lcd.print("IN USE[ ");
+        lcd.print(F("IN USE[ "));
         lcd.print(newLocData->slot);
-        lcd.print("]");
+        lcd.write(']');
       }
       ui_ShowNav(navRunLocChange);
     }
@@ -748,7 +781,8 @@ bool ui_RunMenuHandler (uint8_t event, uint8_t code) {
     }
     else if (keyCode == KEY_4) { // toggle function
       curLoc.funcs ^= ((uint32_t) 0x1 << curHighlightFunc); // toggle func bit
-      ui_SetLocFunction(curLoc.address,curHighlightFunc,curLoc.funcs);
+      if (!ui_SetLocFunction(curLoc.address,curHighlightFunc,curLoc.funcs))
+        curLoc.funcs ^= ((uint32_t) 0x1 << curHighlightFunc); // not accepted, display shows the old state
     }
   }
 
@@ -842,7 +876,7 @@ static bool ui_TestMenuHandler (uint8_t event, uint8_t code) {
     if(code) { // do only manual refresh
       lcd.clear();
       lcd.setCursor(0,1);
-      lcd.print("Test funcs ");
+      lcd.print(F("Test funcs "));
       lcd.setCursor(0,2);
       for (uint8_t c=0;c<8;c++) lcd.write(c); // print all custom glyphs
       ui_ShowNav(navTest);
@@ -886,10 +920,10 @@ static bool ui_SetupMenuHandler (uint8_t event, uint8_t code) {
   if (event == EVENT_UI_UPDATE) {
     if (code) { // do only manual refresh
       lcd.setCursor(0,1);
-      lcd.print("SETUP ");
-      lcd.setCursor(0,2); lcd.print("scherm niet af!");
+      lcd.print(F("SETUP "));
+      lcd.setCursor(0,2); lcd.print(F("scherm niet af!"));
       clearLine(3);
-      lcd.setCursor(0,3); lcd.print("back");
+      lcd.setCursor(0,3); lcd.print(F("back"));
     }
     return false;
   }
@@ -910,6 +944,160 @@ static bool ui_SetupMenuHandler (uint8_t event, uint8_t code) {
   return (keyHandled);
 } // ui_SetupMenuHandler
 
+// dcc underruns and cycle budget of the ISRs (ISR_PROFILING in config.h)
+// the texts of both diag pages are in flash (F()), they are built in with every configuration
+// line 0 : "ee w:wwwww s:sssss"   eeprom bytes written / writes saved by the loco database
+// line 1 : "und:uuuuu nnnn mmmmm" underruns, isr name, missed deadlines
+// line 2 : "mmmmm aaaaa xxxxx cy" min/avg/max cpu cycles
+#if (ISR_PROFILING == 1)
+static uint8_t diagIsrId;
+static const char diagIsrNames[] PROGMEM = "dcc rx  udrerot ";  // 4 chars per ISRPROF_* id
+#endif
+
+static bool ui_DiagMenuHandler (uint8_t event, uint8_t code) {
+  uint8_t keyCode;
+
+  if (event == EVENT_UI_UPDATE) { // manual + auto refresh, the values keep changing
+    if (code) {
+      lcd.clear();
+      ui_ShowNav(navDiag);
+    }
+    uint16_t eeWrites, eeSaved;
+    database_GetWearStat(&eeWrites, &eeSaved);
+    lcd.setCursor(0,0);
+    lcd.print(F("ee w:"));
+    printValueFixedWidth(eeWrites,5,' ');
+    lcd.print(F(" s:"));
+    printValueFixedWidth(eeSaved,5,' ');
+    lcd.setCursor(0,1);
+    lcd.print(F("und:"));
+    printValueFixedWidth(dccout_GetUnderruns(),5,' ');
+#if (ISR_PROFILING == 1)
+    t_isrprof prof;
+    isrprof_Get(diagIsrId, &prof);
+    if (prof.count == 0) prof.min = 0;
+    lcd.write(' ');
+    for (uint8_t i=0;i<4;i++) lcd.write(pgm_read_byte(&diagIsrNames[4*diagIsrId+i]));
+    lcd.write(' ');
+    printValueFixedWidth(prof.missed,5,' ');
+    lcd.setCursor(0,2);
+    printValueFixedWidth(prof.min,5,' ');
+    lcd.write(' ');
+    printValueFixedWidth(isrprof_GetAvg(&prof),5,' ');
+    lcd.write(' ');
+    printValueFixedWidth(prof.max,5,' ');
+    lcd.print(F(" cy"));
+#else
+    lcd.setCursor(0,2);
+    lcd.print(F("no isr profiling"));
+#endif
+    return false;
+  }
+
+  // handle key events
+  keyCode = code;
+
+  // don't handle key up/longdown & rotary key
+  if ((keyCode == KEY_ROTARY) || (keyCode == KEY_ENTER) ||
+      (event == EVENT_KEY_UP) || (event == EVENT_KEY_LONGDOWN))
+    return false;
+
+  if (keyCode == KEY_1) {
+    ui_State = UISTATE_HOME_PAGE1;
+    ui_ActiveMenuHandler = ui_HomeMenuHandler;
+  }
+#if (ISR_PROFILING == 1)
+  else if (keyCode == KEY_2) { // next isr
+    diagIsrId++;
+    if (diagIsrId >= ISRPROF_NUM) diagIsrId = 0;
+  }
+  else if (keyCode == KEY_3) {
+    isrprof_Reset();
+    isrprof_Capture(diagIsrId); // samples for xpnet 0x22 0xF9
+  }
+#endif
+  else if (keyCode == KEY_4) {
+    ui_State = UISTATE_DIAG_PAGE2;
+    ui_ActiveMenuHandler = ui_Diag2MenuHandler;
+  }
+  return (true);
+} // ui_DiagMenuHandler
+
+// command to rail latency per origin (CMD_LATENCY in config.h)
+// line 0 : "slot sss   n:nnnnn"   origin: xpnet slot, 0 = ui, 127 = others
+// line 1 : "mmmmm aaaaa xxxxx ms" min/avg/max
+// line 2 : "p99 < ppp ms"
+#if (CMD_LATENCY == 1)
+static uint8_t diagLatIndex;
+#endif
+
+static bool ui_Diag2MenuHandler (uint8_t event, uint8_t code) {
+  uint8_t keyCode;
+
+  if (event == EVENT_UI_UPDATE) {
+    if (code) {
+      lcd.clear();
+      ui_ShowNav(navDiag2);
+    }
+#if (CMD_LATENCY == 1)
+    t_cmdlat_result lat;
+    if (!cmdlat_Get(diagLatIndex, &lat)) {
+      diagLatIndex = 0;
+      if (!cmdlat_Get(diagLatIndex, &lat)) {
+        clearLine(0);
+        clearLine(1);
+        clearLine(2);
+        lcd.setCursor(0,0);
+        lcd.print(F("no commands"));
+        return false;
+      }
+    }
+    lcd.setCursor(0,0);
+    lcd.print(F("slot "));
+    printValueFixedWidth(lat.origin,3,' ');
+    lcd.print(F("   n:"));
+    printValueFixedWidth(lat.count,5,' ');
+    lcd.setCursor(0,1);
+    printValueFixedWidth(lat.min / 10,5,' ');
+    lcd.write(' ');
+    printValueFixedWidth(lat.avg / 10,5,' ');
+    lcd.write(' ');
+    printValueFixedWidth(lat.max / 10,5,' ');
+    lcd.print(F(" ms"));
+    lcd.setCursor(0,2);
+    if (lat.p99 == 255) lcd.print(F("p99 > 128 ms"));
+    else {
+      lcd.print(F("p99 < "));
+      printValueFixedWidth(lat.p99,3,' ');
+      lcd.print(F(" ms"));
+    }
+#else
+    lcd.setCursor(0,1);
+    lcd.print(F("no latency stats"));
+#endif
+    return false;
+  }
+
+  keyCode = code;
+  if ((keyCode == KEY_ROTARY) || (keyCode == KEY_ENTER) ||
+      (event == EVENT_KEY_UP) || (event == EVENT_KEY_LONGDOWN))
+    return false;
+
+  if (keyCode == KEY_1) {
+    ui_State = UISTATE_HOME_PAGE1;
+    ui_ActiveMenuHandler = ui_HomeMenuHandler;
+  }
+#if (CMD_LATENCY == 1)
+  else if (keyCode == KEY_2) diagLatIndex++;   // next origin, wraps on display
+  else if (keyCode == KEY_3) cmdlat_Reset();
+#endif
+  else if (keyCode == KEY_4) {
+    ui_State = UISTATE_DIAG_PAGE1;
+    ui_ActiveMenuHandler = ui_DiagMenuHandler;
+  }
+  return (true);
+} // ui_Diag2MenuHandler
+
 
 
 static void ui_ShowProgContext (uint8_t progState) {
@@ -940,7 +1128,7 @@ static void ui_ShowProgContext (uint8_t progState) {
   lcd.setCursor(0,0);
   if ((progState == UISTATE_PROG_INIT) || (progState == UISTATE_PROG_SELECT_TYPE)) {
     lcd.write('>');
-    lcd.setCursor(2,0);lcd.print((__FlashStringHelper*) progTypeTxt[progContext.progType]);
+    lcd.setCursor(2,0);lcd.print((__FlashStringHelper*) pgm_read_ptr(&progTypeTxt[progContext.progType]));
   }
   else 
     lcd.write(' ');
@@ -1115,7 +1303,7 @@ static bool ui_EventHandler (uint8_t event, uint8_t code) {
       triggerBacklight();
       clearLine(3);
       lcd.setCursor(15,3);
-      lcd.print("OK");
+      lcd.print(F("OK"));
       
       if (uiEvent.mainShort) ui_ShowEventText(evtMainTrackShortText);
       else if (uiEvent.progShort) ui_ShowEventText(evtProgTrackShortText);
@@ -47,6 +47,9 @@
 #include "organizer.h"
 #include "xpnet.h"
 #include "accessories.h"
+#include "isrprof.h"
+#include "cmdlat.h"
+#include "railcom.h"      // pom cvrd result
 
 
 // TODO SDS20201 : we parkeren dat event voorlopig hier ipv in status
@@ -80,11 +83,158 @@ static unsigned char xp_BC_locos_aus[] = {0x81, 0x00};            // Alle Loks g
 //          c) slot with use_counter == 0 are unused.
 //          d) every time when a round with all used slots is done, one unused
 //             slot is called.
+//
+// XP_ADAPTIVE_SLOTS: a) - c) stay, but the used slots are not called in a fixed round:
+//          e) every request raises the activity of its slot (0..255), all activities
+//             decay by 1/8 every XP_SLOT_DECAY ms (half-life about 5 * XP_SLOT_DECAY).
+//             An inquiry without answer lasts about 0.3ms.
+//          f) the used slot with the highest age * weight is called, age = inquiries
+//             since the last call, weight = 2 ^ (activity/32) (1..128); a throttle
+//             that sends a request at every call gets most of the calls, one that
+//             sends every second or so about 1/32 of it.
+//          g) a used slot is called at the latest after XP_SLOT_MAX_INTERVAL inquiries
+//             (if there are less used slots than that).
+//          h) every XP_SLOT_SCAN_RATE-th inquiry (or if no slot is used) one unused
+//             slot is called.
 
 static unsigned char slot_use_counter[32];
-static unsigned char used_slot;        // 1 .. 31 (actual position for used ones)
 static unsigned char unused_slot;      // 1 .. 31 (actual position for unused ones)
 
+#if (XP_ADAPTIVE_SLOTS == 1)
+
+#if (XP_SLOT_MAX_INTERVAL > 200)
+#error XP_SLOT_MAX_INTERVAL too large (ages are counted in unsigned char)
+#endif
+
+static unsigned char slot_activity[32];
+static unsigned char slot_last_call[32];     // inquiry number of the last call (wraps)
+static unsigned char inquiry_no;             // counts all inquiries
+static unsigned int decay_time;          // millis() of the last decay
+static unsigned char scan_count;
+
+#if (XP_SLOT_STATS == 1)
+// statistics: the average interval of a slot is window / calls in the window;
+// window and calls are halved on overflow, so the average stays a moving one.
+static uint16_t slot_calls[32];
+static unsigned char slot_max_age[32];       // longest interval in inquiries
+static uint16_t window_calls;                // inquiries in the window
+static unsigned long window_start;           // millis() at start of the window
+
+static void slot_stats_halve() {
+  unsigned char i;
+  for (i=1; i<32; i++) slot_calls[i] >>= 1;
+  window_calls >>= 1;
+  window_start += (millis() - window_start) / 2;
+} // slot_stats_halve
+#endif // XP_SLOT_STATS
+
+static void slot_called(unsigned char slot) {
+#if (XP_SLOT_STATS == 1)
+  unsigned char age = inquiry_no - slot_last_call[slot];
+#endif
+
+  if (slot_use_counter[slot] > 0) {
+    slot_use_counter[slot]--;
+#if (XP_SLOT_STATS == 1)
+    if (age > slot_max_age[slot]) slot_max_age[slot] = age;
+#endif
+  }
+  slot_last_call[slot] = inquiry_no;
+#if (XP_SLOT_STATS == 1)
+  if (slot_calls[slot] == 0xFFFF || window_calls == 0xFFFF) slot_stats_halve();
+  slot_calls[slot]++;
+#endif
+} // slot_called
+
+static unsigned char get_next_slot() {
+  unsigned char i, age, best_slot = 0;
+  uint16_t score, best_score = 0;
+
+  inquiry_no++;
+#if (XP_SLOT_STATS == 1)
+  window_calls++;
+#endif
+
+  if ((unsigned int)(millis() - decay_time) >= XP_SLOT_DECAY) {
+    decay_time += XP_SLOT_DECAY;
+    for (i=1; i<32; i++) slot_activity[i] -= slot_activity[i] >> 3;
+  }
+
+  if (++scan_count < XP_SLOT_SCAN_RATE) {
+    for (i=1; i<32; i++) {
+      if (slot_use_counter[i] == 0) continue;
+      age = inquiry_no - slot_last_call[i];
+      if (age >= XP_SLOT_MAX_INTERVAL) score = 0x8000 + age;        // overdue, oldest first
+      else score = (uint16_t)age << (slot_activity[i] >> 5);
+      if (score > best_score) {
+        best_score = score;
+        best_slot = i;
+      }
+    }
+  }
+  if (best_slot == 0) {
+    // scan turn or no used slot (ready to be called) - call an unsued one
+    scan_count = 0;
+    i = 31;
+    do {
+      unused_slot++;
+      if (unused_slot == 32) unused_slot = 1;  // wrap
+    } while ((slot_use_counter[unused_slot] > 0) && --i);
+    best_slot = unused_slot;
+  }
+  slot_called(best_slot);
+  return(best_slot);
+} // get_next_slot
+
+static void set_slot_used(unsigned char slot) {
+  if (slot_use_counter[slot] == 0) {
+    slot_last_call[slot] = inquiry_no;      // just came alive, age starts now
+#if (XP_SLOT_STATS == 1)
+    slot_max_age[slot] = 0;
+#endif
+  }
+  slot_use_counter[slot] = 255;           // alive
+  slot_activity[slot] += (255 - slot_activity[slot]) >> 2;
+}
+
+static void set_slot_to_watch(unsigned char slot) {
+  slot_use_counter[slot] = 10;           // nearly dead
+  slot_activity[slot] = 0;
+}
+
+#if (XP_SLOT_STATS == 1)
+// average interval of the calls of this slot in 0.1ms, 0xFFFF = not called (or too long)
+static uint16_t get_slot_interval(unsigned char slot) {
+  unsigned long window = millis() - window_start;
+
+  if (slot_calls[slot] == 0) return(0xFFFF);
+  window = window * 10 / slot_calls[slot];
+  if (window > 0xFFFE) return(0xFFFE);
+  return((uint16_t)window);
+} // get_slot_interval
+
+static void reset_slot_stats() {
+  unsigned char i;
+  for (i=1; i<32; i++) {
+    slot_calls[i] = 0;
+    slot_max_age[i] = 0;
+  }
+  window_calls = 0;
+  window_start = millis();
+} // reset_slot_stats
+#endif // XP_SLOT_STATS
+
+static void slot_scheduler_Init() {
+  decay_time = millis();
+#if (XP_SLOT_STATS == 1)
+  reset_slot_stats();
+#endif
+} // slot_scheduler_Init
+
+#else
+
+static unsigned char used_slot;        // 1 .. 31 (actual position for used ones)
+
 static unsigned char get_next_slot() {
   used_slot++;             // advance
   while (used_slot < 32) {        
@@ -112,6 +262,7 @@ static void set_slot_used(unsigned char slot) {
 static void set_slot_to_watch(unsigned char slot) {
   slot_use_counter[slot] = 10;           // nearly dead
 }
+#endif // XP_ADAPTIVE_SLOTS
 
 //===============================================================================
 //
@@ -120,11 +271,12 @@ static void set_slot_to_watch(unsigned char slot) {
 //===============================================================================
 static unsigned char current_slot;     // 1 .. 31
 
-static unsigned char rx_message[17];             // current message from client
-static unsigned char rx_index;
-static unsigned char rx_size;
+static unsigned char *rx_message;                // current message from client (frame of rs485)
 
-static unsigned char tx_message[17];             // current message from master
+// messages are sent from their buffer (see rs485.h), so there are two for the answers:
+// after a message is queued, tx_message switches to the other one.
+static unsigned char tx_buffer[2][17];           // also the frames of the database transfer (6 + LOK_NAME_LENGTH)
+static unsigned char *tx_message = tx_buffer[0]; // current message from master
 static unsigned char *tx_ptr;
 
 // predefined messages
@@ -250,6 +402,36 @@ static void xpnet_send_ServiceModeInformationResponse() {
   }
 } // xpnet_send_ServiceModeInformationResponse
 
+#if (RAILCOM_DETECTOR == 1)
+// result of a pom cvrd, read with RailCom; sent like the result of a service mode read
+// ret: 0 if there was no pom cvrd
+static unsigned char xpnet_send_PomResponse() {
+  unsigned int cv;
+  unsigned char data;
+
+  switch (railcom_GetPomResult(&cv, &data)) {
+    case RC_POM_BUSY:
+      tx_message[0] = 0x61;
+      tx_message[1] = 0x1f;
+      break;
+    case RC_POM_OKAY:
+      tx_message[0] = 0x63;
+      tx_message[1] = 0x14 + ((cv / 256) & 0x3);    // header codes 0x14, 0x15, 0x16, 0x17
+      tx_message[2] = (unsigned char) cv;
+      tx_message[3] = data;
+      break;
+    case RC_POM_NOANSWER:
+      tx_message[0] = 0x61;
+      tx_message[1] = 0x13;                         // not found
+      break;
+    default:
+      return(0);
+  }
+  xp_send_message_to_current_slot(tx_ptr = tx_message);
+  return(1);
+} // xpnet_send_PomResponse
+#endif
+
 static void xp_send_CommandStationBusyResponse() {
   xp_send_message_to_current_slot(tx_ptr = xp_busy); 
 }
@@ -283,6 +465,100 @@ static void xp_send_CommandStationStatusIndicationResponse() {
   xp_send_message_to_current_slot(tx_ptr = tx_message); 
 } // xp_send_CommandStationStatusIndicationResponse
 
+#if (ISR_PROFILING == 1)
+// vendor specific: cycle budget of one ISR (see isrprof.h)
+// Hex : 0x6A 0xF8 ID MINH MINL AVGH AVGL MAXH MAXL MISSH MISSL X-Or-Byte
+static void xp_send_IsrProfileResponse(unsigned char id) {
+  t_isrprof prof;
+  uint16_t avg;
+
+  isrprof_Get(id, &prof);
+  avg = isrprof_GetAvg(&prof);
+  if (prof.count == 0) prof.min = 0;
+  tx_message[0] = 0x6A;
+  tx_message[1] = 0xF8;
+  tx_message[2] = id;
+  tx_message[3] = prof.min >> 8;
+  tx_message[4] = prof.min & 0xFF;
+  tx_message[5] = avg >> 8;
+  tx_message[6] = avg & 0xFF;
+  tx_message[7] = prof.max >> 8;
+  tx_message[8] = prof.max & 0xFF;
+  tx_message[9] = prof.missed >> 8;
+  tx_message[10] = prof.missed & 0xFF;
+  xp_send_message_to_current_slot(tx_ptr = tx_message);
+} // xp_send_IsrProfileResponse
+
+// vendor specific: 4 captured samples, starting with sample N, not yet captured = 0xFFFF
+// Hex : 0x6B 0xF9 N ID S0H S0L S1H S1L S2H S2L S3H S3L X-Or-Byte
+static void xp_send_IsrSamplesResponse(unsigned char first) {
+  uint16_t samples[4];
+  unsigned char i, n;
+
+  n = isrprof_GetSamples(samples, first, 4);
+  tx_message[0] = 0x6B;
+  tx_message[1] = 0xF9;
+  tx_message[2] = first;
+  tx_message[3] = isrprof_capture_id;
+  for (i=0; i<4; i++) {
+    if (i >= n) samples[i] = 0xFFFF;
+    tx_message[4+2*i] = samples[i] >> 8;
+    tx_message[5+2*i] = samples[i] & 0xFF;
+  }
+  xp_send_message_to_current_slot(tx_ptr = tx_message);
+} // xp_send_IsrSamplesResponse
+#endif // ISR_PROFILING
+
+#if (CMD_LATENCY == 1)
+// vendor specific: command to rail latency of the N-th origin (see cmdlat.h)
+// ORIGIN: xpnet slot, 0 = local ui, 0x7F = all others, 0xFF = no data
+// Hex : 0x6D 0xFB N ORIGIN CNTH CNTL MINH MINL AVGH AVGL MAXH MAXL P99 X-Or-Byte
+//       min/avg/max in 0.1ms, p99 in ms (upper bound, 255 = more than 128ms)
+static void xp_send_CmdLatencyResponse(unsigned char n) {
+  t_cmdlat_result lat;
+
+  if (!cmdlat_Get(n, &lat)) {
+    memset(&lat, 0, sizeof(lat));
+    lat.origin = CMDLAT_ORIGIN_NONE;
+  }
+  tx_message[0] = 0x6D;
+  tx_message[1] = 0xFB;
+  tx_message[2] = n;
+  tx_message[3] = lat.origin;
+  tx_message[4] = lat.count >> 8;
+  tx_message[5] = lat.count & 0xFF;
+  tx_message[6] = lat.min >> 8;
+  tx_message[7] = lat.min & 0xFF;
+  tx_message[8] = lat.avg >> 8;
+  tx_message[9] = lat.avg & 0xFF;
+  tx_message[10] = lat.max >> 8;
+  tx_message[11] = lat.max & 0xFF;
+  tx_message[12] = lat.p99;
+  xp_send_message_to_current_slot(tx_ptr = tx_message);
+} // xp_send_CmdLatencyResponse
+#endif // CMD_LATENCY
+
+#if (XP_ADAPTIVE_SLOTS == 1) && (XP_SLOT_STATS == 1)
+// vendor specific: scheduler state of slot N (1..31)
+// Hex : 0x67 0xFD N USE ACT AVGH AVGL MAXAGE X-Or-Byte
+//       USE: use counter (0 = unused), ACT: activity, AVG: average call interval in 0.1ms
+//       (0xFFFF = not called), MAXAGE: longest interval while used, in inquiries
+static void xp_send_SlotStatsResponse(unsigned char slot) {
+  uint16_t avg;
+
+  slot &= 0x1F;
+  avg = get_slot_interval(slot);
+  tx_message[0] = 0x67;
+  tx_message[1] = 0xFD;
+  tx_message[2] = slot;
+  tx_message[3] = slot_use_counter[slot];
+  tx_message[4] = slot_activity[slot];
+  tx_message[5] = avg >> 8;
+  tx_message[6] = avg & 0xFF;
+  tx_message[7] = slot_max_age[slot];
+  xp_send_message_to_current_slot(tx_ptr = tx_message);
+} // xp_send_SlotStatsResponse
+#endif // XP_SLOT_STATS
 
 static void xp_send_LocAddressRetrievalResponse(unsigned int locAddress)     
 {
@@ -303,11 +579,13 @@ static void xp_send_LocInformationResponse(unsigned int locAddress) {
   unsigned char data, speed;
   uint32_t retval = 0;
   locomem *lbData;
-  uint8_t convert_format[4] = {
+  uint8_t convert_format[6] = {
     0b000,      // DCC14
     0b001,      // DCC27
     0b010,      // DCC28
     0b100,      // DCC128
+    0b000,      // MM1 (MAERKLIN_ENABLED), 14 steps
+    0b000,      // MM2
   };
 
   tx_message[0] = 0xE4; // Headerbyte = 0xE4
@@ -326,6 +604,8 @@ static void xp_send_LocInformationResponse(unsigned int locAddress) {
 
     speed = convert_speed_to_rail(lbData->speed, lbData->format);
     switch(lbData->format) {
+      case MM1:
+      case MM2:
       case DCC14:
         tx_message[2] = speed;    //Byte2 = Speed = R000 VVVV;
         break;
@@ -459,6 +739,12 @@ static void xp_parser() {
       switch(rx_message[1]) {
         case 0x10: 
           // 0x21 0x10 0x31
+          #if (RAILCOM_DETECTOR == 1)
+          if (xpnet_send_PomResponse()) {
+            processed = 1;
+            break;
+          }
+          #endif
           if (opendcc_state >= PROG_OKAY) {
             xpnet_send_ServiceModeInformationResponse();
             processed = 1;
@@ -538,6 +824,55 @@ static void xp_parser() {
           xp_send_CommandStationStatusIndicationResponse();
           processed = 1; 
           break;
+#if (ISR_PROFILING == 1)
+        case 0xF8:
+          // vendor: ISR cycle budget 0x22 0xF8 ID X-Or
+          xp_send_IsrProfileResponse(rx_message[2]);
+          processed = 1;
+          break;
+        case 0xF9:
+          // vendor: captured ISR samples 0x22 0xF9 N X-Or
+          xp_send_IsrSamplesResponse(rx_message[2]);
+          processed = 1;
+          break;
+        case 0xFA:
+          // vendor: reset ISR statistics and capture samples of ISR ID 0x22 0xFA ID X-Or
+          isrprof_Reset();
+          isrprof_Capture(rx_message[2]);
+          processed = 1;                              // no answer
+          break;
+#endif
+#if (CMD_LATENCY == 1)
+        case 0xFB:
+          // vendor: command to rail latency of the N-th origin 0x22 0xFB N X-Or
+          xp_send_CmdLatencyResponse(rx_message[2]);
+          processed = 1;
+          break;
+        case 0xFC:
+          // vendor: reset latency statistics 0x22 0xFC 0x00 X-Or
+          cmdlat_Reset();
+          processed = 1;                              // no answer
+          break;
+#endif
+#if (MAERKLIN_ENABLED == 1)
+        case 0xF7:
+          // vendor: loco format 0x24 0xF7 AddrH AddrL FMT X-Or, FMT = 0, 2, 3: DCC14, DCC28, DCC128, 4: MM1, 5: MM2
+          // answer: locomotive information (as for 0xE3 0x00), unknown command if not possible
+          addr = ((rx_message[2] & 0x3F) * 256) + rx_message[3];
+          if (do_loco_format(addr, rx_message[4])) {
+            xp_send_LocInformationResponse(addr);
+            processed = 1;
+          }
+          break;
+#endif
+#if (XP_ADAPTIVE_SLOTS == 1) && (XP_SLOT_STATS == 1)
+        case 0xFD:
+          // vendor: scheduler state of slot N 0x22 0xFD N X-Or, N = 0: reset statistics (no answer)
+          if (rx_message[2] == 0) reset_slot_stats();
+          else xp_send_SlotStatsResponse(rx_message[2]);
+          processed = 1;
+          break;
+#endif
         case 0x80:    
           // 0x21 0x80 0xA1 "Stop operations request (emergency off)"
           status_SetState(RUN_OFF);
@@ -594,7 +929,7 @@ static void xp_parser() {
       // either answer the request or/and send out a broadcast
       // we do both
       xp_send_message_to_current_slot(tx_ptr = tx_message);
-      xpnet_SendMessage(FUTURE_ID | 0, tx_message);
+      xpnet_SendMessage(FUTURE_ID | 0, tx_ptr);         // same buffer again
       processed = 1;
       break;
 
@@ -607,19 +942,8 @@ static void xp_parser() {
       // TODO : feedback bijhouden in iets à la s88!
       // TODO : for now just broadcast back to all xpnet clients ()
       // format according to §2.1.11 (nibbles), TT=10 (feedback decoder), I=0
-      uint8_t prevData, newData;
-      newData = rx_message[2];
-      prevData = feedback_update(rx_message[1],newData);
-      if ((prevData & 0xF) != (newData & 0xF)) { // lower nibble changed
-        tx_message[0] = 0x42;
-        accessory_getInfo(rx_message[1],0,&tx_message[1]);
-        xpnet_SendMessage(FUTURE_ID | 0, tx_message);
-      }
-      if ((prevData & 0xF0) != (newData & 0xF0)) { // upper nibble changed
-        tx_message[0] = 0x42;
-        accessory_getInfo(rx_message[1],1,&tx_message[1]);
-        xpnet_SendMessage(FUTURE_ID | 0, tx_message);
-      }
+      // changed nibbles are broadcast in XP_CHECK_FEEDBACK, together with other changes
+      feedback_update(rx_message[1],rx_message[2]);
       processed = 1;
       break;
 
@@ -781,6 +1105,7 @@ static void xp_parser() {
               if (organizer_IsReady()) {
                 #if (DCC_F13_F28 == 1)
                 retval = do_loco_func_grp4(current_slot, addr, rx_message[4]);
+                if (retval & ORGZ_FHIGH_FULL) xp_send_CommandStationBusyResponse();   // no F13..F28 entry free
                 if (retval & ORGZ_STOLEN) {
                   xpnet_SendLocStolen(orgz_old_lok_owner,addr);
                 }
@@ -808,6 +1133,7 @@ static void xp_parser() {
               if (organizer_IsReady()) {
                 #if (DCC_F13_F28 == 1)
                 retval = do_loco_func_grp5(current_slot, addr, rx_message[4]);
+                if (retval & ORGZ_FHIGH_FULL) xp_send_CommandStationBusyResponse();   // no F13..F28 entry free
                 if (retval & ORGZ_STOLEN) {
                     xpnet_SendLocStolen(orgz_old_lok_owner,addr);
                 }
@@ -927,6 +1253,7 @@ static void xp_parser() {
                 #if (DCC_F13_F28 == 1)
                   addr = ((rx_message[2] & 0x3F) * 256) + rx_message[3];
                   retval = do_loco_func_grp4(current_slot, addr, rx_message[4]);
+                  if (retval & ORGZ_FHIGH_FULL) xp_send_CommandStationBusyResponse();   // no F13..F28 entry free
                   if (retval & ORGZ_STOLEN) {
                     xpnet_SendLocStolen(orgz_old_lok_owner,addr);
                   }
@@ -972,7 +1299,6 @@ enum xp_states { // actual state for the Xpressnet Task
   XP_WAIT_FOR_TX_COMPLETE,            // complete inquiry sent?
   XP_WAIT_FOR_REQUEST,                // client request
   XP_WAIT_FOR_REQUEST_COMPLETE,
-  XP_WAIT_FOR_ANSWER_COMPLETE,        // Our answer complete sent?
   XP_CHECK_BROADCAST,                 // is there a broadcast event
   XP_CHECK_FEEDBACK,                  // is there a feedback event
   XP_CHECK_DATABASE,                  // is there a database transfer
@@ -981,144 +1307,141 @@ enum xp_states { // actual state for the Xpressnet Task
 static signed char slot_timeout;
 static uint32_t rx_timeout; // zelfde eenheid als millis()
 
+// feedback broadcast: 0x4N ADR DAT ADR DAT ... (up to 7 pairs), see feedback_GetChanges
+#define XP_FEEDBACK_PAIRS   7
+static unsigned char xp_feedback_message[1 + 2 * XP_FEEDBACK_PAIRS];
+static unsigned int feedback_time;          // millis() of the last feedback broadcast
+
 void xpnet_Init() {
   xp_state = XP_INIT;
+  rx_message = XP_rx_frame();
+#if (XP_ADAPTIVE_SLOTS == 1)
+  slot_scheduler_Init();
+#endif
 } // xpnet_Init
 
+// Pipelined: the states follow each other in one call, until there is something
+// to wait for (bus, client or room in the tx fifo). Answers, broadcasts and the
+// next inquiry are not waited for, they queue up in the tx fifo and go out
+// back-to-back; only the inquiry has to be sent completely before the slot
+// timeout starts. The request is put together by the rx isr (see rs485.cpp).
 void xpnet_Run() {
-  switch (xp_state) {
-    case XP_INIT:
-      // we supose this is done: init_timer2(); // running with 4us per tick
-      xp_state = XP_INQUIRE_SLOT;
-      break;
+  for (;;) {
+    switch (xp_state) {
+      case XP_INIT:
+        // we supose this is done: init_timer2(); // running with 4us per tick
+        xp_state = XP_INQUIRE_SLOT;
+        break;
 
-    case XP_INQUIRE_SLOT:
-      current_slot = get_next_slot();
-      XP_send_call_byte (CALL_ID | current_slot);          // this is a normal inquiry call
-      xp_state = XP_WAIT_FOR_TX_COMPLETE;
-      break;
+      case XP_INQUIRE_SLOT:
+        if (!XP_tx_ready()) return;                          // previous answer still in the fifo
+        current_slot = get_next_slot();
+        XP_rx_frame_reset();
+        XP_send_call_byte (CALL_ID | current_slot);          // this is a normal inquiry call
+        xp_state = XP_WAIT_FOR_TX_COMPLETE;
+        return;
 
-    case XP_WAIT_FOR_TX_COMPLETE:
-      if (XP_is_all_sent()) {
-        xp_state = XP_WAIT_FOR_REQUEST;
+      case XP_WAIT_FOR_TX_COMPLETE:
+        if (!XP_is_all_sent()) return;
         slot_timeout = TCNT2 + ((XP_SLOT_TIMEOUT+XP_CALL_DURATION) / XP_TIMER_TICK);
-      }
-      break;
+        xp_state = XP_WAIT_FOR_REQUEST;
+        break;
 
-    case XP_WAIT_FOR_REQUEST:
-      if (XP_rx_ready()) {
-        // slot is requesting -> process it (a complete message could last up to 3ms)
-        rx_message[0] = XP_rx_read();           // save header
-        rx_size = rx_message[0] & 0x0F;         // length is without xor
-        rx_size++;                              // now including xor
-        rx_index = 1;        
-        rx_timeout = millis();
-        xp_state = XP_WAIT_FOR_REQUEST_COMPLETE;
-      }
-      else if ((signed char)(TCNT2 - slot_timeout) >= 0) {
-        // slot timeout reached, continue
+      case XP_WAIT_FOR_REQUEST:
+        if (XP_rx_frame_state() != XP_FRAME_EMPTY) {
+          // slot is requesting (a complete message could last up to 3ms)
+          rx_timeout = millis();
+          xp_state = XP_WAIT_FOR_REQUEST_COMPLETE;
+        }
+        else if ((signed char)(TCNT2 - slot_timeout) >= 0) {
+          // slot timeout reached, continue
           xp_state = XP_CHECK_BROADCAST;
-      } 
-      break;
+        }
+        else return;
+        break;
 
-    case XP_WAIT_FOR_REQUEST_COMPLETE:
-      if ((millis() - rx_timeout) >= RX_TIMEOUT) {
-        // message incomplete, timeout reached !
-        set_slot_to_watch(current_slot);
-        xp_send_message_to_current_slot(tx_ptr = xp_datenfehler);
-        xp_state = XP_WAIT_FOR_ANSWER_COMPLETE;
-      }
-      else {
-        if (XP_rx_ready()) {
-          rx_message[rx_index] = XP_rx_read();
-          if (rx_index == rx_size) {
-            unsigned char i, my_check = 0;
-            // all data and xor read, now check xor
-            for (i=0; i<=rx_size; i++) my_check ^= rx_message[i];   
-            if (my_check == 0) {
-              // packet is received and okay, now parse it
-              set_slot_used(current_slot);
-              xp_parser();
-              xp_state = XP_WAIT_FOR_ANSWER_COMPLETE;
-            }
-            else {
-              // XOR is wrong!
-              xp_send_message_to_current_slot(tx_ptr = xp_datenfehler);
-              set_slot_to_watch(current_slot);
-              xp_state = XP_WAIT_FOR_ANSWER_COMPLETE;
-            }
-          }
-          else {
-            rx_index++;
-            if (rx_index == 17-1) rx_index = 17-1;   // overrun!
-          }
+      case XP_WAIT_FOR_REQUEST_COMPLETE:
+        switch (XP_rx_frame_state()) {
+          case XP_FRAME_OK:
+            // packet is received and okay, now parse it
+            set_slot_used(current_slot);
+            CMDLAT_ACCEPT(current_slot);
+            xp_parser();
+            CMDLAT_CLEAR();
+            break;
+          case XP_FRAME_BAD:
+            // XOR is wrong!
+            xp_send_message_to_current_slot(tx_ptr = xp_datenfehler);
+            set_slot_to_watch(current_slot);
+            break;
+          default:
+            if ((millis() - rx_timeout) < RX_TIMEOUT) return;
+            // message incomplete, timeout reached !
+            set_slot_to_watch(current_slot);
+            xp_send_message_to_current_slot(tx_ptr = xp_datenfehler);
+            break;
         }
-      }           
-      break;
+        xp_state = XP_CHECK_BROADCAST;                       // the answer goes out by the isr
+        break;
 
-    case XP_WAIT_FOR_ANSWER_COMPLETE:
-      if (XP_is_all_sent()) {
-          xp_state = XP_CHECK_BROADCAST;
-      }
-      break;
-    case XP_CHECK_BROADCAST:
-      if (xpEvent.statusChanged) {
-        xp_send_BroadcastMessage();                            // report any Status Change
-        xp_state = XP_WAIT_FOR_ANSWER_COMPLETE;
-      }
-      #if (DCC_FAST_CLOCK == 1)
-      else if (xpEvent.clockChanged) {
-        xp_send_FastClockResponse(0);    // send as broadcast   // new: 23.06.2009; possibly we need a flag
-        xp_state = XP_WAIT_FOR_ANSWER_COMPLETE;
-      }
-      #endif
-      else {
-        xp_state = XP_CHECK_FEEDBACK;
-      }
-      break;
+      case XP_CHECK_BROADCAST:
+        if (!XP_tx_ready()) return;                          // room for the next message
+        if (xpEvent.statusChanged) {
+          xp_send_BroadcastMessage();                        // report any Status Change
+        }
+        #if (DCC_FAST_CLOCK == 1)
+        else if (xpEvent.clockChanged) {
+          xp_send_FastClockResponse(0);    // send as broadcast   // new: 23.06.2009; possibly we need a flag
+        }
+        #endif
+        else {
+          xp_state = XP_CHECK_FEEDBACK;
+        }
+        break;
 
-    case XP_CHECK_FEEDBACK:
-      // SDS : we don't do S88, feedback comes over xpressnet, so don't need this state anymore
-      xp_state = XP_CHECK_DATABASE;
-      break;
+      case XP_CHECK_FEEDBACK:
+        // SDS : we don't do S88, feedback comes over xpressnet (0x7 extension, see xp_parser);
+        // all changes since the last broadcast go out in one message, at most every XP_FEEDBACK_INTERVAL
+        if (feedback_IsChanged()
+            && ((unsigned int)(millis() - feedback_time) >= XP_FEEDBACK_INTERVAL)
+            && !XP_tx_pending(xp_feedback_message)) {
+          unsigned char n;
+          if (!XP_tx_ready()) return;
+          n = feedback_GetChanges(&xp_feedback_message[1], XP_FEEDBACK_PAIRS);
+          xp_feedback_message[0] = 0x40 + 2 * n;
+          xpnet_SendMessage(FUTURE_ID | 0, xp_feedback_message);
+          feedback_time = millis();
+        }
+        xp_state = XP_CHECK_DATABASE;
+        break;
 
-    case XP_CHECK_DATABASE:
-      if (database_XpnetMessageFlag == 0) {
-        xp_state = XP_INQUIRE_SLOT;
-      }
-      else {
-        if (database_XpnetMessageFlag == 1)
-          xpnet_SendMessage(MESSAGE_ID | 0, database_XpnetMessage);   // send this as MESSAGE (normal download)
-        else
-          xpnet_SendMessage(CALL_ID | 0, database_XpnetMessage);      // send this as 'CALL' (Roco hack, info W.Kufer)
-        // TODO SDS2021 : toch maar een vieze implementatie, maar allee
-        database_XpnetMessageFlag = 0;
-        xp_state = XP_WAIT_FOR_ANSWER_COMPLETE;
-      }                                                  
-      break;
+      case XP_CHECK_DATABASE:
+        // database transfer: the frames are due as the profile says (MESSAGE or 'CALL', Roco hack, info W.Kufer;
+        // to one slot MESSAGE frames only, see database.cpp)
+        {
+          unsigned char call;
+          if (XP_tx_ready() && database_XpnetFrame(&call, tx_message)) {   // built into the free tx buffer
+            xpnet_SendMessage(call, tx_message);
+            xp_state = XP_CHECK_BROADCAST;
+          }
+          else xp_state = XP_INQUIRE_SLOT;
+        }
+        break;
+    }
   }
 } // xpnet_Run
 
 // function for sending a generic message on the xpnet
 // used by UI for sending accessory feedback, and in this file
+// the message is not copied: msg must stay unchanged until it is sent (XP_tx_pending)
 void xpnet_SendMessage(unsigned char callByte, unsigned char *msg) {
-  unsigned char n, total, my_xor;
+  while (!XP_tx_ready()) BUSY_WAIT();                 // busy waiting! (but shouldn't happen, queue of 7)
 
-  n = 0;
-  my_xor = msg[0];
-  total = msg[0] & 0x0F;
-  
-  while (!XP_tx_ready()) ;                 // busy waiting! (but shouldn't happen)
-
-  XP_send_call_byte(callByte);              // send slot (9th bit is 1)
-  XP_send_byte(msg[0]);                    // send header
-
-  while (n != total) {
-    n++;
-    my_xor ^= msg[n];
-    XP_send_byte(msg[n]);              // send data
-  }    
-  XP_send_byte(my_xor);                   // send xor
+  XP_send_message(callByte, msg);                     // call byte, header, data; xor by the isr
+  if (msg == tx_message) {
+    tx_message = (tx_message == tx_buffer[0]) ? tx_buffer[1] : tx_buffer[0];
+    while (XP_tx_pending(tx_message)) BUSY_WAIT();    // both on the way (shouldn't happen either)
+  }
 } // xpnet_SendMessage
 
 // used by UI after stealing a loc from another xpnet device (slot), and used in this file
@@ -29,7 +29,8 @@ typedef enum {
 
 void xpnet_Init();
 void xpnet_Run();                       // multitask replacement
-void xpnet_SendMessage(unsigned char callByte, unsigned char *str);   // send a message with this callbyte (ID+slot)
+void xpnet_SendMessage(unsigned char callByte, unsigned char *str);   // send a message with this callbyte (ID+slot),
+                                                                     // sent from str: keep it unchanged until it is out
 
 // nu wordt locobuffer[].owner_changed flag niet meer gebruikt, maar wel die mottige orgz_old_owner
 void xpnet_SendLocStolen(unsigned char slot, unsigned int locAddress);
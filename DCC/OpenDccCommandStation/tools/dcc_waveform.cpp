@@ -0,0 +1,612 @@
+//----------------------------------------------------------------
+//
+// OpenDCC
+//
+// This source file is subject of the GNU general public license 2,
+// that is available at the world-wide-web at
+// http://www.gnu.org/licenses/gpl.txt
+//
+//-----------------------------------------------------------------
+//
+// file:      dcc_waveform.cpp  (host tool, not part of the firmware)
+// history:   2026-10-16 V0.1 started
+//            2026-10-16 V0.2 PROG_TRACK_CONCURRENT: output of the programming track
+//            2026-10-16 V0.3 scenario estop
+//            2026-10-16 V0.4 cutout start outside TCS is an error
+//            2026-10-16 V0.5 preamble: the cutout is one bit; line% only inside the window
+//
+//-----------------------------------------------------------------
+//
+// purpose:   waveform of dccout (ISR(TIMER1_COMPA_vect)) checked against the
+//            NMRA timing, and the packet rate the output reaches
+//
+// build:     pio run -e native_waveform  (firmware + lib/native_hal)
+// usage:     .pio/build/native_waveform/program [scenario]
+//            scenario: idle, lengths, locos, pom, nocutout, service, estop, concurrent (default: all)
+//            concurrent: pio run -e native_waveform_prog (PROG_TRACK_CONCURRENT = 1)
+//
+// how:       The complete main loop runs on the simulated ATmega328 (timer1 CTC
+//            with the TCCR1A / OCR1A / OCR1B writes of dccout, see native_hal).
+//            native_OnDccEdge / native_OnNdccEdge get the edges of D9 (DCC) and
+//            D10 (NDCC) at the cycle of the compare match. A bit starts with the
+//            rising edge of DCC. Checked:
+//            - NDCC is the inverse of DCC and changes on the same edge; both low
+//              is the railcom cutout
+//            - half bits (S-9.1, command station): '1' 55..61us, the two halves
+//              differ by 3us at most; '0' 95..9900us, whole bit 12ms at most
+//            - preamble (S-9.2): 14 bits, 20 while the programming track is switched
+//              on (PROG_TRACK_STATE, at start of preamble and start bit), exactly as
+//              dccout sends them; counted after the end bit, the cutout is one bit
+//              (the stretched CUTOUT_1 of dccout)
+//            - cutout (RCN-217): starts 26..32us after the end bit (CUTOUT_GAP,
+//              dccout.cpp), ends 454..488us after it,
+//              directly after the end bit
+//            - xor of every packet, no pulses outside of the bit classes
+//            PROG_TRACK_CONCURRENT: the programming track has its own output on D11
+//            (progout, native_OnProgEdge), checked the same way (no NDCC, no cutout,
+//            preamble always 20); the main track keeps 14 preamble bits. Scenario
+//            concurrent: the packet rate of the main track while cv's are read on
+//            the programming track must be the same as without (1% at most below).
+//            Scenario estop: locos running and pom writes, at different points of
+//            the packets status_SetState(RUN_STOP) (as xpnet 0x21 0x80); the start
+//            bit of the broadcast stop must follow within one packet time (ESTOP_MAX,
+//            dccout_EmergencyStop), and after it no loco may get a speed > 0.
+//            Simulated time only -> results are deterministic.
+//
+// output:    one line per scenario:
+//              pkt/s      packets per second (valid xor)
+//              3B .. 6B   packets per second of this length (bytes incl. xor)
+//              line%      start bit .. end bit plus the minimum preamble of all packets,
+//                         in percent of the time; the rest is cutout, longer preambles and
+//                         underruns. Only the part inside the window counts (a packet
+//                         that started before it, the packet at its end), more than 100%
+//                         is an error
+//              pre        preamble bits min..max (service mode in brackets)
+//              one/zero   half bits min..max [us]
+//              cutout     start / end after the end bit [us], the latest ones
+//            PROG_TRACK_CONCURRENT: a second line ' prog' for the programming track
+//            estop: a second line, request -> start bit of the stop min..max / avg [ms]
+//            exit code 1: a check failed
+//
+//-----------------------------------------------------------------
+
+#include <stdio.h>
+#include <string.h>
+#include "native_hal.h"
+#include "hardware.h"
+#include "config.h"
+#include "organizer.h"
+#include "programmer.h"
+#include "status.h"
+#include "dccout.h"
+
+#define LOOP_US       100                // duration of one main loop (besides waits)
+#define CYC_PER_US    (F_CPU / 1000000L)
+#define US(x)         ((uint64_t)(x) * CYC_PER_US)
+
+// S-9.1, command station
+#define ONE_MIN       US(55)
+#define ONE_MAX       US(61)
+#define ONE_DIFF      US(3)
+#define ZERO_MIN      US(95)
+#define ZERO_MAX      US(9900)
+#define ZERO_BIT_MAX  US(12000)
+// classes of a half bit (like the decoder in native_hal), outside: pulse error
+#define CLASS_ONE_MIN   US(52)
+#define CLASS_ONE_MAX   US(64)
+#define CLASS_ZERO_MIN  US(90)
+#define CLASS_ZERO_MAX  US(10000)
+// S-9.2
+#define PREAMBLE        14
+#define PREAMBLE_PROG   20
+#define BIT_ONE         US(116)
+// RCN-217, after the end of the end bit
+#define TCS_MIN       US(26)
+#define TCS_MAX       US(32)
+#define TCE_MIN       US(454)
+#define TCE_MAX       US(488)
+// main track during service mode, packet rate compared to the same traffic without
+#define RATE_TOL      1                  // percent
+// emergency stop: request -> start bit of the broadcast stop, at most one packet time:
+// the longest packet (6 bytes incl. xor, all bits 0, end bit) and a preamble with cutout
+#define ESTOP_MAX     (6 * 9 * 2 * BIT_ONE + BIT_ONE + (PREAMBLE + 3) * BIT_ONE)
+#define ESTOP_TRIALS  40
+
+void setup();
+void loop();
+
+//---------------------------------------------------------------------------------
+// results of a scenario
+//---------------------------------------------------------------------------------
+
+typedef struct {
+  uint64_t t0;                       // start of the window (result_Reset)
+  uint32_t packets;
+  uint32_t len[7];                   // packets with 3 .. 6 bytes (incl. xor)
+  uint64_t line;                     // cycles: start bit .. end bit + minimum preamble
+  uint16_t pre_min, pre_max;         // preamble bits
+  uint16_t prog_min, prog_max;       // same, programming track on
+  uint64_t one_min, one_max, zero_min, zero_max;
+  uint32_t cutouts;
+  uint64_t tcs_min, tcs_max, tce_min, tce_max;
+  // errors
+  uint32_t halves;                   // half bit timing
+  uint32_t preambles;                // too short
+  uint32_t cutout_window;            // end outside TCE, or not after an end bit
+  uint32_t polarity;                 // NDCC not the inverse of DCC, or an edge of its own
+  uint32_t pulses;                   // outside of the classes (glitch)
+  uint32_t framing;                  // 0 after less than 10 ones, xor wrong
+  uint32_t tcs;                      // cutout start outside TCS
+  uint32_t rate;                     // main track slower during service mode
+  uint32_t overlap;                  // line% > 100: the accounting is wrong
+} t_result;
+
+static t_result r;                   // main track (DCC, NDCC)
+static t_result rp;                  // programming track (PROG_DCC), PROG_TRACK_CONCURRENT
+
+static void minmax(uint64_t v, uint64_t *min, uint64_t *max) {
+  if (v < *min) *min = v;
+  if (v > *max) *max = v;
+}
+
+static void minmax16(uint16_t v, uint16_t *min, uint16_t *max) {
+  if (v < *min) *min = v;
+  if (v > *max) *max = v;
+}
+
+static void result_Reset(t_result *res) {
+  memset(res, 0, sizeof(*res));
+  res->t0 = native_Cycles();
+  res->pre_min = res->prog_min = 0xFFFF;
+  res->one_min = res->zero_min = res->tcs_min = res->tce_min = UINT64_MAX;
+}
+
+//---------------------------------------------------------------------------------
+// edges -> bits -> packets
+//---------------------------------------------------------------------------------
+
+typedef struct {
+  t_result *res;
+  bool own;                          // output of the programming track: always service mode
+  uint64_t rise;                     // last rising edge of DCC (start of the current bit), 0: none yet
+  uint64_t fall;                     // last falling edge of DCC
+  uint8_t ndcc;                      // level of NDCC
+  uint64_t ndcc_edge;                // its last edge
+  bool cutout;
+  uint64_t end_bit;                  // end of the last end bit
+  // packet
+  uint8_t state;                     // 0: preamble, 1: data bits, 2: separator
+  uint16_t ones;                     // preamble bits
+  bool prog;                         // programming track on at start of preamble
+  bool service;                      // and at the start bit of this packet
+  uint64_t start;                    // start bit
+  uint8_t bits, size;
+  uint8_t pkt[16];
+} t_decoder;
+
+static t_decoder wf;                                // DCC / NDCC, see main
+static t_decoder pf;                                // PROG_DCC
+
+// scenario estop
+static uint64_t estop_req;           // cycles of the request, 0: stop seen
+static uint64_t estop_min, estop_max, estop_sum;
+static uint32_t estop_n;
+static bool estop_halted;            // the stop is on the rails
+static uint32_t estop_moving;        // speed packets > 0 after it (error)
+
+// speed packet of a loco with a speed step > 0 (e-stop: 1)
+static bool moving(const uint8_t *p) {
+  uint8_t i;
+
+  if ((p[0] > 0) && (p[0] < 128)) i = 1;            // short address
+  else if ((p[0] >= 192) && (p[0] < 232)) i = 2;    // long address
+  else return (false);
+  if (p[i] == 0x3F) return ((p[i + 1] & 0x7F) > 1); // 128 speed steps
+  if ((p[i] & 0xC0) == 0x40) return ((p[i] & 0x0F) > 1);   // 14 / 28 speed steps
+  return (false);
+}
+
+// every valid packet of the main track
+static void estop_packet(t_decoder *d) {
+  uint64_t t;
+
+  if ((d->size == 3) && (d->pkt[0] == 0x00) && (d->pkt[1] == 0x71)) {
+    if (estop_req == 0) return;
+    t = (d->start > estop_req) ? d->start - estop_req : 0;
+    minmax(t, &estop_min, &estop_max);
+    estop_sum += t;
+    estop_n++;
+    estop_req = 0;
+    estop_halted = true;
+  }
+  else if (estop_halted && moving(d->pkt)) estop_moving++;
+}
+
+// service mode preamble required
+static bool prog_track(t_decoder *d) {
+  if (d->own) return (true);
+  return (!PROG_TRACK_CONCURRENT && (digitalRead(SW_ENABLE_PROG) != 0));
+}
+
+// begin of the line time of the current packet (minimum preamble), not before the window
+static uint64_t line_begin(t_decoder *d) {
+  uint64_t pre = (d->service ? PREAMBLE_PROG : PREAMBLE) * BIT_ONE;
+
+  return ((d->start < d->res->t0 + pre) ? d->res->t0 : d->start - pre);
+}
+
+// line time of the packet on the rails at the end of the window
+static uint64_t line_tail(t_decoder *d, uint64_t now) {
+  if ((d->state == 0) || (d->start == 0)) return (0);
+  return (now - line_begin(d));
+}
+
+static void wf_bit(t_decoder *d, uint8_t bit, uint64_t begin, uint64_t end) {
+  t_result *res = d->res;
+  uint8_t i, x;
+
+  switch (d->state) {
+    case 0:                                         // preamble
+      if (bit) {
+        if (d->ones == 0) d->prog = prog_track(d);  // after a pulse error
+        d->ones++;
+        return;
+      }
+      if (d->ones < 10) {                           // no valid preamble
+        res->framing++;
+        d->ones = 0;
+        return;
+      }
+      d->service = d->prog && prog_track(d);        // switched on for the whole preamble
+      if (d->service) {
+        minmax16(d->ones, &res->prog_min, &res->prog_max);
+        if (d->ones < PREAMBLE_PROG) res->preambles++;
+      }
+      else {
+        minmax16(d->ones, &res->pre_min, &res->pre_max);
+        if (d->ones != PREAMBLE) res->preambles++;  // the main track sends 14, never more
+      }
+      d->start = begin;
+      d->size = 0;
+      d->bits = 0;
+      d->state = 1;
+      return;
+    case 1:                                         // data
+      d->pkt[d->size] = (d->pkt[d->size] << 1) | bit;
+      if (++d->bits == 8) {
+        d->bits = 0;
+        d->size++;
+        d->state = 2;
+      }
+      return;
+    default:                                        // separator or end bit
+      if ((bit == 0) && (d->size < sizeof(d->pkt))) {
+        d->state = 1;
+        return;
+      }
+      d->state = 0;
+      d->ones = 0;
+      for (i = 0, x = 0; i < d->size; i++) x ^= d->pkt[i];
+      if (!bit || (d->size < 3) || x) {
+        res->framing++;
+        return;
+      }
+      d->end_bit = end;
+      d->prog = prog_track(d);                      // preamble of the next one starts
+      res->packets++;
+      if (!d->own) estop_packet(d);
+      if (d->size < sizeof(res->len) / sizeof(res->len[0])) res->len[d->size]++;
+      res->line += end - line_begin(d);
+      return;
+  }
+}
+
+// rising edge at cycles: the bit since d->rise is complete
+static void wf_halves(t_decoder *d, uint64_t cycles) {
+  t_result *res = d->res;
+  uint64_t h = d->fall - d->rise;
+  uint64_t l = cycles - d->fall;
+
+  if ((h >= CLASS_ONE_MIN) && (h <= CLASS_ONE_MAX) && (l >= CLASS_ONE_MIN) && (l <= CLASS_ONE_MAX)) {
+    minmax(h, &res->one_min, &res->one_max);
+    minmax(l, &res->one_min, &res->one_max);
+    if ((h < ONE_MIN) || (h > ONE_MAX) || (l < ONE_MIN) || (l > ONE_MAX) ||
+        ((h > l ? h - l : l - h) > ONE_DIFF)) res->halves++;
+    wf_bit(d, 1, d->rise, cycles);
+  }
+  else if ((h >= CLASS_ZERO_MIN) && (h <= CLASS_ZERO_MAX) && (l >= CLASS_ZERO_MIN) && (l <= CLASS_ZERO_MAX)) {
+    minmax(h, &res->zero_min, &res->zero_max);
+    minmax(l, &res->zero_min, &res->zero_max);
+    if ((h < ZERO_MIN) || (h > ZERO_MAX) || (l < ZERO_MIN) || (l > ZERO_MAX) || (h + l > ZERO_BIT_MAX))
+      res->halves++;
+    wf_bit(d, 0, d->rise, cycles);
+  }
+  else {
+    res->pulses++;
+    d->state = 0;
+    d->ones = 0;
+  }
+  d->rise = cycles;
+}
+
+void native_OnNdccEdge(uint8_t level, uint64_t cycles) {
+  wf.ndcc = level;
+  wf.ndcc_edge = cycles;
+}
+
+void native_OnProgEdge(uint8_t level, uint64_t cycles) {
+  if (!level) pf.fall = cycles;
+  else if (pf.rise == 0) pf.rise = cycles;          // first bit starts
+  else wf_halves(&pf, cycles);
+}
+
+void native_OnDccEdge(uint8_t level, uint64_t cycles) {
+  uint64_t h, l;
+  bool paired = (wf.ndcc_edge == cycles);
+
+  if (!level) {                                     // high part of the bit is done
+    wf.fall = cycles;
+    if (!wf.ndcc) {                                 // both low: cutout
+      wf.cutout = true;
+      r.cutouts++;
+      if (wf.rise != wf.end_bit) r.cutout_window++;
+      else {
+        h = cycles - wf.end_bit;
+        minmax(h, &r.tcs_min, &r.tcs_max);
+        if ((h < TCS_MIN) || (h > TCS_MAX)) r.tcs++;
+      }
+      if (paired) r.polarity++;
+      return;
+    }
+    if (!paired) r.polarity++;
+    return;
+  }
+  if (wf.ndcc || (!paired && !wf.cutout)) r.polarity++;
+  if (wf.cutout) {                                  // end of cutout, next bit starts
+    wf.cutout = false;
+    if (wf.rise == wf.end_bit) {
+      l = cycles - wf.end_bit;
+      minmax(l, &r.tce_min, &r.tce_max);
+      if ((l < TCE_MIN) || (l > TCE_MAX)) r.cutout_window++;
+      if (wf.state == 0) wf.ones++;                // the cutout is one preamble bit (CUTOUT_1, stretched)
+    }
+    wf.rise = cycles;
+    return;
+  }
+  wf_halves(&wf, cycles);
+}
+
+//---------------------------------------------------------------------------------
+// scenarios
+//---------------------------------------------------------------------------------
+
+static uint32_t errors;
+
+static void run(uint32_t ms) {
+  uint32_t i;
+
+  for (i = 0; i < ms * 1000 / LOOP_US; i++) {
+    loop();
+    native_Advance(LOOP_US);
+  }
+}
+
+static uint32_t per_s(uint32_t n, uint64_t cycles) {
+  return ((uint32_t)(n * (uint64_t)F_CPU / cycles));
+}
+
+static void us_range(char *s, size_t size, uint64_t min, uint64_t max) {
+  if (min > max) snprintf(s, size, "-");
+  else snprintf(s, size, "%.1f..%.1f", min / (double)CYC_PER_US, max / (double)CYC_PER_US);
+}
+
+// the window: result_Reset (start) .. now
+static void report_line(const char *name, t_decoder *d) {
+  t_result *res = d->res;
+  uint64_t now = native_Cycles();
+  uint64_t t = now - res->t0;
+  uint32_t e;
+  char pre[24], one[24], zero[24], cut[24];
+
+  res->line += line_tail(d, now);
+  if (res->line > t) res->overlap++;
+  e = res->halves + res->preambles + res->cutout_window + res->tcs + res->polarity + res->pulses +
+      res->framing + res->rate + res->overlap;
+
+  if (res->pre_min > res->pre_max) snprintf(pre, sizeof(pre), "-");
+  else snprintf(pre, sizeof(pre), "%u..%u", res->pre_min, res->pre_max);
+  if (res->prog_min <= res->prog_max)
+    snprintf(pre + strlen(pre), sizeof(pre) - strlen(pre), " (%u..%u)", res->prog_min, res->prog_max);
+  us_range(one, sizeof(one), res->one_min, res->one_max);
+  us_range(zero, sizeof(zero), res->zero_min, res->zero_max);
+  if (res->cutouts == 0) snprintf(cut, sizeof(cut), "-");
+  else snprintf(cut, sizeof(cut), "%.1f/%.1f", res->tcs_max / (double)CYC_PER_US, res->tce_max / (double)CYC_PER_US);
+  printf("%-10s %5u %4u %4u %4u %4u  %5.1f  %-13s %-10s %-12s %-12s %-4s",
+         name, per_s(res->packets, t), per_s(res->len[3], t), per_s(res->len[4], t), per_s(res->len[5], t),
+         per_s(res->len[6], t), res->line * 100.0 / t, pre, one, zero, cut, e ? "FAIL" : "ok");
+  if (e) printf("  halves %u preamble %u cutout %u start %u polarity %u pulses %u framing %u rate %u line %u",
+                res->halves, res->preambles, res->cutout_window, res->tcs, res->polarity, res->pulses,
+                res->framing, res->rate, res->overlap);
+  printf("\n");
+  errors += e;
+}
+
+static void report(const char *name) {
+  report_line(name, &wf);
+  if (PROG_TRACK_CONCURRENT) report_line(" prog", &pf);
+}
+
+// the window of the results starts here
+static void start() {
+  run(20);                           // packets of the scenario before
+  result_Reset(&r);
+  result_Reset(&rp);
+}
+
+static void locos(bool on) {
+  unsigned int i;
+
+  for (i = 0; i < 8; i++) {
+    if (on) {
+      do_loco_speed_f(1, 3 + i, 0x80 | (10 + i), DCC28);        // 3 bytes
+      do_loco_speed_f(1, 1000 + i, 0x80 | (40 + i), DCC128);    // 5 bytes
+      do_loco_func_grp0(1, 1000 + i, 1);                         // 4 bytes
+      do_loco_func_grp1(1, 3 + i, 0x05);                         // 3 bytes
+    }
+    else {
+      do_loco_speed(1, 3 + i, 0);
+      do_loco_speed(1, 1000 + i, 0);
+      lb_ReleaseLoc(3 + i);
+      lb_ReleaseLoc(1000 + i);
+    }
+  }
+}
+
+static void scenario(const char *name) {
+  unsigned char msg[5] = { 0x03, 0x3F, 0xA5, 0x5A, 0xC3 };
+  char s[16];
+  uint32_t i, rate;
+  uint8_t n, k;
+
+  if (!strcmp(name, "idle")) {                        // idle packets, and the loco 3 dummy
+    start();
+    run(1000);
+    report(name);
+  }
+  else if (!strcmp(name, "lengths")) {                // raw packets, the queue always filled
+    for (n = 2; n <= 5; n++) {
+      run(1500);                                      // repeats of the length before
+      start();
+      for (i = 0; i < 1000 * 1000 / LOOP_US; i++) {
+        for (k = 0; (k < SIZE_QUEUE_LP) && !do_raw_msg(msg, n); k++);   // until the queue is full
+        loop();
+        native_Advance(LOOP_US);
+      }
+      snprintf(s, sizeof(s), "len %u", n + 1);
+      report(s);
+    }
+  }
+  else if (!strcmp(name, "locos")) {                  // refresh of 16 locos, dcc28 and dcc128
+    start();
+    locos(true);
+    run(2000);
+    report(name);
+    locos(false);
+  }
+  else if (!strcmp(name, "pom")) {                    // refresh and pom writes
+    start();
+    locos(true);
+    for (i = 0; i < 40; i++) {
+      do_pom_loco(1000 + (i & 7), 3, i);              // 6 bytes
+      do_accessory(i, 0, 1);                          // 3 bytes
+      run(50);
+    }
+    report(name);
+    locos(false);
+  }
+  else if (!strcmp(name, "nocutout")) {              // railcom off
+    dccout_DisableCutout();
+    start();
+    locos(true);
+    run(1000);
+    report(name);
+    locos(false);
+    dccout_EnableCutout();
+  }
+  else if (!strcmp(name, "service")) {                // direct mode read, no ack: long preambles
+    start();
+    programmer_CvDirectRead(1);
+    run(3000);
+    report(name);
+    programmer_Reset();                               // without ack the read goes on for 256 values
+    status_SetState(RUN_OKAY);                        // resume operations
+  }
+  else if (!strcmp(name, "estop")) {                 // stop all locos, at different points of the packets
+    locos(true);
+    run(500);
+    start();
+    estop_min = UINT64_MAX;
+    estop_max = estop_sum = 0;
+    estop_n = estop_moving = 0;
+    for (n = 0; n < ESTOP_TRIALS; n++) {
+      for (k = 0; k < 4; k++) do_pom_loco(1000 + k, 3, n);  // 6 byte packets in the queue
+      native_Advance(1 + n * 373 % 7000);            // somewhere in a packet
+      estop_req = native_Cycles();
+      status_SetState(RUN_STOP);                      // like xpnet: stop all locos
+      for (i = 0; estop_req && (i < 1000); i++) run(1);
+      if (estop_req) estop_max = UINT64_MAX;          // no stop at all
+      run(100);                                       // masked speeds, repetitions of the stop
+      estop_halted = false;
+      estop_req = 0;
+      status_SetState(RUN_OKAY);                      // the refresh starts the locos again
+      run(300);
+    }
+    report(name);
+    if (estop_n && (estop_max != UINT64_MAX))
+      printf(" stop      %u requests, start bit after %.1f..%.1f ms, avg %.1f (limit %.1f), moving after the stop %u",
+             estop_n, estop_min / (CYC_PER_US * 1000.0), estop_max / (CYC_PER_US * 1000.0),
+             estop_sum / (estop_n * CYC_PER_US * 1000.0), ESTOP_MAX / (CYC_PER_US * 1000.0), estop_moving);
+    else printf(" stop      no broadcast stop seen");
+    if ((estop_n != ESTOP_TRIALS) || (estop_max > ESTOP_MAX) || estop_moving) {
+      printf("  FAIL\n");
+      errors++;
+    }
+    else printf("  ok\n");
+    locos(false);
+  }
+  else if (!strcmp(name, "concurrent")) {             // refresh of 16 locos, without and with cv reads
+    if (!PROG_TRACK_CONCURRENT) {
+      printf("%-10s needs PROG_TRACK_CONCURRENT = 1 ([env:native_waveform_prog])\n", name);
+      errors++;
+      return;
+    }
+    start();
+    locos(true);
+    run(2000);
+    rate = per_s(r.packets, native_Cycles() - r.t0);
+    report("locos");
+    start();
+    for (i = 0, n = 0; i < 2000 * 1000 / LOOP_US; i++) {
+      if (!prog_event.busy) programmer_CvDirectRead(1 + (n++ & 7));   // no ack: keeps on scanning
+      loop();
+      native_Advance(LOOP_US);
+    }
+    if (per_s(r.packets, native_Cycles() - r.t0) * 100 < rate * (100 - RATE_TOL)) r.rate++;
+    report(name);
+    programmer_Reset();
+    status_SetState(RUN_OKAY);
+    locos(false);
+  }
+  else {
+    printf("%-10s unknown\n", name);
+    errors++;
+  }
+}
+
+static const char *scenarios[] = { "idle", "lengths", "locos", "pom", "nocutout", "service", "estop",
+#if (PROG_TRACK_CONCURRENT == 1)
+                                    "concurrent"
+#endif
+                                  };
+
+int main(int argc, char **argv) {
+  unsigned char i;
+
+  wf.res = &r;
+  pf.res = &rp;
+  pf.own = true;
+  native_Init();
+  native_SetPin(NSHORT_MAIN, HIGH);  // see native_main.cpp
+  native_SetPin(NSHORT_PROG, HIGH);
+  native_SetPin(ACK_DETECTED, LOW);
+  native_SetAnalog(EXT_STOP, 1023);
+  setup();
+  run(200);
+
+  printf("scenario   pkt/s   3B   4B   5B   6B  line%%  pre           one us     zero us      cutout us\n");
+  if (argc > 1) scenario(argv[1]);
+  else {
+    for (i = 0; i < sizeof(scenarios) / sizeof(scenarios[0]); i++) scenario(scenarios[i]);
+  }
+  return (errors ? 1 : 0);
+}
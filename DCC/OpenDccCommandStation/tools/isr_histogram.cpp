@@ -0,0 +1,95 @@
+//----------------------------------------------------------------
+//
+// OpenDCC
+//
+// This source file is subject of the GNU general public license 2,
+// that is available at the world-wide-web at
+// http://www.gnu.org/licenses/gpl.txt
+//
+//-----------------------------------------------------------------
+//
+// file:      isr_histogram.cpp  (host tool, not part of the firmware)
+// history:   2026-10-16 V0.1 started
+//
+//-----------------------------------------------------------------
+//
+// purpose:   latency histogram of captured ISR samples (ISR_PROFILING)
+//
+// build:     g++ -O2 -o isr_histogram isr_histogram.cpp
+// usage:     isr_histogram [bucket width in cycles, default 32] < capture.txt
+//
+// input:     one line per xpnet answer to 0x22 0xF9 N, as hex bytes:
+//              6B F9 00 00 01 7C 01 80 01 7A 01 9E 2C
+//            (header, 0xF9, N, ID, 4 samples msb first, [xor]; 0xFFFF = not captured)
+//            other lines are read as decimal samples (cpu cycles), one or more per line.
+//
+//-----------------------------------------------------------------
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+#define F_CPU           16000000L
+#define DEADLINE        (F_CPU / 1000000L * 50)    // same as ISRPROF_DEADLINE
+#define BAR_WIDTH       50
+
+static void read_line(char *line, std::vector<unsigned int> &samples) {
+  unsigned int b[16];
+  unsigned int n = 0;
+  char *tok;
+
+  if ((strncmp(line, "6B", 2) == 0) || (strncmp(line, "6b", 2) == 0)) {
+    for (tok = strtok(line, " \t\r\n"); tok && (n < 16); tok = strtok(NULL, " \t\r\n"))
+      b[n++] = strtoul(tok, NULL, 16);
+    if ((n < 12) || (b[1] != 0xF9)) return;
+    for (unsigned int i = 0; i < 4; i++) {
+      unsigned int s = (b[4+2*i] << 8) | b[5+2*i];
+      if (s != 0xFFFF) samples.push_back(s);
+    }
+    return;
+  }
+  for (tok = strtok(line, " \t\r\n,;"); tok; tok = strtok(NULL, " \t\r\n,;"))
+    samples.push_back(strtoul(tok, NULL, 10));
+}
+
+int main(int argc, char **argv) {
+  std::vector<unsigned int> samples;
+  std::vector<unsigned int> hist;
+  unsigned int width = 32;
+  unsigned int min = 0xFFFFFFFF, max = 0, missed = 0, peak = 0;
+  unsigned long sum = 0;
+  char line[256];
+
+  if (argc > 1) width = atoi(argv[1]);
+  if (width == 0) width = 1;
+
+  while (fgets(line, sizeof(line), stdin)) read_line(line, samples);
+  if (samples.empty()) {
+    fprintf(stderr, "no samples\n");
+    return 1;
+  }
+
+  for (unsigned int i = 0; i < samples.size(); i++) {
+    unsigned int s = samples[i];
+    if (s < min) min = s;
+    if (s > max) max = s;
+    if (s > DEADLINE) missed++;
+    sum += s;
+  }
+  hist.resize(max / width + 1);
+  for (unsigned int i = 0; i < samples.size(); i++) {
+    if (++hist[samples[i] / width] > peak) peak = hist[samples[i] / width];
+  }
+
+  printf("samples %u, min %u, avg %lu, max %u cycles (%.1f us), > deadline (%ld): %u\n",
+         (unsigned int)samples.size(), min, sum / samples.size(), max,
+         max * 1000000.0 / F_CPU, DEADLINE, missed);
+  for (unsigned int i = min / width; i < hist.size(); i++) {
+    printf("%5u-%5u %6u ", i * width, (i + 1) * width - 1, hist[i]);
+    for (unsigned int j = 0; j < hist[i] * BAR_WIDTH / peak; j++) putchar('#');
+    if ((i * width <= DEADLINE) && ((i + 1) * width > DEADLINE)) printf("  <- deadline");
+    putchar('\n');
+  }
+  return 0;
+}
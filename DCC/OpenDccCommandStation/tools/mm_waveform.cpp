@@ -0,0 +1,387 @@
+//----------------------------------------------------------------
+//
+// OpenDCC
+//
+// This source file is subject of the GNU general public license 2,
+// that is available at the world-wide-web at
+// http://www.gnu.org/licenses/gpl.txt
+//
+//-----------------------------------------------------------------
+//
+// file:      mm_waveform.cpp  (host tool, not part of the firmware)
+// history:   2026-10-16 V0.1 started
+//
+//-----------------------------------------------------------------
+//
+// purpose:   check of the Motorola output (MAERKLIN_ENABLED): timing of the
+//            packets on the rails, their content, and the dcc packets in between
+//
+// build:     pio run -e native_mmout  (firmware + lib/native_hal, MAERKLIN_ENABLED=1)
+//            the RAM budget warning of config.h is expected on the nano
+// usage:     .pio/build/native_mmout/program [scenario]
+//
+// how:       The firmware runs on the simulated hardware, after setup() only
+//            organizer_Run() is called. native_OnDccEdge gets every edge of
+//            the DCC output; a high pulse of 26 or 182us starts a Motorola bit,
+//            18 bits make a packet. Checked for every packet:
+//            - bit period 208us, short part 26us, long part 182us (+-2us)
+//            - the two copies of a pair are the same, gap between them 1248us (6 bits)
+//            - at least 4.2ms low in front of a pair and after it
+//            The pairs are compared with the trits of the Intellibox table (address,
+//            function trit, speed / direction / function), independent of the tables
+//            in organizer.cpp. native_hal decodes the dcc packets in between, there
+//            must be no dcc error.
+//            Simulated time only -> results are deterministic.
+//
+// output:    one line per scenario with the checked values, then the timing
+//            exit code 1: a check failed
+//
+//-----------------------------------------------------------------
+
+#include <stdio.h>
+#include <string.h>
+#include "native_hal.h"
+#include "hardware.h"
+#include "config.h"
+#include "organizer.h"
+#include "database.h"
+
+#if (MAERKLIN_ENABLED == 0)
+  #error mm_waveform needs MAERKLIN_ENABLED == 1
+#endif
+
+#define LOOP_US       100                // duration of one main loop
+#define CYC_PER_US    (F_CPU / 1000000L)
+#define MM_TOL        2                  // us
+#define MM_GAP_US     1248
+#define MM_PAUSE_US   4200
+#define MAX_PAIRS     1024
+
+void setup();
+
+//---------------------------------------------------------------------------------
+// Motorola decoder (edges of D9)
+//---------------------------------------------------------------------------------
+
+typedef struct {
+  uint8_t addr;                      // 4 trits
+  uint8_t fn;                        // function trit (0 or 3)
+  uint8_t data;                      // 4 trits
+} t_pair;
+
+static struct {
+  uint64_t last;                     // cycles of the last edge
+  uint64_t start;                    // first edge of the packet
+  uint32_t bits;
+  uint8_t n;                         // bits received
+  uint32_t h;                        // high part of the current bit (us), 0: none
+  uint32_t pre;                      // low in front of the packet (us)
+} rx;
+
+static struct {
+  bool valid;
+  uint32_t bits;
+  uint32_t post;                     // low after it (us)
+  uint64_t start;
+} first;                             // first copy of a pair
+
+static t_pair pairs[MAX_PAIRS];
+static uint16_t num_pairs;
+static uint64_t mm_cycles;           // rail time of the pairs, incl. the pause after them
+static uint32_t short_min = 0xFFFF, short_max, long_min = 0xFFFF, long_max, period_min = 0xFFFF, period_max;
+static uint32_t gap_min = 0xFFFF, gap_max, pause_min = 0xFFFFFFFF;
+static uint32_t broken;              // bits without a complete packet
+static uint32_t pair_errors;         // copies differ, gap wrong, copy missing
+static uint32_t pause_errors;        // less than 4.2ms in front of or after a pair
+
+static uint32_t dcc_packets;         // decoded by native_hal
+static uint32_t dcc_loco;            // of these to the dcc loco
+static uint16_t dcc_loco_addr;
+
+static bool near(uint32_t us, uint32_t nominal) {
+  return ((us + MM_TOL >= nominal) && (us <= nominal + MM_TOL));
+}
+
+static void minmax(uint32_t v, uint32_t *min, uint32_t *max) {
+  if (v < *min) *min = v;
+  if (v > *max) *max = v;
+}
+
+static void mm_packet(uint32_t bits, uint32_t pre, uint32_t post, uint64_t end) {
+  if (first.valid && (first.post > 2 * MM_GAP_US)) {   // the copy of the previous one is missing
+    pair_errors++;
+    first.valid = false;
+  }
+  if (!first.valid) {
+    if (pre < MM_PAUSE_US) pause_errors++;
+    first.valid = true;
+    first.bits = bits;
+    first.post = post;
+    first.start = rx.start;
+    return;
+  }
+  first.valid = false;
+  minmax(first.post, &gap_min, &gap_max);
+  if ((bits != first.bits) || !near(first.post, MM_GAP_US)) pair_errors++;
+  if (post < MM_PAUSE_US) pause_errors++;
+  if (post < pause_min) pause_min = post;
+  mm_cycles += end - first.start;
+  if (num_pairs < MAX_PAIRS) {
+    pairs[num_pairs].addr = bits >> 10;
+    pairs[num_pairs].fn = (bits >> 8) & 3;
+    pairs[num_pairs].data = bits & 0xFF;
+    num_pairs++;
+  }
+}
+
+void native_OnDccEdge(uint8_t level, uint64_t cycles) {
+  uint32_t d = (uint32_t)((cycles - rx.last) / CYC_PER_US);   // the level before this edge
+  uint32_t low;
+
+  rx.last = cycles;
+  if (!level) {                                     // high part
+    if ((near(d, 26) || near(d, 182)) && (rx.n || (rx.pre + MM_TOL >= MM_GAP_US))) {
+      if (rx.n == 0) rx.start = cycles - d * CYC_PER_US;
+      rx.h = d;
+    }
+    else {                                          // dcc (packet starts after gap or pause)
+      if (rx.n) broken++;
+      rx.h = 0;
+      rx.n = 0;
+    }
+    return;
+  }
+  if (rx.h == 0) {                                  // dcc, or the low in front of a packet
+    rx.pre = d;
+    return;
+  }
+  minmax(rx.h, (rx.h < 100) ? &short_min : &long_min, (rx.h < 100) ? &short_max : &long_max);
+  rx.bits = (rx.bits << 1) | ((rx.h > 100) ? 1 : 0);
+  rx.n++;
+  low = 208 - rx.h;
+  if (near(rx.h + d, 208) && (rx.n < 18)) {        // next bit follows
+    minmax(rx.h + d, &period_min, &period_max);
+    rx.h = 0;
+    return;
+  }
+  rx.h = 0;
+  if ((rx.n != 18) || (d < low)) {
+    broken++;
+    rx.n = 0;
+    rx.pre = d;
+    return;
+  }
+  mm_packet(rx.bits & 0x3FFFF, rx.pre, d - low, cycles);
+  rx.n = 0;
+  rx.pre = d - low;
+}
+
+void native_OnDccPacket(const uint8_t *data, uint8_t size, uint64_t cycles) {
+  (void)size;
+  (void)cycles;
+  dcc_packets++;
+  if (dcc_loco_addr && (data[0] == dcc_loco_addr)) dcc_loco++;
+}
+
+//---------------------------------------------------------------------------------
+// expected trits (Intellibox table, msb first: 00 = 0, 11 = 1, 10 = open, 01 = short)
+//---------------------------------------------------------------------------------
+
+#define ADR_24          0x28         // 0 o o 0
+#define ADR_78          0x2A         // 0 o o o
+#define ADR_81          0x40         // s 0 0 0
+#define ADR_255         0xA9         // o o o s
+#define MM1_DIR         0xC0         // speed step 'r'
+#define MM1_SPEED_5     0x3C         // 0 1 1 0
+#define MM2_FWD_5       0x39         // 0 1 o s
+#define MM2_REV_5       0x6D         // s o 1 s
+#define MM2_F2_ON_5     0x2D         // 0 o 1 s
+#define MM2_F2_OFF_5    0x2C         // 0 o 1 0
+#define SPEED_5         38           // 128 steps -> DCC14 rail step 6 -> Motorola speed 5
+#define FWD             0x80
+
+//---------------------------------------------------------------------------------
+// scenarios
+//---------------------------------------------------------------------------------
+
+static uint64_t t_start;
+
+static void run(uint32_t ms) {
+  uint32_t i;
+
+  for (i = 0; i < ms * 1000 / LOOP_US; i++) {
+    organizer_Run();
+    native_Advance(LOOP_US);
+  }
+}
+
+static void start() {
+  run(50);                           // let the packets of the previous scenario pass
+  num_pairs = 0;
+  mm_cycles = 0;
+  dcc_packets = 0;
+  dcc_loco = 0;
+  dcc_loco_addr = 0;
+  t_start = native_Cycles();
+}
+
+// pairs to addr with data (fn: 0xFF = any) since index from
+static uint16_t count(uint16_t from, uint8_t addr, uint8_t fn, uint8_t data) {
+  uint16_t i, n = 0;
+
+  for (i = from; i < num_pairs; i++)
+    if ((pairs[i].addr == addr) && (pairs[i].data == data) && ((fn == 0xFF) || (pairs[i].fn == fn))) n++;
+  return (n);
+}
+
+// last pair to addr, NULL: none
+static const t_pair *last(uint8_t addr) {
+  uint16_t i;
+
+  for (i = num_pairs; i > 0; i--)
+    if (pairs[i - 1].addr == addr) return (&pairs[i - 1]);
+  return (NULL);
+}
+
+static char s[80];                   // checked values of a scenario
+static uint32_t errors_before;
+
+static bool check(const char *name, bool ok) {
+  uint32_t e = broken + pair_errors + pause_errors + native_DccStat()->errors;
+
+  ok = ok && (e == errors_before);
+  printf("%-9s %-4s  %-46s pairs %3u dcc %4u  mm share %2u%%\n", name, ok ? "ok" : "FAIL", s,
+         num_pairs, dcc_packets, (unsigned)(mm_cycles * 100 / (native_Cycles() - t_start)));
+  errors_before = e;
+  return (ok);
+}
+
+static bool scenario(const char *name) {
+  const t_pair *p;
+  uint16_t n, m;
+  locomem *lb;
+  bool ok;
+
+  if (!strcmp(name, "mm1")) {                         // speed and light
+    start();
+    ok = do_loco_format(24, MM1);
+    do_loco_speed(1, 24, FWD | SPEED_5);
+    run(500);
+    n = count(0, ADR_24, 0, MM1_SPEED_5);
+    do_loco_func_grp0(1, 24, 1);
+    m = num_pairs;
+    run(500);
+    m = count(m, ADR_24, 3, MM1_SPEED_5);
+    lb_ReleaseLoc(24);
+    snprintf(s, sizeof(s), "speed 5: %u, with light: %u", n, m);
+    return check(name, ok && (n > 0) && (m > 0));
+  }
+  if (!strcmp(name, "mm1dir")) {                      // relative direction: step 'r' once
+    start();
+    do_loco_format(24, MM1);
+    do_loco_speed(1, 24, FWD | SPEED_5);
+    run(300);
+    m = num_pairs;
+    do_loco_speed(1, 24, SPEED_5);
+    run(700);
+    n = count(m, ADR_24, 0xFF, MM1_DIR);
+    p = last(ADR_24);
+    lb_ReleaseLoc(24);
+    snprintf(s, sizeof(s), "direction change: %u, then speed 5: %u", n, p && (p->data == MM1_SPEED_5));
+    return check(name, (n == 1) && p && (p->data == MM1_SPEED_5));
+  }
+  if (!strcmp(name, "mm2")) {                         // absolute direction
+    start();
+    do_loco_format(78, MM2);
+    do_loco_speed(1, 78, FWD | SPEED_5);
+    run(500);
+    n = count(0, ADR_78, 0, MM2_FWD_5);
+    do_loco_speed(1, 78, SPEED_5);
+    m = num_pairs;
+    run(500);
+    m = count(m, ADR_78, 0, MM2_REV_5);
+    p = last(ADR_78);
+    lb_ReleaseLoc(78);
+    snprintf(s, sizeof(s), "forward: %u, reverse: %u", n, m);
+    return check(name, (n > 0) && (m > 0) && p && (p->data == MM2_REV_5) && (count(0, ADR_78, 0xFF, MM1_DIR) == 0));
+  }
+  if (!strcmp(name, "mm2func")) {                     // F2 on (sent and refreshed), off (sent)
+    start();
+    do_loco_format(255, MM2);
+    do_loco_speed(1, 255, FWD | SPEED_5);
+    do_loco_func_grp1(1, 255, 0x02);
+    run(1000);
+    n = count(0, ADR_255, 0, MM2_F2_ON_5);
+    do_loco_func_grp1(1, 255, 0x00);
+    m = num_pairs;
+    run(1000);
+    ok = (count(m, ADR_255, 0, MM2_F2_OFF_5) > 0) && (count(num_pairs - 10, ADR_255, 0, MM2_F2_ON_5) == 0);
+    m = count(m, ADR_255, 0, MM2_F2_OFF_5);
+    lb_ReleaseLoc(255);
+    snprintf(s, sizeof(s), "F2 on: %u, F2 off: %u", n, m);
+    return check(name, ok && (n > 1));
+  }
+  if (!strcmp(name, "format")) {                      // database, sticky format, address range
+    start();
+    ok = !do_loco_format(300, MM1) && do_loco_format(81, MM2);
+    do_loco_speed_f(1, 81, FWD | SPEED_5, DCC28);     // a dcc throttle does not change it
+    run(300);
+    ok = ok && (lb_GetEntry(81, &lb) == 0) && (lb->format == MM2) && (database_GetLocoFormat(81) == MM2);
+    n = count(0, ADR_81, 0, MM2_FWD_5);
+    ok = ok && do_loco_format(81, DCC28);
+    run(100);                                         // repeats already in the queues
+    m = num_pairs;
+    run(300);
+    ok = ok && (database_GetLocoFormat(81) == DCC28) && (num_pairs == m);
+    lb_ReleaseLoc(81);
+    snprintf(s, sizeof(s), "MM2 pairs: %u, after DCC28: %u", n, num_pairs - m);
+    return check(name, ok && (n > 0));
+  }
+  if (!strcmp(name, "mixed")) {                       // dcc and Motorola locos on one track
+    start();
+    dcc_loco_addr = 3;
+    do_loco_format(3, DCC128);
+    do_loco_format(24, MM1);
+    do_loco_format(78, MM2);
+    do_loco_speed(1, 3, FWD | SPEED_5);
+    do_loco_speed(1, 24, FWD | SPEED_5);
+    do_loco_speed(1, 78, FWD | SPEED_5);
+    run(3000);
+    n = count(0, ADR_24, 0xFF, MM1_SPEED_5);        // FL may be on from mm1
+    m = count(0, ADR_78, 0xFF, MM2_FWD_5);
+    lb_ReleaseLoc(3);
+    lb_ReleaseLoc(24);
+    lb_ReleaseLoc(78);
+    snprintf(s, sizeof(s), "dcc loco: %u, MM1: %u, MM2: %u", dcc_loco, n, m);
+    return check(name, (dcc_loco > 10) && (n > 10) && (m > 10));
+  }
+  printf("%-9s unknown\n", name);
+  return false;
+}
+
+static const char *scenarios[] = { "mm1", "mm1dir", "mm2", "mm2func", "format", "mixed" };
+
+int main(int argc, char **argv) {
+  bool ok = true;
+  unsigned char i;
+
+  native_Init();
+  native_SetPin(NSHORT_MAIN, HIGH);  // see native_main.cpp
+  native_SetPin(NSHORT_PROG, HIGH);
+  native_SetPin(ACK_DETECTED, LOW);
+  native_SetAnalog(EXT_STOP, 1023);
+  setup();
+  run(100);
+  errors_before = native_DccStat()->errors;
+
+  if (argc > 1) ok = scenario(argv[1]);
+  else {
+    for (i = 0; i < sizeof(scenarios) / sizeof(scenarios[0]); i++)
+      if (!scenario(scenarios[i])) ok = false;
+  }
+  printf("timing    short %u..%u us, long %u..%u us, bit %u..%u us, gap %u..%u us, pause >= %u us\n",
+         short_min, short_max, long_min, long_max, period_min, period_max, gap_min, gap_max, pause_min);
+  printf("errors    broken %u, pairs %u, pauses %u, dcc %u\n",
+         broken, pair_errors, pause_errors, native_DccStat()->errors);
+  return (ok ? 0 : 1);
+}
@@ -0,0 +1,466 @@
+//----------------------------------------------------------------
+//
+// OpenDCC
+//
+// This source file is subject of the GNU general public license 2,
+// that is available at the world-wide-web at
+// http://www.gnu.org/licenses/gpl.txt
+//
+//-----------------------------------------------------------------
+//
+// file:      packet_bench.cpp  (host tool, not part of the firmware)
+// history:   2026-10-16 V0.1 started
+//            2026-10-16 V0.2 random workload, packet pool check
+//            2026-10-16 V0.3 lookup: cost of the locobuffer address index
+//            2026-10-16 V0.4 cost of the repeatbuffer searches per workload
+//            2026-10-16 V0.5 -h: refresh interval histogram per loco
+//
+//-----------------------------------------------------------------
+//
+// purpose:   throughput benchmark of the organizer, regression gate
+//            for changes of queues, repeat and refresh scheduling
+//
+// build:     pio run -e native_bench  (firmware + lib/native_hal, PACKET_TRACE=1, CMD_LATENCY=1)
+// usage:     .pio/build/native_bench/program [-s seconds] [-t] [-h] [workload]
+//            workload: idle, single, full, mixed, random, lookup (default: all)
+//            -t: dump the packet trace at the end of each workload
+//            -h: histogram of the refresh intervals, per loco and for all locos
+//
+// how:       after setup() only organizer_Run() is called (no xpnet, no ui),
+//            the workload enters its commands with do_loco_speed() etc.
+//            Rail side: native_hal decodes the DCC signal on D9, we see every
+//            packet as it is on the rails (including idle packets of dccout).
+//            'random' sends a random mix (speed short/long address, functions,
+//            turnouts, pom, programming, stop) whenever organizer_IsReady():
+//            queues and packet pool stay at their limit. Run it long for leaks:
+//            program -s 600 random
+//            organizer_CheckPool() verifies that every slot of the packet pool
+//            is free or has exactly one owner (after every workload, and every
+//            100 ms during 'random').
+//            Simulated time only -> results are deterministic.
+//
+// output:    one line per workload:
+//              pkt/s      packets per second on the rail
+//              idle%      idle packets on the rail
+//              hp lp rep lb idle   packets per source (pkttrace), per second
+//              urun       dccout ran dry (dcc_ring empty)
+//              refresh    interval between two packets to the same loco,
+//                         avg and max over all locos of the workload [ms]
+//              command    command to rail latency (cmdlat), avg p99 max [ms];
+//                         loco commands come from slot 1, turnouts from slot 2
+//              evict      repeats given up because the packet pool was exhausted
+//            exit code 1: decoder errors, a loco of the workload was never refreshed,
+//                         or the packet pool is inconsistent (leak)
+//            -h: intervals between two packets to the same loco in classes up to
+//                100, 250, 500 ms, 1, 2, 3, 5 s and above; the locos with long addresses
+//                of 'random' (1001 ...) are listed after the short ones
+//
+// lookup:    cost of lb_hash_find() (address -> locobuffer index) against the
+//            number of locos in the locobuffer, in index entries looked at per
+//            search (organizer_GetProbes). Addresses 1..n (a typical layout) and
+//            n random addresses 1..9999; 'miss' searches an address that is not
+//            in the locobuffer (new loco, lb_PutLocAddress). For comparison the
+//            linear scan of the locobuffer that the index replaced: (n+1)/2 and n.
+//            The index size follows SIZE_LOCOBUFFER (config.h); other buffer
+//            sizes: add -DSIZE_LOCOBUFFER=16 (32, 64 ...) to the build_flags.
+//
+// repeatbuffer: after the workloads, the cost of the repeatbuffer searches during
+//            each workload: 'find' index entries per key search (replace a speed or
+//            turnout command), 'next' buckets per search_repeatbuffer(), 'free'
+//            buckets per entry for a new message. The linear scans they replaced
+//            looked at all SIZE_REPEATBUFFER entries each time.
+//            32 against 128 entries: pio run -e native_bench_rb128 (same workloads)
+//
+//-----------------------------------------------------------------
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "native_hal.h"
+#include "hardware.h"
+#include "config.h"
+#include "organizer.h"
+#include "dccout.h"
+#include "pkttrace.h"
+#include "cmdlat.h"
+
+#if (PACKET_TRACE == 0) || (CMD_LATENCY == 0)
+  #error packet_bench needs PACKET_TRACE == 1 and CMD_LATENCY == 1
+#endif
+
+#define BENCH_LOOP_US   100          // duration of one main loop
+#define MAX_LOCO_ADDR   10240
+#define LOOKUP_NUM      10000        // searches per fill level
+
+void setup();
+
+typedef struct {
+  const char *name;
+  unsigned char locos;               // number of running locos (addr 1 ...)
+  uint16_t speed_ms;                 // change speed of one loco every ... ms, 0 = never
+  uint16_t acc_ms;                   // switch a turnout every ... ms, 0 = never
+  unsigned char random;              // random commands, as fast as accepted
+} t_workload;
+
+static const t_workload workloads[] = {
+  { "idle",     0,                   0,   0,   0 },
+  { "single",   1,                   0,   0,   0 },
+  { "full",     SIZE_LOCOBUFFER,     0,   0,   0 },    // every locobuffer entry in use
+  { "mixed",    SIZE_LOCOBUFFER,     100, 500, 0 },    // + speed changes and turnouts
+  { "random",   SIZE_LOCOBUFFER / 2, 0,   0,   1 },    // + the same locos with long address
+};
+#define NUM_WORKLOADS   (sizeof(workloads) / sizeof(workloads[0]))
+
+static t_probe_stat probes[NUM_WORKLOADS][PROBE_NUM];   // searches of each workload
+
+// rail side
+static uint64_t last_seen[MAX_LOCO_ADDR];
+static uint64_t max_gap[MAX_LOCO_ADDR];
+static uint64_t sum_gap[MAX_LOCO_ADDR];
+static uint32_t num_gap[MAX_LOCO_ADDR];
+
+#define NUM_HIST        8
+static const uint16_t hist_ms[NUM_HIST - 1] = { 100, 250, 500, 1000, 2000, 3000, 5000 };
+static uint32_t hist[MAX_LOCO_ADDR][NUM_HIST];
+
+void native_OnDccPacket(const uint8_t *data, uint8_t size, uint64_t cycles) {
+  uint16_t addr;
+  uint64_t gap;
+  unsigned char i;
+
+  (void)size;
+  if ((data[0] > 0) && (data[0] < 112)) addr = data[0];
+  else if ((data[0] >= 192) && (data[0] < 232)) addr = ((data[0] & 0x3F) << 8) | data[1];
+  else return;                       // broadcast, idle, accessory
+  if (last_seen[addr] != 0) {
+    gap = cycles - last_seen[addr];
+    if (gap > max_gap[addr]) max_gap[addr] = gap;
+    sum_gap[addr] += gap;
+    num_gap[addr]++;
+    for (i = 0; (i < NUM_HIST - 1) && (gap > (uint64_t)hist_ms[i] * (F_CPU / 1000)); i++);
+    hist[addr][i]++;
+  }
+  last_seen[addr] = cycles;
+}
+
+static uint32_t rnd_state = 1;
+static uint32_t rnd() {              // deterministic
+  rnd_state = rnd_state * 1103515245L + 12345;
+  return (rnd_state >> 16) & 0x7FFF;
+}
+
+static double ms(uint64_t cycles) { return (double)cycles * 1000.0 / F_CPU; }
+
+static void dump_trace() {
+  static const char *src[TRACE_SRC_NUM] = {"hp", "lp", "rep", "lb", "idle", "prog", "direct"};
+  t_pkttrace entries[SIZE_PACKET_TRACE];
+  unsigned char i, n;
+
+  n = pkttrace_Get(entries, SIZE_PACKET_TRACE);
+  for (i = 0; i < n; i++)
+    printf("  %5u ms  %-6s type %u  size %u  %02X %02X\n", entries[i].time,
+           src[entries[i].source_type >> 4], entries[i].source_type & 0x0F,
+           entries[i].size, entries[i].dcc[0], entries[i].dcc[1]);
+}
+
+// one random command; loco n also runs as 1000 + n (long address, large packets)
+static void random_command(const t_workload *w) {
+  static t_message prog = {1, {{3, is_prog}}, {0x7C, 0x00, 0x00}, 0};   // key 0: never coalesced
+  unsigned int addr;
+
+  addr = (rnd() % w->locos) + 1;
+  if (rnd() & 1) addr += 1000;
+  CMDLAT_ACCEPT(1);
+  switch (rnd() % 16) {
+    case 0: case 1: case 2: case 3: case 4:
+      do_loco_speed(1, addr, rnd() % 127 + 1); break;
+    case 5: case 6:
+      do_loco_func_grp1(1, addr, rnd() & 0x1F); break;
+    case 7:
+      do_loco_func_grp2(1, addr, rnd() & 0x0F); break;
+    case 8:
+      do_loco_func_grp3(1, addr, rnd() & 0x0F); break;
+#if (DCC_F13_F28 == 1)
+    case 9:
+      do_loco_func_grp4(1, addr, rnd() & 0xFF); break;
+    case 10:
+      do_loco_func_grp5(1, addr, rnd() & 0xFF); break;
+#endif
+    case 11: case 12:
+      CMDLAT_ACCEPT(2);
+      do_accessory(rnd() % 256, rnd() & 1, 1); break;
+    case 13:
+      do_pom_loco(addr, rnd() % 1024 + 1, rnd() & 0xFF); break;
+    case 14:                         // never sent in run mode: fills up and flushes
+      put_in_queue_prog(&prog); break;
+    default:
+      if ((rnd() % 64) == 0) do_all_stop();  // broadcast without asking
+      break;
+  }
+}
+
+static void print_hist_line(const char *name, uint32_t *h, uint64_t max) {
+  unsigned char i;
+
+  printf("  %-6s", name);
+  for (i = 0; i < NUM_HIST; i++) printf(" %7u", (unsigned)h[i]);
+  printf(" %9.1f\n", ms(max));
+}
+
+// histogram of the refresh intervals: one line per loco, then all locos
+static void print_hist(const t_workload *w) {
+  uint32_t all[NUM_HIST];
+  uint64_t max = 0;
+  unsigned int a, i;
+  char name[8];
+
+  memset(all, 0, sizeof(all));
+  printf("  loco   ");
+  for (i = 0; i < NUM_HIST - 1; i++) printf("  <=%-5u", hist_ms[i]);
+  printf("    >%-5u  max [ms]\n", hist_ms[NUM_HIST - 2]);
+  for (a = 1; a < MAX_LOCO_ADDR; a++) {
+    if ((a > w->locos) && (!w->random || (a <= 1000) || (a > 1000u + w->locos))) continue;
+    snprintf(name, sizeof(name), "%u", a);
+    print_hist_line(name, hist[a], max_gap[a]);
+    for (i = 0; i < NUM_HIST; i++) all[i] += hist[a][i];
+    if (max_gap[a] > max) max = max_gap[a];
+  }
+  print_hist_line("all", all, max);
+}
+
+static bool run_workload(const t_workload *w, uint32_t seconds, bool trace, bool histogram) {
+  uint32_t t, next_speed, next_acc;
+  unsigned char i;
+  uint16_t turnout = 0;
+  uint32_t packets, idle, errors, underruns;
+  uint64_t start, max = 0, sum = 0;
+  uint32_t num = 0, never = 0;
+  t_cmdlat_result lat;
+  uint32_t lat_n = 0, lat_sum = 0;
+  uint16_t lat_max = 0;
+  uint8_t lat_p99 = 0;
+  uint32_t pool_faults = 0;
+  uint16_t evictions;
+  const t_native_dcc_stat *dcc = native_DccStat();
+
+  organizer_Init();                  // empty queues and locobuffer
+  native_Advance(50000);             // let dcc_ring run empty
+  memset(last_seen, 0, sizeof(last_seen));
+  memset(max_gap, 0, sizeof(max_gap));
+  memset(sum_gap, 0, sizeof(sum_gap));
+  memset(num_gap, 0, sizeof(num_gap));
+  memset(hist, 0, sizeof(hist));
+  rnd_state = 1;
+  pkttrace_Reset();
+  cmdlat_Reset();
+  organizer_GetProbes(probes[w - workloads]);   // reset
+  packets = dcc->packets;
+  idle = dcc->idle_packets;
+  errors = dcc->errors;
+  underruns = dccout_GetUnderruns();
+  start = native_Cycles();
+
+  for (i = 0; i < w->locos; i++) {
+    while (!organizer_IsReady()) {
+      organizer_Run();
+      native_Advance(BENCH_LOOP_US);
+    }
+    CMDLAT_ACCEPT(1);
+    do_loco_speed(1, i + 1, 20 + i);
+    CMDLAT_ACCEPT(1);
+    do_loco_func_grp1(1, i + 1, 0x10);  // light
+  }
+
+  next_speed = w->speed_ms;
+  next_acc = w->acc_ms;
+  for (t = 0; t < seconds * 10000L; t++) {      // BENCH_LOOP_US steps
+    uint32_t now_ms = t / 10;
+    if (w->speed_ms && (now_ms >= next_speed) && organizer_IsReady()) {
+      next_speed += w->speed_ms;
+      CMDLAT_ACCEPT(1);
+      do_loco_speed(1, (rnd() % w->locos) + 1, rnd() % 127 + 1);
+    }
+    if (w->acc_ms && (now_ms >= next_acc) && organizer_IsReady()) {
+      next_acc += w->acc_ms;
+      CMDLAT_ACCEPT(2);
+      do_accessory(turnout / 2, turnout & 1, 1);
+      turnout = (turnout + 1) % 64;
+    }
+    if (w->random && organizer_IsReady()) random_command(w);
+    organizer_Run();
+    if (w->random && ((t % 1000) == 0)) pool_faults += organizer_CheckPool(&evictions);
+    native_Advance(BENCH_LOOP_US);
+  }
+
+  pool_faults += organizer_CheckPool(&evictions);
+  organizer_GetProbes(probes[w - workloads]);
+  seconds = (uint32_t)((native_Cycles() - start) / F_CPU);
+  if (seconds == 0) seconds = 1;
+  packets = dcc->packets - packets;
+  idle = dcc->idle_packets - idle;
+  errors = dcc->errors - errors;
+  underruns = dccout_GetUnderruns() - underruns;
+  for (i = 0; i < w->locos; i++) {
+    if (num_gap[i + 1] == 0) {
+      never++;
+      continue;
+    }
+    sum += sum_gap[i + 1];
+    num += num_gap[i + 1];
+    if (max_gap[i + 1] > max) max = max_gap[i + 1];
+  }
+
+  for (i = 0; cmdlat_Get(i, &lat); i++) {
+    lat_n += lat.count;
+    lat_sum += (uint32_t)lat.avg * lat.count;
+    if (lat.p99 > lat_p99) lat_p99 = lat.p99;
+    if (lat.max > lat_max) lat_max = lat.max;
+  }
+
+  printf("%-9s %6.1f %5.1f %5.1f %5.1f %5.1f %6.1f %6.1f %5u %8.1f %8.1f",
+         w->name, (double)packets / seconds, packets ? 100.0 * idle / packets : 0.0,
+         (double)pkttrace_GetCount(TRACE_SRC_HP) / seconds,
+         (double)pkttrace_GetCount(TRACE_SRC_LP) / seconds,
+         (double)pkttrace_GetCount(TRACE_SRC_REPEAT) / seconds,
+         (double)pkttrace_GetCount(TRACE_SRC_LOCOBUFFER) / seconds,
+         (double)pkttrace_GetCount(TRACE_SRC_IDLE) / seconds,
+         (unsigned)underruns, num ? ms(sum / num) : 0.0, ms(max));
+  if (lat_n) printf(" %6.1f  %s%3u %6.1f", lat_sum / 10.0 / lat_n, (lat_p99 == 255) ? ">" : "<",
+                    (lat_p99 == 255) ? 128 : lat_p99, lat_max / 10.0);
+  if (evictions) printf("  %u evict", (unsigned)evictions);
+  if (errors) printf("  %u DECODER ERRORS", (unsigned)errors);
+  if (never) printf("  %u LOCOS NOT REFRESHED", (unsigned)never);
+  if (pool_faults) printf("  %u PACKET POOL FAULTS", (unsigned)pool_faults);
+  printf("\n");
+  if (trace) dump_trace();
+  if (histogram && w->locos) print_hist(w);
+  return ((errors == 0) && (never == 0) && (pool_faults == 0));
+}
+
+// enter n locos; addr[] random addresses or 1..n
+static void lookup_fill(uint16_t *addr, unsigned int n, bool random) {
+  locomem *entry;
+  unsigned int i;
+
+  organizer_Init();
+  for (i = 0; i < n; i++) {
+    if (!random) addr[i] = i + 1;
+    else {
+      do addr[i] = rnd() % 9999 + 1;
+      while (lb_GetEntry(addr[i], &entry) == 0);
+    }
+    while (!organizer_IsReady()) {
+      organizer_Run();
+      native_Advance(BENCH_LOOP_US);
+    }
+    do_loco_speed(1, addr[i], 20);
+  }
+}
+
+static bool lookup_member(uint16_t *addr, unsigned int n, uint16_t a) {
+  unsigned int i;
+
+  for (i = 0; i < n; i++)
+    if (addr[i] == a) return (true);
+  return (false);
+}
+
+static double probe_avg(t_probe_stat *stat) {
+  return (stat->lookups ? (double)stat->probes / stat->lookups : 0.0);
+}
+
+static void print_repeat(const char *only, uint32_t seconds) {
+  t_probe_stat *p;
+  unsigned char i;
+
+  printf("\nrepeatbuffer: %u entries, %u index entries, %u buckets\n",
+         SIZE_REPEATBUFFER, SIZE_REPEATBUFFER_HASH, NUM_REPEAT_BUCKETS);
+  printf("workload     find avg/max     next avg/max     free avg/max      n/s   linear scan\n");
+  for (i = 0; i < NUM_WORKLOADS; i++) {
+    if (only && strcmp(only, workloads[i].name)) continue;
+    p = probes[i];
+    printf("%-9s %8.2f %4u %11.2f %4u %11.2f %4u %8u %8u\n", workloads[i].name,
+           probe_avg(&p[PROBE_RB_FIND]), p[PROBE_RB_FIND].max,
+           probe_avg(&p[PROBE_RB_NEXT]), p[PROBE_RB_NEXT].max,
+           probe_avg(&p[PROBE_RB_FREE]), p[PROBE_RB_FREE].max,
+           (unsigned)((p[PROBE_RB_FIND].lookups + p[PROBE_RB_NEXT].lookups + p[PROBE_RB_FREE].lookups) / seconds),
+           SIZE_REPEATBUFFER);
+  }
+}
+
+static bool run_lookup() {
+  static uint16_t addr[SIZE_LOCOBUFFER];
+  t_probe_stat seq[PROBE_NUM], hit[PROBE_NUM], miss[PROBE_NUM];
+  locomem *entry;
+  unsigned int n, step;
+  uint32_t k;
+  uint16_t a;
+  bool ok = true;
+
+  printf("\nlocobuffer index: %u entries, %u index entries, %u searches each\n",
+         SIZE_LOCOBUFFER, SIZE_LOCOBUFFER_HASH, LOOKUP_NUM);
+  printf("locos  load%%   1..n avg/max   random avg/max   miss avg/max   linear scan hit/miss\n");
+  step = (SIZE_LOCOBUFFER >= 8) ? SIZE_LOCOBUFFER / 8 : 1;
+  for (n = step; n <= SIZE_LOCOBUFFER; n += step) {
+    rnd_state = n;
+    lookup_fill(addr, n, false);
+    organizer_GetProbes(seq);        // reset
+    for (k = 0; k < LOOKUP_NUM; k++)
+      if (lb_GetEntry(addr[rnd() % n], &entry) != 0) ok = false;
+    organizer_GetProbes(seq);
+
+    lookup_fill(addr, n, true);
+    organizer_GetProbes(hit);
+    for (k = 0; k < LOOKUP_NUM; k++)
+      if (lb_GetEntry(addr[rnd() % n], &entry) != 0) ok = false;
+    organizer_GetProbes(hit);
+    for (k = 0; k < LOOKUP_NUM; k++) {
+      do a = rnd() % 9999 + 1;
+      while (lookup_member(addr, n, a));
+      if (lb_GetEntry(a, &entry) == 0) ok = false;
+    }
+    organizer_GetProbes(miss);
+
+    printf("%5u %6.1f %9.2f %4u %12.2f %4u %10.2f %4u %14.1f %5u\n",
+           n, 100.0 * n / SIZE_LOCOBUFFER_HASH,
+           probe_avg(&seq[PROBE_LB]), seq[PROBE_LB].max,
+           probe_avg(&hit[PROBE_LB]), hit[PROBE_LB].max,
+           probe_avg(&miss[PROBE_LB]), miss[PROBE_LB].max,
+           (n + 1) / 2.0, n);
+  }
+  if (!ok) printf("  LOCOBUFFER INDEX ERRORS\n");
+  return (ok);
+}
+
+int main(int argc, char **argv) {
+  uint32_t seconds = 10;
+  bool trace = false;
+  bool histogram = false;
+  const char *only = NULL;
+  bool ok = true;
+  unsigned char i;
+
+  for (i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "-s") && (i + 1 < argc)) seconds = atol(argv[++i]);
+    else if (!strcmp(argv[i], "-t")) trace = true;
+    else if (!strcmp(argv[i], "-h")) histogram = true;
+    else only = argv[i];
+  }
+
+  native_Init();
+  native_SetPin(NSHORT_MAIN, HIGH);  // see native_main.cpp
+  native_SetPin(NSHORT_PROG, HIGH);
+  native_SetPin(ACK_DETECTED, LOW);
+  native_SetAnalog(EXT_STOP, 1023);
+  setup();
+
+  printf("workload   pkt/s idle%%    hp    lp   rep     lb   idle  urun  refresh avg/max [ms]  command avg p99 max [ms]\n");
+  for (i = 0; i < NUM_WORKLOADS; i++) {
+    if (only && strcmp(only, workloads[i].name)) continue;
+    if (!run_workload(&workloads[i], seconds, trace, histogram)) ok = false;
+  }
+  if (!only || strcmp(only, "lookup")) print_repeat(only, seconds ? seconds : 1);
+  if (!only || !strcmp(only, "lookup"))
+    if (!run_lookup()) ok = false;
+  return (ok ? 0 : 1);
+}
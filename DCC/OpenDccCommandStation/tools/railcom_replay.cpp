@@ -0,0 +1,294 @@
+//----------------------------------------------------------------
+//
+// OpenDCC
+//
+// This source file is subject of the GNU general public license 2,
+// that is available at the world-wide-web at
+// http://www.gnu.org/licenses/gpl.txt
+//
+//-----------------------------------------------------------------
+//
+// file:      railcom_replay.cpp  (host tool, not part of the firmware)
+// history:   2026-10-16 V0.1 started
+//            2026-10-16 V0.2 recordings for CUTOUT_GAP 30us
+//
+//-----------------------------------------------------------------
+//
+// purpose:   test of the RailCom receiver (railcom.cpp) with recorded
+//            detector output, regression gate for dccout and railcom
+//
+// build:     pio run -e native_railcom  (firmware + lib/native_hal, RAILCOM_DETECTOR=1)
+//            the RAM budget warning of config.h is expected: the detector
+//            is made for the atmega644P (USART1, 4k), native_hal is a nano
+// usage:     .pio/build/native_railcom/program [scenario]
+//
+// how:       The firmware runs on the simulated hardware, after setup() only
+//            organizer_Run() and railcom_Run() are called. native_hal decodes
+//            the DCC signal; for every packet the decoders on the track (model
+//            below) answer with recordings of the detector output (time after
+//            the start of the cutout, raw byte), railcom_Replay() puts them into
+//            the cutout that follows the packet. So the whole way is tested:
+//            dccout hooks (doi.type, packet bytes), channel split by time,
+//            4 of 8 decoding, correlation with the packet, seen table and
+//            pom cvrd results.
+//            Simulated time only -> results are deterministic.
+//
+// output:    one line per scenario with the checked values
+//            exit code 1: a check failed or the ring overflowed
+//
+//-----------------------------------------------------------------
+
+#include <stdio.h>
+#include <string.h>
+#include "native_hal.h"
+#include "hardware.h"
+#include "config.h"
+#include "organizer.h"
+#include "railcom.h"
+
+#if (RAILCOM_DETECTOR == 0)
+  #error railcom_replay needs RAILCOM_DETECTOR == 1
+#endif
+
+#define LOOP_US   100                // duration of one main loop
+
+void setup();
+
+//---------------------------------------------------------------------------------
+// recordings: start of each byte [us after start of the cutout], byte on RXD1
+// channel 1 starts at 80us, channel 2 at 193us after the end bit, the cutout 30us
+// (CUTOUT_GAP, dccout.cpp; recorded with 38us, the times are moved by 8us)
+//---------------------------------------------------------------------------------
+
+typedef struct {
+  uint8_t n;
+  uint16_t us[6];
+  uint8_t data[6];
+} t_recording;
+
+static const t_recording rec_adr_high_short = { 2, {  52,  92 }, { 0xA3, 0xAC } };    // ID1 ADR_HIGH 0x00
+static const t_recording rec_adr_low_3      = { 2, {  52,  92 }, { 0x99, 0xA5 } };    // ID2 ADR_LOW  3
+static const t_recording rec_adr_high_1234  = { 2, {  51,  91 }, { 0x9C, 0xA3 } };    // ID1 ADR_HIGH 0x84
+static const t_recording rec_adr_low_1234   = { 2, {  51,  91 }, { 0x96, 0xB8 } };    // ID2 ADR_LOW  0xD2
+static const t_recording rec_pom_145        = { 2, { 166, 206 }, { 0xA9, 0xB4 } };    // ID0 145
+static const t_recording rec_pom_3          = { 2, { 165, 205 }, { 0xAC, 0xA5 } };    // ID0 3
+static const t_recording rec_pom_60         = { 2, { 166, 206 }, { 0xAC, 0x2D } };    // ID0 60
+static const t_recording rec_ack            = { 1, { 168 },      { 0xF0 } };          // ACK
+static const t_recording rec_noise          = { 3, {  58,  98, 178 }, { 0x00, 0x87, 0xFF } };  // framing error, reserved, no 4 of 8
+
+//---------------------------------------------------------------------------------
+// decoders on the track
+//---------------------------------------------------------------------------------
+
+typedef struct {
+  uint16_t addr;
+  const t_recording *adr_high;       // channel 1, NULL: silent
+  const t_recording *adr_low;
+  uint16_t cv;                       // this cv answers with
+  const t_recording *cv_value;       // ... this recording
+} t_decoder;
+
+static const t_decoder loco_3    = { 3,    &rec_adr_high_short, &rec_adr_low_3,    8,  &rec_pom_145 };
+static const t_decoder loco_1234 = { 1234, &rec_adr_high_1234,  &rec_adr_low_1234, 29, &rec_pom_3 };
+static const t_decoder loco_7    = { 7,    NULL,                NULL,              0,  NULL };   // no channel 1, ack only
+
+#define MAX_ON_TRACK  2
+static const t_decoder *on_track[MAX_ON_TRACK];
+static bool noise;                   // bad detector: garbage in every cutout
+static uint8_t ch1_toggle;           // ADR_HIGH / ADR_LOW alternate
+
+// detector output of one cutout, channel 1 and 2 merged
+static uint16_t cut_us[16];
+static uint8_t cut_data[16];
+static uint8_t cut_n;
+
+static void add(const t_recording *rec) {
+  uint8_t i;
+
+  for (i = 0; (i < rec->n) && (cut_n < sizeof(cut_data)); i++) {
+    cut_us[cut_n] = rec->us[i];
+    cut_data[cut_n++] = rec->data[i];
+  }
+}
+
+// called at the end bit, the cutout follows
+void native_OnDccPacket(const uint8_t *data, uint8_t size, uint64_t cycles) {
+  const t_decoder *dec;
+  uint16_t addr;
+  uint8_t instr, i;
+
+  (void)size;
+  (void)cycles;
+  cut_n = 0;
+  if ((data[0] > 0) && (data[0] <= DCC_SHORT_ADDR_LIMIT)) { addr = data[0]; instr = 1; }
+  else if ((data[0] >= 0xC0) && (data[0] <= 0xE7)) { addr = ((data[0] & 0x3F) << 8) | data[1]; instr = 2; }
+  else addr = 0;                     // broadcast, idle, accessory
+
+  if (noise) add(&rec_noise);
+  if (addr) {
+    ch1_toggle ^= 1;
+    for (i = 0; i < MAX_ON_TRACK; i++) {
+      dec = on_track[i];
+      if (dec && dec->adr_high) add(ch1_toggle ? dec->adr_high : dec->adr_low);   // any loco packet
+    }
+    for (i = 0; i < MAX_ON_TRACK; i++) {
+      dec = on_track[i];
+      if (!dec || (dec->addr != addr)) continue;
+      if ((data[instr] & 0xFC) == 0xE4) {                                       // pom cvrd
+        if (dec->cv_value && (dec->cv == (((data[instr] & 0x03) << 8) | data[instr + 1]) + 1))
+          add(dec->cv_value);
+        else add(&rec_ack);
+      }
+      else if (((data[instr] & 0xFC) == 0xEC) && (data[instr + 2] == 60)) add(&rec_pom_60);   // pom write
+      else add(&rec_ack);
+    }
+  }
+  if (cut_n) railcom_Replay(cut_us, cut_data, cut_n);
+}
+
+//---------------------------------------------------------------------------------
+// scenarios
+//---------------------------------------------------------------------------------
+
+static void run(uint32_t ms) {
+  uint32_t i;
+
+  for (i = 0; i < ms * 1000 / LOOP_US; i++) {
+    organizer_Run();
+    railcom_Run();
+    native_Advance(LOOP_US);
+  }
+}
+
+// wait for the pom result, ret: ms until it was there
+static uint32_t wait_pom(t_railcom_pom *result, unsigned int *cv, uint8_t *data) {
+  uint32_t i;
+
+  for (i = 0; i < 2000 * 1000 / LOOP_US; i++) {
+    organizer_Run();
+    railcom_Run();
+    native_Advance(LOOP_US);
+    *result = railcom_GetPomResult(cv, data);
+    if (*result != RC_POM_BUSY) break;
+  }
+  return (i * LOOP_US / 1000);
+}
+
+static void start(const t_decoder *a, const t_decoder *b, bool with_noise) {
+  on_track[0] = a;
+  on_track[1] = b;
+  noise = with_noise;
+  run(50);                           // let the last cutouts of the previous scenario pass
+  railcom_Init();
+}
+
+static char s[80];                   // checked values of a scenario
+
+static bool check(const char *name, bool ok) {
+  t_railcom_stat stat;
+
+  railcom_GetStat(&stat);
+  printf("%-10s %-4s  %-38s", name, (ok && (stat.overruns == 0)) ? "ok" : "FAIL", s);
+  printf("cutouts %u answers %u errors %u overruns %u\n", stat.cutouts, stat.answers, stat.errors, stat.overruns);
+  return (ok && (stat.overruns == 0));
+}
+
+static bool scenario(const char *name) {
+  t_railcom_pom result;
+  unsigned int cv;
+  uint8_t data;
+  uint32_t t;
+  t_railcom_stat stat;
+  bool ok;
+
+  if (!strcmp(name, "ch1")) {                         // channel 1, short address
+    start(&loco_3, NULL, false);
+    do_loco_speed(1, 3, 40);
+    do_loco_speed(1, 5, 40);
+    run(1000);
+    snprintf(s, sizeof(s), "channel 1: %u, on track 3: %u 5: %u", railcom_GetChannel1(), railcom_IsOnTrack(3), railcom_IsOnTrack(5));
+    return check(name, (railcom_GetChannel1() == 3) && railcom_IsOnTrack(3) && !railcom_IsOnTrack(5));
+  }
+  if (!strcmp(name, "ch1long")) {                     // channel 1, long address
+    start(&loco_1234, NULL, false);
+    do_loco_speed(1, 1234, 40);
+    run(1000);
+    snprintf(s, sizeof(s), "channel 1: %u, on track 1234: %u", railcom_GetChannel1(), railcom_IsOnTrack(1234));
+    return check(name, (railcom_GetChannel1() == 1234) && railcom_IsOnTrack(1234));
+  }
+  if (!strcmp(name, "pom")) {                         // pom cvrd, answer in channel 2
+    start(&loco_3, &loco_1234, false);
+    do_pom_loco_cvrd(3, 8);
+    t = wait_pom(&result, &cv, &data);
+    ok = (result == RC_POM_OKAY) && (cv == 8) && (data == 145);
+    do_pom_loco_cvrd(1234, 29);
+    t += wait_pom(&result, &cv, &data);
+    ok = ok && (result == RC_POM_OKAY) && (cv == 29) && (data == 3);
+    snprintf(s, sizeof(s), "cv %u = %u, both after %u ms", cv, data, t);
+    return check(name, ok);
+  }
+  if (!strcmp(name, "pomwrite")) {                    // ID0 of a pom write is not the result of the read
+    start(&loco_3, NULL, false);
+    do_pom_loco(3, 7, 60);
+    do_pom_loco_cvrd(3, 8);
+    t = wait_pom(&result, &cv, &data);
+    snprintf(s, sizeof(s), "cv %u = %u after %u ms", cv, data, t);
+    return check(name, (result == RC_POM_OKAY) && (cv == 8) && (data == 145));
+  }
+  if (!strcmp(name, "pomabsent")) {                   // no decoder: not found after RAILCOM_POM_TIMEOUT
+    start(&loco_3, NULL, false);
+    do_pom_loco_cvrd(5, 8);
+    t = wait_pom(&result, &cv, &data);
+    snprintf(s, sizeof(s), "result %u (3: no answer) after %u ms", result, t);
+    return check(name, result == RC_POM_NOANSWER);
+  }
+  if (!strcmp(name, "ack")) {                         // channel 2 only
+    start(&loco_7, NULL, false);
+    do_loco_speed(1, 7, 40);
+    run(1000);
+    snprintf(s, sizeof(s), "on track 7: %u, channel 1: %u", railcom_IsOnTrack(7), railcom_GetChannel1());
+    return check(name, railcom_IsOnTrack(7) && (railcom_GetChannel1() == 0));
+  }
+  if (!strcmp(name, "noise")) {                       // garbage: counted, never decoded
+    start(NULL, NULL, true);
+    do_loco_speed(1, 3, 40);
+    run(1000);
+    railcom_GetStat(&stat);
+    snprintf(s, sizeof(s), "on track 3: %u, channel 1: %u", railcom_IsOnTrack(3), railcom_GetChannel1());
+    return check(name, (stat.answers == 0) && (stat.errors > 0) && !railcom_IsOnTrack(3) && (railcom_GetChannel1() == 0));
+  }
+  if (!strcmp(name, "timeout")) {                     // loco leaves the track
+    start(&loco_3, NULL, false);
+    do_loco_speed(1, 3, 40);
+    run(1000);
+    ok = railcom_IsOnTrack(3);
+    on_track[0] = NULL;
+    run(RAILCOM_SEEN_TIMEOUT + 1000);
+    snprintf(s, sizeof(s), "on track 3: %u, after %u ms: %u", ok, RAILCOM_SEEN_TIMEOUT + 1000, railcom_IsOnTrack(3));
+    return check(name, ok && !railcom_IsOnTrack(3));
+  }
+  printf("%-10s unknown\n", name);
+  return false;
+}
+
+static const char *scenarios[] = { "ch1", "ch1long", "pom", "pomwrite", "pomabsent", "ack", "noise", "timeout" };
+
+int main(int argc, char **argv) {
+  bool ok = true;
+  unsigned char i;
+
+  native_Init();
+  native_SetPin(NSHORT_MAIN, HIGH);  // see native_main.cpp
+  native_SetPin(NSHORT_PROG, HIGH);
+  native_SetPin(ACK_DETECTED, LOW);
+  native_SetAnalog(EXT_STOP, 1023);
+  setup();
+  run(100);
+
+  if (argc > 1) ok = scenario(argv[1]);
+  else {
+    for (i = 0; i < sizeof(scenarios) / sizeof(scenarios[0]); i++)
+      if (!scenario(scenarios[i])) ok = false;
+  }
+  return (ok ? 0 : 1);
+}
@@ -0,0 +1,78 @@
+//----------------------------------------------------------------
+//
+// OpenDCC
+//
+// This source file is subject of the GNU general public license 2,
+// that is available at the world-wide-web at
+// http://www.gnu.org/licenses/gpl.txt
+//
+//-----------------------------------------------------------------
+//
+// file:      ram_report.cpp  (host tool, not part of the firmware)
+// history:   2026-10-16 V0.1 started
+//            2026-10-16 V0.2 complete budget: modules, core and stack too
+//
+//-----------------------------------------------------------------
+//
+// purpose:   lists the RAM budget of the buffers, as configured in config.h
+//
+// build:     pio run -e native_ramreport
+// usage:     .pio/build/native_ramreport/program
+//
+// how:       prints the RAM_xxx terms of USED_RAM (config.h), which count
+//            the bytes on the AVR; organizer.cpp checks at compile time that
+//            RAM_LOCOBUFFER matches its arrays. Then the other modules
+//            (RAM_MODULES), the arduino core with Wire (RAM_CORE) and the
+//            stack reserve (RAM_STACK), see config.h 5.4.
+//            exit code 1: the total exceeds SRAM_SIZE
+//            RAM_MODULES is counted from the declarations; avr-size on the
+//            firmware.elf (data + bss) must show at most
+//            USED_RAM + RAM_MODULES + RAM_CORE.
+//
+//-----------------------------------------------------------------
+
+#include <stdio.h>
+#include "Arduino.h"
+#include "hardware.h"
+#include "config.h"
+
+static void line(const char *name, unsigned bytes, const char *detail) {
+  printf("  %-16s %5u   %s\n", name, bytes, detail);
+}
+
+int main() {
+  char s[80];
+
+  printf("RAM budget (bytes, AVR)\n");
+  snprintf(s, sizeof(s), "prog %u, lp %u, hp %u entries", SIZE_QUEUE_PROG, SIZE_QUEUE_LP, SIZE_QUEUE_HP);
+  line("queues", RAM_QUEUES, s);
+  snprintf(s, sizeof(s), "%u * 3 + %u * %u bytes, for queues and repeatbuffer",
+           SIZE_PKT_POOL_SMALL, SIZE_PKT_POOL_LARGE, MAX_DCC_SIZE);
+  line("packet pool", RAM_PKT_POOL, s);
+  snprintf(s, sizeof(s), "%u entries%s", SIZE_DCC_RING, DCCOUT_BITSTREAM ? ", bitstream" : "");
+  line("dcc ring", RAM_DCC_RING, s);
+  snprintf(s, sizeof(s), "%u entries, hash %u", SIZE_REPEATBUFFER, SIZE_REPEATBUFFER_HASH);
+  line("repeatbuffer", RAM_REPEATBUFFER, s);
+  snprintf(s, sizeof(s), "%u locos * %u.5, hash %u, F13..F28 for %u locos",
+           SIZE_LOCOBUFFER, SIZE_LOCOBUFFER_ENTRY, SIZE_LOCOBUFFER_HASH, DCC_F13_F28 * SIZE_LOCOBUFFER_FHIGH);
+  line("locobuffer", RAM_LOCOBUFFER, s);
+  line("packet cache", RAM_PACKET_CACHE, LOCOBUFFER_PACKET_CACHE ? "on" : "off");
+  snprintf(s, sizeof(s), "isrprof %u, pkttrace %u, cmdlat %u", ISR_PROFILING, PACKET_TRACE, CMD_LATENCY);
+  line("diagnostics", RAM_DIAG, s);
+  line("xpnet slots", RAM_XP_SLOTS, !XP_ADAPTIVE_SLOTS ? "round robin" :
+                                     XP_SLOT_STATS ? "adaptive, statistics" : "adaptive");
+  snprintf(s, sizeof(s), "%u locos, hash %u, 1 name waiting for the eeprom%s", LOCODB_NUM_ENTRIES,
+           LOCODB_HASH_SIZE, LOCODB_EXT_EEPROM ? " (i2c)" : "");
+  line("database", RAM_DB_CACHE, s);
+  line("database xfer", RAM_DB_XFER, "state only, the frames are built in the xpnet tx buffer");
+  line("railcom", RAM_RAILCOM, RAILCOM_DETECTOR ? "detector on USART1" : "off");
+  line("motorola", RAM_MM, MAERKLIN_ENABLED ? "MM1/MM2 between the dcc packets" : "off");
+  line("prog track", RAM_PROGOUT, PROG_TRACK_CONCURRENT ? "own dcc output, concurrent with the main track" : "off");
+  printf("  %-16s %5u\n", "USED_RAM", USED_RAM);
+  line("other modules", RAM_MODULES, "globals outside the buffers, strings in flash");
+  line("core", RAM_CORE, "millis, vtables, Wire + twi");
+  line("stack", RAM_STACK, "reserve");
+  printf("  %-16s %5u   of %u, %d left\n", "total", USED_RAM + RAM_MODULES + RAM_CORE + RAM_STACK,
+         SRAM_SIZE, SRAM_SIZE - (USED_RAM + RAM_MODULES + RAM_CORE + RAM_STACK));
+  return ((USED_RAM + RAM_MODULES + RAM_CORE + RAM_STACK > SRAM_SIZE) ? 1 : 0);
+}
@@ -0,0 +1,410 @@
+//----------------------------------------------------------------
+//
+// OpenDCC
+//
+// This source file is subject of the GNU general public license 2,
+// that is available at the world-wide-web at
+// http://www.gnu.org/licenses/gpl.txt
+//
+//-----------------------------------------------------------------
+//
+// file:      xpnet_bench.cpp  (host tool, not part of the firmware)
+// history:   2026-10-16 V0.1 started
+//            2026-10-16 V0.2 feedback decoders (storm)
+//            2026-10-16 V0.3 loco database transfer (db...)
+//            2026-10-16 V0.4 db: slot transfers without the CALL frames
+//
+//-----------------------------------------------------------------
+//
+// purpose:   bus level benchmark of the Xpressnet master (xpnet.cpp, rs485.cpp)
+//
+// build:     pio run -e native_xpbench  (firmware + lib/native_hal)
+// usage:     .pio/build/native_xpbench/program [-s seconds] [workload]
+//            workload: quiet, mixed, busy, storm, db (default: all)
+//
+// how:       the complete main loop runs on the simulated ATmega328, one
+//            loop() costs BENCH_LOOP_US besides the waits of the firmware.
+//            31 simulated clients sit on the bus (native_OnUartTx): a client
+//            that is called while it has a request pending answers right
+//            after the call byte, like a real throttle. Requests alternate
+//            between 'status' (0x21 0x24) and 'loco info' (0xE3 0x00).
+//            Feedback decoders (slot 1 ..) send 0x72 ADR DAT with one bit
+//            changed, like a train running over occupancy sections.
+//            Simulated time only -> results are deterministic.
+//
+// output:    one line per workload:
+//              inq/s      inquiry calls per second (slot 1..31)
+//              req/s      requests sent by the clients per second
+//              ans/s      answers of the master per second
+//              poll       interval between two calls of a busy client, avg and max [ms]
+//              resp       request sent until the answer is complete, avg and max [ms]
+//              fb         nibbles changed by feedback decoders, feedback broadcasts
+//                         and address/data pairs in them, per second
+//            db: the loco database (LOCODB_NUM_ENTRIES locos) is sent with every
+//            transfer profile, as broadcast and to slot DB_SLOT, while the quiet
+//            clients keep asking; one line per transfer:
+//              entries    entries received / in the data base
+//              frames     frames received / expected (profile; to one slot
+//                         the MESSAGE frames only, all of them MESSAGE | DB_SLOT)
+//              ms/entry   from database_StartTransferTo to the end of the last frame
+//            exit code 1: data errors on the bus (either side), or requests without answer,
+//                       or a database transfer incomplete or wrong
+//
+//-----------------------------------------------------------------
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "native_hal.h"
+#include "hardware.h"
+#include "config.h"
+#include "xpnet.h"
+#include "database.h"
+
+#if (XPRESSNET_ENABLED == 0)
+  #error xpnet_bench needs XPRESSNET_ENABLED == 1
+#endif
+
+#define BENCH_LOOP_US   100          // duration of one main loop (besides waits)
+#define NUM_CLIENTS     31
+#define DB_SLOT         5            // target of the transfers to one slot
+
+void setup();
+void loop();
+
+typedef struct {
+  const char *name;
+  unsigned char busy;                // the next clients have always a request pending
+  uint16_t period_ms;                // the other clients send a request every ... ms
+  unsigned char feedback;            // clients 1 .. feedback are feedback decoders
+  uint16_t feedback_ms;              // a feedback decoder changes a bit every ... ms
+} t_workload;
+
+static const t_workload workloads[] = {
+  { "quiet",    0,            1000, 0, 0  },
+  { "mixed",    3,            1000, 0, 0  },
+  { "busy",     NUM_CLIENTS,  0,    0, 0  },
+  { "storm",    0,            1000, 8, 10 },    // 8 decoders, 800 changes/s
+};
+
+typedef struct {
+  uint64_t next_request;             // cycles, request becomes pending
+  uint64_t last_call;
+  uint64_t request_sent;             // 0: no request on the way
+  unsigned char toggle;
+  unsigned char feedback;            // inputs of a feedback decoder
+} t_client;
+
+static const t_workload *workload;
+static t_client clients[NUM_CLIENTS + 1];
+static unsigned char answer_slot;    // message to this slot in progress
+static unsigned char answer_left;    // bytes of this message still to come (incl. xor)
+static unsigned char answer_error;
+static unsigned char answer_xor;
+static bool answer_feedback;         // message is a feedback broadcast
+
+static uint32_t inquiries, requests, answers, data_errors;
+static uint64_t poll_sum, poll_max, resp_sum, resp_max;
+static uint32_t poll_num, resp_num;
+static uint32_t fb_changes, fb_frames, fb_pairs;
+
+typedef struct {
+  const char *name;
+  unsigned char profile;
+  unsigned char frames;              // per entry, see database.cpp
+  unsigned char slot_frames;         // per entry to one slot (no CALL frames)
+} t_dbprofile;
+
+static const t_dbprofile dbprofiles[] = {
+  { "multimaus", DB_PROFILE_MULTIMAUS, 4, 2 },
+  { "fast",      DB_PROFILE_FAST,      2, 1 },
+  { "single",    DB_PROFILE_SINGLE,    1, 1 },
+};
+
+// frames of the database transfer, seen on the bus
+static bool db_watch_on;
+static unsigned char db_call;
+static unsigned char db_buf[18];
+static unsigned char db_len;
+static unsigned char db_slot;        // expected: 0 broadcast
+static uint32_t db_frames, db_errors;
+static uint8_t db_seen[256];         // frames per entry
+static uint64_t db_last_end;
+
+static uint32_t rnd_state = 1;
+static uint32_t rnd() {              // deterministic
+  rnd_state = rnd_state * 1103515245L + 12345;
+  return (rnd_state >> 16) & 0x7FFF;
+}
+
+static double ms(uint64_t cycles) { return (double)cycles * 1000.0 / F_CPU; }
+
+static void send_request(unsigned char slot, t_client *c) {
+  unsigned char msg[5], i, n, x = 0;
+
+  if (c->toggle ^= 1) {
+    msg[0] = 0x21; msg[1] = 0x24; msg[2] = 0x05;          // status request, xor included
+    n = 3;
+  }
+  else {
+    msg[0] = 0xE3; msg[1] = 0x00; msg[2] = 0x00; msg[3] = slot;   // loco info of loco 'slot'
+    for (i = 0; i < 4; i++) x ^= msg[i];
+    msg[4] = x;
+    n = 5;
+  }
+  for (i = 0; i < n; i++) native_UartRx(msg[i]);
+  requests++;
+}
+
+static void send_feedback(unsigned char slot, t_client *c) {
+  unsigned char msg[4], i;
+
+  c->feedback ^= 1 << (rnd() & 7);
+  msg[0] = 0x72;
+  msg[1] = slot - 1;                 // decoder address
+  msg[2] = c->feedback;
+  msg[3] = msg[0] ^ msg[1] ^ msg[2];
+  for (i = 0; i < 4; i++) native_UartRx(msg[i]);
+  fb_changes++;
+}
+
+static void db_watch(uint16_t data, uint64_t cycles) {
+  unsigned char i, x = 0;
+
+  if (data & 0x100) {                // call byte: a new frame
+    db_call = data & 0x7F;           // without parity
+    db_len = 0;
+    return;
+  }
+  if (db_len >= sizeof(db_buf)) return;
+  db_buf[db_len++] = data;
+  if ((db_len < 2) || (db_len != (db_buf[0] & 0x0F) + 2)) return;
+  if (((db_buf[0] & 0xF0) != 0xE0) || (db_buf[1] != 0xF1)) return;    // not a database frame
+  for (i = 0; i < db_len; i++) x ^= db_buf[i];
+  if (x != 0) db_errors++;
+  if (db_slot ? (db_call != (MESSAGE_ID | db_slot))
+              : ((db_call != MESSAGE_ID) && (db_call != CALL_ID))) db_errors++;
+  db_frames++;
+  db_seen[db_buf[4]]++;
+  db_last_end = cycles;
+}
+
+void native_OnUartTx(uint16_t data, uint64_t cycles) {
+  unsigned char slot;
+  t_client *c;
+  bool busy;
+
+  if (db_watch_on) db_watch(data, cycles);
+
+  if (!(data & 0x100)) {
+    // data byte of a message from the master
+    if (answer_left == 0) return;
+    answer_xor ^= data;
+    if (answer_left == 0xFF) {       // header
+      answer_left = (data & 0x0F) + 1;
+      answer_error = (data == 0x61);
+      if (answer_feedback && ((data & 0xF0) == 0x40)) {
+        fb_frames++;
+        fb_pairs += (data & 0x0F) / 2;
+      }
+      return;
+    }
+    if (answer_error && (data == 0x80)) data_errors++;
+    answer_error = 0;
+    if (--answer_left == 0) {
+      if (answer_xor != 0) data_errors++;       // xor of the master wrong
+      c = &clients[answer_slot];
+      if (answer_slot && c->request_sent) {
+        answers++;
+        resp_sum += cycles - c->request_sent;
+        resp_num++;
+        if (cycles - c->request_sent > resp_max) resp_max = cycles - c->request_sent;
+        c->request_sent = 0;
+      }
+    }
+    return;
+  }
+
+  // call byte: 'P 1 1 A A A A A' message, 'P 1 0 A A A A A' inquiry
+  slot = data & 0x1F;
+  if (((data & 0x60) == MESSAGE_ID) || ((data & 0x60) == FUTURE_ID)) {
+    answer_slot = slot;
+    answer_left = 0xFF;
+    answer_xor = 0;
+    answer_feedback = ((data & 0x60) == FUTURE_ID);
+    return;
+  }
+  answer_left = 0;
+  if (((data & 0x60) != CALL_ID) || (slot == 0) || (workload == NULL)) return;
+
+  inquiries++;
+  c = &clients[slot];
+  if (slot <= workload->feedback) {
+    if (cycles >= c->next_request) {
+      send_feedback(slot, c);
+      c->next_request = cycles + (uint64_t)workload->feedback_ms * (F_CPU / 1000);
+    }
+    return;
+  }
+  busy = (slot <= workload->feedback + workload->busy);
+  if (busy) {
+    if (c->last_call) {
+      poll_sum += cycles - c->last_call;
+      poll_num++;
+      if (cycles - c->last_call > poll_max) poll_max = cycles - c->last_call;
+    }
+    c->last_call = cycles;
+  }
+  if ((c->request_sent == 0) && (cycles >= c->next_request)) {
+    send_request(slot, c);
+    c->request_sent = cycles;
+    if (!busy) c->next_request = cycles + (uint64_t)workload->period_ms * (F_CPU / 1000);
+  }
+}
+
+static bool run_workload(const t_workload *w, uint32_t seconds) {
+  uint64_t start, end;
+  unsigned char i;
+  uint32_t open = 0;
+
+  memset(clients, 0, sizeof(clients));
+  rnd_state = 1;
+  start = native_Cycles();
+  for (i = 1; i <= NUM_CLIENTS; i++)         // spread the quiet ones
+    if (w->period_ms) clients[i].next_request = start + (uint64_t)(rnd() % w->period_ms) * (F_CPU / 1000);
+  workload = w;
+
+  // warm up: let the master find the clients
+  end = start + F_CPU;
+  while (native_Cycles() < end) {
+    loop();
+    native_Advance(BENCH_LOOP_US);
+  }
+
+  inquiries = requests = answers = data_errors = 0;
+  poll_sum = poll_max = resp_sum = resp_max = 0;
+  poll_num = resp_num = 0;
+  fb_changes = fb_frames = fb_pairs = 0;
+  for (i = 1; i <= NUM_CLIENTS; i++) {
+    clients[i].last_call = 0;
+    if (clients[i].request_sent) open++;     // answered in this run, but not counted
+  }
+  start = native_Cycles();
+  end = start + (uint64_t)seconds * F_CPU;
+  while (native_Cycles() < end) {
+    loop();
+    native_Advance(BENCH_LOOP_US);
+  }
+  workload = NULL;
+  for (i = 1; i <= NUM_CLIENTS; i++)
+    if (clients[i].request_sent) open++;
+
+  printf("%-9s %7.1f %7.1f %7.1f %8.2f %8.2f %8.2f %8.2f",
+         w->name, (double)inquiries / seconds, (double)requests / seconds, (double)answers / seconds,
+         poll_num ? ms(poll_sum / poll_num) : 0.0, ms(poll_max),
+         resp_num ? ms(resp_sum / resp_num) : 0.0, ms(resp_max));
+  if (w->feedback) printf(" %7.1f %7.1f %7.1f", (double)fb_changes / seconds, (double)fb_frames / seconds,
+                          (double)fb_pairs / seconds);
+  if (data_errors) printf("  %u DATA ERRORS", (unsigned)data_errors);
+  if (requests + open > answers + NUM_CLIENTS) printf("  %u REQUESTS NOT ANSWERED", (unsigned)(requests - answers));
+  printf("\n");
+
+  // let the last answers go out before the next workload
+  end = native_Cycles() + F_CPU / 10;
+  while (native_Cycles() < end) {
+    loop();
+    native_Advance(BENCH_LOOP_US);
+  }
+  return ((data_errors == 0) && (requests + open <= answers + NUM_CLIENTS));
+}
+
+static bool run_dbxfer(const t_dbprofile *p, unsigned char slot) {
+  uint64_t start, end;
+  unsigned char name[LOK_NAME_LENGTH];
+  uint16_t i, entries = 0;
+  unsigned char frames = slot ? p->slot_frames : p->frames;
+  bool ok;
+
+  database_Clear();
+  for (i = 0; i < LOCODB_NUM_ENTRIES; i++) {
+    snprintf((char *)name, sizeof(name), "LOCO %u", i);
+    database_PutLocoName(100 + i, name);
+  }
+  memset(clients, 0, sizeof(clients));
+  rnd_state = 1;
+  workload = &workloads[0];          // quiet clients, the bus is not empty
+  start = native_Cycles();
+  for (i = 1; i <= NUM_CLIENTS; i++)
+    clients[i].next_request = start + (uint64_t)(rnd() % workload->period_ms) * (F_CPU / 1000);
+  end = start + 2 * F_CPU;           // write-behind done, clients found
+  while (native_Cycles() < end) {
+    loop();
+    native_Advance(BENCH_LOOP_US);
+  }
+
+  db_frames = db_errors = 0;
+  memset(db_seen, 0, sizeof(db_seen));
+  db_slot = slot;
+  db_watch_on = true;
+  start = db_last_end = native_Cycles();
+  database_StartTransferTo(slot, p->profile);
+  end = start + 120 * (uint64_t)F_CPU;
+  while (database_TransferBusy() && (native_Cycles() < end)) {
+    loop();
+    native_Advance(BENCH_LOOP_US);
+  }
+  end = native_Cycles() + F_CPU / 10;  // last frames out
+  while (native_Cycles() < end) {
+    loop();
+    native_Advance(BENCH_LOOP_US);
+  }
+  db_watch_on = false;
+  workload = NULL;
+
+  for (i = 0; i < 256; i++) {
+    if (db_seen[i] == 0) continue;
+    entries++;
+    if (db_seen[i] != frames) db_errors++;
+  }
+  ok = (db_errors == 0) && (entries == LOCODB_NUM_ENTRIES) && (db_frames == (uint32_t)entries * frames);
+  printf("%-9s %-9s %5u/%-4u %5u/%-5u %8.2f%s\n", p->name, slot ? "slot" : "broadcast",
+         entries, LOCODB_NUM_ENTRIES, (unsigned)db_frames, (unsigned)(LOCODB_NUM_ENTRIES * frames),
+         entries ? ms(db_last_end - start) / entries : 0.0, ok ? "" : "  TRANSFER ERRORS");
+  return ok;
+}
+
+int main(int argc, char **argv) {
+  uint32_t seconds = 10;
+  const char *only = NULL;
+  bool ok = true;
+  unsigned char i;
+
+  for (i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "-s") && (i + 1 < argc)) seconds = atol(argv[++i]);
+    else only = argv[i];
+  }
+
+  native_Init();
+  native_SetPin(NSHORT_MAIN, HIGH);  // see native_main.cpp
+  native_SetPin(NSHORT_PROG, HIGH);
+  native_SetPin(ACK_DETECTED, LOW);
+  native_SetPin(ROTENC_CLK, HIGH);
+  native_SetPin(ROTENC_DT, HIGH);
+  native_SetAnalog(EXT_STOP, 1023);
+  native_SetAnalog(A7, 4);
+  setup();
+
+  if (!only || strcmp(only, "db"))
+    printf("workload    inq/s   req/s   ans/s  poll avg/max [ms]  resp avg/max [ms]  fb chg/s  frames/s  pairs/s\n");
+  for (i = 0; i < sizeof(workloads) / sizeof(workloads[0]); i++) {
+    if (only && strcmp(only, workloads[i].name)) continue;
+    if (!run_workload(&workloads[i], seconds)) ok = false;
+  }
+  if (only && strcmp(only, "db")) return (ok ? 0 : 1);
+  printf("\ndatabase  to         entries    frames   ms/entry\n");
+  for (i = 0; i < sizeof(dbprofiles) / sizeof(dbprofiles[0]); i++) {
+    if (!run_dbxfer(&dbprofiles[i], 0)) ok = false;
+    if (!run_dbxfer(&dbprofiles[i], DB_SLOT)) ok = false;
+  }
+  return (ok ? 0 : 1);
+}